@@ -19,11 +19,13 @@ class DnfIntegration:
 
     dbo = None
     manager = None
+    catalogue = None
 
     def __init__(self):
         self.build_dbo()
         self.manager = Ldm.Manager()
-        self.build_providers()
+        self.catalogue = Ldm.Catalogue.new("leCatalogue")
+        self.build_catalogue()
 
         # Allow recieving hotplug events
         self.manager.connect('device-added', self.on_device_added)
@@ -51,14 +53,18 @@ class DnfIntegration:
         self.sack = self.dbo.fill_sack(
             load_system_repo=False, load_available_repos=True)
 
-    def build_providers(self):
-        """ Iterate dnf package providers and populate storage with modaliases """
+    def build_catalogue(self):
+        """ Iterate dnf package providers and index their modaliases on disk
+
+            The catalogue only keeps the shards a device routes to in memory
+            while looking it up, so this scales to the whole repository
+            where a plugin per package would not.
+        """
         query = self.sack.query()
         avail = query.available()
         for item in avail:
             if not item.provides:
                 continue
-            modalias_plugin = None
 
             for i in item.provides:
                 it = str(i)
@@ -66,15 +72,10 @@ class DnfIntegration:
                     continue
                 it = it.split("=")[0].strip()
                 subitem = it[9:len(it)-1]
-                if not modalias_plugin:
-                    modalias_plugin = Ldm.ModaliasPlugin.new(item.name)
                 # TODO: Extract actual module name
-                modalias_plugin.add_modalias(
-                    Ldm.Modalias.new(subitem, item.name, item.name))
+                self.catalogue.add_alias(subitem, item.name, item.name)
 
-            # If we built a modalias plugin, add to manager
-            if modalias_plugin:
-                self.manager.add_plugin(modalias_plugin)
+        self.catalogue.commit()
 
     def on_device_added(self, manager, device):
         """ Try finding a provider for newly added device """
@@ -87,14 +88,14 @@ class DnfIntegration:
             self.print_device(device)
 
     def print_device(self, device):
-        """ Handle pretty printing of a device and providers """
-        providers = self.manager.get_providers(device)
-        if not providers:
+        """ Handle pretty printing of a device and its packages """
+        packages = self.catalogue.get_packages(device)
+        if not packages:
             return
 
         print("Device: {} {}".format(device.get_vendor(), device.get_name()))
-        for provider in providers:
-            print(" * Provider: {}".format(provider.get_package()))
+        for package in packages:
+            print(" * Package: {}".format(package))
         print()
 
     def gpu_print(self):
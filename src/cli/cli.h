@@ -22,6 +22,7 @@ typedef int (*ldm_cli_command)(int argc, char **argv);
 int ldm_cli_configure(int argc, char **argv);
 #endif
 
+int ldm_cli_run(int argc, char **argv);
 int ldm_cli_status(int argc, char **argv);
 int ldm_cli_version(int argc, char **argv);
 
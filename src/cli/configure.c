@@ -20,7 +20,7 @@
 
 static inline void print_usage(void)
 {
-        fputs("configure takes exactly one argument: gpu\n", stderr);
+        fputs("configure takes one argument: gpu [always-on|offload]\n", stderr);
 }
 
 /**
@@ -30,8 +30,11 @@ static inline void print_usage(void)
  *
  * In future we'll support glvnd as and when Solus does, but for now we
  * need to know about both methods..
+ *
+ * The hybrid mode is only changed when given, otherwise an Optimus system
+ * keeps whichever mode it was last configured with.
  */
-static int ldm_cli_configure_gpu(void)
+static int ldm_cli_configure_gpu(const gchar *hybrid_mode)
 {
         g_autoptr(LdmManager) manager = NULL;
         g_autoptr(LdmGPUConfig) gpu_config = NULL;
@@ -52,6 +55,18 @@ static int ldm_cli_configure_gpu(void)
         }
 
         glx_manager = ldm_glx_manager_new();
+        if (hybrid_mode) {
+                g_autoptr(GEnumClass) modes = g_type_class_ref(LDM_TYPE_HYBRID_MODE);
+                GEnumValue *mode = g_enum_get_value_by_nick(modes, hybrid_mode);
+
+                if (!mode) {
+                        fprintf(stderr, "Unknown hybrid mode '%s'\n", hybrid_mode);
+                        print_usage();
+                        return EXIT_FAILURE;
+                }
+                ldm_glx_manager_set_hybrid_mode(glx_manager, (LdmHybridMode)mode->value);
+        }
+
         if (!ldm_glx_manager_apply_configuration(glx_manager, gpu_config)) {
                 fputs("Failed to apply GLX configuration\n", stderr);
                 return EXIT_FAILURE;
@@ -63,7 +78,7 @@ static int ldm_cli_configure_gpu(void)
 
 int ldm_cli_configure(int argc, char **argv)
 {
-        if (argc != 2) {
+        if (argc != 2 && argc != 3) {
                 print_usage();
                 return EXIT_FAILURE;
         }
@@ -91,7 +106,7 @@ int ldm_cli_configure(int argc, char **argv)
                         fputs("You must be root to use this function\n", stderr);
                         return EXIT_FAILURE;
                 }
-                return ldm_cli_configure_gpu();
+                return ldm_cli_configure_gpu(argc == 3 ? argv[2] : NULL);
         }
 
         print_usage();
@@ -54,6 +54,16 @@ int main(int argc, char **argv)
         int ret = EXIT_FAILURE;
         ldm_cli_command command = NULL;
 
+        /* Arguments to run belong to the program being run, so keep them from GOption */
+        if (argc > 1 && g_str_equal(argv[1], "run")) {
+                return ldm_cli_run(argc - 1, argv + 1);
+        }
+
+        /* status has options of its own */
+        if (argc > 1 && g_str_equal(argv[1], "status")) {
+                return ldm_cli_status(argc - 1, argv + 1);
+        }
+
         opt_context = g_option_context_new(NULL);
         g_option_context_add_main_entries(opt_context, cli_entries, "linux-driver-management");
         g_option_context_set_summary(opt_context,
@@ -62,7 +72,9 @@ int main(int argc, char **argv)
                                          "This tool accepts a number of subcommands:\n\
 \n\
         configure   - Attempt configuration of a subsystem\n\
+        run         - Run a program on the discrete or integrated GPU\n\
         status      - Emit the status for known, detected devices\n\
+                      (--memory also reports the memory used by the library)\n\
         version     - Print the version and quit\n\
 ");
 
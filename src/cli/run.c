@@ -0,0 +1,152 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include "cli.h"
+#include "config.h"
+#include "ldm.h"
+#include "util.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static inline void print_usage(void)
+{
+        fputs("usage: run [--dgpu|--igpu] [--] command [arguments]\n", stderr);
+}
+
+/**
+ * Set up the environment for an NVIDIA Optimus system that was configured
+ * with the proprietary driver. In "always on" mode everything already runs
+ * on the NVIDIA GPU, so only render offload needs any help.
+ */
+static void ldm_cli_run_setup_optimus(LdmHybridMode mode, gboolean dgpu)
+{
+        static const gchar *offload_vars[][2] = {
+                { "__NV_PRIME_RENDER_OFFLOAD", "1" },
+                { "__GLX_VENDOR_LIBRARY_NAME", "nvidia" },
+                { "__VK_LAYER_NV_optimus", "NVIDIA_only" },
+        };
+
+        if (mode != LDM_HYBRID_MODE_OFFLOAD) {
+                if (!dgpu) {
+                        fputs("The discrete GPU renders everything in always-on mode\n", stderr);
+                }
+                return;
+        }
+
+        for (guint i = 0; i < G_N_ELEMENTS(offload_vars); i++) {
+                if (dgpu) {
+                        g_setenv(offload_vars[i][0], offload_vars[i][1], TRUE);
+                } else {
+                        g_unsetenv(offload_vars[i][0]);
+                }
+        }
+}
+
+/**
+ * Work out the environment for the requested GPU.
+ *
+ * The hybrid file written by `configure gpu` doubles as a cache of the GPU
+ * configuration: when present, this is a configured Optimus system and no
+ * devices need to be enumerated at all. Otherwise we take a quick look at
+ * the GPUs only, and rely on Mesa's DRI_PRIME for any hybrid system.
+ */
+static gboolean ldm_cli_run_setup(gboolean dgpu)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        g_autoptr(LdmGPUConfig) gpu_config = NULL;
+
+        if (access(LDM_HYBRID_FILE, F_OK) == 0) {
+                g_autoptr(LdmGLXManager) glx_manager = ldm_glx_manager_new();
+
+                ldm_cli_run_setup_optimus(ldm_glx_manager_get_hybrid_mode(glx_manager), dgpu);
+                return TRUE;
+        }
+
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR | LDM_MANAGER_FLAGS_GPU_QUICK);
+        if (!manager) {
+                fputs("Failed to initialise LdmManager\n", stderr);
+                return FALSE;
+        }
+
+        gpu_config = ldm_gpu_config_new(manager);
+        if (!gpu_config) {
+                fputs("Failed to initialize LdmGPUConfig\n", stderr);
+                return FALSE;
+        }
+
+        /* Simple configurations only have the one GPU to run on */
+        if (ldm_gpu_config_has_type(gpu_config, LDM_GPU_TYPE_HYBRID)) {
+                g_setenv("DRI_PRIME", dgpu ? "1" : "0", TRUE);
+        }
+
+        return TRUE;
+}
+
+/**
+ * Run a program on the discrete (default) or integrated GPU of a hybrid
+ * system. We exec the program directly, so nothing is left behind.
+ */
+int ldm_cli_run(int argc, char **argv)
+{
+        gboolean dgpu = TRUE;
+        int i = 1;
+
+        for (; i < argc; i++) {
+                if (g_str_equal(argv[i], "--dgpu")) {
+                        dgpu = TRUE;
+                } else if (g_str_equal(argv[i], "--igpu")) {
+                        dgpu = FALSE;
+                } else if (g_str_equal(argv[i], "--")) {
+                        ++i;
+                        break;
+                } else if (argv[i][0] == '-') {
+                        fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+                        print_usage();
+                        return EXIT_FAILURE;
+                } else {
+                        break;
+                }
+        }
+
+        if (i >= argc) {
+                print_usage();
+                return EXIT_FAILURE;
+        }
+
+        if (!ldm_cli_run_setup(dgpu)) {
+                return EXIT_FAILURE;
+        }
+
+        execvp(argv[i], argv + i);
+
+        fprintf(stderr, "Failed to execute %s: %s\n", argv[i], strerror(errno));
+        return EXIT_FAILURE;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -17,7 +17,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-static void print_drivers(LdmManager *manager, LdmDevice *device)
+/**
+ * Describe what is already present on the system for the provider
+ */
+static const gchar *provider_state(LdmProvider *provider)
+{
+        if (ldm_provider_get_loaded(provider)) {
+                return " (loaded)";
+        }
+        if (ldm_provider_get_installed(provider)) {
+                return " (installed)";
+        }
+        return "";
+}
+
+static void print_drivers(LdmManager *manager, LdmModuleResolver *resolver, LdmDevice *device)
 {
         g_autoptr(GPtrArray) providers = NULL;
 
@@ -26,6 +40,7 @@ static void print_drivers(LdmManager *manager, LdmDevice *device)
         if (providers->len < 1) {
                 return;
         }
+        ldm_module_resolver_resolve(resolver, providers);
 
         fprintf(stdout,
                 "\nLDM Providers for %s: %d\n",
@@ -37,7 +52,7 @@ static void print_drivers(LdmManager *manager, LdmDevice *device)
                 const gchar *name = NULL;
 
                 name = ldm_provider_get_package(provider);
-                fprintf(stdout, " -  %s\n", name);
+                fprintf(stdout, " -  %s%s\n", name, provider_state(provider));
         }
 }
 /**
@@ -83,7 +98,8 @@ static void print_device(LdmDevice *device)
 /**
  * Handle pretty printing of the GPU configuration to the display
  */
-static void print_gpu_config(LdmManager *manager, LdmGPUConfig *config)
+static void print_gpu_config(LdmManager *manager, LdmModuleResolver *resolver,
+                             LdmGPUConfig *config)
 {
         LdmDevice *primary = NULL, *secondary = NULL;
 
@@ -125,7 +141,7 @@ static void print_gpu_config(LdmManager *manager, LdmGPUConfig *config)
 emit_gpu_drivers:
 
         /* Only emit the drivers for the primary detection device */
-        print_drivers(manager, ldm_gpu_config_get_detection_device(config));
+        print_drivers(manager, resolver, ldm_gpu_config_get_detection_device(config));
 }
 
 /**
@@ -142,7 +158,7 @@ static void print_platform_device(LdmDevice *device)
 /**
  * Handle pretty printing of the remaining devices.
  */
-static void print_non_gpu(LdmManager *manager, LdmDevice *device)
+static void print_non_gpu(LdmManager *manager, LdmModuleResolver *resolver, LdmDevice *device)
 {
         const gchar *device_title = NULL;
         g_autoptr(GPtrArray) providers = NULL;
@@ -162,6 +178,7 @@ static void print_non_gpu(LdmManager *manager, LdmDevice *device)
         if (providers->len < 1) {
                 return;
         }
+        ldm_module_resolver_resolve(resolver, providers);
 
         /* Try to ascertain the primary role */
         if (ldm_device_has_type(device, LDM_DEVICE_TYPE_AUDIO)) {
@@ -192,19 +209,65 @@ static void print_non_gpu(LdmManager *manager, LdmDevice *device)
         for (guint i = 0; i < providers->len; i++) {
                 LdmProvider *provider = providers->pdata[i];
                 fprintf(stdout,
-                        "  \u2558 Provider %02u  : %s\n",
+                        "  \u2558 Provider %02u  : %s%s\n",
                         i + 1,
-                        ldm_provider_get_package(provider));
+                        ldm_provider_get_package(provider),
+                        provider_state(provider));
         }
 
         fputs("\n", stdout);
 }
 
-int ldm_cli_status(__ldm_unused__ int argc, __ldm_unused__ char **argv)
+/**
+ * Emit the memory used by the manager, by category
+ */
+static void print_memory_usage(LdmManager *manager)
+{
+        static const gchar *categories[LDM_MEMORY_N_CATEGORIES] = {
+                [LDM_MEMORY_CATEGORY_DEVICES] = "Devices",
+                [LDM_MEMORY_CATEGORY_PROPERTIES] = "Properties",
+                [LDM_MEMORY_CATEGORY_ALIASES] = "Aliases",
+                [LDM_MEMORY_CATEGORY_STRINGS] = "Strings",
+                [LDM_MEMORY_CATEGORY_CACHES] = "Caches",
+        };
+        LdmMemoryUsage usage = { 0 };
+        guint objects = 0;
+
+        ldm_manager_get_memory_usage(manager, &usage);
+
+        fprintf(stdout, " \u2552 %s\n", "Memory Usage");
+        for (guint i = 0; i < LDM_MEMORY_N_CATEGORIES; i++) {
+                fprintf(stdout,
+                        " \u255E %-12s: %10" G_GSIZE_FORMAT " bytes in %u objects\n",
+                        categories[i],
+                        usage.bytes[i],
+                        usage.objects[i]);
+                objects += usage.objects[i];
+        }
+        fprintf(stdout,
+                " \u2558 %-12s: %10" G_GSIZE_FORMAT " bytes in %u objects\n",
+                "Total",
+                ldm_memory_usage_get_total(&usage),
+                objects);
+        fputs("\n", stdout);
+}
+
+int ldm_cli_status(int argc, char **argv)
 {
         g_autoptr(LdmManager) manager = NULL;
         g_autoptr(LdmGPUConfig) gpu_config = NULL;
         g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(LdmModuleResolver) resolver = NULL;
+        gboolean memory = FALSE;
+
+        for (int i = 1; i < argc; i++) {
+                if (g_str_equal(argv[i], "--memory")) {
+                        memory = TRUE;
+                } else {
+                        fprintf(stderr, "Unknown option '%s'\n", argv[i]);
+                        return EXIT_FAILURE;
+                }
+        }
 
         /* No need for hot plug events */
         manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
@@ -224,14 +287,21 @@ int ldm_cli_status(__ldm_unused__ int argc, __ldm_unused__ char **argv)
                 return EXIT_FAILURE;
         }
 
+        /* Module indexes and the loaded modules are read once for the whole run */
+        resolver = ldm_module_resolver_new();
+
         /* Emit non GPU items here, platform first */
         devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_ANY);
         for (guint i = 0; i < devices->len; i++) {
-                print_non_gpu(manager, devices->pdata[i]);
+                print_non_gpu(manager, resolver, devices->pdata[i]);
         }
 
         /* Emit GPU config last for consistency */
-        print_gpu_config(manager, gpu_config);
+        print_gpu_config(manager, resolver, gpu_config);
+
+        if (memory) {
+                print_memory_usage(manager);
+        }
 
         return EXIT_SUCCESS;
 }
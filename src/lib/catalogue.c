@@ -0,0 +1,842 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "catalogue.h"
+#include "route.h"
+
+#define LDM_CATALOGUE_SUFFIX ".shard"
+
+/* Link to the build lookups read from, and the link that replaces it */
+#define LDM_CATALOGUE_CURRENT "current"
+#define LDM_CATALOGUE_CURRENT_PENDING "current.new"
+
+/* Every build is written to its own directory */
+#define LDM_CATALOGUE_BUILD_PREFIX "build-"
+#define LDM_CATALOGUE_BUILD_TEMPLATE LDM_CATALOGUE_BUILD_PREFIX "XXXXXX"
+
+/* Builds are moved aside under this prefix before they're removed */
+#define LDM_CATALOGUE_RETIRED_PREFIX "retired-"
+
+/* Shard for aliases that can't be routed to a bus */
+#define LDM_CATALOGUE_ANY "any"
+
+/* Aliases buffered by a build before they're written out */
+#define LDM_CATALOGUE_BUFFER_BYTES (1024 * 1024)
+
+/* Longest match copied on the stack while scanning a shard */
+#define LDM_CATALOGUE_MATCH_MAX 256
+
+struct _LdmCatalogueClass {
+        GObjectClass parent_class;
+};
+
+/**
+ * SECTION:catalogue
+ * @Short_description: On-disk index of modaliases for a whole repository
+ * @see_also: #LdmModalias, #LdmModaliasPlugin
+ * @Title: LdmCatalogue
+ *
+ * An LdmCatalogue answers which packages support a device, for every
+ * package in a software repository rather than the installed ones. Loading
+ * an #LdmModaliasPlugin per package doesn't scale to whole repositories, so
+ * the catalogue keeps its aliases on disk instead.
+ *
+ * The catalogue is a directory of shards, one per bus and vendor, named
+ * after the route of the aliases, i.e. `pci-000010de.shard`. Aliases
+ * matching any vendor on a bus live in `pci-any.shard`, and those that
+ * can't be routed in `any.shard`. Each shard is a plain `.modaliases` file.
+ *
+ * Each build is written to a directory of its own, and the `current` link
+ * in the catalogue directory names the build that lookups read. A lookup
+ * resolves the link once and maps every shard it needs before scanning any
+ * of them, so it reads all of its shards from one build. A build is moved
+ * aside before it is removed, so a lookup that loses its build to a commit
+ * while mapping shards notices, and starts again from the new build.
+ *
+ * A lookup only reads the shards a device (or one of its children) can be
+ * routed to, and nothing is kept in memory between lookups, so the memory
+ * used is independent of the size of the repository.
+ *
+ * To build a catalogue, add every alias of the repository and commit:
+ *
+ * |[<!-- language="C" -->
+ *      LdmCatalogue *catalogue = ldm_catalogue_new("/var/cache/ldm/catalogue");
+ *      ldm_catalogue_add_alias(catalogue, "pci:v000010DEd*", "nvidia", "nvidia-glx-driver", NULL);
+ *      ldm_catalogue_commit(catalogue, NULL);
+ * ]|
+ *
+ * A commit replaces the whole catalogue with the aliases added since the
+ * last commit, by swapping the `current` link to the new build in a single
+ * rename. The previous build is moved aside and removed afterwards, and
+ * lookups that already mapped its shards keep reading them until they're
+ * done.
+ */
+
+/*
+ * LdmCatalogue
+ *
+ * Sharded on-disk modalias index.
+ */
+struct _LdmCatalogue {
+        GObject parent;
+
+        gchar *directory;
+
+        /* Aliases added since the last commit */
+        struct {
+                gchar *path;         /* Directory of the build, once started */
+                GHashTable *buffers; /* Shard name -> GString of pending lines */
+                GHashTable *written; /* Shard names with a file in the build */
+                gsize buffered;      /* Bytes over all buffers */
+        } build;
+};
+
+static void ldm_catalogue_set_property(GObject *object, guint id, const GValue *value,
+                                       GParamSpec *spec);
+static void ldm_catalogue_get_property(GObject *object, guint id, GValue *value,
+                                       GParamSpec *spec);
+static void ldm_catalogue_remove_build(const gchar *path);
+
+G_DEFINE_TYPE(LdmCatalogue, ldm_catalogue, G_TYPE_OBJECT)
+
+/* Property IDs */
+enum { PROP_DIRECTORY = 1, N_PROPS };
+
+static GParamSpec *obj_properties[N_PROPS] = {
+        NULL,
+};
+
+/**
+ * ldm_catalogue_dispose:
+ *
+ * Clean up a LdmCatalogue instance
+ */
+static void ldm_catalogue_dispose(GObject *obj)
+{
+        LdmCatalogue *self = LDM_CATALOGUE(obj);
+
+        /* Uncommitted builds are never reachable, so don't leave them behind */
+        if (self->build.path) {
+                ldm_catalogue_remove_build(self->build.path);
+                g_clear_pointer(&self->build.path, g_free);
+        }
+
+        g_clear_pointer(&self->directory, g_free);
+        g_clear_pointer(&self->build.buffers, g_hash_table_unref);
+        g_clear_pointer(&self->build.written, g_hash_table_unref);
+
+        G_OBJECT_CLASS(ldm_catalogue_parent_class)->dispose(obj);
+}
+
+/**
+ * ldm_catalogue_class_init:
+ *
+ * Handle class initialisation
+ */
+static void ldm_catalogue_class_init(LdmCatalogueClass *klazz)
+{
+        GObjectClass *obj_class = G_OBJECT_CLASS(klazz);
+
+        /* gobject vtable hookup */
+        obj_class->dispose = ldm_catalogue_dispose;
+        obj_class->get_property = ldm_catalogue_get_property;
+        obj_class->set_property = ldm_catalogue_set_property;
+
+        /**
+         * LdmCatalogue:directory
+         *
+         * Directory holding the shards of the catalogue. It is created by
+         * the first commit if needed.
+         */
+        obj_properties[PROP_DIRECTORY] =
+            g_param_spec_string("directory",
+                                "Directory",
+                                "Directory holding the catalogue",
+                                NULL,
+                                G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+        g_object_class_install_properties(obj_class, N_PROPS, obj_properties);
+}
+
+static void ldm_catalogue_set_property(GObject *object, guint id, const GValue *value,
+                                       GParamSpec *spec)
+{
+        LdmCatalogue *self = LDM_CATALOGUE(object);
+
+        switch (id) {
+        case PROP_DIRECTORY:
+                g_free(self->directory);
+                self->directory = g_value_dup_string(value);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+                break;
+        }
+}
+
+static void ldm_catalogue_get_property(GObject *object, guint id, GValue *value,
+                                       GParamSpec *spec)
+{
+        LdmCatalogue *self = LDM_CATALOGUE(object);
+
+        switch (id) {
+        case PROP_DIRECTORY:
+                g_value_set_string(value, self->directory);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+                break;
+        }
+}
+
+static void ldm_catalogue_buffer_free(GString *buffer)
+{
+        g_string_free(buffer, TRUE);
+}
+
+/* Missing shards are stored as NULL */
+static void ldm_catalogue_shard_free(GMappedFile *shard)
+{
+        if (shard) {
+                g_mapped_file_unref(shard);
+        }
+}
+
+/**
+ * ldm_catalogue_init:
+ *
+ * Handle construction of the LdmCatalogue
+ */
+static void ldm_catalogue_init(LdmCatalogue *self)
+{
+        self->build.buffers = g_hash_table_new_full(g_str_hash,
+                                                    g_str_equal,
+                                                    g_free,
+                                                    (GDestroyNotify)ldm_catalogue_buffer_free);
+        self->build.written = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+}
+
+/**
+ * ldm_catalogue_new:
+ * @directory: Directory holding the catalogue
+ *
+ * Open the catalogue in the given directory. The directory doesn't need to
+ * exist until the catalogue is first committed.
+ *
+ * Returns: (transfer full): A new #LdmCatalogue
+ */
+LdmCatalogue *ldm_catalogue_new(const gchar *directory)
+{
+        g_return_val_if_fail(directory != NULL, NULL);
+
+        return g_object_new(LDM_TYPE_CATALOGUE, "directory", directory, NULL);
+}
+
+/**
+ * ldm_catalogue_get_directory:
+ *
+ * Returns: (transfer none): The directory holding the catalogue
+ */
+const gchar *ldm_catalogue_get_directory(LdmCatalogue *self)
+{
+        g_return_val_if_fail(self != NULL, NULL);
+
+        return self->directory;
+}
+
+/**
+ * ldm_catalogue_shard_name:
+ * @route: (nullable): Route of an alias or device, NULL if it has none
+ * @any_vendor: Use the shard for any vendor on the bus of the route
+ *
+ * Bus names come from the data, so anything that isn't a plain word is
+ * treated as unroutable rather than becoming part of a path.
+ *
+ * Returns: (transfer full): Name of the shard, without the suffix
+ */
+static gchar *ldm_catalogue_shard_name(const LdmRoute *route, gboolean any_vendor)
+{
+        if (!route || !*route->bus) {
+                return g_strdup(LDM_CATALOGUE_ANY);
+        }
+
+        for (const gchar *c = route->bus; *c; c++) {
+                if (!g_ascii_isalnum(*c) && *c != '_') {
+                        return g_strdup(LDM_CATALOGUE_ANY);
+                }
+        }
+
+        if (any_vendor || route->any_vendor) {
+                return g_strdup_printf("%s-any", route->bus);
+        }
+
+        return g_strdup_printf("%s-%08x", route->bus, route->vendor_id);
+}
+
+static gchar *ldm_catalogue_shard_path(const gchar *root, const gchar *name)
+{
+        g_autofree gchar *basename = g_strconcat(name, LDM_CATALOGUE_SUFFIX, NULL);
+
+        return g_build_filename(root, basename, NULL);
+}
+
+/**
+ * ldm_catalogue_remove_build:
+ * @path: Directory of a build
+ *
+ * Builds only ever hold shards, so this needn't recurse
+ */
+static void ldm_catalogue_remove_build(const gchar *path)
+{
+        g_autoptr(GDir) dir = NULL;
+        const gchar *entry = NULL;
+
+        dir = g_dir_open(path, 0, NULL);
+        if (dir) {
+                while ((entry = g_dir_read_name(dir)) != NULL) {
+                        g_autofree gchar *shard = g_build_filename(path, entry, NULL);
+
+                        if (unlink(shard) != 0) {
+                                g_warning("Failed to remove %s: %s", shard, strerror(errno));
+                        }
+                }
+        }
+
+        if (rmdir(path) != 0) {
+                g_warning("Failed to remove %s: %s", path, strerror(errno));
+        }
+}
+
+/**
+ * ldm_catalogue_retire_build:
+ * @name: Name of the build within the catalogue directory
+ *
+ * Rename the build out of the way before removing its shards, so a lookup
+ * never sees a build that is only partly removed: either every shard is
+ * still there, or the build directory is gone.
+ */
+static void ldm_catalogue_retire_build(const gchar *directory, const gchar *name)
+{
+        g_autofree gchar *retired_name = NULL;
+        g_autofree gchar *retired = NULL;
+        g_autofree gchar *path = NULL;
+
+        path = g_build_filename(directory, name, NULL);
+        retired_name = g_strconcat(LDM_CATALOGUE_RETIRED_PREFIX, name, NULL);
+        retired = g_build_filename(directory, retired_name, NULL);
+
+        if (rename(path, retired) != 0) {
+                g_warning("Failed to remove %s: %s", path, strerror(errno));
+                return;
+        }
+
+        ldm_catalogue_remove_build(retired);
+}
+
+/**
+ * ldm_catalogue_start_build:
+ *
+ * Create the directory for the build if we haven't already
+ */
+static gboolean ldm_catalogue_start_build(LdmCatalogue *self, GError **error)
+{
+        g_autofree gchar *path = NULL;
+
+        if (self->build.path) {
+                return TRUE;
+        }
+
+        path = g_build_filename(self->directory, LDM_CATALOGUE_BUILD_TEMPLATE, NULL);
+        if (g_mkdir_with_parents(self->directory, 00755) != 0 || !g_mkdtemp_full(path, 00755)) {
+                g_set_error(error,
+                            G_FILE_ERROR,
+                            g_file_error_from_errno(errno),
+                            "Failed to create %s: %s",
+                            path,
+                            strerror(errno));
+                return FALSE;
+        }
+
+        self->build.path = g_steal_pointer(&path);
+        return TRUE;
+}
+
+/**
+ * ldm_catalogue_flush:
+ *
+ * Append every buffered line to the file of its shard in the build
+ */
+static gboolean ldm_catalogue_flush(LdmCatalogue *self, GError **error)
+{
+        GHashTableIter iter = { 0 };
+        const gchar *name = NULL;
+        GString *buffer = NULL;
+
+        if (!ldm_catalogue_start_build(self, error)) {
+                return FALSE;
+        }
+
+        g_hash_table_iter_init(&iter, self->build.buffers);
+        while (g_hash_table_iter_next(&iter, (void **)&name, (void **)&buffer)) {
+                g_autofree gchar *path = NULL;
+                gboolean started = FALSE;
+                FILE *fp = NULL;
+
+                if (buffer->len < 1) {
+                        continue;
+                }
+
+                started = g_hash_table_contains(self->build.written, name);
+                path = ldm_catalogue_shard_path(self->build.path, name);
+
+                fp = fopen(path, started ? "a" : "w");
+                if (!fp || fwrite(buffer->str, 1, buffer->len, fp) != buffer->len) {
+                        g_set_error(error,
+                                    G_FILE_ERROR,
+                                    g_file_error_from_errno(errno),
+                                    "Failed to write %s: %s",
+                                    path,
+                                    strerror(errno));
+                        if (fp) {
+                                fclose(fp);
+                        }
+                        return FALSE;
+                }
+                if (fclose(fp) != 0) {
+                        g_set_error(error,
+                                    G_FILE_ERROR,
+                                    g_file_error_from_errno(errno),
+                                    "Failed to write %s: %s",
+                                    path,
+                                    strerror(errno));
+                        return FALSE;
+                }
+
+                if (!started) {
+                        g_hash_table_add(self->build.written, g_strdup(name));
+                }
+                g_string_truncate(buffer, 0);
+        }
+
+        self->build.buffered = 0;
+        return TRUE;
+}
+
+/**
+ * ldm_catalogue_add_alias:
+ * @match: fnmatch style modalias pattern
+ * @driver: Kernel module supporting matching hardware
+ * @package: Package providing the kernel module
+ * @error: (nullable): Storage for any error
+ *
+ * Add an alias to the catalogue. Aliases are buffered, and only become
+ * visible to lookups once committed with #ldm_catalogue_commit.
+ *
+ * Returns: TRUE if the alias was added
+ */
+gboolean ldm_catalogue_add_alias(LdmCatalogue *self, const gchar *match, const gchar *driver,
+                                 const gchar *package, GError **error)
+{
+        g_autofree gchar *name = NULL;
+        LdmRoute route = { 0 };
+        GString *buffer = NULL;
+        gsize len = 0;
+
+        g_return_val_if_fail(self != NULL, FALSE);
+        g_return_val_if_fail(match != NULL, FALSE);
+        g_return_val_if_fail(driver != NULL, FALSE);
+        g_return_val_if_fail(package != NULL, FALSE);
+
+        /* Columns are split on spaces, and the package runs to the end of the line */
+        if (!*match || !*driver || !*package || strpbrk(match, " \t\n") ||
+            strpbrk(driver, " \t\n") || strchr(package, '\n')) {
+                g_set_error(error,
+                            G_FILE_ERROR,
+                            G_FILE_ERROR_INVAL,
+                            "Invalid alias: %s %s %s",
+                            match,
+                            driver,
+                            package);
+                return FALSE;
+        }
+
+        if (ldm_route_parse(&route, match)) {
+                name = ldm_catalogue_shard_name(&route, FALSE);
+        } else {
+                name = ldm_catalogue_shard_name(NULL, FALSE);
+        }
+
+        buffer = g_hash_table_lookup(self->build.buffers, name);
+        if (!buffer) {
+                buffer = g_string_new(NULL);
+                g_hash_table_insert(self->build.buffers, g_strdup(name), buffer);
+        }
+
+        len = buffer->len;
+        g_string_append_printf(buffer, "alias %s %s %s\n", match, driver, package);
+        self->build.buffered += buffer->len - len;
+
+        if (self->build.buffered >= LDM_CATALOGUE_BUFFER_BYTES) {
+                return ldm_catalogue_flush(self, error);
+        }
+
+        return TRUE;
+}
+
+/**
+ * ldm_catalogue_add_modalias:
+ * @modalias: The modalias to add
+ * @error: (nullable): Storage for any error
+ *
+ * Add the match, driver and package of the modalias, as with
+ * #ldm_catalogue_add_alias.
+ *
+ * Returns: TRUE if the alias was added
+ */
+gboolean ldm_catalogue_add_modalias(LdmCatalogue *self, LdmModalias *modalias, GError **error)
+{
+        g_return_val_if_fail(self != NULL, FALSE);
+        g_return_val_if_fail(modalias != NULL, FALSE);
+
+        return ldm_catalogue_add_alias(self,
+                                       ldm_modalias_get_match(modalias),
+                                       ldm_modalias_get_driver(modalias),
+                                       ldm_modalias_get_package(modalias),
+                                       error);
+}
+
+/**
+ * ldm_catalogue_commit:
+ * @error: (nullable): Storage for any error
+ *
+ * Replace the catalogue on disk with the aliases added since the last
+ * commit, which may be none at all to empty it. Lookups see either the
+ * previous catalogue or the new one in full, never a mix of the two.
+ *
+ * Returns: TRUE if the catalogue was written
+ */
+gboolean ldm_catalogue_commit(LdmCatalogue *self, GError **error)
+{
+        g_autofree gchar *current = NULL;
+        g_autofree gchar *pending = NULL;
+        g_autofree gchar *target = NULL;
+        g_autofree gchar *previous = NULL;
+
+        g_return_val_if_fail(self != NULL, FALSE);
+
+        if (!ldm_catalogue_flush(self, error)) {
+                return FALSE;
+        }
+
+        current = g_build_filename(self->directory, LDM_CATALOGUE_CURRENT, NULL);
+        pending = g_build_filename(self->directory, LDM_CATALOGUE_CURRENT_PENDING, NULL);
+        target = g_path_get_basename(self->build.path);
+        previous = g_file_read_link(current, NULL);
+
+        /* A link left over from an interrupted commit is simply replaced */
+        if ((unlink(pending) != 0 && errno != ENOENT) || symlink(target, pending) != 0 ||
+            rename(pending, current) != 0) {
+                g_set_error(error,
+                            G_FILE_ERROR,
+                            g_file_error_from_errno(errno),
+                            "Failed to replace %s: %s",
+                            current,
+                            strerror(errno));
+                return FALSE;
+        }
+
+        /* Only ever remove builds that we named */
+        if (previous && g_str_has_prefix(previous, LDM_CATALOGUE_BUILD_PREFIX) &&
+            !strchr(previous, '/') && !g_str_equal(previous, target)) {
+                ldm_catalogue_retire_build(self->directory, previous);
+        }
+
+        g_clear_pointer(&self->build.path, g_free);
+        g_hash_table_remove_all(self->build.buffers);
+        g_hash_table_remove_all(self->build.written);
+
+        return TRUE;
+}
+
+/**
+ * ldm_catalogue_scan:
+ * @modalias: Modalias of the device
+ * @packages: Packages found so far, in order
+ * @seen: Set of the packages found so far
+ *
+ * Test every alias in the shard against the modalias. Lines are parsed in
+ * place, as in a `.modaliases` file, with only the match copied out for
+ * fnmatch.
+ */
+static void ldm_catalogue_scan(GMappedFile *shard, const gchar *modalias, GPtrArray *packages,
+                               GHashTable *seen)
+{
+        const gchar *data = g_mapped_file_get_contents(shard);
+        const gchar *end = data + g_mapped_file_get_length(shard);
+        const gchar *line = data;
+
+        while (line < end) {
+                const gchar *stop = memchr(line, '\n', (gsize)(end - line));
+                const gchar *match = NULL;
+                const gchar *driver = NULL;
+                const gchar *package = NULL;
+                gchar buffer[LDM_CATALOGUE_MATCH_MAX];
+                g_autofree gchar *long_match = NULL;
+                const gchar *pattern = NULL;
+                gchar *copy = NULL;
+                gsize match_len = 0;
+
+                if (!stop) {
+                        stop = end;
+                }
+
+                /* We wrote the shard, so anything else is skipped quietly */
+                if ((gsize)(stop - line) <= strlen("alias ") ||
+                    strncmp(line, "alias ", strlen("alias ")) != 0) {
+                        line = stop + 1;
+                        continue;
+                }
+                match = line + strlen("alias ");
+                driver = memchr(match, ' ', (gsize)(stop - match));
+                package = driver ? memchr(driver + 1, ' ', (gsize)(stop - driver - 1)) : NULL;
+                line = stop + 1;
+                if (!package) {
+                        continue;
+                }
+
+                match_len = (gsize)(driver - match);
+                if (match_len < sizeof(buffer)) {
+                        memcpy(buffer, match, match_len);
+                        buffer[match_len] = '\0';
+                        pattern = buffer;
+                } else {
+                        long_match = g_strndup(match, match_len);
+                        pattern = long_match;
+                }
+
+                if (fnmatch(pattern, modalias, 0) != 0) {
+                        continue;
+                }
+
+                ++package;
+                copy = g_strndup(package, (gsize)(stop - package));
+                if (g_hash_table_contains(seen, copy)) {
+                        g_free(copy);
+                        continue;
+                }
+                g_hash_table_add(seen, copy);
+                g_ptr_array_add(packages, g_strdup(copy));
+        }
+}
+
+/**
+ * ldm_catalogue_route_shards:
+ * @modalias: Modalias of a device
+ * @names: (out): Names of the shards the modalias can be routed to
+ *
+ * Returns: The number of names stored, to be freed by the caller
+ */
+static guint ldm_catalogue_route_shards(const gchar *modalias, gchar *names[3])
+{
+        LdmRoute route = { 0 };
+        guint n_names = 0;
+
+        if (ldm_route_parse(&route, modalias)) {
+                if (!route.any_vendor) {
+                        names[n_names++] = ldm_catalogue_shard_name(&route, FALSE);
+                }
+                names[n_names++] = ldm_catalogue_shard_name(&route, TRUE);
+        }
+        names[n_names++] = ldm_catalogue_shard_name(NULL, FALSE);
+
+        return n_names;
+}
+
+/**
+ * ldm_catalogue_collect:
+ * @modaliases: (element-type utf8): Modaliases found so far, owned by the devices
+ *
+ * Gather the modaliases of the device and then its children, in lookup order
+ */
+static void ldm_catalogue_collect(LdmDevice *device, GPtrArray *modaliases)
+{
+        g_autoptr(GList) kids = NULL;
+        const gchar *modalias = NULL;
+
+        modalias = ldm_device_get_modalias(device);
+        if (modalias) {
+                g_ptr_array_add(modaliases, (gpointer)modalias);
+        }
+
+        kids = ldm_device_get_children(device);
+        for (GList *elem = kids; elem; elem = elem->next) {
+                ldm_catalogue_collect(LDM_DEVICE(elem->data), modaliases);
+        }
+}
+
+/**
+ * ldm_catalogue_open_shard:
+ * @root: Directory of the build being read
+ * @shards: Shards opened by the current lookup
+ *
+ * Map the shard unless we already have, remembering missing shards too
+ */
+static void ldm_catalogue_open_shard(const gchar *root, GHashTable *shards, const gchar *name)
+{
+        g_autofree gchar *path = NULL;
+        GMappedFile *shard = NULL;
+
+        if (g_hash_table_contains(shards, name)) {
+                return;
+        }
+
+        path = ldm_catalogue_shard_path(root, name);
+        shard = g_mapped_file_new(path, FALSE, NULL);
+        if (shard && g_mapped_file_get_length(shard) < 1) {
+                g_clear_pointer(&shard, g_mapped_file_unref);
+        }
+
+        g_hash_table_insert(shards, g_strdup(name), shard);
+}
+
+/**
+ * ldm_catalogue_open_shards:
+ * @root: Directory of the build being read
+ * @modaliases: (element-type utf8): Modaliases of the lookup
+ * @shards: Storage for the mapped shards, by name
+ *
+ * Map every shard the lookup needs before any is scanned. A mapping stays
+ * valid once the shard is removed, and builds are only removed after being
+ * moved aside, so if the build is still in place after mapping then every
+ * shard came from it, and a shard that couldn't be found was never written.
+ *
+ * Returns: FALSE if the build was removed while we were mapping it
+ */
+static gboolean ldm_catalogue_open_shards(const gchar *root, GPtrArray *modaliases,
+                                          GHashTable *shards)
+{
+        for (guint i = 0; i < modaliases->len; i++) {
+                gchar *names[3] = { NULL };
+                guint n_names = ldm_catalogue_route_shards(modaliases->pdata[i], names);
+
+                for (guint j = 0; j < n_names; j++) {
+                        ldm_catalogue_open_shard(root, shards, names[j]);
+                        g_free(names[j]);
+                }
+        }
+
+        return g_file_test(root, G_FILE_TEST_IS_DIR);
+}
+
+/**
+ * ldm_catalogue_scan_shards:
+ * @modaliases: (element-type utf8): Modaliases of the lookup
+ * @shards: Shards mapped by #ldm_catalogue_open_shards
+ *
+ * Scan the shards each modalias can be routed to, in lookup order
+ */
+static void ldm_catalogue_scan_shards(GPtrArray *modaliases, GHashTable *shards,
+                                      GPtrArray *packages, GHashTable *seen)
+{
+        for (guint i = 0; i < modaliases->len; i++) {
+                const gchar *modalias = modaliases->pdata[i];
+                gchar *names[3] = { NULL };
+                guint n_names = ldm_catalogue_route_shards(modalias, names);
+
+                for (guint j = 0; j < n_names; j++) {
+                        GMappedFile *shard = g_hash_table_lookup(shards, names[j]);
+
+                        if (shard) {
+                                ldm_catalogue_scan(shard, modalias, packages, seen);
+                        }
+                        g_free(names[j]);
+                }
+        }
+}
+
+/**
+ * ldm_catalogue_get_packages:
+ * @device: Device to find packages for
+ *
+ * Find every package with an alias matching the device, or one of its
+ * children. Only the shards for the buses and vendors of those devices are
+ * read, all from the same build, and they are unmapped again before
+ * returning. If a commit removes the build before all of its shards are
+ * mapped, the lookup starts again from the build that replaced it.
+ *
+ * Returns: (element-type utf8) (transfer full): Names of the packages, in match order
+ */
+GPtrArray *ldm_catalogue_get_packages(LdmCatalogue *self, LdmDevice *device)
+{
+        g_autoptr(GPtrArray) modaliases = NULL;
+        g_autoptr(GHashTable) shards = NULL;
+        g_autoptr(GHashTable) seen = NULL;
+        g_autofree gchar *current = NULL;
+        GPtrArray *packages = NULL;
+
+        g_return_val_if_fail(self != NULL, NULL);
+        g_return_val_if_fail(device != NULL, NULL);
+
+        packages = g_ptr_array_new_with_free_func(g_free);
+
+        modaliases = g_ptr_array_new();
+        ldm_catalogue_collect(device, modaliases);
+
+        shards = g_hash_table_new_full(g_str_hash,
+                                       g_str_equal,
+                                       g_free,
+                                       (GDestroyNotify)ldm_catalogue_shard_free);
+        current = g_build_filename(self->directory, LDM_CATALOGUE_CURRENT, NULL);
+
+        /* Only a commit landing while shards are mapped sends us round again */
+        for (;;) {
+                g_autofree gchar *target = NULL;
+                g_autofree gchar *root = NULL;
+
+                /* Never committed, so there's nothing to find */
+                target = g_file_read_link(current, NULL);
+                if (!target) {
+                        return packages;
+                }
+                root = g_build_filename(self->directory, target, NULL);
+
+                if (ldm_catalogue_open_shards(root, modaliases, shards)) {
+                        break;
+                }
+                g_hash_table_remove_all(shards);
+        }
+
+        seen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        ldm_catalogue_scan_shards(modaliases, shards, packages, seen);
+
+        return packages;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,62 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include <device.h>
+#include <modalias.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LdmCatalogue LdmCatalogue;
+typedef struct _LdmCatalogueClass LdmCatalogueClass;
+
+#define LDM_TYPE_CATALOGUE ldm_catalogue_get_type()
+#define LDM_CATALOGUE(o) (G_TYPE_CHECK_INSTANCE_CAST((o), LDM_TYPE_CATALOGUE, LdmCatalogue))
+#define LDM_IS_CATALOGUE(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), LDM_TYPE_CATALOGUE))
+#define LDM_CATALOGUE_CLASS(o)                                                                     \
+        (G_TYPE_CHECK_CLASS_CAST((o), LDM_TYPE_CATALOGUE, LdmCatalogueClass))
+#define LDM_IS_CATALOGUE_CLASS(o) (G_TYPE_CHECK_CLASS_TYPE((o), LDM_TYPE_CATALOGUE))
+#define LDM_CATALOGUE_GET_CLASS(o)                                                                 \
+        (G_TYPE_INSTANCE_GET_CLASS((o), LDM_TYPE_CATALOGUE, LdmCatalogueClass))
+
+GType ldm_catalogue_get_type(void);
+
+/* API */
+LdmCatalogue *ldm_catalogue_new(const gchar *directory);
+const gchar *ldm_catalogue_get_directory(LdmCatalogue *catalogue);
+
+gboolean ldm_catalogue_add_alias(LdmCatalogue *catalogue, const gchar *match,
+                                 const gchar *driver, const gchar *package, GError **error);
+gboolean ldm_catalogue_add_modalias(LdmCatalogue *catalogue, LdmModalias *modalias,
+                                    GError **error);
+gboolean ldm_catalogue_commit(LdmCatalogue *catalogue, GError **error);
+
+GPtrArray *ldm_catalogue_get_packages(LdmCatalogue *catalogue, LdmDevice *device);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LdmCatalogue, g_object_unref)
+
+G_END_DECLS
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,500 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "device-filter.h"
+#include "ldm-private.h"
+#include "route.h"
+
+struct _LdmDeviceFilterClass {
+        GObjectClass parent_class;
+};
+
+/**
+ * SECTION:device-filter
+ * @Short_description: Exclude devices ahead of enumeration
+ * @see_also: #LdmManager
+ * @Title: LdmDeviceFilter
+ *
+ * An LdmDeviceFilter holds rules for devices that an #LdmManager should
+ * never construct, such as USB hubs and PCI bridges. The rules are checked
+ * against the raw udev device, using only the uevent properties, so an
+ * excluded device costs a lookup rather than a full #LdmDevice.
+ *
+ * A rule matches when all of its fields match, and a device is excluded if
+ * any rule matches. USB interfaces, and the devices attached to them, are
+ * also excluded with the USB device owning them.
+ *
+ * Rules may be loaded from a key file, with one group per rule. The group
+ * names are only there for the benefit of the reader.
+ *
+ * |[
+ *      [usb-hubs]
+ *      Subsystem=usb
+ *      DevType=usb_device
+ *      Class=9
+ *
+ *      [pci-bridges]
+ *      Subsystem=pci
+ *      Class=0x060000
+ *      ClassMask=0xff0000
+ * ]|
+ *
+ * The PCI class is the full 24-bit class code, USB devices and interfaces
+ * have their 8-bit class. Without a `ClassMask` the class must match
+ * exactly. `VendorID` restricts the rule to a single vendor. A
+ * #LdmManager constructed without a filter uses the rules in
+ * `$(sysconfdir)/linux-driver-management/device-filter.conf`, or in the
+ * file named by the `LDM_DEVICE_FILTER_FILE` environment variable when it
+ * is set, i.e. so that tests don't depend on the host configuration.
+ */
+
+/*
+ * LdmDeviceFilterRule
+ *
+ * Single exclusion rule. Strings are interned, unset fields match anything.
+ */
+typedef struct LdmDeviceFilterRule {
+        const gchar *subsystem;
+        const gchar *devtype;
+        guint class_code;
+        guint class_mask; /* 0 to ignore the class */
+        guint vendor_id;  /* 0 to ignore the vendor */
+} LdmDeviceFilterRule;
+
+/*
+ * LdmDeviceFilterKey
+ *
+ * The fields of a udev device that rules look at. Class and vendor are only
+ * looked up once a rule needs them.
+ */
+typedef struct LdmDeviceFilterKey {
+        udev_device *device;
+        const char *subsystem;
+        const char *devtype;
+        gint class_code; /* -1 if unknown */
+        gint64 vendor_id; /* -1 if unknown */
+        gboolean resolved;
+} LdmDeviceFilterKey;
+
+/*
+ * LdmDeviceFilter
+ *
+ * Rule set consulted before devices are constructed.
+ */
+struct _LdmDeviceFilter {
+        GObject parent;
+
+        GArray *rules; /* LdmDeviceFilterRule */
+};
+
+G_DEFINE_TYPE(LdmDeviceFilter, ldm_device_filter, G_TYPE_OBJECT)
+
+/**
+ * ldm_device_filter_dispose:
+ *
+ * Clean up a LdmDeviceFilter instance
+ */
+static void ldm_device_filter_dispose(GObject *obj)
+{
+        LdmDeviceFilter *self = LDM_DEVICE_FILTER(obj);
+
+        g_clear_pointer(&self->rules, g_array_unref);
+
+        G_OBJECT_CLASS(ldm_device_filter_parent_class)->dispose(obj);
+}
+
+/**
+ * ldm_device_filter_class_init:
+ *
+ * Handle class initialisation
+ */
+static void ldm_device_filter_class_init(LdmDeviceFilterClass *klazz)
+{
+        GObjectClass *obj_class = G_OBJECT_CLASS(klazz);
+
+        /* gobject vtable hookup */
+        obj_class->dispose = ldm_device_filter_dispose;
+}
+
+/**
+ * ldm_device_filter_init:
+ *
+ * Handle construction of the LdmDeviceFilter
+ */
+static void ldm_device_filter_init(LdmDeviceFilter *self)
+{
+        self->rules = g_array_new(FALSE, FALSE, sizeof(LdmDeviceFilterRule));
+}
+
+/**
+ * ldm_device_filter_new:
+ *
+ * Create a new LdmDeviceFilter without any rules
+ *
+ * Returns: (transfer full): An #LdmDeviceFilter instance.
+ */
+LdmDeviceFilter *ldm_device_filter_new()
+{
+        return g_object_new(LDM_TYPE_DEVICE_FILTER, NULL);
+}
+
+/**
+ * ldm_device_filter_add_rule:
+ * @subsystem: (nullable): udev subsystem, i.e. "usb"
+ * @devtype: (nullable): udev device type, i.e. "usb_device"
+ * @class_code: Class code of the device
+ * @class_mask: Bits of @class_code to compare, or 0 to match any class
+ * @vendor_id: Vendor of the device, or 0 to match any vendor
+ *
+ * Exclude every device matching all of the given fields. At least one field
+ * must be set, as the rule would otherwise exclude every device.
+ */
+void ldm_device_filter_add_rule(LdmDeviceFilter *self, const gchar *subsystem,
+                                const gchar *devtype, guint class_code, guint class_mask,
+                                guint vendor_id)
+{
+        LdmDeviceFilterRule rule = {
+                .subsystem = g_intern_string(subsystem),
+                .devtype = g_intern_string(devtype),
+                .class_code = class_code & class_mask,
+                .class_mask = class_mask,
+                .vendor_id = vendor_id,
+        };
+
+        g_return_if_fail(self != NULL);
+        g_return_if_fail(subsystem || devtype || class_mask || vendor_id);
+
+        g_array_append_val(self->rules, rule);
+}
+
+/**
+ * ldm_device_filter_get_id:
+ * @value: (inout): Left alone if the key is missing
+ *
+ * Read a decimal or hexadecimal ID from the rule
+ */
+static gboolean ldm_device_filter_get_id(GKeyFile *file, const gchar *group, const gchar *key,
+                                         guint *value, GError **error)
+{
+        g_autofree gchar *str = NULL;
+        gchar *end = NULL;
+        guint64 id = 0;
+
+        if (!g_key_file_has_key(file, group, key, NULL)) {
+                return TRUE;
+        }
+
+        str = g_key_file_get_string(file, group, key, error);
+        if (!str) {
+                return FALSE;
+        }
+
+        id = g_ascii_strtoull(g_strstrip(str), &end, 0);
+        if (end == str || *end != '\0' || id > G_MAXUINT32) {
+                g_set_error(error,
+                            G_KEY_FILE_ERROR,
+                            G_KEY_FILE_ERROR_INVALID_VALUE,
+                            "Invalid %s in rule [%s]: %s",
+                            key,
+                            group,
+                            str);
+                return FALSE;
+        }
+
+        *value = (guint)id;
+        return TRUE;
+}
+
+/**
+ * ldm_device_filter_add_rules_from_file:
+ * @path: Path to the rules file
+ * @error: (nullable): Storage for any error
+ *
+ * Add every rule from the given key file. If any rule is invalid, none of
+ * the rules in the file are added.
+ *
+ * Returns: TRUE if the rules were added
+ */
+gboolean ldm_device_filter_add_rules_from_file(LdmDeviceFilter *self, const gchar *path,
+                                               GError **error)
+{
+        g_autoptr(GKeyFile) file = NULL;
+        g_autoptr(GArray) rules = NULL;
+        g_auto(GStrv) groups = NULL;
+
+        g_return_val_if_fail(self != NULL, FALSE);
+        g_return_val_if_fail(path != NULL, FALSE);
+
+        file = g_key_file_new();
+        if (!g_key_file_load_from_file(file, path, G_KEY_FILE_NONE, error)) {
+                return FALSE;
+        }
+
+        rules = g_array_new(FALSE, FALSE, sizeof(LdmDeviceFilterRule));
+        groups = g_key_file_get_groups(file, NULL);
+
+        for (guint i = 0; groups[i]; i++) {
+                const gchar *group = groups[i];
+                g_autofree gchar *subsystem = NULL;
+                g_autofree gchar *devtype = NULL;
+                LdmDeviceFilterRule rule = { 0 };
+
+                subsystem = g_key_file_get_string(file, group, "Subsystem", NULL);
+                devtype = g_key_file_get_string(file, group, "DevType", NULL);
+
+                if (!ldm_device_filter_get_id(file, group, "Class", &rule.class_code, error) ||
+                    !ldm_device_filter_get_id(file, group, "VendorID", &rule.vendor_id, error)) {
+                        return FALSE;
+                }
+
+                /* A class on its own is matched exactly */
+                if (g_key_file_has_key(file, group, "Class", NULL)) {
+                        rule.class_mask = G_MAXUINT32;
+                }
+                if (!ldm_device_filter_get_id(file, group, "ClassMask", &rule.class_mask, error)) {
+                        return FALSE;
+                }
+
+                if (!subsystem && !devtype && !rule.class_mask && !rule.vendor_id) {
+                        g_set_error(error,
+                                    G_KEY_FILE_ERROR,
+                                    G_KEY_FILE_ERROR_INVALID_VALUE,
+                                    "Rule [%s] would exclude every device",
+                                    group);
+                        return FALSE;
+                }
+
+                rule.subsystem = g_intern_string(subsystem);
+                rule.devtype = g_intern_string(devtype);
+                rule.class_code &= rule.class_mask;
+                g_array_append_val(rules, rule);
+        }
+
+        g_array_append_vals(self->rules, rules->data, rules->len);
+        return TRUE;
+}
+
+/**
+ * ldm_device_filter_get_system_path:
+ *
+ * Returns: (transfer none): Path of the system configuration file
+ */
+static const gchar *ldm_device_filter_get_system_path(void)
+{
+        const gchar *path = g_getenv("LDM_DEVICE_FILTER_FILE");
+
+        return path && *path ? path : LDM_DEVICE_FILTER_FILE;
+}
+
+/**
+ * ldm_device_filter_add_system_rules:
+ *
+ * Add the rules from the system configuration file, if there is one.
+ * Invalid files are reported and otherwise ignored. The
+ * `LDM_DEVICE_FILTER_FILE` environment variable overrides the location of
+ * the file.
+ *
+ * Returns: TRUE if any rules were added
+ */
+gboolean ldm_device_filter_add_system_rules(LdmDeviceFilter *self)
+{
+        g_autoptr(GError) error = NULL;
+        const gchar *path = NULL;
+        guint n_rules = 0;
+
+        g_return_val_if_fail(self != NULL, FALSE);
+
+        path = ldm_device_filter_get_system_path();
+        if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
+                return FALSE;
+        }
+
+        n_rules = self->rules->len;
+        if (!ldm_device_filter_add_rules_from_file(self, path, &error)) {
+                g_warning("Failed to load %s: %s", path, error->message);
+                return FALSE;
+        }
+
+        return self->rules->len > n_rules;
+}
+
+/**
+ * ldm_device_filter_get_n_rules:
+ *
+ * Returns: The number of rules in the filter
+ */
+guint ldm_device_filter_get_n_rules(LdmDeviceFilter *self)
+{
+        g_return_val_if_fail(self != NULL, 0);
+
+        return self->rules->len;
+}
+
+/**
+ * ldm_device_filter_key_resolve:
+ *
+ * Find the class and vendor in the uevent properties, which libudev has
+ * already read for the subsystem. Nothing else is touched in sysfs.
+ */
+static void ldm_device_filter_key_resolve(LdmDeviceFilterKey *key)
+{
+        const char *value = NULL;
+        LdmRoute route = { 0 };
+
+        key->resolved = TRUE;
+        key->class_code = -1;
+        key->vendor_id = -1;
+
+        if (g_str_equal(key->subsystem, "pci")) {
+                /* PCI_CLASS=C0330, PCI_ID=8086:A12F */
+                value = udev_device_get_property_value(key->device, "PCI_CLASS");
+                if (value) {
+                        key->class_code = (gint)strtoul(value, NULL, 16);
+                }
+                value = udev_device_get_property_value(key->device, "PCI_ID");
+                if (value) {
+                        key->vendor_id = (gint64)strtoul(value, NULL, 16);
+                }
+                return;
+        }
+
+        if (g_str_equal(key->subsystem, "usb")) {
+                /* TYPE=9/0/1 or INTERFACE=1/1/0, PRODUCT=1d6b/2/414 */
+                if (key->devtype && g_str_equal(key->devtype, "usb_interface")) {
+                        value = udev_device_get_property_value(key->device, "INTERFACE");
+                } else {
+                        value = udev_device_get_property_value(key->device, "TYPE");
+                }
+                if (value) {
+                        key->class_code = (gint)strtoul(value, NULL, 10);
+                }
+                value = udev_device_get_property_value(key->device, "PRODUCT");
+                if (value) {
+                        key->vendor_id = (gint64)strtoul(value, NULL, 16);
+                }
+                return;
+        }
+
+        /* Everything else only has a vendor, through the modalias */
+        value = udev_device_get_property_value(key->device, "MODALIAS");
+        if (value && ldm_route_parse(&route, value) && !route.any_vendor) {
+                key->vendor_id = route.vendor_id;
+        }
+}
+
+/**
+ * ldm_device_filter_matches:
+ *
+ * Returns: TRUE if any rule matches the device
+ */
+static gboolean ldm_device_filter_matches(LdmDeviceFilter *self, udev_device *device)
+{
+        LdmDeviceFilterKey key = {
+                .device = device,
+                .subsystem = udev_device_get_subsystem(device),
+                .devtype = udev_device_get_devtype(device),
+        };
+
+        if (!key.subsystem) {
+                return FALSE;
+        }
+
+        for (guint i = 0; i < self->rules->len; i++) {
+                const LdmDeviceFilterRule *rule =
+                    &g_array_index(self->rules, LdmDeviceFilterRule, i);
+
+                if (rule->subsystem && !g_str_equal(rule->subsystem, key.subsystem)) {
+                        continue;
+                }
+                if (rule->devtype && (!key.devtype || !g_str_equal(rule->devtype, key.devtype))) {
+                        continue;
+                }
+
+                if (!rule->class_mask && !rule->vendor_id) {
+                        return TRUE;
+                }
+                if (!key.resolved) {
+                        ldm_device_filter_key_resolve(&key);
+                }
+
+                if (rule->class_mask &&
+                    (key.class_code < 0 ||
+                     ((guint)key.class_code & rule->class_mask) != rule->class_code)) {
+                        continue;
+                }
+                if (rule->vendor_id && key.vendor_id != rule->vendor_id) {
+                        continue;
+                }
+
+                return TRUE;
+        }
+
+        return FALSE;
+}
+
+/**
+ * ldm_device_filter_excludes:
+ * @filter: (nullable): The filter to consult
+ * @device: The raw udev device
+ *
+ * Decide whether the device should be constructed at all. Only the filter
+ * is read, so this is safe to call from the manager probe threads.
+ *
+ * Returns: TRUE if the device must be skipped
+ */
+gboolean ldm_device_filter_excludes(LdmDeviceFilter *self, udev_device *device)
+{
+        udev_device *owner = NULL;
+        const char *subsystem = NULL;
+        const char *devtype = NULL;
+
+        if (!self || self->rules->len < 1) {
+                return FALSE;
+        }
+
+        if (ldm_device_filter_matches(self, device)) {
+                return TRUE;
+        }
+
+        /* PCI and DMI devices are never parented to USB devices */
+        subsystem = udev_device_get_subsystem(device);
+        if (!subsystem || g_str_equal(subsystem, "pci") || g_str_equal(subsystem, "dmi")) {
+                return FALSE;
+        }
+
+        devtype = udev_device_get_devtype(device);
+        if (devtype && g_str_equal(devtype, "usb_device")) {
+                return FALSE;
+        }
+
+        /* Interfaces and the devices on them go with their USB device */
+        owner = udev_device_get_parent_with_subsystem_devtype(device, "usb", "usb_device");
+        return owner && ldm_device_filter_matches(self, owner);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
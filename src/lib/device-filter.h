@@ -0,0 +1,59 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LdmDeviceFilter LdmDeviceFilter;
+typedef struct _LdmDeviceFilterClass LdmDeviceFilterClass;
+
+#define LDM_TYPE_DEVICE_FILTER ldm_device_filter_get_type()
+#define LDM_DEVICE_FILTER(o)                                                                       \
+        (G_TYPE_CHECK_INSTANCE_CAST((o), LDM_TYPE_DEVICE_FILTER, LdmDeviceFilter))
+#define LDM_IS_DEVICE_FILTER(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), LDM_TYPE_DEVICE_FILTER))
+#define LDM_DEVICE_FILTER_CLASS(o)                                                                 \
+        (G_TYPE_CHECK_CLASS_CAST((o), LDM_TYPE_DEVICE_FILTER, LdmDeviceFilterClass))
+#define LDM_IS_DEVICE_FILTER_CLASS(o) (G_TYPE_CHECK_CLASS_TYPE((o), LDM_TYPE_DEVICE_FILTER))
+#define LDM_DEVICE_FILTER_GET_CLASS(o)                                                             \
+        (G_TYPE_INSTANCE_GET_CLASS((o), LDM_TYPE_DEVICE_FILTER, LdmDeviceFilterClass))
+
+GType ldm_device_filter_get_type(void);
+
+/* API */
+LdmDeviceFilter *ldm_device_filter_new(void);
+
+void ldm_device_filter_add_rule(LdmDeviceFilter *filter, const gchar *subsystem,
+                                const gchar *devtype, guint class_code, guint class_mask,
+                                guint vendor_id);
+gboolean ldm_device_filter_add_rules_from_file(LdmDeviceFilter *filter, const gchar *path,
+                                               GError **error);
+gboolean ldm_device_filter_add_system_rules(LdmDeviceFilter *filter);
+guint ldm_device_filter_get_n_rules(LdmDeviceFilter *filter);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LdmDeviceFilter, g_object_unref)
+
+G_END_DECLS
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -11,6 +11,8 @@
 
 #define _GNU_SOURCE
 
+#include <string.h>
+
 #include "device.h"
 #include "ldm-enums.h"
 #include "ldm-private.h"
@@ -439,11 +441,6 @@ LdmDevice *ldm_device_new_from_udev(LdmDevice *parent, udev_device *device, udev
 
         /* Set the absolute basics */
         self->os.sysfs_path = g_strdup(udev_device_get_syspath(device));
-        sysattr = udev_device_get_sysattr_value(device, "modalias");
-        if (sysattr) {
-                self->os.modalias = g_strdup(sysattr);
-        }
-
         /* Shouldn't happen, but is definitely possible.. */
         if (!properties) {
                 goto post_hwdb;
@@ -483,6 +480,16 @@ LdmDevice *ldm_device_new_from_udev(LdmDevice *parent, udev_device *device, udev
 
 post_hwdb:
 
+        /* Prefer the uevent snapshot, reading sysfs may wake a suspended device */
+        sysattr = g_hash_table_lookup(self->os.hwdb_info, "MODALIAS");
+        if (!sysattr) {
+                sysattr = udev_device_get_sysattr_value(device, "modalias");
+        }
+        if (sysattr) {
+                self->os.modalias = g_strdup(sysattr);
+                ldm_modalias_fields_parse(&self->os.modalias_fields, self->os.modalias);
+        }
+
         if (special_type == LDM_TYPE_PCI_DEVICE) {
                 ldm_pci_device_init_private(self, device);
         } else if (special_type == LDM_TYPE_USB_DEVICE) {
@@ -708,6 +715,49 @@ gint ldm_device_get_priority(LdmDevice *self)
         return self->priority;
 }
 
+/**
+ * ldm_device_account_memory:
+ * @usage: Usage to add the memory of this device to
+ *
+ * Account the memory used by this device, its udev properties and all of
+ * its children.
+ */
+void ldm_device_account_memory(LdmDevice *self, LdmMemoryUsage *usage)
+{
+        GHashTableIter iter = { 0 };
+        gpointer key = NULL;
+        gpointer value = NULL;
+        GTypeQuery query = { 0 };
+
+        g_return_if_fail(self != NULL);
+        g_return_if_fail(usage != NULL);
+
+        g_type_query(G_OBJECT_TYPE(self), &query);
+        ldm_memory_usage_add(usage, LDM_MEMORY_CATEGORY_DEVICES, query.instance_size, 1);
+
+        ldm_memory_usage_add_string(usage, LDM_MEMORY_CATEGORY_STRINGS, self->os.sysfs_path);
+        ldm_memory_usage_add_string(usage, LDM_MEMORY_CATEGORY_STRINGS, self->os.modalias);
+        ldm_memory_usage_add_string(usage, LDM_MEMORY_CATEGORY_STRINGS, self->id.name);
+        ldm_memory_usage_add_string(usage, LDM_MEMORY_CATEGORY_STRINGS, self->id.vendor);
+
+        /* Each udev property is a key/value pair of our own strings */
+        ldm_memory_usage_add_hash_table(usage, LDM_MEMORY_CATEGORY_PROPERTIES, self->os.hwdb_info);
+        g_hash_table_iter_init(&iter, self->os.hwdb_info);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+                ldm_memory_usage_add(usage,
+                                     LDM_MEMORY_CATEGORY_PROPERTIES,
+                                     strlen(key) + 1 + (value ? strlen(value) + 1 : 0),
+                                     1);
+        }
+
+        ldm_memory_usage_add_hash_table(usage, LDM_MEMORY_CATEGORY_DEVICES, self->tree.kids);
+        g_hash_table_iter_init(&iter, self->tree.kids);
+        while (g_hash_table_iter_next(&iter, &key, &value)) {
+                ldm_memory_usage_add_string(usage, LDM_MEMORY_CATEGORY_STRINGS, key);
+                ldm_device_account_memory(value, usage);
+        }
+}
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
@@ -22,6 +22,7 @@
 
 #include "device.h"
 #include "glx-manager.h"
+#include "ldm-enums.h"
 #include "pci-device.h"
 #include "util.h"
 
@@ -53,6 +54,12 @@ struct _LdmGLXManagerClass {
  * drivers for Optimus systems. This control file is used by `ldm-session-init(1)` to provide
  * xrandr bootstrap during the early initialisation of an X11 desktop session.
  *
+ * Optimus systems may be configured in one of two ways, see #LdmHybridMode. By default the
+ * NVIDIA GPU renders everything and the iGPU only scans out the result. In render offload mode
+ * the iGPU remains the primary GPU, and the NVIDIA GPU is only used by applications that ask
+ * for it, i.e. with `__NV_PRIME_RENDER_OFFLOAD=1`. The mode is recorded in the hybrid control
+ * file, and is kept when the configuration is applied again unless explicitly changed.
+ *
  * This manager does not, and will not, control the specifics for Wayland. It is assumed that
  * Wayland compositors will set up offscreen surfaces with libGL_nvidia via glvnd and then
  * render the final result to the Intel device GL context (libGL_mesa). For non Optimus systems
@@ -69,22 +76,45 @@ struct _LdmGLXManagerClass {
 struct _LdmGLXManager {
         GObject parent;
 
+        gchar *root; /* Alternative root for all paths, NULL for the host */
+
         gchar *stock_xorg_config;
         gchar *glx_xorg_config;
+        gchar *hybrid_file;
+        gchar *xorg_module_dir;
+
+        LdmHybridMode hybrid_mode;
 };
 
+static void ldm_glx_manager_set_property(GObject *object, guint id, const GValue *value,
+                                         GParamSpec *spec);
+static void ldm_glx_manager_get_property(GObject *object, guint id, GValue *value,
+                                         GParamSpec *spec);
+static void ldm_glx_manager_constructed(GObject *obj);
+
 G_DEFINE_TYPE(LdmGLXManager, ldm_glx_manager, G_TYPE_OBJECT)
 
+/* Property IDs */
+enum { PROP_ROOT = 1, PROP_HYBRID_MODE, N_PROPS };
+
+static GParamSpec *obj_properties[N_PROPS] = {
+        NULL,
+};
+
 /* Helpers for xorg configurations */
 static gboolean ldm_xorg_config_has_driver(const gchar *path, const gchar *driver);
 static gboolean ldm_xorg_config_write_simple(const gchar *path, LdmDevice *device);
 static gboolean ldm_xorg_config_write_optimus(const gchar *path, LdmDevice *device);
-static gboolean ldm_xorg_driver_present(LdmDevice *device);
+static gboolean ldm_xorg_config_write_offload(const gchar *path, LdmDevice *igpu,
+                                              LdmDevice *dgpu);
+static gboolean ldm_xorg_config_write_composite(const gchar *path, GPtrArray *devices);
+static gboolean ldm_xorg_driver_present(const gchar *module_dir, LdmDevice *device);
 
 /* Private helpers for our class */
 static gboolean ldm_glx_manager_configure_optimus(LdmGLXManager *self, LdmGPUConfig *config);
 static gboolean ldm_glx_manager_configure_simple(LdmGLXManager *self, LdmGPUConfig *config);
-static void ldm_glx_manager_nuke_legacy(void);
+static gboolean ldm_glx_manager_configure_composite(LdmGLXManager *self, LdmGPUConfig *config);
+static void ldm_glx_manager_nuke_legacy(LdmGLXManager *self);
 
 /**
  * ldm_glx_manager_dispose:
@@ -95,8 +125,11 @@ static void ldm_glx_manager_dispose(GObject *obj)
 {
         LdmGLXManager *self = LDM_GLX_MANAGER(obj);
 
+        g_clear_pointer(&self->root, g_free);
         g_clear_pointer(&self->stock_xorg_config, g_free);
         g_clear_pointer(&self->glx_xorg_config, g_free);
+        g_clear_pointer(&self->hybrid_file, g_free);
+        g_clear_pointer(&self->xorg_module_dir, g_free);
 
         G_OBJECT_CLASS(ldm_glx_manager_parent_class)->dispose(obj);
 }
@@ -111,7 +144,76 @@ static void ldm_glx_manager_class_init(LdmGLXManagerClass *klazz)
         GObjectClass *obj_class = G_OBJECT_CLASS(klazz);
 
         /* gobject vtable hookup */
+        obj_class->constructed = ldm_glx_manager_constructed;
         obj_class->dispose = ldm_glx_manager_dispose;
+        obj_class->get_property = ldm_glx_manager_get_property;
+        obj_class->set_property = ldm_glx_manager_set_property;
+
+        /**
+         * LdmGLXManager:root
+         *
+         * Alternative root directory that all configuration files are
+         * read from and written to, i.e. for an image being built. When
+         * unset, the host system is configured.
+         */
+        obj_properties[PROP_ROOT] = g_param_spec_string("root",
+                                                        "Root directory",
+                                                        "Root directory for all configuration",
+                                                        NULL,
+                                                        G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+        /**
+         * LdmGLXManager:hybrid-mode
+         *
+         * How Optimus systems should be configured. Defaults to the mode
+         * found in the hybrid file, or #LDM_HYBRID_MODE_ALWAYS_ON.
+         */
+        obj_properties[PROP_HYBRID_MODE] =
+            g_param_spec_enum("hybrid-mode",
+                              "Hybrid mode",
+                              "How Optimus systems are configured",
+                              LDM_TYPE_HYBRID_MODE,
+                              LDM_HYBRID_MODE_ALWAYS_ON,
+                              G_PARAM_READWRITE);
+
+        g_object_class_install_properties(obj_class, N_PROPS, obj_properties);
+}
+
+static void ldm_glx_manager_set_property(GObject *object, guint id, const GValue *value,
+                                         GParamSpec *spec)
+{
+        LdmGLXManager *self = LDM_GLX_MANAGER(object);
+
+        switch (id) {
+        case PROP_ROOT:
+                g_free(self->root);
+                self->root = g_value_dup_string(value);
+                break;
+        case PROP_HYBRID_MODE:
+                self->hybrid_mode = g_value_get_enum(value);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+                break;
+        }
+}
+
+static void ldm_glx_manager_get_property(GObject *object, guint id, GValue *value,
+                                         GParamSpec *spec)
+{
+        LdmGLXManager *self = LDM_GLX_MANAGER(object);
+
+        switch (id) {
+        case PROP_ROOT:
+                g_value_set_string(value, self->root);
+                break;
+        case PROP_HYBRID_MODE:
+                g_value_set_enum(value, self->hybrid_mode);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+                break;
+        }
 }
 
 /**
@@ -121,12 +223,53 @@ static void ldm_glx_manager_class_init(LdmGLXManagerClass *klazz)
  */
 static void ldm_glx_manager_init(LdmGLXManager *self)
 {
+        self->hybrid_mode = LDM_HYBRID_MODE_ALWAYS_ON;
+}
+
+/**
+ * ldm_glx_manager_build_path:
+ * @path: Absolute path on the host
+ *
+ * Returns: (transfer full): The path relative to our root
+ */
+static gchar *ldm_glx_manager_build_path(LdmGLXManager *self, const gchar *path)
+{
+        if (!self->root) {
+                return g_strdup(path);
+        }
+        return g_build_filename(self->root, path, NULL);
+}
+
+/**
+ * ldm_glx_manager_constructed:
+ *
+ * Root is now known, so build our paths and pick up the hybrid mode that
+ * was last written, so that reapplying the configuration doesn't lose it.
+ */
+static void ldm_glx_manager_constructed(GObject *obj)
+{
+        LdmGLXManager *self = LDM_GLX_MANAGER(obj);
+        g_autofree gchar *contents = NULL;
+        g_autofree gchar *sysconfdir = NULL;
+
+        sysconfdir = ldm_glx_manager_build_path(self, SYSCONFDIR);
+
         /* Primary X.Org configuration */
-        self->stock_xorg_config = g_build_filename(SYSCONFDIR, "X11", "xorg.conf", NULL);
+        self->stock_xorg_config = g_build_filename(sysconfdir, "X11", "xorg.conf", NULL);
 
         /* Where we'll make our config changes */
         self->glx_xorg_config =
-            g_build_filename(SYSCONFDIR, "X11", "xorg.conf.d", "00-ldm.conf", NULL);
+            g_build_filename(sysconfdir, "X11", "xorg.conf.d", "00-ldm.conf", NULL);
+
+        self->hybrid_file = ldm_glx_manager_build_path(self, LDM_HYBRID_FILE);
+        self->xorg_module_dir = ldm_glx_manager_build_path(self, XORG_MODULE_DIRECTORY);
+
+        if (g_file_get_contents(self->hybrid_file, &contents, NULL, NULL) &&
+            g_str_equal(g_strstrip(contents), "2")) {
+                self->hybrid_mode = LDM_HYBRID_MODE_OFFLOAD;
+        }
+
+        G_OBJECT_CLASS(ldm_glx_manager_parent_class)->constructed(obj);
 }
 
 /**
@@ -370,6 +513,212 @@ static gboolean ldm_xorg_config_write_optimus(const gchar *path, LdmDevice *devi
         return TRUE;
 }
 
+/**
+ * ldm_xorg_config_write_offload:
+ * @path: File path to alter
+ * @igpu: Integrated GPU, used as the primary GPU
+ * @dgpu: NVIDIA GPU to expose as a render offload sink
+ */
+static gboolean ldm_xorg_config_write_offload(const gchar *path, LdmDevice *igpu,
+                                              LdmDevice *dgpu)
+{
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *dirname = NULL;
+        g_autofree gchar *contents = NULL;
+        guint igpu_bus = 0, igpu_dev = 0;
+        gint igpu_func = 0;
+        guint dgpu_bus = 0, dgpu_dev = 0;
+        gint dgpu_func = 0;
+
+        dirname = g_path_get_dirname(path);
+        if (!dirname) {
+                return FALSE;
+        }
+
+        /* Make sure we have the leading directory first */
+        if (!g_file_test(dirname, G_FILE_TEST_IS_DIR) &&
+            g_mkdir_with_parents(dirname, 00755) != 0) {
+                g_warning("Failed to construct leading directory %s: %s", dirname, strerror(errno));
+                return FALSE;
+        }
+
+        /* Bit of sanity if you please. */
+        if (!igpu || !ldm_device_has_type(igpu, LDM_DEVICE_TYPE_PCI)) {
+                g_message("Something is insane with configuration: missing PCI iGPU!");
+                return FALSE;
+        }
+        if (ldm_device_get_vendor_id(dgpu) != LDM_PCI_VENDOR_ID_NVIDIA) {
+                g_message("Something is insane with configuration: %s is not an NVIDIA device!",
+                          ldm_device_get_name(dgpu));
+                return FALSE;
+        }
+        if (!ldm_device_has_type(dgpu, LDM_DEVICE_TYPE_PCI)) {
+                g_message("Something is insane with configuration: %s is not a PCI device!",
+                          ldm_device_get_name(dgpu));
+                return FALSE;
+        }
+
+        /* Stash addresses for DRM style PCI IDs */
+        ldm_pci_device_get_address(LDM_PCI_DEVICE(igpu), &igpu_bus, &igpu_dev, &igpu_func);
+        ldm_pci_device_get_address(LDM_PCI_DEVICE(dgpu), &dgpu_bus, &dgpu_dev, &dgpu_func);
+
+        /* The iGPU drives the only screen, NVIDIA is a GPU screen for offload */
+        contents = g_strdup_printf(
+            "Section \"ServerLayout\"\n"
+            "        Identifier \"layout\"\n"
+            "        Screen 0 \"%s Screen\"\n"
+            "        Option \"AllowNVIDIAGPUScreens\"\n"
+            "EndSection\n\n"
+            "Section \"Device\"\n"
+            "        Identifier \"%s Card\"\n"
+            "        Driver \"modesetting\"\n"
+            "        BusID \"PCI:%u:%u:%d\"\n"
+            "        VendorName \"%s\"\n"
+            "        BoardName \"%s\"\n"
+            "EndSection\n\n"
+            "Section \"Screen\"\n"
+            "        Identifier \"%s Screen\"\n"
+            "        Device \"%s Card\"\n"
+            "EndSection\n\n"
+            "Section \"Device\"\n"
+            "        Identifier \"%s Card\"\n"
+            "        Driver \"%s\"\n"
+            "        BusID \"PCI:%u:%u:%d\"\n"
+            "        VendorName \"%s\"\n"
+            "        BoardName \"%s\"\n"
+            "EndSection\n",
+            ldm_xorg_config_id(igpu),
+            ldm_xorg_config_id(igpu),
+            igpu_bus,
+            igpu_dev,
+            igpu_func,
+            ldm_device_get_vendor(igpu),
+            ldm_device_get_name(igpu),
+            ldm_xorg_config_id(igpu),
+            ldm_xorg_config_id(igpu),
+            ldm_xorg_config_id(dgpu),
+            ldm_xorg_config_driver(dgpu),
+            dgpu_bus,
+            dgpu_dev,
+            dgpu_func,
+            ldm_device_get_vendor(dgpu),
+            ldm_device_get_name(dgpu));
+
+        /* Write the file */
+        if (!g_file_set_contents(path, contents, (gssize)strlen(contents), &error)) {
+                g_warning("Failed to set X.Org config %s: %s", path, error->message);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * ldm_xorg_config_write_composite:
+ * @path: File path to alter
+ * @devices: GPUs of the SLI/Crossfire group, primary first
+ *
+ * Every GPU gets a Device section with its BusID so that the driver can
+ * find the whole group, while the primary GPU drives the only screen.
+ * NVIDIA needs SLI requesting on that screen. Crossfire is left to the
+ * AMD driver once it can see all of the devices.
+ */
+static gboolean ldm_xorg_config_write_composite(const gchar *path, GPtrArray *devices)
+{
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *dirname = NULL;
+        g_autoptr(GString) contents = NULL;
+        LdmDevice *primary = NULL;
+        const gchar *device_id = NULL;
+        const gchar *driver = NULL;
+
+        dirname = g_path_get_dirname(path);
+        if (!dirname) {
+                return FALSE;
+        }
+
+        /* Make sure we have the leading directory first */
+        if (!g_file_test(dirname, G_FILE_TEST_IS_DIR) &&
+            g_mkdir_with_parents(dirname, 00755) != 0) {
+                g_warning("Failed to construct leading directory %s: %s", dirname, strerror(errno));
+                return FALSE;
+        }
+
+        /* Bit of sanity if you please. */
+        if (devices->len < 2) {
+                g_message("Something is insane with configuration: composite needs 2 GPUs!");
+                return FALSE;
+        }
+
+        primary = devices->pdata[0];
+        device_id = ldm_xorg_config_id(primary);
+        driver = ldm_xorg_config_driver(primary);
+        if (!driver) {
+                g_warning("SHOULD NOT HAPPEN: Missing driver translation on %s",
+                          ldm_device_get_path(primary));
+                return FALSE;
+        }
+
+        contents = g_string_new(NULL);
+        g_string_append_printf(contents,
+                               "Section \"ServerLayout\"\n"
+                               "        Identifier \"layout\"\n"
+                               "        Screen 0 \"%s Screen\"\n"
+                               "EndSection\n\n",
+                               device_id);
+
+        for (guint i = 0; i < devices->len; i++) {
+                LdmDevice *device = devices->pdata[i];
+                guint bus = 0, dev = 0;
+                gint func = 0;
+
+                if (!ldm_device_has_type(device, LDM_DEVICE_TYPE_PCI)) {
+                        g_message("Something is insane with configuration: %s is not a PCI device!",
+                                  ldm_device_get_name(device));
+                        return FALSE;
+                }
+
+                /* Stash addresses for DRM style PCI IDs */
+                ldm_pci_device_get_address(LDM_PCI_DEVICE(device), &bus, &dev, &func);
+
+                g_string_append_printf(contents,
+                                       "Section \"Device\"\n"
+                                       "        Identifier \"%s Card %u\"\n"
+                                       "        Driver \"%s\"\n"
+                                       "        BusID \"PCI:%u:%u:%d\"\n"
+                                       "        VendorName \"%s\"\n"
+                                       "        BoardName \"%s\"\n"
+                                       "EndSection\n\n",
+                                       device_id,
+                                       i,
+                                       driver,
+                                       bus,
+                                       dev,
+                                       func,
+                                       ldm_device_get_vendor(device),
+                                       ldm_device_get_name(device));
+        }
+
+        g_string_append_printf(contents,
+                               "Section \"Screen\"\n"
+                               "        Identifier \"%s Screen\"\n"
+                               "        Device \"%s Card 0\"\n",
+                               device_id,
+                               device_id);
+        if (ldm_device_get_vendor_id(primary) == LDM_PCI_VENDOR_ID_NVIDIA) {
+                g_string_append(contents, "        Option \"SLI\" \"Auto\"\n");
+        }
+        g_string_append(contents, "EndSection\n");
+
+        /* Write the file */
+        if (!g_file_set_contents(path, contents->str, (gssize)contents->len, &error)) {
+                g_warning("Failed to set X.Org config %s: %s", path, error->message);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
 /**
  * ldm_xorg_driver_present:
  *
@@ -382,7 +731,7 @@ static gboolean ldm_xorg_config_write_optimus(const gchar *path, LdmDevice *devi
  * Wayland world is KMS driven and in NVIDIA requires eglplatform, all of
  * which is automatic and doesn't require any kind of configuration.
  */
-static gboolean ldm_xorg_driver_present(LdmDevice *device)
+static gboolean ldm_xorg_driver_present(const gchar *module_dir, LdmDevice *device)
 {
         g_autofree gchar *test_path = NULL;
         const gchar *drv_fragment = NULL;
@@ -398,7 +747,7 @@ static gboolean ldm_xorg_driver_present(LdmDevice *device)
                 return FALSE;
         }
 
-        test_path = g_build_filename(XORG_MODULE_DIRECTORY, "drivers", drv_fragment, NULL);
+        test_path = g_build_filename(module_dir, "drivers", drv_fragment, NULL);
         if (!test_path) {
                 return FALSE;
         }
@@ -411,13 +760,13 @@ static gboolean ldm_xorg_driver_present(LdmDevice *device)
  *
  * Nuke traces of the optimus configuration
  */
-static void ldm_glx_manager_nuke_optimus(void)
+static void ldm_glx_manager_nuke_optimus(LdmGLXManager *self)
 {
         /* Remove any existing hybrid tracking file */
-        if (g_file_test(LDM_HYBRID_FILE, G_FILE_TEST_EXISTS)) {
-                if (unlink(LDM_HYBRID_FILE) != 0) {
+        if (g_file_test(self->hybrid_file, G_FILE_TEST_EXISTS)) {
+                if (unlink(self->hybrid_file) != 0) {
                         g_warning("Failed to remove hybrid tracking file %s: %s",
-                                  LDM_HYBRID_FILE,
+                                  self->hybrid_file,
                                   strerror(errno));
                 }
         }
@@ -467,7 +816,7 @@ static gboolean ldm_glx_manager_nuke_user_configurations(LdmGLXManager *self)
 static void ldm_glx_manager_nuke_configurations(LdmGLXManager *self)
 {
         ldm_glx_manager_nuke_user_configurations(self);
-        ldm_glx_manager_nuke_optimus();
+        ldm_glx_manager_nuke_optimus(self);
 
         if (g_file_test(self->glx_xorg_config, G_FILE_TEST_EXISTS)) {
                 fprintf(stderr, "Removing now invalid X11 GLX config %s\n", self->glx_xorg_config);
@@ -488,21 +837,35 @@ static gboolean ldm_glx_manager_configure_optimus(LdmGLXManager *self, LdmGPUCon
 {
         g_autoptr(GError) error = NULL;
         g_autofree gchar *dirname = NULL;
+        LdmDevice *dgpu = NULL;
+        gboolean wrote = FALSE;
 
-        /* For now we just write a 1 to touch the file and don't care about the contents.
-           In future we'll use 0 or non-existent to disable, 1 for "always on", and 2 for dynamic.
-        */
-        static const gchar *contents = "1";
+        /* Non-existent to disable, 1 for "always on" and 2 for render offload */
+        const gchar *contents = NULL;
 
         ldm_glx_manager_nuke_user_configurations(self);
 
+        dgpu = ldm_gpu_config_get_secondary_device(config);
+
         /* Before we can write the hybrid bit, we have to be able to set the xorg config */
-        if (!ldm_xorg_config_write_optimus(self->glx_xorg_config,
-                                           ldm_gpu_config_get_secondary_device(config))) {
+        switch (self->hybrid_mode) {
+        case LDM_HYBRID_MODE_OFFLOAD:
+                wrote = ldm_xorg_config_write_offload(self->glx_xorg_config,
+                                                      ldm_gpu_config_get_primary_device(config),
+                                                      dgpu);
+                contents = "2";
+                break;
+        case LDM_HYBRID_MODE_ALWAYS_ON:
+        default:
+                wrote = ldm_xorg_config_write_optimus(self->glx_xorg_config, dgpu);
+                contents = "1";
+                break;
+        }
+        if (!wrote) {
                 return FALSE;
         }
 
-        dirname = g_path_get_dirname(LDM_HYBRID_FILE);
+        dirname = g_path_get_dirname(self->hybrid_file);
         if (!dirname) {
                 return FALSE;
         }
@@ -515,9 +878,9 @@ static gboolean ldm_glx_manager_configure_optimus(LdmGLXManager *self, LdmGPUCon
         }
 
         /* Write the hybrid file contents now */
-        if (!g_file_set_contents(LDM_HYBRID_FILE, contents, (gssize)strlen(contents), &error)) {
+        if (!g_file_set_contents(self->hybrid_file, contents, (gssize)strlen(contents), &error)) {
                 g_warning("Failed to set hybrid file contents %s: %s",
-                          LDM_HYBRID_FILE,
+                          self->hybrid_file,
                           error->message);
                 return FALSE;
         }
@@ -533,7 +896,7 @@ static gboolean ldm_glx_manager_configure_optimus(LdmGLXManager *self, LdmGPUCon
 static gboolean ldm_glx_manager_configure_simple(LdmGLXManager *self, LdmGPUConfig *config)
 {
         /* Make sure we don't have Optimus! */
-        ldm_glx_manager_nuke_optimus();
+        ldm_glx_manager_nuke_optimus(self);
 
         /* Try to write new config first */
         if (!ldm_xorg_config_write_simple(self->glx_xorg_config,
@@ -544,6 +907,26 @@ static gboolean ldm_glx_manager_configure_simple(LdmGLXManager *self, LdmGPUConf
         return ldm_glx_manager_nuke_user_configurations(self);
 }
 
+/**
+ * ldm_glx_manager_configure_composite:
+ *
+ * Attempt configuration of SLI/Crossfire with proprietary drivers
+ */
+static gboolean ldm_glx_manager_configure_composite(LdmGLXManager *self, LdmGPUConfig *config)
+{
+        g_autoptr(GPtrArray) devices = NULL;
+
+        /* Make sure we don't have Optimus! */
+        ldm_glx_manager_nuke_optimus(self);
+
+        devices = ldm_gpu_config_get_devices(config);
+        if (!ldm_xorg_config_write_composite(self->glx_xorg_config, devices)) {
+                return FALSE;
+        }
+        /* Now try to nuke any existing user config */
+        return ldm_glx_manager_nuke_user_configurations(self);
+}
+
 /**
  * ldm_glx_manager_apply_configuration:
  * @config: Valid LdmGPUConfiguration
@@ -566,7 +949,7 @@ gboolean ldm_glx_manager_apply_configuration(LdmGLXManager *self, LdmGPUConfig *
         g_return_val_if_fail(self != NULL, FALSE);
 
         /* Clean up before doing anything. */
-        ldm_glx_manager_nuke_legacy();
+        ldm_glx_manager_nuke_legacy(self);
 
         detection_device = ldm_gpu_config_get_detection_device(config);
 
@@ -577,12 +960,12 @@ gboolean ldm_glx_manager_apply_configuration(LdmGLXManager *self, LdmGPUConfig *
         }
 
         /* If there isn't a valid driver for this device, remove configurations for it */
-        if (!ldm_xorg_driver_present(detection_device)) {
+        if (!ldm_xorg_driver_present(self->xorg_module_dir, detection_device)) {
                 ldm_glx_manager_nuke_configurations(self);
                 return TRUE;
         }
 
-        /* TODO: Support SLI/Crossfire + Hybrid etc. */
+        /* TODO: Support AMD Hybrid */
         if (ldm_gpu_config_has_type(config, LDM_GPU_TYPE_OPTIMUS)) {
                 if (!ldm_glx_manager_configure_optimus(self, config)) {
                         goto failed;
@@ -590,6 +973,13 @@ gboolean ldm_glx_manager_apply_configuration(LdmGLXManager *self, LdmGPUConfig *
                 return TRUE;
         }
 
+        if (ldm_gpu_config_has_type(config, LDM_GPU_TYPE_COMPOSITE)) {
+                if (!ldm_glx_manager_configure_composite(self, config)) {
+                        goto failed;
+                }
+                return TRUE;
+        }
+
         /* Assume we're just a simple device. */
         if (!ldm_glx_manager_configure_simple(self, config)) {
                 goto failed;
@@ -604,13 +994,47 @@ failed:
         return FALSE;
 }
 
+/**
+ * ldm_glx_manager_get_hybrid_mode:
+ *
+ * Get the mode used for Optimus systems. Unless it has been changed, this
+ * is the mode found in the hybrid file when the manager was created.
+ *
+ * Returns: The #LdmHybridMode in use
+ */
+LdmHybridMode ldm_glx_manager_get_hybrid_mode(LdmGLXManager *self)
+{
+        g_return_val_if_fail(self != NULL, LDM_HYBRID_MODE_ALWAYS_ON);
+
+        return self->hybrid_mode;
+}
+
+/**
+ * ldm_glx_manager_set_hybrid_mode:
+ * @mode: New #LdmHybridMode
+ *
+ * Set the mode used for Optimus systems by the next call to
+ * #ldm_glx_manager_apply_configuration.
+ */
+void ldm_glx_manager_set_hybrid_mode(LdmGLXManager *self, LdmHybridMode mode)
+{
+        g_return_if_fail(self != NULL);
+
+        if (self->hybrid_mode == mode) {
+                return;
+        }
+
+        self->hybrid_mode = mode;
+        g_object_notify_by_pspec(G_OBJECT(self), obj_properties[PROP_HYBRID_MODE]);
+}
+
 /**
  * ldm_glx_manager_nuke_legacy:
  *
  * Nuke previously constructed files from the old LDM implementation that are no longer
  * needed.
  */
-static void ldm_glx_manager_nuke_legacy()
+static void ldm_glx_manager_nuke_legacy(LdmGLXManager *self)
 {
         /* Garbage paths left over from old LDM, make sure they die */
         static const gchar *bad_paths[] = {
@@ -621,7 +1045,7 @@ static void ldm_glx_manager_nuke_legacy()
         };
 
         for (guint i = 0; i < G_N_ELEMENTS(bad_paths); i++) {
-                const gchar *path = bad_paths[i];
+                g_autofree gchar *path = ldm_glx_manager_build_path(self, bad_paths[i]);
                 if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
                         continue;
                 }
@@ -20,6 +20,19 @@ G_BEGIN_DECLS
 typedef struct _LdmGLXManager LdmGLXManager;
 typedef struct _LdmGLXManagerClass LdmGLXManagerClass;
 
+/**
+ * LdmHybridMode:
+ * @LDM_HYBRID_MODE_ALWAYS_ON: The discrete GPU renders everything, displayed via the iGPU
+ * @LDM_HYBRID_MODE_OFFLOAD: The iGPU renders by default, the discrete GPU is a render offload sink
+ *
+ * The way in which an Optimus system is configured. The value is recorded in
+ * the hybrid file so that `ldm-session-init(1)` knows what it has to do.
+ */
+typedef enum {
+        LDM_HYBRID_MODE_ALWAYS_ON = 1,
+        LDM_HYBRID_MODE_OFFLOAD = 2,
+} LdmHybridMode;
+
 #define LDM_TYPE_GLX_MANAGER ldm_glx_manager_get_type()
 #define LDM_GLX_MANAGER(o) (G_TYPE_CHECK_INSTANCE_CAST((o), LDM_TYPE_GLX_MANAGER, LdmGLXManager))
 #define LDM_IS_GLX_MANAGER(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), LDM_TYPE_GLX_MANAGER))
@@ -35,6 +48,8 @@ GType ldm_glx_manager_get_type(void);
 LdmGLXManager *ldm_glx_manager_new(void);
 
 gboolean ldm_glx_manager_apply_configuration(LdmGLXManager *manager, LdmGPUConfig *config);
+LdmHybridMode ldm_glx_manager_get_hybrid_mode(LdmGLXManager *manager);
+void ldm_glx_manager_set_hybrid_mode(LdmGLXManager *manager, LdmHybridMode mode);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(LdmGLXManager, g_object_unref)
 
@@ -13,6 +13,7 @@
 
 #include "gpu-config.h"
 #include "ldm-enums.h"
+#include "manager-private.h"
 #include "util.h"
 
 struct _LdmGPUConfigClass {
@@ -47,6 +48,9 @@ struct _LdmGPUConfig {
         LdmDevice *primary;   /* Primary GPU */
         LdmDevice *secondary; /* Secondary GPU */
 
+        /* Every GPU taking part in the configuration, primary first */
+        GPtrArray *devices;
+
         guint n_gpu;    /* How many GPUs we got? */
         guint gpu_type; /* Primary type */
 };
@@ -73,6 +77,10 @@ static GParamSpec *obj_properties[N_PROPS] = {
  */
 static void ldm_gpu_config_dispose(GObject *obj)
 {
+        LdmGPUConfig *self = LDM_GPU_CONFIG(obj);
+
+        g_clear_pointer(&self->devices, g_ptr_array_unref);
+
         G_OBJECT_CLASS(ldm_gpu_config_parent_class)->dispose(obj);
 }
 
@@ -211,6 +219,7 @@ static void ldm_gpu_config_init(LdmGPUConfig *self)
 {
         self->n_gpu = 0;
         self->gpu_type = LDM_GPU_TYPE_SIMPLE;
+        self->devices = g_ptr_array_new_with_free_func(g_object_unref);
 }
 
 /**
@@ -219,20 +228,26 @@ static void ldm_gpu_config_init(LdmGPUConfig *self)
  * @not_like: Item to not be.
  *
  * Utility method to find the boot_vga device, i.e. the GPU that was used
- * to boot the system.
+ * to boot the system. The manager holds a reference to the returned device.
  */
-static LdmDevice *ldm_gpu_config_search_boot(GPtrArray *devices, gboolean vga_boot,
+static LdmDevice *ldm_gpu_config_search_boot(LdmGPUConfig *self, gboolean vga_boot,
                                              LdmDevice *not_like)
 {
-        for (guint i = 0; i < devices->len; i++) {
-                LdmDevice *device = devices->pdata[i];
-
-                if (device == not_like) {
-                        continue;
-                }
+        g_autoptr(GPtrArray) devices = NULL;
+        LdmDeviceQuery query = {
+                .types = LDM_DEVICE_TYPE_PCI | LDM_DEVICE_TYPE_GPU,
+        };
+
+        if (vga_boot) {
+                query.attributes = LDM_DEVICE_ATTRIBUTE_BOOT_VGA;
+        } else {
+                query.no_attributes = LDM_DEVICE_ATTRIBUTE_BOOT_VGA;
+        }
 
-                if (ldm_device_has_attribute(device, LDM_DEVICE_ATTRIBUTE_BOOT_VGA) == vga_boot) {
-                        return device;
+        devices = ldm_manager_query_devices(self->manager, &query);
+        for (guint i = 0; i < devices->len; i++) {
+                if (devices->pdata[i] != not_like) {
+                        return devices->pdata[i];
                 }
         }
 
@@ -305,6 +320,57 @@ static gboolean ldm_gpu_config_do_amd_hybrid(LdmGPUConfig *self, LdmDevice *prim
         return TRUE;
 }
 
+/**
+ * ldm_gpu_config_do_composite:
+ *
+ * Composite graphics are formed by every GPU that shares the vendor of the
+ * primary GPU, when that vendor supports SLI or Crossfire. The primary GPU
+ * leads the group.
+ *
+ * Returns: TRUE if we detected a composite configuration
+ */
+static gboolean ldm_gpu_config_do_composite(LdmGPUConfig *self, LdmDevice *primary)
+{
+        g_autoptr(GPtrArray) devices = NULL;
+        gint vendor_id = ldm_device_get_vendor_id(primary);
+        LdmGPUType composite_type = 0;
+        LdmDeviceQuery query = {
+                .types = LDM_DEVICE_TYPE_PCI | LDM_DEVICE_TYPE_GPU,
+                .vendor_id = vendor_id,
+        };
+
+        switch (vendor_id) {
+        case LDM_PCI_VENDOR_ID_AMD:
+                composite_type = LDM_GPU_TYPE_CROSSFIRE;
+                break;
+        case LDM_PCI_VENDOR_ID_NVIDIA:
+                composite_type = LDM_GPU_TYPE_SLI;
+                break;
+        default:
+                return FALSE;
+        }
+
+        g_ptr_array_add(self->devices, g_object_ref(primary));
+        devices = ldm_manager_query_devices(self->manager, &query);
+        for (guint i = 0; i < devices->len; i++) {
+                if (devices->pdata[i] == primary) {
+                        continue;
+                }
+                g_ptr_array_add(self->devices, g_object_ref(devices->pdata[i]));
+        }
+
+        /* Just the one GPU from this vendor */
+        if (self->devices->len < 2) {
+                g_ptr_array_set_size(self->devices, 0);
+                return FALSE;
+        }
+
+        self->gpu_type = LDM_GPU_TYPE_COMPOSITE | composite_type;
+        self->primary = primary;
+        self->secondary = self->devices->pdata[1];
+        return TRUE;
+}
+
 /**
  * ldm_gpu_config_analyze:
  *
@@ -315,7 +381,6 @@ static void ldm_gpu_config_analyze(LdmGPUConfig *self)
         g_autoptr(GPtrArray) devices = NULL;
         LdmDevice *boot_vga = NULL;
         LdmDevice *non_boot_vga = NULL;
-        gint vendor_id = 0;
 
         devices = ldm_manager_get_devices(self->manager, LDM_DEVICE_TYPE_PCI | LDM_DEVICE_TYPE_GPU);
         self->n_gpu = devices->len;
@@ -330,11 +395,11 @@ static void ldm_gpu_config_analyze(LdmGPUConfig *self)
         /* Trivial GPU configuration */
         if (self->n_gpu == 1) {
                 self->gpu_type = LDM_GPU_TYPE_SIMPLE;
-                return;
+                goto simple;
         }
 
         /* Ensure we have boot_vga, compensate if required */
-        boot_vga = ldm_gpu_config_search_boot(devices, TRUE, NULL);
+        boot_vga = ldm_gpu_config_search_boot(self, TRUE, NULL);
         if (!boot_vga) {
                 boot_vga = devices->pdata[0];
         }
@@ -343,35 +408,33 @@ static void ldm_gpu_config_analyze(LdmGPUConfig *self)
         self->primary = boot_vga;
 
         /* Find a non_boot_vga that isn't boot_vga */
-        non_boot_vga = ldm_gpu_config_search_boot(devices, FALSE, boot_vga);
+        non_boot_vga = ldm_gpu_config_search_boot(self, FALSE, boot_vga);
 
         /* Optimus? */
         if (ldm_gpu_config_do_optimus(self, boot_vga, non_boot_vga)) {
-                return;
+                goto hybrid;
         }
 
         /* AMD hybrid? */
         if (ldm_gpu_config_do_amd_hybrid(self, boot_vga, non_boot_vga)) {
-                return;
+                goto hybrid;
         }
 
         /* Do we have composite graphics, i.e. SLI? */
-        vendor_id = ldm_device_get_vendor_id(boot_vga);
-        if (vendor_id == ldm_device_get_vendor_id(non_boot_vga)) {
-                switch (vendor_id) {
-                case LDM_PCI_VENDOR_ID_AMD:
-                        self->gpu_type = LDM_GPU_TYPE_COMPOSITE | LDM_GPU_TYPE_CROSSFIRE;
-                        return;
-                case LDM_PCI_VENDOR_ID_NVIDIA:
-                        self->gpu_type = LDM_GPU_TYPE_COMPOSITE | LDM_GPU_TYPE_SLI;
-                        return;
-                default:
-                        break;
-                }
+        if (ldm_gpu_config_do_composite(self, boot_vga)) {
+                return;
         }
 
         /* Fugit, back to being simple device */
         self->gpu_type = LDM_GPU_TYPE_SIMPLE;
+
+simple:
+        g_ptr_array_add(self->devices, g_object_ref(self->primary));
+        return;
+
+hybrid:
+        g_ptr_array_add(self->devices, g_object_ref(self->primary));
+        g_ptr_array_add(self->devices, g_object_ref(self->secondary));
 }
 
 /**
@@ -509,6 +572,33 @@ LdmDevice *ldm_gpu_config_get_detection_device(LdmGPUConfig *self)
         return self->primary;
 }
 
+/**
+ * ldm_gpu_config_get_devices:
+ *
+ * Get every GPU taking part in this #LdmGPUConfig, starting with the
+ * primary device. For #LDM_GPU_TYPE_COMPOSITE configurations this is
+ * the whole SLI or Crossfire group, for hybrid configurations it is the
+ * primary and secondary device, and otherwise just the primary device.
+ *
+ * GPUs that don't take part, such as an onboard GPU left idle by a
+ * discrete card, are not included. Use #ldm_gpu_config_count for those.
+ *
+ * Returns: (element-type Ldm.Device) (transfer container): The GPUs in this configuration
+ */
+GPtrArray *ldm_gpu_config_get_devices(LdmGPUConfig *self)
+{
+        GPtrArray *ret = NULL;
+
+        g_return_val_if_fail(self != NULL, NULL);
+
+        ret = g_ptr_array_new_with_free_func(g_object_unref);
+        for (guint i = 0; i < self->devices->len; i++) {
+                g_ptr_array_add(ret, g_object_ref(self->devices->pdata[i]));
+        }
+
+        return ret;
+}
+
 /**
  * ldm_gpu_config_get_providers:
  *
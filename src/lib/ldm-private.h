@@ -14,7 +14,10 @@
 #include <glib-object.h>
 #include <libudev.h>
 
+#include "device-filter.h"
 #include "device.h"
+#include "memory-usage.h"
+#include "modalias-fields.h"
 #include "util.h"
 
 /*
@@ -51,6 +54,7 @@ struct _LdmDevice {
         struct {
                 gchar *sysfs_path;
                 gchar *modalias;
+                LdmModaliasFields modalias_fields; /* Parsed modalias, for matching */
                 GHashTable *hwdb_info;
                 guint devtype;
                 guint attributes;
@@ -87,6 +91,12 @@ void ldm_device_remove_child(LdmDevice *device, LdmDevice *child);
 void ldm_device_remove_child_by_path(LdmDevice *device, const gchar *path);
 LdmDevice *ldm_device_get_child_by_path(LdmDevice *device, const gchar *path);
 
+/* private accounting API */
+void ldm_device_account_memory(LdmDevice *device, LdmMemoryUsage *usage);
+
+/* private filter API */
+gboolean ldm_device_filter_excludes(LdmDeviceFilter *filter, udev_device *device);
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
@@ -11,12 +11,16 @@
 
 #pragma once
 
+#include <catalogue.h>
+#include <device-filter.h>
 #include <device.h>
 #include <glx-manager.h>
 #include <gpu-config.h>
 #include <ldm-enums.h>
 #include <manager.h>
+#include <memory-usage.h>
 #include <modalias.h>
+#include <module-resolver.h>
 #include <provider.h>
 
 /* Specialised devices */
@@ -29,6 +33,7 @@
 /* Plugin API */
 #include <plugin.h>
 #include <plugins/modalias-plugin.h>
+#include <plugins/native-plugin.h>
 
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
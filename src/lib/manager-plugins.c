@@ -12,12 +12,63 @@
 #define _GNU_SOURCE
 
 #include <glob.h>
+#include <string.h>
 
 #include "config.h"
 #include "manager-private.h"
+#include "modalias-stream.h"
+#include "plugin-private.h"
 #include "plugin.h"
+#include "route.h"
 
 #include "plugins/modalias-plugin.h"
+#include "plugins/native-plugin.h"
+
+/**
+ * ldm_manager_get_plugin_id:
+ *
+ * If a plugin id is unspecified, it is the class name
+ */
+static const gchar *ldm_manager_get_plugin_id(LdmPlugin *plugin)
+{
+        const gchar *plugin_id = NULL;
+
+        plugin_id = ldm_plugin_get_name(plugin);
+        if (!plugin_id) {
+                plugin_id = G_OBJECT_CLASS_NAME(LDM_PLUGIN_GET_CLASS(plugin));
+        }
+
+        return plugin_id;
+}
+
+/**
+ * ldm_manager_find_plugin:
+ * @index: (out): Index of the plugin in the priority order
+ *
+ * Returns: TRUE if we have a plugin with the given id
+ */
+static gboolean ldm_manager_find_plugin(LdmManager *self, const gchar *plugin_id, guint *index)
+{
+        for (guint i = 0; i < self->plugins->len; i++) {
+                if (g_str_equal(ldm_manager_get_plugin_id(self->plugins->pdata[i]), plugin_id)) {
+                        *index = i;
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+/**
+ * ldm_manager_plugin_changed:
+ *
+ * A plugin changed its priority or coverage, so the plugin order, routing
+ * tables and providers of the manager are now stale.
+ */
+static void ldm_manager_plugin_changed(LdmManager *self)
+{
+        ++self->plugin_serial;
+}
 
 /**
  * ldm_manager_add_plugin:
@@ -27,47 +78,64 @@
  * provide automatic hardware detection capabilities to the #LdmManager
  * and provide the internal API required for #ldm_manager_get_providers to
  * work.
+ *
+ * Plugins are consulted in order of their #LdmPlugin:priority, highest
+ * first. Plugins of equal priority are consulted in the order they were added.
  */
 void ldm_manager_add_plugin(LdmManager *self, LdmPlugin *plugin)
 {
         const gchar *plugin_id = NULL;
+        guint index = 0;
 
         g_return_if_fail(self != NULL);
         g_return_if_fail(plugin != NULL);
 
-        /* If a plugin id is unspecified, make it the class name */
-        plugin_id = ldm_plugin_get_name(plugin);
-        if (!plugin_id) {
-                plugin_id = G_OBJECT_CLASS_NAME(LDM_PLUGIN_GET_CLASS(plugin));
-        }
+        /* Handle pythonic apis with non floating references */
+        g_object_ref_sink(plugin);
+        plugin_id = ldm_manager_get_plugin_id(plugin);
 
-        if (g_hash_table_contains(self->plugins, plugin_id)) {
+        if (ldm_manager_find_plugin(self, plugin_id, &index)) {
                 g_debug("replacing plugin '%s'", plugin_id);
+                g_signal_handlers_disconnect_by_data(self->plugins->pdata[index], self);
+                g_ptr_array_remove_index(self->plugins, index);
         } else {
                 g_debug("new plugin: %s", plugin_id);
         }
 
-        /* Handle pythonic apis with non floating references */
-        g_hash_table_replace(self->plugins, g_strdup(plugin_id), g_object_ref_sink(plugin));
+        /* After every plugin of the same or higher priority */
+        for (index = 0; index < self->plugins->len; index++) {
+                if (ldm_plugin_get_priority(self->plugins->pdata[index]) <
+                    ldm_plugin_get_priority(plugin)) {
+                        break;
+                }
+        }
+
+        g_ptr_array_insert(self->plugins, (gint)index, plugin);
+        g_signal_connect_object(plugin,
+                                "changed",
+                                G_CALLBACK(ldm_manager_plugin_changed),
+                                self,
+                                G_CONNECT_SWAPPED);
+
+        /* Routing tables may now reference a stale plugin. The change is
+         * logged lazily, together with any other plugin change since. */
+        self->routes.dirty = TRUE;
+        ++self->plugin_serial;
 }
 
 /**
- * ldm_manager_add_modalias_plugin_for_path:
- * @path: The fully qualified ".modaliases" file path
+ * ldm_manager_add_native_plugin_for_path:
+ * @path: The fully qualified path to a compiled matcher module
  *
- * Add a new #LdmModaliasPlugin to the manager for the given path. This is a convenience
- * wrapper around #ldm_modalias_plugin_new_from_filename and #ldm_manager_add_plugin.
+ * Add a new #LdmNativePlugin to the manager for the given path. This is a convenience
+ * wrapper around #ldm_native_plugin_new_from_filename and #ldm_manager_add_plugin.
  *
- * Note that newer modalias plugins have a higher priority than older plugins,
- * so you should add newest drivers last if you have multiple driver versions.
- * This is already taken care of by using the glob-based function
- * #ldm_manager_add_modalias_plugins_for_directory
- *
- * i.e. insert 380 driver AFTER 340.
+ * Native plugins share their priority ordering with modalias plugins, see
+ * #ldm_manager_add_modalias_plugin_for_path
  *
  * Returns: TRUE if a new plugin was added
  */
-gboolean ldm_manager_add_modalias_plugin_for_path(LdmManager *self, const gchar *path)
+gboolean ldm_manager_add_native_plugin_for_path(LdmManager *self, const gchar *path)
 {
         LdmPlugin *plugin = NULL;
 
@@ -75,7 +143,10 @@ gboolean ldm_manager_add_modalias_plugin_for_path(LdmManager *self, const gchar
                 return FALSE;
         }
 
-        plugin = ldm_modalias_plugin_new_from_filename(path);
+        plugin = ldm_native_plugin_new_from_filename(path);
+        if (!plugin) {
+                return FALSE;
+        }
 
         /* Enforce priority based on insert order */
         ldm_plugin_set_priority(plugin, self->modalias_plugin_priority);
@@ -87,24 +158,317 @@ gboolean ldm_manager_add_modalias_plugin_for_path(LdmManager *self, const gchar
 }
 
 /**
- * ldm_manager_add_modalias_plugins_for_directory:
- * @directory: Path containing `*.modaliases` files
+ * ldm_deferred_plugin_free:
  *
- * Attempt to bulk-add #LdmModaliasPlugin objects from the given directory to
- * ensure preservation of sort order and ease of use.
+ * Free a deferred plugin
+ */
+void ldm_deferred_plugin_free(LdmDeferredPlugin *deferred)
+{
+        ldm_modalias_header_clear(&deferred->header);
+        g_free(deferred->path);
+        g_free(deferred->native_path);
+        g_free(deferred->name);
+        g_free(deferred);
+}
+
+/**
+ * ldm_manager_header_covers_device:
  *
- * This function is used to add well known modalias paths to the plugin and
- * construct plugins used for hardware detection.
+ * Test the device and its children against the routes of a header
+ */
+static gboolean ldm_manager_header_covers_device(const LdmModaliasHeader *header,
+                                                 LdmDevice *device)
+{
+        GHashTableIter iter = { 0 };
+        LdmDevice *child = NULL;
+        LdmRoute route = { 0 };
+
+        if (device->os.modalias && ldm_route_parse(&route, device->os.modalias) &&
+            ldm_modalias_header_covers(header, &route)) {
+                return TRUE;
+        }
+
+        g_hash_table_iter_init(&iter, device->tree.kids);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&child)) {
+                if (ldm_manager_header_covers_device(header, child)) {
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+/**
+ * ldm_manager_drop_deferred_plugin:
+ *
+ * A plugin of the same name replaces anything we held back
+ */
+static void ldm_manager_drop_deferred_plugin(LdmManager *self, const gchar *name)
+{
+        for (guint i = 0; i < self->deferred->len; i++) {
+                LdmDeferredPlugin *deferred = self->deferred->pdata[i];
+
+                if (g_str_equal(deferred->name, name)) {
+                        g_ptr_array_remove_index(self->deferred, i);
+                        return;
+                }
+        }
+}
+
+/**
+ * ldm_manager_read_modalias_header:
+ * @header: (out caller-allocates): Storage for the header
+ *
+ * Read the header of a modaliases file. Plain files are mapped, so only the
+ * pages holding the header are read, and compressed files are decompressed
+ * only as far as the end of the header.
+ *
+ * Returns: TRUE if a usable header was found
+ */
+static gboolean ldm_manager_read_modalias_header(const gchar *path, LdmModaliasHeader *header)
+{
+        LdmModaliasCompression compression = LDM_MODALIAS_COMPRESSION_NONE;
+        g_autoptr(LdmModaliasStream) stream = NULL;
+        g_autoptr(GMappedFile) file = NULL;
+        g_autoptr(GString) line = NULL;
+
+        ldm_modalias_compression_for_path(path, &compression);
+        if (compression != LDM_MODALIAS_COMPRESSION_NONE) {
+                stream = ldm_modalias_stream_open(path, NULL);
+                if (!stream) {
+                        return FALSE;
+                }
+                line = g_string_new(NULL);
+                return ldm_modalias_stream_read_header(stream, header, line, NULL);
+        }
+
+        file = g_mapped_file_new(path, FALSE, NULL);
+        if (!file) {
+                return FALSE;
+        }
+
+        return ldm_modalias_header_parse(header,
+                                         g_mapped_file_get_contents(file),
+                                         g_mapped_file_get_length(file));
+}
+
+/**
+ * ldm_manager_defer_modalias_plugin:
+ * @name: Name the plugin would have
+ * @native_path: (nullable): Compiled matcher generated from the file, to prefer
+ *
+ * Read just the header of a modaliases file, and hold the file back if none
+ * of the known devices are covered by it. A compiled matcher covers the same
+ * routes as the file it was generated from, so it is held back the same way.
+ *
+ * Returns: TRUE if the file was deferred
+ */
+static gboolean ldm_manager_defer_modalias_plugin(LdmManager *self, const gchar *path,
+                                                  const gchar *native_path, const gchar *name)
+{
+        LdmDeferredPlugin *deferred = NULL;
+        LdmModaliasHeader header = { 0 };
+
+        if (!ldm_manager_read_modalias_header(path, &header)) {
+                goto load;
+        }
+
+        for (guint i = 0; i < self->devices->len; i++) {
+                if (ldm_manager_header_covers_device(&header, self->devices->pdata[i])) {
+                        goto load;
+                }
+        }
+
+        g_debug("deferring plugin: %s", name);
+
+        deferred = g_new0(LdmDeferredPlugin, 1);
+        deferred->path = g_strdup(path);
+        deferred->native_path = g_strdup(native_path);
+        deferred->name = g_strdup(name);
+        deferred->priority = self->modalias_plugin_priority;
+        deferred->header = header;
+
+        ldm_manager_drop_deferred_plugin(self, name);
+        g_ptr_array_add(self->deferred, deferred);
+
+        ++self->modalias_plugin_priority;
+        return TRUE;
+
+load:
+        ldm_modalias_header_clear(&header);
+        return FALSE;
+}
+
+/**
+ * ldm_manager_load_modalias_plugin:
+ * @native_path: (nullable): Compiled matcher generated from the file, to prefer
+ *
+ * Load the compiled matcher if we have one, falling back to the modaliases
+ * file it was generated from when the module can't be loaded.
+ *
+ * Returns: (transfer full) (nullable): The new plugin
+ */
+static LdmPlugin *ldm_manager_load_modalias_plugin(const gchar *path, const gchar *native_path)
+{
+        LdmPlugin *plugin = NULL;
+
+        if (native_path) {
+                plugin = ldm_native_plugin_new_from_filename(native_path);
+        }
+        if (!plugin) {
+                plugin = ldm_modalias_plugin_new_from_filename(path);
+        }
+
+        return plugin;
+}
+
+/**
+ * ldm_manager_load_deferred_plugins:
+ * @device: Newly added device
+ *
+ * Load every deferred plugin covering the new device
+ */
+void ldm_manager_load_deferred_plugins(LdmManager *self, LdmDevice *device)
+{
+        for (guint i = 0; i < self->deferred->len;) {
+                LdmDeferredPlugin *deferred = self->deferred->pdata[i];
+                LdmPlugin *plugin = NULL;
+
+                if (!ldm_manager_header_covers_device(&deferred->header, device)) {
+                        ++i;
+                        continue;
+                }
+
+                g_debug("loading deferred plugin: %s", deferred->name);
+
+                plugin = ldm_manager_load_modalias_plugin(deferred->path, deferred->native_path);
+                if (plugin) {
+                        ldm_plugin_set_priority(plugin, deferred->priority);
+                        ldm_manager_add_plugin(self, plugin);
+                }
+
+                g_ptr_array_remove_index(self->deferred, i);
+        }
+}
+
+/**
+ * ldm_manager_add_modalias_plugin_full:
+ * @native_path: (nullable): Compiled matcher generated from the file, to prefer
+ *
+ * Add the plugin for a modaliases file, deferring it if possible. Only
+ * callers that trust the directory of the file may pass a @native_path, as
+ * loading the module runs its code.
+ *
+ * Returns: TRUE if a new plugin was added, or deferred
+ */
+static gboolean ldm_manager_add_modalias_plugin_full(LdmManager *self, const gchar *path,
+                                                     const gchar *native_path)
+{
+        LdmPlugin *plugin = NULL;
+        g_autofree gchar *stem = NULL;
+        g_autofree gchar *name = NULL;
+
+        if (!g_file_test(path, G_FILE_TEST_EXISTS)) {
+                return FALSE;
+        }
+
+        /* Same name as the plugin will have */
+        stem = ldm_modalias_path_get_stem(path);
+        name = g_path_get_basename(stem ? stem : path);
+
+        if (ldm_manager_defer_modalias_plugin(self, path, native_path, name)) {
+                return TRUE;
+        }
+        ldm_manager_drop_deferred_plugin(self, name);
+
+        plugin = ldm_manager_load_modalias_plugin(path, native_path);
+        if (!plugin) {
+                return FALSE;
+        }
+
+        /* Enforce priority based on insert order */
+        ldm_plugin_set_priority(plugin, self->modalias_plugin_priority);
+        ++self->modalias_plugin_priority;
+
+        ldm_manager_add_plugin(self, plugin);
+
+        return TRUE;
+}
+
+/**
+ * ldm_manager_add_modalias_plugin_for_path:
+ * @path: The fully qualified ".modaliases" file path
+ *
+ * Add a new #LdmModaliasPlugin to the manager for the given path. This is a convenience
+ * wrapper around #ldm_modalias_plugin_new_from_filename and #ldm_manager_add_plugin.
+ *
+ * Note that newer modalias plugins have a higher priority than older plugins,
+ * so you should add newest drivers last if you have multiple driver versions.
+ * This is already taken care of by using the glob-based function
+ * #ldm_manager_add_modalias_plugins_for_directory
+ *
+ * i.e. insert 380 driver AFTER 340.
+ *
+ * Files with a header from `mkmodaliases` declare the buses and vendors they
+ * cover. When none of the known devices are covered, only the header is read
+ * and loading the file is deferred until such a device is added.
+ *
+ * The file may be compressed, as `.modaliases.gz` or `.modaliases.zst`, in
+ * which case it is decompressed while being parsed.
+ *
+ * Only the file itself is read: a compiled matcher module alongside it is
+ * never loaded, see #ldm_manager_add_native_plugin_for_path.
+ *
+ * Returns: TRUE if a new plugin was added, or deferred
+ */
+gboolean ldm_manager_add_modalias_plugin_for_path(LdmManager *self, const gchar *path)
+{
+        return ldm_manager_add_modalias_plugin_full(self, path, NULL);
+}
+
+/**
+ * ldm_manager_modalias_path_rank:
+ *
+ * Rank the copies of one .modaliases file, lowest first. Plain files are
+ * mapped rather than decompressed, and zstd decompresses faster than gzip.
+ * A copy this build cannot read is only ever used when it is the only one,
+ * so that loading it reports the problem.
+ */
+static guint ldm_manager_modalias_path_rank(const gchar *path)
+{
+        static const guint rank[LDM_N_MODALIAS_COMPRESSIONS] = {
+                [LDM_MODALIAS_COMPRESSION_NONE] = 0,
+                [LDM_MODALIAS_COMPRESSION_ZSTD] = 1,
+                [LDM_MODALIAS_COMPRESSION_GZIP] = 2,
+        };
+        LdmModaliasCompression compression = LDM_MODALIAS_COMPRESSION_NONE;
+
+        ldm_modalias_compression_for_path(path, &compression);
+        if (!ldm_modalias_compression_is_supported(compression)) {
+                return rank[compression] + LDM_N_MODALIAS_COMPRESSIONS;
+        }
+        return rank[compression];
+}
+
+/**
+ * ldm_manager_add_modalias_plugins_from:
+ * @native: Whether the directory is trusted to hold compiled matcher modules
+ *
+ * Add one plugin per modaliases file in the directory, in sort order, see
+ * #ldm_manager_add_modalias_plugins_for_directory.
  *
  * Returns: TRUE if a new plugin was added
  */
-gboolean ldm_manager_add_modalias_plugins_for_directory(LdmManager *self, const gchar *directory)
+gboolean ldm_manager_add_modalias_plugins_from(LdmManager *self, const gchar *directory,
+                                               gboolean native)
 {
         g_autofree gchar *glob_path = NULL;
+        g_autoptr(GHashTable) chosen = NULL;
         glob_t glo = { 0 };
         gboolean ret = FALSE;
 
-        glob_path = g_strdup_printf("%s%s*.modaliases", directory, G_DIR_SEPARATOR_S);
+        /* One glob keeps the sort order across compressions */
+        glob_path = g_strdup_printf("%s%s*.modaliases*", directory, G_DIR_SEPARATOR_S);
 
         if (glob(glob_path, 0, NULL, &glo) != 0) {
                 goto cleanup;
@@ -114,8 +478,45 @@ gboolean ldm_manager_add_modalias_plugins_for_directory(LdmManager *self, const
                 goto cleanup;
         }
 
+        /* Stem -> the one copy we load, so copies never replace each other */
+        chosen = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
         for (size_t i = 0; i < glo.gl_pathc; i++) {
-                if (ldm_manager_add_modalias_plugin_for_path(self, glo.gl_pathv[i])) {
+                const gchar *path = glo.gl_pathv[i];
+                const gchar *current = NULL;
+                gchar *stem = NULL;
+
+                stem = ldm_modalias_path_get_stem(path);
+                if (!stem) {
+                        continue;
+                }
+
+                current = g_hash_table_lookup(chosen, stem);
+                if (current && ldm_manager_modalias_path_rank(current) <=
+                                   ldm_manager_modalias_path_rank(path)) {
+                        g_free(stem);
+                        continue;
+                }
+                g_hash_table_insert(chosen, stem, (gpointer)path);
+        }
+
+        for (size_t i = 0; i < glo.gl_pathc; i++) {
+                g_autofree gchar *native_path = NULL;
+                g_autofree gchar *stem = NULL;
+
+                stem = ldm_modalias_path_get_stem(glo.gl_pathv[i]);
+                if (!stem || g_hash_table_lookup(chosen, stem) != glo.gl_pathv[i]) {
+                        continue;
+                }
+
+                /* Prefer the compiled matcher when the package ships one */
+                if (native) {
+                        native_path = g_strconcat(stem, ".so", NULL);
+                        if (!g_file_test(native_path, G_FILE_TEST_IS_REGULAR)) {
+                                g_clear_pointer(&native_path, g_free);
+                        }
+                }
+
+                if (ldm_manager_add_modalias_plugin_full(self, glo.gl_pathv[i], native_path)) {
                         ret = TRUE;
                 }
         }
@@ -125,6 +526,30 @@ cleanup:
         return ret;
 }
 
+/**
+ * ldm_manager_add_modalias_plugins_for_directory:
+ * @directory: Path containing `*.modaliases` files
+ *
+ * Attempt to bulk-add #LdmModaliasPlugin objects from the given directory to
+ * ensure preservation of sort order and ease of use. Compressed
+ * `*.modaliases.gz` and `*.modaliases.zst` files are sorted along with the
+ * plain files. When the same file is present more than once, i.e. both as
+ * `foo.modaliases` and `foo.modaliases.gz`, only one copy is used, preferring
+ * the plain file, then zstd, then gzip.
+ *
+ * This function is used to add well known modalias paths to the plugin and
+ * construct plugins used for hardware detection.
+ *
+ * As with #ldm_manager_add_modalias_plugin_for_path, compiled matcher modules
+ * in the directory are never loaded.
+ *
+ * Returns: TRUE if a new plugin was added
+ */
+gboolean ldm_manager_add_modalias_plugins_for_directory(LdmManager *self, const gchar *directory)
+{
+        return ldm_manager_add_modalias_plugins_from(self, directory, FALSE);
+}
+
 /**
  * ldm_manager_add_system_modalias_plugins:
  *
@@ -132,22 +557,211 @@ cleanup:
  * set when the library was compiled.
  *
  * This is a convenience wrapper around #ldm_manager_add_modalias_plugins_for_directory.
+ * As the system directory is trusted, a compiled matcher module installed
+ * alongside a file (i.e. `nvidia.so` for `nvidia.modaliases`) is loaded in
+ * place of the file, see #LdmNativePlugin.
  *
  * Returns: TRUE if any modalias plugins were added.
  */
 gboolean ldm_manager_add_system_modalias_plugins(LdmManager *self)
 {
-        return ldm_manager_add_modalias_plugins_for_directory(self, MODALIAS_DIR);
+        return ldm_manager_add_modalias_plugins_from(self, MODALIAS_DIR, TRUE);
 }
 
 static gint ldm_manager_sort_plugin_by_priority(gconstpointer a, gconstpointer b)
 {
-        gint prioA = ldm_plugin_get_priority(ldm_provider_get_plugin(*(LdmProvider **)a));
-        gint prioB = ldm_plugin_get_priority(ldm_provider_get_plugin(*(LdmProvider **)b));
+        gint prioA = ldm_plugin_get_priority(*(LdmPlugin **)a);
+        gint prioB = ldm_plugin_get_priority(*(LdmPlugin **)b);
 
         return prioB - prioA;
 }
 
+/**
+ * ldm_manager_build_routes:
+ *
+ * (Re)sort the plugins and build the routing table from the plugin coverage
+ * if needed. Each (bus, vendor) route maps to the indices of the plugins that
+ * could possibly match a device with that route. Plugins that never declared
+ * coverage are unrouted, and will always be consulted.
+ */
+static void ldm_manager_build_routes(LdmManager *self)
+{
+        if (!self->routes.dirty && self->routes.serial == self->plugin_serial) {
+                return;
+        }
+
+        /* Priorities may have changed since insertion. This sort is stable. */
+        g_ptr_array_sort(self->plugins, ldm_manager_sort_plugin_by_priority);
+
+        g_clear_pointer(&self->routes.table, g_hash_table_unref);
+        g_clear_pointer(&self->routes.unrouted, g_array_unref);
+
+        self->routes.table = g_hash_table_new_full(ldm_route_hash,
+                                                   ldm_route_equal,
+                                                   g_free,
+                                                   (GDestroyNotify)g_array_unref);
+        self->routes.unrouted = g_array_new(FALSE, FALSE, sizeof(guint));
+
+        for (guint i = 0; i < self->plugins->len; i++) {
+                GHashTable *coverage = NULL;
+                GHashTableIter route_iter = { 0 };
+                LdmRoute *route = NULL;
+
+                coverage = ldm_plugin_get_coverage(self->plugins->pdata[i]);
+                if (!coverage) {
+                        g_array_append_val(self->routes.unrouted, i);
+                        continue;
+                }
+
+                g_hash_table_iter_init(&route_iter, coverage);
+                while (g_hash_table_iter_next(&route_iter, (void **)&route, NULL)) {
+                        GArray *plugins = NULL;
+
+                        plugins = g_hash_table_lookup(self->routes.table, route);
+                        if (!plugins) {
+                                LdmRoute *key = g_new0(LdmRoute, 1);
+                                *key = *route;
+                                plugins = g_array_new(FALSE, FALSE, sizeof(guint));
+                                g_hash_table_insert(self->routes.table, key, plugins);
+                        }
+                        g_array_append_val(plugins, i);
+                }
+        }
+
+        self->routes.serial = self->plugin_serial;
+        self->routes.dirty = FALSE;
+}
+
+/**
+ * ldm_manager_route_plugins:
+ *
+ * Remember the plugins for the given route as candidates, if any. Interfaces
+ * tend to share the route of their device, so repeats are dropped early.
+ */
+static void ldm_manager_route_plugins(LdmManager *self, const LdmRoute *route)
+{
+        GPtrArray *hits = self->routes.hits;
+        GArray *plugins = NULL;
+
+        plugins = g_hash_table_lookup(self->routes.table, route);
+        if (!plugins || (hits->len > 0 && hits->pdata[hits->len - 1] == plugins)) {
+                return;
+        }
+        g_ptr_array_add(hits, plugins);
+}
+
+/**
+ * ldm_manager_route_device:
+ *
+ * Find the candidate plugins for the device and all of its children. Plugins
+ * match against child devices (i.e. USB interfaces), so they must be routed too.
+ */
+static void ldm_manager_route_device(LdmManager *self, LdmDevice *device)
+{
+        GHashTableIter iter = { 0 };
+        LdmDevice *child = NULL;
+        LdmRoute route = { 0 };
+
+        if (device->os.modalias && ldm_route_parse(&route, device->os.modalias)) {
+                ldm_manager_route_plugins(self, &route);
+
+                /* Now try plugins covering any vendor on this bus */
+                if (!route.any_vendor) {
+                        route.vendor_id = 0;
+                        route.any_vendor = TRUE;
+                        ldm_manager_route_plugins(self, &route);
+                }
+        }
+
+        g_hash_table_iter_init(&iter, device->tree.kids);
+        while (g_hash_table_iter_next(&iter, NULL, (void **)&child)) {
+                ldm_manager_route_device(self, child);
+        }
+}
+
+/**
+ * ldm_manager_compare_index:
+ *
+ * Plugin indices follow priority order.
+ */
+static gint ldm_manager_compare_index(gconstpointer a, gconstpointer b)
+{
+        guint index_a = *(const guint *)a;
+        guint index_b = *(const guint *)b;
+
+        return index_a < index_b ? -1 : (index_a > index_b ? 1 : 0);
+}
+
+/**
+ * ldm_manager_get_candidates:
+ *
+ * Only plugins that could possibly match this device need to be consulted.
+ * Most devices hit a single plugin list of the routing table, which is
+ * handed back as is. Otherwise the lists are merged into scratch space of
+ * the manager, so routing a device never allocates once it has warmed up.
+ *
+ * Returns: (transfer none) (nullable): Indices of the candidate plugins in
+ * priority order, valid until the next call, or NULL if there are none
+ */
+static const GArray *ldm_manager_get_candidates(LdmManager *self, LdmDevice *device)
+{
+        GArray *merged = self->routes.merged;
+        guint n_merged = 0;
+
+        ldm_manager_build_routes(self);
+
+        g_ptr_array_set_size(self->routes.hits, 0);
+        if (self->routes.unrouted->len > 0) {
+                g_ptr_array_add(self->routes.hits, self->routes.unrouted);
+        }
+        ldm_manager_route_device(self, device);
+
+        if (self->routes.hits->len == 0) {
+                return NULL;
+        }
+        if (self->routes.hits->len == 1) {
+                return self->routes.hits->pdata[0];
+        }
+
+        g_array_set_size(merged, 0);
+        for (guint i = 0; i < self->routes.hits->len; i++) {
+                GArray *plugins = self->routes.hits->pdata[i];
+
+                g_array_append_vals(merged, plugins->data, plugins->len);
+        }
+
+        /* Lists are short, and one plugin may be routed more than once */
+        g_array_sort(merged, ldm_manager_compare_index);
+        for (guint i = 0; i < merged->len; i++) {
+                guint index = g_array_index(merged, guint, i);
+
+                if (n_merged == 0 || g_array_index(merged, guint, n_merged - 1) != index) {
+                        g_array_index(merged, guint, n_merged++) = index;
+                }
+        }
+        g_array_set_size(merged, n_merged);
+
+        return merged;
+}
+
+/**
+ * ldm_manager_get_plugin_provider:
+ *
+ * Returns: (transfer full) (nullable): Provider of the plugin at index for the device
+ */
+static LdmProvider *ldm_manager_get_plugin_provider(LdmManager *self, guint index,
+                                                    LdmDevice *device)
+{
+        LdmProvider *provider = NULL;
+
+        provider = ldm_plugin_get_provider(self->plugins->pdata[index], device);
+        if (provider && g_object_is_floating(provider)) {
+                g_object_ref_sink(provider);
+        }
+
+        return provider;
+}
+
 /**
  * ldm_manager_get_providers:
  *
@@ -155,41 +769,119 @@ static gint ldm_manager_sort_plugin_by_priority(gconstpointer a, gconstpointer b
  * if they can support it. The returned #GPtrArray will free all elements
  * when it itself is freed.
  *
+ * Only plugins whose coverage includes the bus and vendor of the device (or
+ * one of its children) are consulted, see #ldm_plugin_add_coverage.
+ *
+ * Providers are sorted by the priority of their plugin, highest first. If
+ * only the highest priority provider is needed, #ldm_manager_get_best_provider
+ * is cheaper.
+ *
  * Returns: (element-type Ldm.Provider) (transfer container): a list of all possible providers
  */
 GPtrArray *ldm_manager_get_providers(LdmManager *self, LdmDevice *device)
 {
         GPtrArray *ret = NULL;
-        __ldm_unused__ gpointer k = NULL;
-        LdmPlugin *plugin = NULL;
-        GHashTableIter iter = { 0 };
+        const GArray *candidates = NULL;
 
         g_return_val_if_fail(self != NULL, NULL);
+        g_return_val_if_fail(device != NULL, NULL);
 
         ret = g_ptr_array_new_with_free_func(g_object_unref);
 
-        g_hash_table_iter_init(&iter, self->plugins);
-        while (g_hash_table_iter_next(&iter, &k, (void **)&plugin)) {
+        candidates = ldm_manager_get_candidates(self, device);
+        if (!candidates) {
+                return ret;
+        }
+
+        /* Plugins are already in priority order */
+        for (guint i = 0; i < candidates->len; i++) {
                 LdmProvider *provider = NULL;
 
                 /* See if this plugin supports the device */
-                provider = ldm_plugin_get_provider(plugin, device);
-                if (!provider) {
-                        continue;
-                }
-
-                if (g_object_is_floating(provider)) {
-                        g_ptr_array_add(ret, g_object_ref_sink(provider));
-                } else {
+                provider = ldm_manager_get_plugin_provider(self,
+                                                           g_array_index(candidates, guint, i),
+                                                           device);
+                if (provider) {
                         g_ptr_array_add(ret, provider);
                 }
         }
 
-        g_ptr_array_sort(ret, ldm_manager_sort_plugin_by_priority);
+        return ret;
+}
+
+/**
+ * ldm_manager_get_provider_results:
+ *
+ * Find the same providers as #ldm_manager_get_providers, in the same order,
+ * as plain results. No #LdmProvider is constructed unless a plugin lacks a
+ * `get_result` implementation, which makes this the cheaper choice when
+ * resolving many devices. Use #ldm_provider_new_from_result for the
+ * results that need an #LdmProvider.
+ *
+ * Returns: (element-type Ldm.ProviderResult) (transfer full): The results for the device
+ */
+GArray *ldm_manager_get_provider_results(LdmManager *self, LdmDevice *device)
+{
+        GArray *ret = NULL;
+        const GArray *candidates = NULL;
+
+        g_return_val_if_fail(self != NULL, NULL);
+        g_return_val_if_fail(device != NULL, NULL);
+
+        ret = g_array_new(FALSE, FALSE, sizeof(LdmProviderResult));
+
+        candidates = ldm_manager_get_candidates(self, device);
+        if (!candidates) {
+                return ret;
+        }
+
+        for (guint i = 0; i < candidates->len; i++) {
+                LdmProviderResult result = { 0 };
+                LdmPlugin *plugin = self->plugins->pdata[g_array_index(candidates, guint, i)];
+
+                if (ldm_plugin_get_result(plugin, device, &result)) {
+                        g_array_append_val(ret, result);
+                }
+        }
 
         return ret;
 }
 
+/**
+ * ldm_manager_get_best_provider:
+ *
+ * Find the highest priority provider for the given device. This is the
+ * first element #ldm_manager_get_providers would return, however plugins are
+ * consulted in priority order and the search stops at the first match.
+ *
+ * Returns: (transfer full) (nullable): The best provider for the device, if any
+ */
+LdmProvider *ldm_manager_get_best_provider(LdmManager *self, LdmDevice *device)
+{
+        const GArray *candidates = NULL;
+
+        g_return_val_if_fail(self != NULL, NULL);
+        g_return_val_if_fail(device != NULL, NULL);
+
+        candidates = ldm_manager_get_candidates(self, device);
+        if (!candidates) {
+                return NULL;
+        }
+
+        for (guint i = 0; i < candidates->len; i++) {
+                LdmProvider *provider = NULL;
+
+                provider = ldm_manager_get_plugin_provider(self,
+                                                           g_array_index(candidates, guint, i),
+                                                           device);
+                if (provider) {
+                        return provider;
+                }
+        }
+
+        return NULL;
+}
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
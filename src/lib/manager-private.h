@@ -16,6 +16,7 @@
 #include "device.h"
 #include "ldm-private.h"
 #include "manager.h"
+#include "modalias-header.h"
 
 struct _LdmManagerClass {
         GObjectClass parent_class;
@@ -25,26 +26,121 @@ struct _LdmManagerClass {
         void (*device_removed)(LdmManager *self, LdmDevice *device);
 };
 
+/*
+ * LdmDeferredPlugin
+ *
+ * A modalias file whose header shows it can't match any known device, so it
+ * is only loaded once a device it covers is added.
+ */
+typedef struct LdmDeferredPlugin {
+        gchar *path;
+        gchar *native_path; /* Compiled matcher to prefer, if trusted */
+        gchar *name;        /* Plugin name the file will have */
+        gint priority; /* Priority reserved in insertion order */
+        LdmModaliasHeader header;
+} LdmDeferredPlugin;
+
+/* Changes remembered for #ldm_manager_get_changes */
+#define LDM_MANAGER_CHANGE_LOG_SIZE 256
+
+typedef enum {
+        LDM_MANAGER_CHANGE_DEVICE_ADDED = 0,
+        LDM_MANAGER_CHANGE_DEVICE_REMOVED,
+        LDM_MANAGER_CHANGE_PROVIDERS, /* Plugins were added or changed */
+} LdmManagerChangeType;
+
+/*
+ * LdmManagerChange
+ *
+ * One entry of the change log. Every change has a generation of its own, so
+ * the entry for a generation is found without searching.
+ */
+typedef struct LdmManagerChange {
+        guint64 generation;
+        LdmManagerChangeType type;
+        LdmDevice *device; /* Top level device, NULL for provider changes */
+} LdmManagerChange;
+
 struct _LdmManager {
         GObject parent;
         GPtrArray *devices;
-        GHashTable *plugins;
+        GPtrArray *plugins;  /* Highest priority first, ties in insertion order */
+        GPtrArray *deferred; /* LdmDeferredPlugin, in insertion order */
 
         gint modalias_plugin_priority;
         gint device_priority;
+        guint plugin_serial; /* Bumped whenever a plugin is added or changed */
 
         /* Udev */
         udev_connection *udev;
 
         LdmManagerFlags flags;
+        LdmDeviceFilter *filter; /* Devices never to construct */
 
         struct {
                 udev_monitor *udev;  /* Connection to udev.. */
                 GIOChannel *channel; /* Main channel for poll main loop */
                 guint source;        /* GIO source */
         } monitor;
+
+        /* Plugin routing, rebuilt lazily when the plugins change */
+        struct {
+                GHashTable *table; /* LdmRoute -> GArray of plugin indices */
+                GArray *unrouted;  /* Indices of plugins that must see every device */
+                GPtrArray *hits;   /* Scratch: plugin lists routed to the current device */
+                GArray *merged;    /* Scratch: union of hits when there is more than one */
+                guint serial;      /* Plugin serial at build time */
+                gboolean dirty;
+        } routes;
+
+        /* Filter columns, one row per entry in devices and in the same order */
+        struct {
+                GArray *types;      /* LdmDeviceType of the device and its children */
+                GArray *attributes; /* LdmDeviceAttribute of the device and its children */
+                GArray *vendor_id;
+                GArray *product_id;
+                GArray *priority;
+        } index;
+
+        /* Ring of the most recent changes, oldest at head */
+        struct {
+                LdmManagerChange log[LDM_MANAGER_CHANGE_LOG_SIZE];
+                guint head;
+                guint len;
+                guint64 generation;  /* Generation of the newest change */
+                guint plugin_serial; /* Plugin serial when last checked */
+        } changes;
 };
 
+/*
+ * LdmDeviceQuery
+ *
+ * Filter over the top level devices of a manager. Types and attributes have
+ * the meaning of #ldm_device_has_type and #ldm_device_has_attribute, so they
+ * may be found on a child of the device. A zero ID matches any device.
+ */
+typedef struct LdmDeviceQuery {
+        LdmDeviceType types;
+        LdmDeviceAttribute attributes;
+        LdmDeviceAttribute no_attributes; /* Attributes the device must lack */
+        gint vendor_id;
+        gint product_id;
+} LdmDeviceQuery;
+
+GPtrArray *ldm_manager_query_devices(LdmManager *manager, const LdmDeviceQuery *query);
+
+/* Change log */
+void ldm_manager_record_change(LdmManager *manager, LdmManagerChangeType type,
+                               LdmDevice *device);
+
+/* Deferred plugins */
+void ldm_deferred_plugin_free(LdmDeferredPlugin *deferred);
+void ldm_manager_load_deferred_plugins(LdmManager *manager, LdmDevice *device);
+
+/* Modalias directories, loading compiled matchers only from trusted ones */
+gboolean ldm_manager_add_modalias_plugins_from(LdmManager *manager, const gchar *directory,
+                                               gboolean native);
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
@@ -12,12 +12,15 @@
 #define _GNU_SOURCE
 
 #include <libudev.h>
+#include <string.h>
 
 #include "device.h"
 #include "ldm-enums.h"
 #include "ldm-private.h"
 #include "manager-private.h"
 #include "manager.h"
+#include "plugin.h"
+#include "route.h"
 #include "util.h"
 
 static void ldm_manager_set_property(GObject *object, guint id, const GValue *value,
@@ -27,16 +30,42 @@ static void ldm_manager_constructed(GObject *obj);
 
 static void ldm_manager_init_udev_monitor(LdmManager *self);
 static void ldm_manager_init_udev_static(LdmManager *self);
-static void ldm_manager_push_sysfs(LdmManager *self, const char *sysfs_path);
-static void ldm_manager_push_device(LdmManager *self, udev_device *device, gboolean emit_signal);
+static void ldm_manager_probe_sysfs(LdmManager *self, GPtrArray *sysfs_paths);
+static void ldm_manager_push_device(LdmManager *self, udev_device *device, LdmDevice *probed,
+                                    gboolean emit_signal);
 static void ldm_manager_remove_device(LdmManager *self, udev_device *device);
 static gboolean ldm_manager_io_ready(GIOChannel *source, GIOCondition condition, gpointer v);
 static LdmDevice *ldm_manager_get_device_parent(LdmManager *self, const char *subsystem,
                                                 udev_device *device);
 static void ldm_manager_emit_usb(LdmManager *self, udev_device *device);
 
+/* Fewest sysfs paths handed to each probe thread, below this threads cost more than they save */
+#define LDM_MANAGER_PROBE_BATCH 64
+
+/* Upper bound for probe threads, sysfs reads stop scaling well beyond this */
+#define LDM_MANAGER_PROBE_THREADS 8
+
+/**
+ * LdmManagerProbe:
+ *
+ * A device constructed from sysfs ahead of being added to the manager. The
+ * #LdmDevice is detached, it has neither a parent nor a priority yet.
+ */
+typedef struct LdmManagerProbe {
+        const char *sysfs_path; /* Owned by the caller */
+        udev_device *device;
+        LdmDevice *ldm_device; /* Floating */
+} LdmManagerProbe;
+
+typedef struct LdmManagerProbeQueue {
+        LdmDeviceFilter *filter; /* Owned by the manager */
+        LdmManagerProbe *probes;
+        guint n_probes;
+        gint next; /* Index of the next unclaimed probe */
+} LdmManagerProbeQueue;
+
 /* Property IDs */
-enum { PROP_FLAGS = 1, N_PROPS };
+enum { PROP_FLAGS = 1, PROP_FILTER, N_PROPS };
 
 static GParamSpec *obj_properties[N_PROPS] = {
         NULL,
@@ -60,6 +89,14 @@ static guint obj_signals[N_SIGNALS] = { 0 };
  * and hotplug event capabilities, but will convert those raw devices and
  * interfaces into the more readily consumable #LdmDevice type.
  *
+ * Infrastructure such as USB hubs and PCI bridges may be left out entirely
+ * with an #LdmDeviceFilter, see #ldm_manager_new_with_filter.
+ *
+ * Every device added or removed, and every change to the plugins, bumps the
+ * generation of the manager. Consumers that poll rather than listen for
+ * signals can ask for just the changes since the generation they last saw,
+ * see #ldm_manager_get_changes.
+ *
  * Using the manager is very simple, and in a few lines you can grab all
  * the devices from the system for introspection.
  *
@@ -104,11 +141,31 @@ static void ldm_manager_dispose(GObject *obj)
         }
 
         g_clear_pointer(&self->udev, udev_unref);
+        g_clear_object(&self->filter);
 
         /* clean ourselves up */
         g_clear_pointer(&self->devices, g_ptr_array_unref);
 
-        g_clear_pointer(&self->plugins, g_hash_table_unref);
+        g_clear_pointer(&self->plugins, g_ptr_array_unref);
+        g_clear_pointer(&self->deferred, g_ptr_array_unref);
+        g_clear_pointer(&self->routes.table, g_hash_table_unref);
+        g_clear_pointer(&self->routes.unrouted, g_array_unref);
+        g_clear_pointer(&self->routes.hits, g_ptr_array_unref);
+        g_clear_pointer(&self->routes.merged, g_array_unref);
+
+        g_clear_pointer(&self->index.types, g_array_unref);
+        g_clear_pointer(&self->index.attributes, g_array_unref);
+        g_clear_pointer(&self->index.vendor_id, g_array_unref);
+        g_clear_pointer(&self->index.product_id, g_array_unref);
+        g_clear_pointer(&self->index.priority, g_array_unref);
+
+        for (guint i = 0; i < self->changes.len; i++) {
+                LdmManagerChange *change =
+                    &self->changes.log[(self->changes.head + i) % LDM_MANAGER_CHANGE_LOG_SIZE];
+
+                g_clear_object(&change->device);
+        }
+        self->changes.len = 0;
 
         G_OBJECT_CLASS(ldm_manager_parent_class)->dispose(obj);
 }
@@ -182,6 +239,19 @@ static void ldm_manager_class_init(LdmManagerClass *klazz)
                                                         LDM_TYPE_MANAGER_FLAGS,
                                                         LDM_MANAGER_FLAGS_NONE,
                                                         G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+        /**
+         * LdmManager:filter
+         *
+         * Rules for devices that should never be added to this manager.
+         * When unset, the rules of the system configuration are used.
+         */
+        obj_properties[PROP_FILTER] = g_param_spec_object("filter",
+                                                          "Device filter",
+                                                          "Devices excluded from this manager",
+                                                          LDM_TYPE_DEVICE_FILTER,
+                                                          G_PARAM_CONSTRUCT_ONLY |
+                                                              G_PARAM_READWRITE);
         g_object_class_install_properties(obj_class, N_PROPS, obj_properties);
 }
 
@@ -194,6 +264,10 @@ static void ldm_manager_set_property(GObject *object, guint id, const GValue *va
         case PROP_FLAGS:
                 self->flags = g_value_get_flags(value);
                 break;
+        case PROP_FILTER:
+                g_clear_object(&self->filter);
+                self->filter = g_value_dup_object(value);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
                 break;
@@ -208,6 +282,9 @@ static void ldm_manager_get_property(GObject *object, guint id, GValue *value, G
         case PROP_FLAGS:
                 g_value_set_flags(value, self->flags);
                 break;
+        case PROP_FILTER:
+                g_value_set_object(value, self->filter);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
                 break;
@@ -223,6 +300,12 @@ static void ldm_manager_constructed(GObject *obj)
 {
         LdmManager *self = LDM_MANAGER(obj);
 
+        /* Filter must be in place before the first device is seen */
+        if (!self->filter) {
+                self->filter = ldm_device_filter_new();
+                ldm_device_filter_add_system_rules(self->filter);
+        }
+
         /* Get udev going */
         self->udev = udev_new();
         g_assert(self->udev != NULL);
@@ -251,8 +334,21 @@ static void ldm_manager_init(LdmManager *self)
         /* Devices is an array of devices in the order that we encounter them */
         self->devices = g_ptr_array_new_full(30, g_object_unref);
 
-        /* Plugin table is a mapping from plugin name to plugin */
-        self->plugins = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+        /* Plugins are kept in the order they should be consulted */
+        self->plugins = g_ptr_array_new_with_free_func(g_object_unref);
+        self->deferred = g_ptr_array_new_with_free_func((GDestroyNotify)ldm_deferred_plugin_free);
+
+        /* Routing tables are built on demand from the plugins */
+        self->routes.dirty = TRUE;
+        self->routes.hits = g_ptr_array_new();
+        self->routes.merged = g_array_new(FALSE, FALSE, sizeof(guint));
+
+        /* Filter columns follow devices row for row */
+        self->index.types = g_array_sized_new(FALSE, FALSE, sizeof(guint), 30);
+        self->index.attributes = g_array_sized_new(FALSE, FALSE, sizeof(guint), 30);
+        self->index.vendor_id = g_array_sized_new(FALSE, FALSE, sizeof(gint), 30);
+        self->index.product_id = g_array_sized_new(FALSE, FALSE, sizeof(gint), 30);
+        self->index.priority = g_array_sized_new(FALSE, FALSE, sizeof(gint), 30);
 }
 
 /**
@@ -265,6 +361,7 @@ static void ldm_manager_init_udev_static(LdmManager *self)
 {
         autofree(udev_enum) *ue = NULL;
         udev_list *list = NULL, *entry = NULL;
+        g_autoptr(GPtrArray) sysfs_paths = NULL;
         static const char *subsystems[] = {
                 "dmi",       "usb",       "pci",
                 "ieee80211", "bluetooth", "hid", /*< As child of USB typically */
@@ -301,10 +398,13 @@ static void ldm_manager_init_udev_static(LdmManager *self)
         list = udev_enumerate_get_list_entry(ue);
 
         /* Walk said list */
+        sysfs_paths = g_ptr_array_new();
         udev_list_entry_foreach(entry, list)
         {
-                ldm_manager_push_sysfs(self, udev_list_entry_get_name(entry));
+                g_ptr_array_add(sysfs_paths, (gpointer)udev_list_entry_get_name(entry));
         }
+
+        ldm_manager_probe_sysfs(self, sysfs_paths);
 }
 
 /**
@@ -312,10 +412,16 @@ static void ldm_manager_init_udev_static(LdmManager *self)
  *
  * Set up the udev monitor and attach the file descriptor to the main event
  * context to enable receiving the events on the idle loop.
+ *
+ * With LDM_MANAGER_FLAGS_KERNEL_EVENTS we listen to the raw kernel uevent
+ * group instead. libudev parses the uevent payload (ACTION, DEVPATH,
+ * SUBSYSTEM, DEVTYPE, MODALIAS) and attributes are read from sysfs, so the
+ * devices are equivalent, minus the hwdb properties udevd would have added.
  */
 static void ldm_manager_init_udev_monitor(LdmManager *self)
 {
         int fd = 0;
+        const char *source = "udev";
         static const char *subsystem_filters[] = {
                 "usb",
                 "hid",
@@ -323,9 +429,14 @@ static void ldm_manager_init_udev_monitor(LdmManager *self)
                 "ieee80211",
         };
 
-        self->monitor.udev = udev_monitor_new_from_netlink(self->udev, "udev");
+        /* Without udevd (containers, initramfs) only the kernel will notify us */
+        if ((self->flags & LDM_MANAGER_FLAGS_KERNEL_EVENTS) == LDM_MANAGER_FLAGS_KERNEL_EVENTS) {
+                source = "kernel";
+        }
+
+        self->monitor.udev = udev_monitor_new_from_netlink(self->udev, source);
         if (!self->monitor.udev) {
-                g_warning("udev monitoring is unavailable");
+                g_warning("%s monitoring is unavailable", source);
                 return;
         }
 
@@ -388,7 +499,7 @@ static gboolean ldm_manager_io_ready(__ldm_unused__ GIOChannel *source, GIOCondi
 
         /* Interesting actions */
         if (g_str_equal(action, "add")) {
-                ldm_manager_push_device(self, device, TRUE);
+                ldm_manager_push_device(self, device, NULL, TRUE);
         } else if (g_str_equal(action, "remove")) {
                 ldm_manager_remove_device(self, device);
         } else if (g_str_equal(action, "bind")) {
@@ -437,6 +548,84 @@ static gboolean ldm_manager_device_by_sysfs_path(LdmManager *self, const char *s
         return FALSE;
 }
 
+/**
+ * ldm_manager_index_collect:
+ *
+ * Gather the types and attributes of a device and all of its children, which
+ * is everything #ldm_device_has_type and #ldm_device_has_attribute look at.
+ */
+static void ldm_manager_index_collect(LdmDevice *device, guint *types, guint *attributes)
+{
+        GHashTableIter iter = { 0 };
+        gpointer value = NULL;
+
+        *types |= device->os.devtype;
+        *attributes |= device->os.attributes;
+
+        g_hash_table_iter_init(&iter, device->tree.kids);
+        while (g_hash_table_iter_next(&iter, NULL, &value)) {
+                ldm_manager_index_collect(value, types, attributes);
+        }
+}
+
+/**
+ * ldm_manager_index_append:
+ *
+ * Add the row for a new top level device, which must be the last in devices
+ */
+static void ldm_manager_index_append(LdmManager *self, LdmDevice *device)
+{
+        guint types = 0;
+        guint attributes = 0;
+
+        ldm_manager_index_collect(device, &types, &attributes);
+
+        g_array_append_val(self->index.types, types);
+        g_array_append_val(self->index.attributes, attributes);
+        g_array_append_val(self->index.vendor_id, device->id.vendor_id);
+        g_array_append_val(self->index.product_id, device->id.product_id);
+        g_array_append_val(self->index.priority, device->priority);
+}
+
+/**
+ * ldm_manager_index_remove:
+ *
+ * Drop the row of a top level device, before it leaves devices
+ */
+static void ldm_manager_index_remove(LdmManager *self, guint index)
+{
+        g_array_remove_index(self->index.types, index);
+        g_array_remove_index(self->index.attributes, index);
+        g_array_remove_index(self->index.vendor_id, index);
+        g_array_remove_index(self->index.product_id, index);
+        g_array_remove_index(self->index.priority, index);
+}
+
+/**
+ * ldm_manager_index_refresh:
+ *
+ * A child was added to or removed from @device, so the row of its top level
+ * device must be computed again.
+ */
+static void ldm_manager_index_refresh(LdmManager *self, LdmDevice *device)
+{
+        guint types = 0;
+        guint attributes = 0;
+        guint index = 0;
+
+        while (device->tree.parent) {
+                device = device->tree.parent;
+        }
+
+        if (!g_ptr_array_find(self->devices, device, &index)) {
+                return;
+        }
+
+        ldm_manager_index_collect(device, &types, &attributes);
+        g_array_index(self->index.types, guint, index) = types;
+        g_array_index(self->index.attributes, guint, index) = attributes;
+}
+
 /**
  * ldm_manager_remove_device:
  *
@@ -457,6 +646,7 @@ static void ldm_manager_remove_device(LdmManager *self, udev_device *device)
         parent = ldm_manager_get_device_parent(self, subsystem, device);
         if (parent) {
                 ldm_device_remove_child_by_path(parent, sysfs_path);
+                ldm_manager_index_refresh(self, parent);
                 return;
         }
 
@@ -467,23 +657,167 @@ static void ldm_manager_remove_device(LdmManager *self, udev_device *device)
         /*  Emit signal for the device removal */
         g_signal_emit(self, obj_signals[SIGNAL_DEVICE_REMOVED], 0, node);
 
+        ldm_manager_record_change(self, LDM_MANAGER_CHANGE_DEVICE_REMOVED, node);
+
         /* Remove from our known devices */
+        ldm_manager_index_remove(self, index);
         g_ptr_array_remove_index(self->devices, index);
 }
 
 /**
- * ldm_manager_push_sysfs:
- * @sysfs_path: Path within the sysfs for the new device
+ * ldm_manager_probe:
+ * @udev: udev context owned by the calling thread
+ *
+ * Do the expensive part of adding a device, which is reading its uevent,
+ * properties and attributes from sysfs. The parent chain is walked so that
+ * the merge only ever hits the libudev caches.
  *
- * Potentially add a device from the sysfs name if it happens to have a modalias
+ * Devices excluded by the filter are dropped as soon as the uevent is known.
  */
-static void ldm_manager_push_sysfs(LdmManager *self, const char *sysfs_path)
+static void ldm_manager_probe(udev_connection *udev, LdmDeviceFilter *filter,
+                              LdmManagerProbe *probe)
 {
-        autofree(udev_device) *device = NULL;
+        udev_list *properties = NULL;
+
+        probe->device = udev_device_new_from_syspath(udev, probe->sysfs_path);
+        if (!probe->device) {
+                return;
+        }
+
+        if (ldm_device_filter_excludes(filter, probe->device)) {
+                g_clear_pointer(&probe->device, udev_device_unref);
+                return;
+        }
 
-        device = udev_device_new_from_syspath(self->udev, sysfs_path);
+        for (udev_device *parent = udev_device_get_parent(probe->device); parent;
+             parent = udev_device_get_parent(parent)) {
+                udev_device_get_subsystem(parent);
+                udev_device_get_devtype(parent);
+        }
+
+        properties = udev_device_get_properties_list_entry(probe->device);
+        probe->ldm_device = ldm_device_new_from_udev(NULL, probe->device, properties, 0);
+}
+
+/**
+ * ldm_manager_probe_queue_run:
+ *
+ * Claim and probe devices from the queue until there are none left.
+ */
+static void ldm_manager_probe_queue_run(LdmManagerProbeQueue *queue, udev_connection *udev)
+{
+        for (;;) {
+                guint index = (guint)g_atomic_int_add(&queue->next, 1);
+
+                if (index >= queue->n_probes) {
+                        return;
+                }
+                ldm_manager_probe(udev, queue->filter, &queue->probes[index]);
+        }
+}
+
+/**
+ * ldm_manager_probe_thread:
+ *
+ * libudev contexts are not thread safe, so each thread has its own. It is
+ * returned to the caller to outlive the devices created from it.
+ *
+ * Returns: (transfer full): The udev context of the thread
+ */
+static gpointer ldm_manager_probe_thread(gpointer v)
+{
+        LdmManagerProbeQueue *queue = v;
+        udev_connection *udev = NULL;
+
+        udev = udev_new();
+        if (!udev) {
+                return NULL;
+        }
+
+        ldm_manager_probe_queue_run(queue, udev);
+
+        return udev;
+}
+
+/**
+ * ldm_manager_get_probe_threads:
+ * @n_probes: Number of sysfs paths to probe
+ *
+ * The `LDM_PROBE_THREADS` environment variable forces the number of probe
+ * threads, so that the tests can compare parallel and serial probing on
+ * any machine.
+ *
+ * Returns: Number of threads to probe with, including the calling thread
+ */
+static guint ldm_manager_get_probe_threads(guint n_probes)
+{
+        const gchar *forced = g_getenv("LDM_PROBE_THREADS");
+        guint n_threads = 0;
+
+        if (forced && *forced) {
+                n_threads = (guint)g_ascii_strtoull(forced, NULL, 10);
+                return CLAMP(n_threads, 1, LDM_MANAGER_PROBE_THREADS);
+        }
+
+        n_threads = MIN((guint)g_get_num_processors(), n_probes / LDM_MANAGER_PROBE_BATCH);
+        return MIN(n_threads, LDM_MANAGER_PROBE_THREADS);
+}
 
-        ldm_manager_push_device(self, device, FALSE);
+/**
+ * ldm_manager_probe_sysfs:
+ * @sysfs_paths: (element-type utf8): Enumerated sysfs paths, in udev order
+ *
+ * Construct devices for each sysfs path in parallel, then add them in the
+ * original order. Priorities, parents and duplicate handling are decided in
+ * the serial merge, so the result is identical to adding one at a time.
+ */
+static void ldm_manager_probe_sysfs(LdmManager *self, GPtrArray *sysfs_paths)
+{
+        LdmManagerProbeQueue queue = { 0 };
+        GThread *threads[LDM_MANAGER_PROBE_THREADS] = { NULL };
+        udev_connection *contexts[LDM_MANAGER_PROBE_THREADS] = { NULL };
+        guint n_threads = 0;
+
+        if (sysfs_paths->len < 1) {
+                return;
+        }
+
+        queue.filter = self->filter;
+        queue.n_probes = sysfs_paths->len;
+        queue.probes = g_new0(LdmManagerProbe, queue.n_probes);
+        for (guint i = 0; i < queue.n_probes; i++) {
+                queue.probes[i].sysfs_path = sysfs_paths->pdata[i];
+        }
+
+        /* Helpers only, we always take part in the work ourselves */
+        n_threads = ldm_manager_get_probe_threads(queue.n_probes);
+        for (guint i = 1; i < n_threads; i++) {
+                threads[i] = g_thread_try_new("ldm-probe", ldm_manager_probe_thread, &queue, NULL);
+        }
+
+        ldm_manager_probe_queue_run(&queue, self->udev);
+
+        for (guint i = 1; i < n_threads; i++) {
+                if (threads[i]) {
+                        contexts[i] = g_thread_join(threads[i]);
+                }
+        }
+
+        /* Merge in udev order */
+        for (guint i = 0; i < queue.n_probes; i++) {
+                LdmManagerProbe *probe = &queue.probes[i];
+
+                if (probe->device) {
+                        ldm_manager_push_device(self, probe->device, probe->ldm_device, FALSE);
+                        udev_device_unref(probe->device);
+                }
+        }
+
+        for (guint i = 1; i < n_threads; i++) {
+                g_clear_pointer(&contexts[i], udev_unref);
+        }
+
+        g_free(queue.probes);
 }
 
 /**
@@ -626,17 +960,25 @@ static void ldm_manager_emit_usb(LdmManager *self, udev_device *device)
 /**
  * ldm_manager_push_device:
  * @device: The udev device to add
+ * @probed: (transfer full) (nullable): Detached device built from @device ahead of time
  *
  * This will handle the real work of adding a new device to the manager
  */
-static void ldm_manager_push_device(LdmManager *self, udev_device *device, gboolean emit_signal)
+static void ldm_manager_push_device(LdmManager *self, udev_device *device, LdmDevice *probed,
+                                    gboolean emit_signal)
 {
-        LdmDevice *ldm_device = NULL;
+        g_autoptr(LdmDevice) ldm_device = NULL;
         LdmDevice *parent = NULL;
         const char *sysfs_path = NULL;
         const char *subsystem = NULL;
         udev_list *properties = NULL;
 
+        if (probed) {
+                ldm_device = g_object_ref_sink(probed);
+        } else if (ldm_device_filter_excludes(self->filter, device)) {
+                return;
+        }
+
         sysfs_path = udev_device_get_syspath(device);
 
         /* Don't dupe these guys. */
@@ -646,7 +988,6 @@ static void ldm_manager_push_device(LdmManager *self, udev_device *device, gbool
 
         /* Get our basic information */
         subsystem = udev_device_get_subsystem(device);
-        properties = udev_device_get_properties_list_entry(device);
 
         parent = ldm_manager_get_device_parent(self, subsystem, device);
 
@@ -655,18 +996,31 @@ static void ldm_manager_push_device(LdmManager *self, udev_device *device, gbool
                 return;
         }
 
-        /* Build the actual device now */
-        ldm_device = ldm_device_new_from_udev(parent, device, properties, self->device_priority);
+        /* Build the actual device now, or attach the probed one */
+        if (ldm_device) {
+                ldm_device->tree.parent = parent;
+                ldm_device->priority = self->device_priority;
+        } else {
+                properties = udev_device_get_properties_list_entry(device);
+                ldm_device = g_object_ref_sink(
+                    ldm_device_new_from_udev(parent, device, properties, self->device_priority));
+        }
 
         /* Note that due to subchilds this index may appear messed up, but that's fine. */
         ++self->device_priority;
 
+        /* New hardware may need a plugin we held back */
+        ldm_manager_load_deferred_plugins(self, ldm_device);
+
         if (parent) {
                 ldm_device_add_child(parent, ldm_device);
+                ldm_manager_index_refresh(self, parent);
                 return;
         }
 
-        g_ptr_array_add(self->devices, g_object_ref_sink(ldm_device));
+        g_ptr_array_add(self->devices, g_object_ref(ldm_device));
+        ldm_manager_index_append(self, ldm_device);
+        ldm_manager_record_change(self, LDM_MANAGER_CHANGE_DEVICE_ADDED, ldm_device);
 
         /*  Emit signal for the new device. */
         if (!emit_signal) {
@@ -694,14 +1048,153 @@ LdmManager *ldm_manager_new(LdmManagerFlags flags)
         return g_object_new(LDM_TYPE_MANAGER, "flags", flags, NULL);
 }
 
-static gint ldm_manager_sort_device_by_priority(gconstpointer a, gconstpointer b)
+/**
+ * ldm_manager_new_with_filter:
+ * @flags: Control behaviour of the new manager.
+ * @filter: Rules for devices to exclude
+ *
+ * Construct a new LdmManager that never adds devices excluded by @filter,
+ * in place of the system filter rules. The filter must not be changed
+ * once the manager is constructed.
+ *
+ * Returns: (transfer full): A newly created #LdmManager
+ */
+LdmManager *ldm_manager_new_with_filter(LdmManagerFlags flags, LdmDeviceFilter *filter)
 {
-        gint prioA = ldm_device_get_priority(*(LdmDevice **)a);
-        gint prioB = ldm_device_get_priority(*(LdmDevice **)b);
+        g_return_val_if_fail(filter != NULL, NULL);
+
+        return g_object_new(LDM_TYPE_MANAGER, "flags", flags, "filter", filter, NULL);
+}
+
+static gint ldm_manager_sort_row_by_priority(gconstpointer a, gconstpointer b, gpointer userdata)
+{
+        GArray *priority = userdata;
+        gint prioA = g_array_index(priority, gint, *(const guint *)a);
+        gint prioB = g_array_index(priority, gint, *(const guint *)b);
 
         return prioA - prioB;
 }
 
+/*
+ * Narrow the candidate rows down to those holding every bit of mask. These
+ * loops are branch free so that they may be vectorized.
+ */
+static void ldm_manager_index_scan_mask(const guint *column, guint n_rows, guint mask,
+                                        guint8 *hits)
+{
+        for (guint i = 0; i < n_rows; i++) {
+                hits[i] &= (guint8)((column[i] & mask) == mask);
+        }
+}
+
+/*
+ * Narrow the candidate rows down to those with the given ID
+ */
+static void ldm_manager_index_scan_id(const gint *column, guint n_rows, gint id, guint8 *hits)
+{
+        for (guint i = 0; i < n_rows; i++) {
+                hits[i] &= (guint8)(column[i] == id);
+        }
+}
+
+/**
+ * ldm_manager_query_confirm:
+ *
+ * The index only knows the union of the types and attributes found in a
+ * device tree. That is exact for a single bit, but a mask of several bits
+ * must all be present on one device, so those are confirmed on the tree.
+ */
+static gboolean ldm_manager_query_confirm(LdmDevice *device, const LdmDeviceQuery *query,
+                                          guint attributes)
+{
+        if ((query->types & (query->types - 1)) != 0 &&
+            !ldm_device_has_type(device, query->types)) {
+                return FALSE;
+        }
+        if ((query->attributes & (query->attributes - 1)) != 0 &&
+            !ldm_device_has_attribute(device, query->attributes)) {
+                return FALSE;
+        }
+        if (query->no_attributes != 0 &&
+            (attributes & query->no_attributes) == query->no_attributes &&
+            ldm_device_has_attribute(device, query->no_attributes)) {
+                return FALSE;
+        }
+        return TRUE;
+}
+
+/**
+ * ldm_manager_query_devices:
+ * @query: Filter to apply
+ *
+ * Find the top level devices matching the query by scanning the index
+ * columns, so that only candidate devices are ever dereferenced.
+ *
+ * Returns: (element-type Ldm.Device) (transfer container): matching devices, sorted by priority
+ */
+GPtrArray *ldm_manager_query_devices(LdmManager *self, const LdmDeviceQuery *query)
+{
+        g_autofree guint8 *hits = NULL;
+        g_autoptr(GArray) rows = NULL;
+        GPtrArray *ret = NULL;
+        guint n_rows = 0;
+
+        g_return_val_if_fail(self != NULL, NULL);
+        g_return_val_if_fail(query != NULL, NULL);
+
+        n_rows = self->devices->len;
+        hits = g_malloc(MAX(n_rows, 1));
+        memset(hits, 1, n_rows);
+
+        if (query->types != LDM_DEVICE_TYPE_ANY) {
+                ldm_manager_index_scan_mask((const guint *)self->index.types->data,
+                                            n_rows,
+                                            query->types,
+                                            hits);
+        }
+        if (query->attributes != LDM_DEVICE_ATTRIBUTE_ANY) {
+                ldm_manager_index_scan_mask((const guint *)self->index.attributes->data,
+                                            n_rows,
+                                            query->attributes,
+                                            hits);
+        }
+        if (query->vendor_id != 0) {
+                ldm_manager_index_scan_id((const gint *)self->index.vendor_id->data,
+                                          n_rows,
+                                          query->vendor_id,
+                                          hits);
+        }
+        if (query->product_id != 0) {
+                ldm_manager_index_scan_id((const gint *)self->index.product_id->data,
+                                          n_rows,
+                                          query->product_id,
+                                          hits);
+        }
+
+        rows = g_array_new(FALSE, FALSE, sizeof(guint));
+        for (guint i = 0; i < n_rows; i++) {
+                if (!hits[i]) {
+                        continue;
+                }
+                if (!ldm_manager_query_confirm(self->devices->pdata[i],
+                                               query,
+                                               g_array_index(self->index.attributes, guint, i))) {
+                        continue;
+                }
+                g_array_append_val(rows, i);
+        }
+
+        g_array_sort_with_data(rows, ldm_manager_sort_row_by_priority, self->index.priority);
+
+        ret = g_ptr_array_new_full(rows->len, g_object_unref);
+        for (guint i = 0; i < rows->len; i++) {
+                g_ptr_array_add(ret,
+                                g_object_ref(self->devices->pdata[g_array_index(rows, guint, i)]));
+        }
+
+        return ret;
+}
+
 /**
  * ldm_manager_get_devices:
  * @class_mask: Bitwise mask of LdmDeviceType
@@ -720,25 +1213,276 @@ static gint ldm_manager_sort_device_by_priority(gconstpointer a, gconstpointer b
  */
 GPtrArray *ldm_manager_get_devices(LdmManager *self, LdmDeviceType class_mask)
 {
-        GPtrArray *ret = NULL;
+        LdmDeviceQuery query = {
+                .types = class_mask,
+        };
 
         g_return_val_if_fail(self != NULL, NULL);
 
-        ret = g_ptr_array_new_with_free_func(g_object_unref);
+        return ldm_manager_query_devices(self, &query);
+}
 
-        for (guint i = 0; i < self->devices->len; i++) {
-                LdmDevice *node = NULL;
+/**
+ * ldm_manager_append_change:
+ * @device: (nullable): Device added or removed
+ *
+ * Bump the generation and log the change, forgetting the oldest change
+ * once the log is full.
+ */
+static void ldm_manager_append_change(LdmManager *self, LdmManagerChangeType type,
+                                      LdmDevice *device)
+{
+        LdmManagerChange *change = NULL;
 
-                node = self->devices->pdata[i];
-                if (!ldm_device_has_type(node, class_mask)) {
-                        continue;
+        if (self->changes.len == LDM_MANAGER_CHANGE_LOG_SIZE) {
+                change = &self->changes.log[self->changes.head];
+                g_clear_object(&change->device);
+                self->changes.head = (self->changes.head + 1) % LDM_MANAGER_CHANGE_LOG_SIZE;
+                --self->changes.len;
+        }
+
+        change = &self->changes.log[(self->changes.head + self->changes.len) %
+                                    LDM_MANAGER_CHANGE_LOG_SIZE];
+        ++self->changes.len;
+
+        change->generation = ++self->changes.generation;
+        change->type = type;
+        change->device = device ? g_object_ref(device) : NULL;
+}
+
+/**
+ * ldm_manager_sync_plugin_changes:
+ *
+ * Plugins only bump the plugin serial when they are added or changed. All
+ * plugin changes since the last sync are logged as one entry, so loading a
+ * large directory of plugins can't push device changes out of the log.
+ */
+static void ldm_manager_sync_plugin_changes(LdmManager *self)
+{
+        if (self->plugin_serial == self->changes.plugin_serial) {
+                return;
+        }
+
+        self->changes.plugin_serial = self->plugin_serial;
+        ldm_manager_append_change(self, LDM_MANAGER_CHANGE_PROVIDERS, NULL);
+}
+
+/**
+ * ldm_manager_record_change:
+ * @device: Device added or removed
+ *
+ * Log a device change, after any plugin change that came before it.
+ */
+void ldm_manager_record_change(LdmManager *self, LdmManagerChangeType type, LdmDevice *device)
+{
+        ldm_manager_sync_plugin_changes(self);
+        ldm_manager_append_change(self, type, device);
+}
+
+/**
+ * ldm_manager_get_generation:
+ *
+ * The generation starts at zero, and increases by one for every device
+ * added to or removed from the manager. Devices present at construction are
+ * counted too. Plugins added or changed since the generation was last asked
+ * for, or since the last device change, increase it by one between them.
+ *
+ * Returns: The current generation
+ */
+guint64 ldm_manager_get_generation(LdmManager *self)
+{
+        g_return_val_if_fail(self != NULL, 0);
+
+        ldm_manager_sync_plugin_changes(self);
+
+        return self->changes.generation;
+}
+
+/**
+ * ldm_manager_get_changes:
+ * @since: Generation last seen by the caller
+ * @generation: (out) (optional): Current generation, to pass next time
+ * @added: (out) (optional) (element-type Ldm.Device) (transfer full): Devices added since
+ * @removed: (out) (optional) (element-type Ldm.Device) (transfer full): Devices removed since
+ * @providers_changed: (out) (optional): Whether plugins were added or changed since
+ *
+ * Find the top level devices added and removed since the given generation,
+ * without building the full device list. The work done only depends on the
+ * number of changes. A device both added and removed since @since is in
+ * neither list.
+ *
+ * Only the most recent changes are kept. When @since is too old, or newer
+ * than the current generation, FALSE is returned and the caller must start
+ * again from #ldm_manager_get_devices and #ldm_manager_get_generation.
+ *
+ * Returns: TRUE if the changes since @since are known
+ */
+gboolean ldm_manager_get_changes(LdmManager *self, guint64 since, guint64 *generation,
+                                 GPtrArray **added, GPtrArray **removed,
+                                 gboolean *providers_changed)
+{
+        g_autoptr(GHashTable) fresh = NULL;
+        g_autoptr(GPtrArray) candidates = NULL;
+        g_autoptr(GPtrArray) added_devices = NULL;
+        g_autoptr(GPtrArray) removed_devices = NULL;
+        gboolean providers = FALSE;
+        guint64 oldest = 0;
+
+        g_return_val_if_fail(self != NULL, FALSE);
+
+        ldm_manager_sync_plugin_changes(self);
+
+        if (generation) {
+                *generation = self->changes.generation;
+        }
+        if (added) {
+                *added = NULL;
+        }
+        if (removed) {
+                *removed = NULL;
+        }
+        if (providers_changed) {
+                *providers_changed = FALSE;
+        }
+
+        /* Generation preceding the oldest change we still have */
+        oldest = self->changes.generation - self->changes.len;
+        if (since < oldest || since > self->changes.generation) {
+                return FALSE;
+        }
+
+        fresh = g_hash_table_new(g_direct_hash, g_direct_equal);
+        candidates = g_ptr_array_new();
+        added_devices = g_ptr_array_new_with_free_func(g_object_unref);
+        removed_devices = g_ptr_array_new_with_free_func(g_object_unref);
+
+        for (guint i = (guint)(since - oldest); i < self->changes.len; i++) {
+                const LdmManagerChange *change =
+                    &self->changes.log[(self->changes.head + i) % LDM_MANAGER_CHANGE_LOG_SIZE];
+
+                switch (change->type) {
+                case LDM_MANAGER_CHANGE_DEVICE_ADDED:
+                        g_hash_table_add(fresh, change->device);
+                        g_ptr_array_add(candidates, change->device);
+                        break;
+                case LDM_MANAGER_CHANGE_DEVICE_REMOVED:
+                        /* Caller never saw it, so there is nothing to remove */
+                        if (!g_hash_table_remove(fresh, change->device)) {
+                                g_ptr_array_add(removed_devices, g_object_ref(change->device));
+                        }
+                        break;
+                case LDM_MANAGER_CHANGE_PROVIDERS:
+                default:
+                        providers = TRUE;
+                        break;
                 }
-                g_ptr_array_add(ret, g_object_ref(node));
         }
 
-        g_ptr_array_sort(ret, ldm_manager_sort_device_by_priority);
+        /* Skip the devices that came and went */
+        for (guint i = 0; i < candidates->len; i++) {
+                if (g_hash_table_contains(fresh, candidates->pdata[i])) {
+                        g_ptr_array_add(added_devices, g_object_ref(candidates->pdata[i]));
+                }
+        }
 
-        return ret;
+        if (added) {
+                *added = g_steal_pointer(&added_devices);
+        }
+        if (removed) {
+                *removed = g_steal_pointer(&removed_devices);
+        }
+        if (providers_changed) {
+                *providers_changed = providers;
+        }
+
+        return TRUE;
+}
+
+/**
+ * ldm_manager_get_memory_usage:
+ * @usage: (out caller-allocates): Usage to fill
+ *
+ * Estimate the memory currently used by this manager, including all known
+ * devices, their udev properties, the loaded plugins and the tables used to
+ * route devices to plugins. The estimate is split into #LdmMemoryCategory
+ * buckets so that growth can be attributed to one part of the library.
+ */
+void ldm_manager_get_memory_usage(LdmManager *self, LdmMemoryUsage *usage)
+{
+        GHashTableIter iter = { 0 };
+        gpointer value = NULL;
+
+        g_return_if_fail(self != NULL);
+        g_return_if_fail(usage != NULL);
+
+        memset(usage, 0, sizeof(*usage));
+
+        ldm_memory_usage_add(usage,
+                             LDM_MEMORY_CATEGORY_DEVICES,
+                             sizeof(LdmManager) + self->devices->len * sizeof(gpointer),
+                             0);
+        for (guint i = 0; i < self->devices->len; i++) {
+                ldm_device_account_memory(self->devices->pdata[i], usage);
+        }
+
+        ldm_memory_usage_add(usage,
+                             LDM_MEMORY_CATEGORY_ALIASES,
+                             self->plugins->len * sizeof(gpointer),
+                             0);
+        for (guint i = 0; i < self->plugins->len; i++) {
+                ldm_plugin_account_memory(self->plugins->pdata[i], usage);
+        }
+        for (guint i = 0; i < self->deferred->len; i++) {
+                LdmDeferredPlugin *deferred = self->deferred->pdata[i];
+
+                ldm_memory_usage_add(usage,
+                                     LDM_MEMORY_CATEGORY_ALIASES,
+                                     sizeof(LdmDeferredPlugin) + sizeof(GArray) +
+                                         deferred->header.routes->len * sizeof(LdmRoute),
+                                     1);
+                ldm_memory_usage_add_string(usage, LDM_MEMORY_CATEGORY_STRINGS, deferred->path);
+                ldm_memory_usage_add_string(usage,
+                                            LDM_MEMORY_CATEGORY_STRINGS,
+                                            deferred->native_path);
+                ldm_memory_usage_add_string(usage, LDM_MEMORY_CATEGORY_STRINGS, deferred->name);
+                ldm_memory_usage_add_string(usage,
+                                            LDM_MEMORY_CATEGORY_STRINGS,
+                                            deferred->header.checksum);
+        }
+
+        /* Routing table, only present once a device has been routed */
+        if (self->routes.table) {
+                ldm_memory_usage_add_hash_table(usage,
+                                                LDM_MEMORY_CATEGORY_CACHES,
+                                                self->routes.table);
+                g_hash_table_iter_init(&iter, self->routes.table);
+                while (g_hash_table_iter_next(&iter, NULL, &value)) {
+                        GArray *plugins = value;
+
+                        ldm_memory_usage_add(usage,
+                                             LDM_MEMORY_CATEGORY_CACHES,
+                                             sizeof(LdmRoute) + sizeof(GArray) +
+                                                 plugins->len * sizeof(guint),
+                                             1);
+                }
+        }
+        /* Filter columns of the device index */
+        ldm_memory_usage_add(usage,
+                             LDM_MEMORY_CATEGORY_CACHES,
+                             (sizeof(GArray) + self->devices->len * sizeof(guint)) * 5,
+                             0);
+
+        if (self->routes.unrouted) {
+                ldm_memory_usage_add(usage,
+                                     LDM_MEMORY_CATEGORY_CACHES,
+                                     sizeof(GArray) + self->routes.unrouted->len * sizeof(guint),
+                                     0);
+        }
+        ldm_memory_usage_add(usage,
+                             LDM_MEMORY_CATEGORY_CACHES,
+                             sizeof(GPtrArray) + self->routes.hits->len * sizeof(gpointer) +
+                                 sizeof(GArray) + self->routes.merged->len * sizeof(guint),
+                             0);
 }
 
 /*
@@ -13,6 +13,7 @@
 
 #include <glib-object.h>
 
+#include <device-filter.h>
 #include <device.h>
 #include <plugin.h>
 
@@ -26,6 +27,7 @@ typedef struct _LdmManagerClass LdmManagerClass;
  * @LDM_MANAGER_FLAGS_NONE: No special behaviour required
  * @LDM_MANAGER_FLAGS_NO_MONITOR: Disable hotplug events
  * @LDM_MANAGER_FLAGS_GPU_QUICK: Only allow GPU devices for fast initialisation
+ * @LDM_MANAGER_FLAGS_KERNEL_EVENTS: Receive hotplug events directly from the kernel
  *
  * Override the behaviour of the new LdmManager to allow disabling
  * of hotplug events, etc.
@@ -34,6 +36,7 @@ typedef enum {
         LDM_MANAGER_FLAGS_NONE = 0,
         LDM_MANAGER_FLAGS_NO_MONITOR = 1 << 0,
         LDM_MANAGER_FLAGS_GPU_QUICK = 1 << 1,
+        LDM_MANAGER_FLAGS_KERNEL_EVENTS = 1 << 2,
 } LdmManagerFlags;
 
 #define LDM_TYPE_MANAGER ldm_manager_get_type()
@@ -47,11 +50,22 @@ GType ldm_manager_get_type(void);
 
 /* Main API */
 LdmManager *ldm_manager_new(LdmManagerFlags flags);
+LdmManager *ldm_manager_new_with_filter(LdmManagerFlags flags, LdmDeviceFilter *filter);
 GPtrArray *ldm_manager_get_devices(LdmManager *manager, LdmDeviceType class_mask);
 GPtrArray *ldm_manager_get_providers(LdmManager *manager, LdmDevice *device);
+LdmProvider *ldm_manager_get_best_provider(LdmManager *manager, LdmDevice *device);
+GArray *ldm_manager_get_provider_results(LdmManager *manager, LdmDevice *device);
+void ldm_manager_get_memory_usage(LdmManager *manager, LdmMemoryUsage *usage);
+
+/* Change tracking */
+guint64 ldm_manager_get_generation(LdmManager *manager);
+gboolean ldm_manager_get_changes(LdmManager *manager, guint64 since, guint64 *generation,
+                                 GPtrArray **added, GPtrArray **removed,
+                                 gboolean *providers_changed);
 
 /* Plugin API */
 gboolean ldm_manager_add_modalias_plugin_for_path(LdmManager *manager, const gchar *path);
+gboolean ldm_manager_add_native_plugin_for_path(LdmManager *manager, const gchar *path);
 gboolean ldm_manager_add_modalias_plugins_for_directory(LdmManager *manager,
                                                         const gchar *directory);
 gboolean ldm_manager_add_system_modalias_plugins(LdmManager *manager);
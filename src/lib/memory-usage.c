@@ -0,0 +1,135 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "memory-usage.h"
+
+/**
+ * SECTION:memory-usage
+ * @Short_description: Memory accounting
+ * @see_also: #LdmManager, #LdmPlugin
+ * @Title: LdmMemoryUsage
+ *
+ * An #LdmMemoryUsage totals the memory used by an #LdmManager, its device
+ * tree and its plugins, split into a number of categories. Plugins report
+ * their own usage through the `account_memory` virtual function of the
+ * #LdmPluginClass, using the helpers here.
+ */
+
+/*
+ * GHashTable keeps keys, values and hashes in arrays of a power of two size,
+ * and grows once it is more than 3/4 full. The table itself is a little
+ * under 100 bytes on 64-bit.
+ */
+#define LDM_HASH_TABLE_SIZE 96
+#define LDM_HASH_TABLE_MIN_BUCKETS 8
+
+/* Growing past the reserved room would change the layout of LdmMemoryUsage */
+G_STATIC_ASSERT(LDM_MEMORY_N_CATEGORIES <= LDM_MEMORY_MAX_CATEGORIES);
+
+/**
+ * ldm_memory_usage_add:
+ * @category: Category to account the memory to
+ * @bytes: Number of bytes
+ * @objects: Number of objects that the bytes belong to
+ *
+ * Add to the totals of a category
+ */
+void ldm_memory_usage_add(LdmMemoryUsage *usage, LdmMemoryCategory category, gsize bytes,
+                          guint objects)
+{
+        g_return_if_fail(usage != NULL);
+        g_return_if_fail(category < LDM_MEMORY_N_CATEGORIES);
+
+        usage->bytes[category] += bytes;
+        usage->objects[category] += objects;
+}
+
+/**
+ * ldm_memory_usage_add_string:
+ * @category: Category to account the memory to
+ * @string: (nullable): String to account for
+ *
+ * Account a nul terminated string as a single object
+ */
+void ldm_memory_usage_add_string(LdmMemoryUsage *usage, LdmMemoryCategory category,
+                                 const gchar *string)
+{
+        if (!string) {
+                return;
+        }
+
+        ldm_memory_usage_add(usage, category, strlen(string) + 1, 1);
+}
+
+/**
+ * ldm_memory_usage_add_hash_table:
+ * @category: Category to account the memory to
+ * @table: (nullable): Table to account for
+ *
+ * Account the storage of a hash table, but not the keys and values it
+ * points to. The table counts as a single object.
+ */
+void ldm_memory_usage_add_hash_table(LdmMemoryUsage *usage, LdmMemoryCategory category,
+                                     GHashTable *table)
+{
+        gsize buckets = LDM_HASH_TABLE_MIN_BUCKETS;
+        gsize n_items = 0;
+
+        if (!table) {
+                return;
+        }
+
+        n_items = g_hash_table_size(table);
+        while (buckets * 3 / 4 < n_items) {
+                buckets <<= 1;
+        }
+
+        ldm_memory_usage_add(usage,
+                             category,
+                             LDM_HASH_TABLE_SIZE +
+                                 buckets * (sizeof(gpointer) * 2 + sizeof(guint)),
+                             1);
+}
+
+/**
+ * ldm_memory_usage_get_total:
+ *
+ * Returns: The number of bytes used across all categories
+ */
+gsize ldm_memory_usage_get_total(const LdmMemoryUsage *usage)
+{
+        gsize total = 0;
+
+        g_return_val_if_fail(usage != NULL, 0);
+
+        for (guint i = 0; i < LDM_MEMORY_N_CATEGORIES; i++) {
+                total += usage->bytes[i];
+        }
+
+        return total;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
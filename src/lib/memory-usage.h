@@ -0,0 +1,87 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+G_BEGIN_DECLS
+
+/**
+ * LdmMemoryCategory:
+ * @LDM_MEMORY_CATEGORY_DEVICES: #LdmDevice instances and the device tree
+ * @LDM_MEMORY_CATEGORY_PROPERTIES: udev properties recorded for each device
+ * @LDM_MEMORY_CATEGORY_ALIASES: Plugin instances and their alias patterns
+ * @LDM_MEMORY_CATEGORY_STRINGS: String storage of devices and plugins
+ * @LDM_MEMORY_CATEGORY_CACHES: Indexes and routing tables that speed up matching
+ *
+ * Categories of memory reported in an #LdmMemoryUsage
+ */
+typedef enum {
+        LDM_MEMORY_CATEGORY_DEVICES = 0,
+        LDM_MEMORY_CATEGORY_PROPERTIES,
+        LDM_MEMORY_CATEGORY_ALIASES,
+        LDM_MEMORY_CATEGORY_STRINGS,
+        LDM_MEMORY_CATEGORY_CACHES,
+        /* New categories go here, see #LdmMemoryUsage */
+} LdmMemoryCategory;
+
+/* Number of #LdmMemoryCategory values */
+#define LDM_MEMORY_N_CATEGORIES 5
+
+/* Categories #LdmMemoryUsage has room for, see there */
+#define LDM_MEMORY_MAX_CATEGORIES 16
+
+/**
+ * LdmMemoryUsage:
+ * @bytes: Bytes used, by #LdmMemoryCategory
+ * @objects: Objects counted, by #LdmMemoryCategory
+ *
+ * Memory used by the library, as estimated by #ldm_manager_get_memory_usage.
+ * Sizes are those requested from the allocator, so allocator overhead is not
+ * included, and the sizes of GLib containers are estimated from the number
+ * of items they hold.
+ *
+ * The structure is allocated by the caller and filled in by the library, so
+ * its layout is part of the ABI. Room is reserved for up to
+ * #LDM_MEMORY_MAX_CATEGORIES categories, and new categories are only ever
+ * appended to #LdmMemoryCategory, never reordered or removed. Callers built
+ * against an older #LDM_MEMORY_N_CATEGORIES keep working, they just don't
+ * see the newer categories. Entries past #LDM_MEMORY_N_CATEGORIES are
+ * always zero.
+ */
+typedef struct _LdmMemoryUsage {
+        gsize bytes[LDM_MEMORY_MAX_CATEGORIES];
+        guint objects[LDM_MEMORY_MAX_CATEGORIES];
+} LdmMemoryUsage;
+
+void ldm_memory_usage_add(LdmMemoryUsage *usage, LdmMemoryCategory category, gsize bytes,
+                          guint objects);
+void ldm_memory_usage_add_string(LdmMemoryUsage *usage, LdmMemoryCategory category,
+                                 const gchar *string);
+void ldm_memory_usage_add_hash_table(LdmMemoryUsage *usage, LdmMemoryCategory category,
+                                     GHashTable *table);
+gsize ldm_memory_usage_get_total(const LdmMemoryUsage *usage);
+
+G_END_DECLS
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,268 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <fnmatch.h>
+#include <string.h>
+
+#include "modalias-fields.h"
+
+typedef struct LdmModaliasField {
+        const gchar *marker;
+        guint width; /* Hex digits */
+} LdmModaliasField;
+
+/*
+ * Field grammars as emitted by the kernel, see file2alias.c. Fields are
+ * always in this order, with fixed width upper case hex values. USB devices
+ * (as opposed to interfaces) stop after the "dp" field.
+ */
+static const LdmModaliasField ldm_modalias_pci[] = {
+        { "v", 8 }, { "d", 8 }, { "sv", 8 }, { "sd", 8 }, { "bc", 2 }, { "sc", 2 }, { "i", 2 },
+};
+
+static const LdmModaliasField ldm_modalias_usb[] = {
+        { "v", 4 },  { "p", 4 },   { "d", 4 },  { "dc", 2 }, { "dsc", 2 },
+        { "dp", 2 }, { "ic", 2 },  { "isc", 2 }, { "ip", 2 }, { "in", 2 },
+};
+
+static const LdmModaliasField ldm_modalias_hid[] = {
+        { "b", 4 },
+        { "g", 4 },
+        { "v", 8 },
+        { "p", 8 },
+};
+
+static const struct {
+        const gchar *bus;
+        const LdmModaliasField *fields;
+        guint n_fields;
+} ldm_modalias_grammars[] = {
+        { "pci", ldm_modalias_pci, G_N_ELEMENTS(ldm_modalias_pci) },
+        { "usb", ldm_modalias_usb, G_N_ELEMENTS(ldm_modalias_usb) },
+        { "hid", ldm_modalias_hid, G_N_ELEMENTS(ldm_modalias_hid) },
+};
+
+G_STATIC_ASSERT(G_N_ELEMENTS(ldm_modalias_usb) <= LDM_MODALIAS_MAX_FIELDS);
+
+/**
+ * ldm_modalias_hex_value:
+ *
+ * Kernel modaliases only use upper case hex. Lower case digits are rejected
+ * as fnmatch would not consider them equal.
+ *
+ * Returns: The digit value, or -1
+ */
+static inline gint ldm_modalias_hex_value(gchar c)
+{
+        if (c >= '0' && c <= '9') {
+                return c - '0';
+        }
+        if (c >= 'A' && c <= 'F') {
+                return c - 'A' + 10;
+        }
+        return -1;
+}
+
+/**
+ * ldm_modalias_fields_parse_full:
+ * @glob: Whether `*` and `?` are wildcards, i.e. this is a pattern
+ *
+ * Walk the grammar of the bus, consuming each marker and its value.
+ *
+ * Returns: TRUE if the whole string follows the grammar
+ */
+static gboolean ldm_modalias_fields_parse_full(LdmModaliasFields *fields, const gchar *modalias,
+                                               gboolean glob)
+{
+        const gchar *c = NULL;
+        gint known = -1;
+        guint i = 0;
+
+        memset(fields, 0, sizeof(*fields));
+
+        c = strchr(modalias, ':');
+        if (!c) {
+                return FALSE;
+        }
+
+        for (guint g = 0; g < G_N_ELEMENTS(ldm_modalias_grammars); g++) {
+                gsize len = strlen(ldm_modalias_grammars[g].bus);
+
+                if ((gsize)(c - modalias) == len &&
+                    strncmp(modalias, ldm_modalias_grammars[g].bus, len) == 0) {
+                        known = (gint)g;
+                        break;
+                }
+        }
+        if (known < 0) {
+                return FALSE;
+        }
+        ++c;
+
+        for (i = 0; i < ldm_modalias_grammars[known].n_fields && *c; i++) {
+                const LdmModaliasField *field = &ldm_modalias_grammars[known].fields[i];
+                gsize marker_len = strlen(field->marker);
+                guint32 value = 0;
+                guint32 mask = 0;
+
+                if (strncmp(c, field->marker, marker_len) != 0) {
+                        return FALSE;
+                }
+                c += marker_len;
+
+                /* Whole field wildcard */
+                if (glob && *c == '*') {
+                        ++c;
+                        fields->open = *c == '\0';
+                        continue;
+                }
+
+                for (guint w = 0; w < field->width; w++, c++) {
+                        gint digit = ldm_modalias_hex_value(*c);
+
+                        value <<= 4;
+                        mask <<= 4;
+
+                        if (glob && *c == '?') {
+                                continue;
+                        }
+                        if (digit < 0) {
+                                return FALSE;
+                        }
+                        value |= (guint32)digit;
+                        mask |= 0xF;
+                }
+
+                fields->values[i] = value;
+                fields->masks[i] = mask;
+        }
+
+        /* Trailing fields we don't understand */
+        if (*c || i == 0) {
+                memset(fields, 0, sizeof(*fields));
+                return FALSE;
+        }
+
+        fields->bus = ldm_modalias_grammars[known].bus;
+        fields->n_fields = i;
+
+        return TRUE;
+}
+
+/**
+ * ldm_modalias_fields_parse:
+ * @fields: (out): Storage for the fields
+ * @modalias: A device modalias as set by the kernel
+ *
+ * Returns: TRUE if the modalias follows a known grammar
+ */
+gboolean ldm_modalias_fields_parse(LdmModaliasFields *fields, const gchar *modalias)
+{
+        g_return_val_if_fail(fields != NULL, FALSE);
+        g_return_val_if_fail(modalias != NULL, FALSE);
+
+        return ldm_modalias_fields_parse_full(fields, modalias, FALSE);
+}
+
+/**
+ * ldm_modalias_fields_parse_pattern:
+ * @fields: (out): Storage for the fields
+ * @pattern: An fnmatch style modalias pattern
+ *
+ * Patterns are only accepted if every field is either a whole-field `*`, or
+ * a full width value in which `?` may stand in for single digits. Anything
+ * else, such as ranges or partial globs, must be handled by fnmatch.
+ *
+ * Returns: TRUE if the pattern could be decomposed
+ */
+gboolean ldm_modalias_fields_parse_pattern(LdmModaliasFields *fields, const gchar *pattern)
+{
+        g_return_val_if_fail(fields != NULL, FALSE);
+        g_return_val_if_fail(pattern != NULL, FALSE);
+
+        return ldm_modalias_fields_parse_full(fields, pattern, TRUE);
+}
+
+/**
+ * ldm_modalias_fields_match:
+ * @pattern: Fields of a pattern
+ * @subject: Fields of a device modalias
+ *
+ * Compare the fields of a device against a pattern. Both must have been
+ * parsed successfully.
+ *
+ * Returns: LDM_MODALIAS_FIELDS_UNKNOWN if the number of fields differ in
+ * a way that only fnmatch can answer
+ */
+LdmModaliasFieldsResult ldm_modalias_fields_match(const LdmModaliasFields *pattern,
+                                                  const LdmModaliasFields *subject)
+{
+        guint32 diff = 0;
+
+        if (pattern->bus != subject->bus) {
+                return LDM_MODALIAS_FIELDS_NO_MATCH;
+        }
+
+        if (pattern->n_fields != subject->n_fields &&
+            !(pattern->open && pattern->n_fields < subject->n_fields)) {
+                return LDM_MODALIAS_FIELDS_UNKNOWN;
+        }
+
+        for (guint i = 0; i < LDM_MODALIAS_MAX_FIELDS; i++) {
+                diff |= (pattern->values[i] ^ subject->values[i]) & pattern->masks[i];
+        }
+
+        return diff == 0 ? LDM_MODALIAS_FIELDS_MATCH : LDM_MODALIAS_FIELDS_NO_MATCH;
+}
+
+/**
+ * ldm_modalias_fields_matches:
+ * @match: fnmatch style modalias pattern
+ * @match_fields: (nullable): Fields of the pattern, if it could be decomposed
+ * @modalias: Device modalias to test
+ * @fields: (nullable): Fields of the modalias, if it could be decomposed
+ *
+ * Compare fields where both sides were decomposed, and use fnmatch for
+ * everything else.
+ *
+ * Returns: TRUE if the modalias matches the pattern
+ */
+gboolean ldm_modalias_fields_matches(const gchar *match, const LdmModaliasFields *match_fields,
+                                     const gchar *modalias, const LdmModaliasFields *fields)
+{
+        if (match_fields && match_fields->bus && fields && fields->bus) {
+                switch (ldm_modalias_fields_match(match_fields, fields)) {
+                case LDM_MODALIAS_FIELDS_MATCH:
+                        return TRUE;
+                case LDM_MODALIAS_FIELDS_NO_MATCH:
+                        return FALSE;
+                default:
+                        break;
+                }
+        }
+
+        return fnmatch(match, modalias, 0) == 0 ? TRUE : FALSE;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,63 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* Most fields of any known modalias grammar (USB interfaces have 10) */
+#define LDM_MODALIAS_MAX_FIELDS 12
+
+/*
+ * LdmModaliasFields
+ *
+ * A modalias, or an fnmatch style modalias pattern, decomposed into numeric
+ * fields following the grammar of its bus, i.e.
+ *
+ *      `pci:vXXXXXXXXdXXXXXXXXsvXXXXXXXXsdXXXXXXXXbcXXscXXiXX`
+ *
+ * Each field of a pattern carries a mask of the hex digits that must match,
+ * so a whole-field `*` has a mask of 0 and a `?` clears a single nibble.
+ * Masks past n_fields are always 0, so the match is a fixed length loop.
+ */
+typedef struct LdmModaliasFields {
+        const gchar *bus; /* Bus of a known grammar, NULL if not parsed */
+        guint n_fields;   /* Number of fields present */
+        gboolean open;    /* Pattern ends in a wildcard field that may span more fields */
+        guint32 values[LDM_MODALIAS_MAX_FIELDS];
+        guint32 masks[LDM_MODALIAS_MAX_FIELDS];
+} LdmModaliasFields;
+
+typedef enum {
+        LDM_MODALIAS_FIELDS_NO_MATCH = 0,
+        LDM_MODALIAS_FIELDS_MATCH,
+        LDM_MODALIAS_FIELDS_UNKNOWN, /* Shapes differ, fnmatch must decide */
+} LdmModaliasFieldsResult;
+
+gboolean ldm_modalias_fields_parse(LdmModaliasFields *fields, const gchar *modalias);
+gboolean ldm_modalias_fields_parse_pattern(LdmModaliasFields *fields, const gchar *pattern);
+LdmModaliasFieldsResult ldm_modalias_fields_match(const LdmModaliasFields *pattern,
+                                                  const LdmModaliasFields *subject);
+gboolean ldm_modalias_fields_matches(const gchar *match, const LdmModaliasFields *match_fields,
+                                     const gchar *modalias, const LdmModaliasFields *fields);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
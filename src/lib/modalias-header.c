@@ -0,0 +1,263 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "modalias-header.h"
+
+/**
+ * ldm_modalias_header_parse_route:
+ *
+ * Parse a single `bus:vendor`, `bus:*` or `*` token of the routes line
+ */
+static gboolean ldm_modalias_header_parse_route(LdmModaliasHeader *header, const gchar *token)
+{
+        g_autofree gchar *bus = NULL;
+        const gchar *sep = NULL;
+        LdmRoute route = { 0 };
+        gchar *end = NULL;
+        guint64 vendor_id = 0;
+
+        if (g_str_equal(token, "*")) {
+                header->any_bus = TRUE;
+                return TRUE;
+        }
+
+        sep = strchr(token, ':');
+        if (!sep || sep == token) {
+                return FALSE;
+        }
+
+        bus = g_strndup(token, (gsize)(sep - token));
+        route.bus = g_intern_string(bus);
+
+        if (g_str_equal(sep + 1, "*")) {
+                route.any_vendor = TRUE;
+        } else {
+                vendor_id = g_ascii_strtoull(sep + 1, &end, 16);
+                if (end == sep + 1 || *end != '\0' || vendor_id > G_MAXUINT32) {
+                        return FALSE;
+                }
+                route.vendor_id = (guint32)vendor_id;
+        }
+
+        g_array_append_val(header->routes, route);
+        return TRUE;
+}
+
+/**
+ * ldm_modalias_header_parse_line:
+ *
+ * Handle one header line. Unknown keys are skipped for the benefit of
+ * later versions.
+ */
+static gboolean ldm_modalias_header_parse_line(LdmModaliasHeader *header, const gchar *line,
+                                               gboolean *have_routes)
+{
+        if (g_str_has_prefix(line, LDM_MODALIAS_HEADER_ROUTES)) {
+                g_auto(GStrv) tokens = NULL;
+
+                tokens = g_strsplit(line + strlen(LDM_MODALIAS_HEADER_ROUTES), " ", -1);
+                for (guint i = 0; tokens[i]; i++) {
+                        if (*tokens[i] == '\0') {
+                                continue;
+                        }
+                        if (!ldm_modalias_header_parse_route(header, tokens[i])) {
+                                return FALSE;
+                        }
+                }
+                *have_routes = TRUE;
+        } else if (g_str_has_prefix(line, LDM_MODALIAS_HEADER_ALIASES)) {
+                header->n_aliases = (guint)strtoul(line + strlen(LDM_MODALIAS_HEADER_ALIASES),
+                                                   NULL,
+                                                   10);
+        } else if (g_str_has_prefix(line, LDM_MODALIAS_HEADER_CHECKSUM)) {
+                g_free(header->checksum);
+                header->checksum =
+                    g_strstrip(g_strdup(line + strlen(LDM_MODALIAS_HEADER_CHECKSUM)));
+        }
+
+        return TRUE;
+}
+
+/**
+ * ldm_modalias_header_parse:
+ * @header: (out caller-allocates): Storage for the header
+ * @data: Contents of a modaliases file, not necessarily nul terminated
+ * @len: Length of the contents
+ *
+ * Read the header at the start of the contents, stopping at the first line
+ * that doesn't belong to it. Only the first few lines of the file are ever
+ * touched. The header must be cleared with #ldm_modalias_header_clear,
+ * whatever the result.
+ *
+ * Returns: TRUE if a usable header was found
+ */
+gboolean ldm_modalias_header_parse(LdmModaliasHeader *header, const gchar *data, gsize len)
+{
+        const gchar *end = data + len;
+        const gchar *line = data;
+        gboolean have_routes = FALSE;
+
+        memset(header, 0, sizeof(*header));
+        header->routes = g_array_new(FALSE, FALSE, sizeof(LdmRoute));
+
+        while (line < end) {
+                g_autofree gchar *copy = NULL;
+                const gchar *stop = memchr(line, '\n', (gsize)(end - line));
+
+                if (!stop) {
+                        stop = end;
+                }
+                if ((gsize)(stop - line) < strlen(LDM_MODALIAS_HEADER_PREFIX) ||
+                    strncmp(line, LDM_MODALIAS_HEADER_PREFIX, strlen(LDM_MODALIAS_HEADER_PREFIX)) !=
+                        0) {
+                        break;
+                }
+
+                copy = g_strndup(line, (gsize)(stop - line));
+                if (!ldm_modalias_header_parse_line(header, g_strchomp(copy), &have_routes)) {
+                        return FALSE;
+                }
+
+                line = stop < end ? stop + 1 : end;
+        }
+
+        header->body_offset = (gsize)(line - data);
+        return have_routes;
+}
+
+/**
+ * ldm_modalias_header_clear:
+ *
+ * Free the contents of the header, but not the header itself
+ */
+void ldm_modalias_header_clear(LdmModaliasHeader *header)
+{
+        g_clear_pointer(&header->routes, g_array_unref);
+        g_clear_pointer(&header->checksum, g_free);
+}
+
+/**
+ * ldm_modalias_header_covers:
+ * @route: Route of a device modalias
+ *
+ * Returns: TRUE if any alias of the file could match a device on the route
+ */
+gboolean ldm_modalias_header_covers(const LdmModaliasHeader *header, const LdmRoute *route)
+{
+        if (header->any_bus) {
+                return TRUE;
+        }
+
+        for (guint i = 0; i < header->routes->len; i++) {
+                const LdmRoute *covered = &g_array_index(header->routes, LdmRoute, i);
+
+                if (covered->bus != route->bus) {
+                        continue;
+                }
+                if (covered->any_vendor || route->any_vendor ||
+                    covered->vendor_id == route->vendor_id) {
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+/**
+ * ldm_modalias_header_checksum:
+ * @body: Everything following the header
+ *
+ * Returns: (transfer full): The checksum as it appears in a header
+ */
+gchar *ldm_modalias_header_checksum(const gchar *body, gsize len)
+{
+        g_autoptr(GChecksum) checksum = ldm_modalias_header_checksum_new();
+
+        g_checksum_update(checksum, (const guchar *)body, (gssize)len);
+        return ldm_modalias_header_checksum_format(checksum);
+}
+
+/**
+ * ldm_modalias_header_checksum_new:
+ *
+ * Begin a checksum of a body read in pieces, see
+ * #ldm_modalias_header_checksum_format
+ *
+ * Returns: (transfer full): A new checksum
+ */
+GChecksum *ldm_modalias_header_checksum_new(void)
+{
+        return g_checksum_new(G_CHECKSUM_SHA256);
+}
+
+/**
+ * ldm_modalias_header_checksum_format:
+ * @checksum: Checksum of the whole body
+ *
+ * Returns: (transfer full): The checksum as it appears in a header
+ */
+gchar *ldm_modalias_header_checksum_format(GChecksum *checksum)
+{
+        return g_strdup_printf("sha256:%s", g_checksum_get_string(checksum));
+}
+
+/**
+ * ldm_modalias_header_write:
+ * @routes: (element-type LdmRoute): Routes covered by the aliases
+ * @any_bus: Whether an alias could not be routed
+ * @n_aliases: Number of aliases in the body
+ * @body: The aliases that will follow the header
+ *
+ * Append a complete header for the body to @out
+ */
+void ldm_modalias_header_write(GString *out, GArray *routes, gboolean any_bus, guint n_aliases,
+                               const gchar *body, gsize len)
+{
+        g_autofree gchar *checksum = NULL;
+
+        g_string_append(out, LDM_MODALIAS_HEADER_ROUTES);
+        if (any_bus) {
+                g_string_append(out, " *");
+        }
+        for (guint i = 0; i < routes->len; i++) {
+                const LdmRoute *route = &g_array_index(routes, LdmRoute, i);
+
+                if (route->any_vendor) {
+                        g_string_append_printf(out, " %s:*", route->bus);
+                } else {
+                        g_string_append_printf(out, " %s:%08X", route->bus, route->vendor_id);
+                }
+        }
+        g_string_append_c(out, '\n');
+
+        g_string_append_printf(out, "%s %u\n", LDM_MODALIAS_HEADER_ALIASES, n_aliases);
+
+        checksum = ldm_modalias_header_checksum(body, len);
+        g_string_append_printf(out, "%s %s\n", LDM_MODALIAS_HEADER_CHECKSUM, checksum);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
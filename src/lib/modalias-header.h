@@ -0,0 +1,71 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+#include "route.h"
+
+/*
+ * LdmModaliasHeader
+ *
+ * Optional block of comments at the very start of a .modaliases file, as
+ * written by mkmodaliases, i.e.
+ *
+ *      # ldm-routes: pci:000010DE usb:*
+ *      # ldm-aliases: 612
+ *      # ldm-checksum: sha256:...
+ *
+ * The routes are the (bus, vendor) keys covered by the aliases in the file,
+ * with `bus:*` covering every vendor on the bus and a lone `*` standing for
+ * an alias that could match on any bus. Older readers see plain comments.
+ *
+ * The checksum covers everything following the header. Loading a file only
+ * compares the alias count, which comes free with the parse, while
+ * `mkmodaliases --verify` hashes the body to check the checksum too.
+ */
+typedef struct LdmModaliasHeader {
+        GArray *routes;    /* LdmRoute */
+        gboolean any_bus;  /* Some alias can't be routed */
+        guint n_aliases;   /* Number of aliases declared */
+        gchar *checksum;   /* "sha256:<hex>" of the body */
+        gsize body_offset; /* Start of the aliases following the header */
+} LdmModaliasHeader;
+
+/* Every header line shares this prefix, anything else ends the header */
+#define LDM_MODALIAS_HEADER_PREFIX "# ldm-"
+
+#define LDM_MODALIAS_HEADER_ROUTES "# ldm-routes:"
+#define LDM_MODALIAS_HEADER_ALIASES "# ldm-aliases:"
+#define LDM_MODALIAS_HEADER_CHECKSUM "# ldm-checksum:"
+
+gboolean ldm_modalias_header_parse(LdmModaliasHeader *header, const gchar *data, gsize len);
+void ldm_modalias_header_clear(LdmModaliasHeader *header);
+gboolean ldm_modalias_header_covers(const LdmModaliasHeader *header, const LdmRoute *route);
+gchar *ldm_modalias_header_checksum(const gchar *body, gsize len);
+GChecksum *ldm_modalias_header_checksum_new(void);
+gchar *ldm_modalias_header_checksum_format(GChecksum *checksum);
+void ldm_modalias_header_write(GString *out, GArray *routes, gboolean any_bus, guint n_aliases,
+                               const gchar *body, gsize len);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,633 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <string.h>
+
+#include "config.h"
+#include "modalias-stream.h"
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+/* Bytes read from the file, and decompressed, at a time */
+#define LDM_MODALIAS_STREAM_CHUNK (64 * 1024)
+
+/* Compression used by mkmodaliases, where size matters more than time */
+#define LDM_MODALIAS_ZSTD_LEVEL 19
+
+static const gchar *ldm_modalias_suffixes[LDM_N_MODALIAS_COMPRESSIONS] = {
+        [LDM_MODALIAS_COMPRESSION_NONE] = ".modaliases",
+        [LDM_MODALIAS_COMPRESSION_GZIP] = ".modaliases.gz",
+        [LDM_MODALIAS_COMPRESSION_ZSTD] = ".modaliases.zst",
+};
+
+struct LdmModaliasStream {
+        LdmModaliasCompression compression;
+        gchar *path;
+        FILE *fp;
+
+        gboolean eof;   /* Nothing left to read from the file */
+        gboolean ended; /* Decompressor saw the end of a complete frame */
+
+        guchar in[LDM_MODALIAS_STREAM_CHUNK];
+        gsize in_len;
+
+        /* Decompressed bytes not yet handed out as lines */
+        gchar out[LDM_MODALIAS_STREAM_CHUNK];
+        gsize out_pos;
+        gsize out_len;
+
+#ifdef HAVE_ZLIB
+        z_stream zlib;
+        gboolean zlib_ready;
+#endif
+#ifdef HAVE_ZSTD
+        ZSTD_DStream *zstd;
+        ZSTD_inBuffer zstd_in;
+#endif
+};
+
+/**
+ * ldm_modalias_compression_for_path:
+ * @compression: (out): Compression given by the suffix
+ *
+ * Returns: TRUE if the path has one of the .modaliases suffixes
+ */
+gboolean ldm_modalias_compression_for_path(const gchar *path, LdmModaliasCompression *compression)
+{
+        for (guint i = 0; i < LDM_N_MODALIAS_COMPRESSIONS; i++) {
+                if (g_str_has_suffix(path, ldm_modalias_suffixes[i])) {
+                        *compression = (LdmModaliasCompression)i;
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+/**
+ * ldm_modalias_compression_is_supported:
+ *
+ * Returns: TRUE if this build can read and write the compression
+ */
+gboolean ldm_modalias_compression_is_supported(LdmModaliasCompression compression)
+{
+        switch (compression) {
+        case LDM_MODALIAS_COMPRESSION_NONE:
+                return TRUE;
+#ifdef HAVE_ZLIB
+        case LDM_MODALIAS_COMPRESSION_GZIP:
+                return TRUE;
+#endif
+#ifdef HAVE_ZSTD
+        case LDM_MODALIAS_COMPRESSION_ZSTD:
+                return TRUE;
+#endif
+        default:
+                return FALSE;
+        }
+}
+
+const gchar *ldm_modalias_compression_get_suffix(LdmModaliasCompression compression)
+{
+        g_return_val_if_fail(compression < LDM_N_MODALIAS_COMPRESSIONS, NULL);
+
+        return ldm_modalias_suffixes[compression];
+}
+
+/**
+ * ldm_modalias_path_get_stem:
+ *
+ * Returns: (transfer full) (nullable): The path without its .modaliases
+ * suffix, or NULL if it has none
+ */
+gchar *ldm_modalias_path_get_stem(const gchar *path)
+{
+        LdmModaliasCompression compression = LDM_MODALIAS_COMPRESSION_NONE;
+
+        if (!ldm_modalias_compression_for_path(path, &compression)) {
+                return NULL;
+        }
+
+        return g_strndup(path, strlen(path) - strlen(ldm_modalias_suffixes[compression]));
+}
+
+static void ldm_modalias_stream_set_errno(LdmModaliasStream *self, GError **error, int err)
+{
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    g_file_error_from_errno(err),
+                    "Failed to read %s: %s",
+                    self->path,
+                    strerror(err));
+}
+
+static void ldm_modalias_stream_set_corrupt(LdmModaliasStream *self, GError **error,
+                                            const gchar *reason)
+{
+        g_set_error(error,
+                    G_FILE_ERROR,
+                    G_FILE_ERROR_FAILED,
+                    "Failed to decompress %s: %s",
+                    self->path,
+                    reason);
+}
+
+/**
+ * ldm_modalias_stream_open:
+ * @path: Path to a .modaliases file, compressed or not
+ *
+ * Returns: (transfer full) (nullable): A new stream, or NULL if the file
+ * can't be opened or its compression isn't supported by this build
+ */
+LdmModaliasStream *ldm_modalias_stream_open(const gchar *path, GError **error)
+{
+        g_autoptr(LdmModaliasStream) self = NULL;
+        LdmModaliasCompression compression = LDM_MODALIAS_COMPRESSION_NONE;
+
+        g_return_val_if_fail(path != NULL, NULL);
+
+        /* Anything else is read as is */
+        ldm_modalias_compression_for_path(path, &compression);
+        if (!ldm_modalias_compression_is_supported(compression)) {
+                g_set_error(error,
+                            G_FILE_ERROR,
+                            G_FILE_ERROR_NOSYS,
+                            "Cannot read %s: %s support was not built",
+                            path,
+                            compression == LDM_MODALIAS_COMPRESSION_GZIP ? "gzip" : "zstd");
+                return NULL;
+        }
+
+        self = g_new0(LdmModaliasStream, 1);
+        self->compression = compression;
+        self->path = g_strdup(path);
+
+        self->fp = fopen(path, "r");
+        if (!self->fp) {
+                ldm_modalias_stream_set_errno(self, error, errno);
+                return NULL;
+        }
+
+        switch (compression) {
+#ifdef HAVE_ZLIB
+        case LDM_MODALIAS_COMPRESSION_GZIP:
+                /* Only accept the gzip wrapper */
+                if (inflateInit2(&self->zlib, 16 + MAX_WBITS) != Z_OK) {
+                        ldm_modalias_stream_set_corrupt(self, error, "zlib initialisation failed");
+                        return NULL;
+                }
+                self->zlib_ready = TRUE;
+                break;
+#endif
+#ifdef HAVE_ZSTD
+        case LDM_MODALIAS_COMPRESSION_ZSTD:
+                self->zstd = ZSTD_createDStream();
+                if (!self->zstd || ZSTD_isError(ZSTD_initDStream(self->zstd))) {
+                        ldm_modalias_stream_set_corrupt(self, error, "zstd initialisation failed");
+                        return NULL;
+                }
+                break;
+#endif
+        default:
+                break;
+        }
+
+        return g_steal_pointer(&self);
+}
+
+void ldm_modalias_stream_free(LdmModaliasStream *self)
+{
+        if (!self) {
+                return;
+        }
+
+#ifdef HAVE_ZLIB
+        if (self->zlib_ready) {
+                inflateEnd(&self->zlib);
+        }
+#endif
+#ifdef HAVE_ZSTD
+        if (self->zstd) {
+                ZSTD_freeDStream(self->zstd);
+        }
+#endif
+        if (self->fp) {
+                fclose(self->fp);
+        }
+        g_free(self->path);
+        g_free(self);
+}
+
+/**
+ * ldm_modalias_stream_read_input:
+ *
+ * Read the next chunk of the file, setting eof once it's exhausted
+ */
+static gboolean ldm_modalias_stream_read_input(LdmModaliasStream *self, GError **error)
+{
+        self->in_len = fread(self->in, 1, sizeof(self->in), self->fp);
+        if (self->in_len < sizeof(self->in)) {
+                if (ferror(self->fp)) {
+                        ldm_modalias_stream_set_errno(self, error, errno);
+                        return FALSE;
+                }
+                self->eof = TRUE;
+        }
+
+        return TRUE;
+}
+
+#ifdef HAVE_ZLIB
+static gssize ldm_modalias_stream_fill_gzip(LdmModaliasStream *self, GError **error)
+{
+        for (;;) {
+                gsize produced = 0;
+                int ret = 0;
+
+                if (self->zlib.avail_in == 0 && !self->eof) {
+                        if (!ldm_modalias_stream_read_input(self, error)) {
+                                return -1;
+                        }
+                        self->zlib.next_in = self->in;
+                        self->zlib.avail_in = (uInt)self->in_len;
+                }
+
+                if (self->ended) {
+                        if (self->zlib.avail_in == 0 && self->eof) {
+                                return 0;
+                        }
+                        /* Concatenated gzip members form a single file */
+                        inflateReset(&self->zlib);
+                        self->ended = FALSE;
+                }
+
+                self->zlib.next_out = (Bytef *)self->out;
+                self->zlib.avail_out = (uInt)sizeof(self->out);
+
+                ret = inflate(&self->zlib, Z_NO_FLUSH);
+                if (ret == Z_STREAM_END) {
+                        self->ended = TRUE;
+                } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                        ldm_modalias_stream_set_corrupt(self,
+                                                        error,
+                                                        self->zlib.msg ? self->zlib.msg
+                                                                       : "invalid data");
+                        return -1;
+                }
+
+                produced = sizeof(self->out) - self->zlib.avail_out;
+                if (produced > 0) {
+                        return (gssize)produced;
+                }
+                if (!self->ended && self->zlib.avail_in == 0 && self->eof) {
+                        ldm_modalias_stream_set_corrupt(self, error, "unexpected end of file");
+                        return -1;
+                }
+        }
+}
+#endif
+
+#ifdef HAVE_ZSTD
+static gssize ldm_modalias_stream_fill_zstd(LdmModaliasStream *self, GError **error)
+{
+        for (;;) {
+                ZSTD_outBuffer output = { self->out, sizeof(self->out), 0 };
+                size_t ret = 0;
+
+                if (self->zstd_in.pos == self->zstd_in.size && !self->eof) {
+                        if (!ldm_modalias_stream_read_input(self, error)) {
+                                return -1;
+                        }
+                        self->zstd_in.src = self->in;
+                        self->zstd_in.size = self->in_len;
+                        self->zstd_in.pos = 0;
+                }
+
+                if (self->ended && self->zstd_in.pos == self->zstd_in.size && self->eof) {
+                        return 0;
+                }
+
+                /* Frames follow one another without a reset */
+                ret = ZSTD_decompressStream(self->zstd, &output, &self->zstd_in);
+                if (ZSTD_isError(ret)) {
+                        ldm_modalias_stream_set_corrupt(self, error, ZSTD_getErrorName(ret));
+                        return -1;
+                }
+                self->ended = ret == 0;
+
+                if (output.pos > 0) {
+                        return (gssize)output.pos;
+                }
+                if (!self->ended && self->zstd_in.pos == self->zstd_in.size && self->eof) {
+                        ldm_modalias_stream_set_corrupt(self, error, "unexpected end of file");
+                        return -1;
+                }
+        }
+}
+#endif
+
+/**
+ * ldm_modalias_stream_fill:
+ *
+ * Returns: Number of bytes now in the output buffer, 0 at the end of the
+ * file, or -1 on error
+ */
+static gssize ldm_modalias_stream_fill(LdmModaliasStream *self, GError **error)
+{
+        gsize filled = 0;
+
+        switch (self->compression) {
+#ifdef HAVE_ZLIB
+        case LDM_MODALIAS_COMPRESSION_GZIP:
+                return ldm_modalias_stream_fill_gzip(self, error);
+#endif
+#ifdef HAVE_ZSTD
+        case LDM_MODALIAS_COMPRESSION_ZSTD:
+                return ldm_modalias_stream_fill_zstd(self, error);
+#endif
+        default:
+                /* Plain files go straight to the output buffer */
+                if (self->eof) {
+                        return 0;
+                }
+                filled = fread(self->out, 1, sizeof(self->out), self->fp);
+                if (filled < sizeof(self->out)) {
+                        if (ferror(self->fp)) {
+                                ldm_modalias_stream_set_errno(self, error, errno);
+                                return -1;
+                        }
+                        self->eof = TRUE;
+                }
+                return (gssize)filled;
+        }
+}
+
+/**
+ * ldm_modalias_stream_read_line:
+ * @line: Storage for the line, including its newline if it has one
+ *
+ * Read the next line of the file. At the end of the file @line is left
+ * empty and FALSE is returned without setting @error.
+ *
+ * Returns: TRUE if a line was read
+ */
+gboolean ldm_modalias_stream_read_line(LdmModaliasStream *self, GString *line, GError **error)
+{
+        g_string_truncate(line, 0);
+
+        for (;;) {
+                const gchar *start = NULL;
+                const gchar *newline = NULL;
+                gsize available = 0;
+
+                if (self->out_pos == self->out_len) {
+                        gssize filled = ldm_modalias_stream_fill(self, error);
+
+                        if (filled < 0) {
+                                g_string_truncate(line, 0);
+                                return FALSE;
+                        }
+                        if (filled == 0) {
+                                return line->len > 0;
+                        }
+                        self->out_pos = 0;
+                        self->out_len = (gsize)filled;
+                }
+
+                start = self->out + self->out_pos;
+                available = self->out_len - self->out_pos;
+                newline = memchr(start, '\n', available);
+                if (newline) {
+                        available = (gsize)(newline - start) + 1;
+                }
+
+                g_string_append_len(line, start, (gssize)available);
+                self->out_pos += available;
+
+                if (newline) {
+                        return TRUE;
+                }
+        }
+}
+
+/**
+ * ldm_modalias_stream_read_header:
+ * @header: (out caller-allocates): Storage for the header
+ * @line: Storage for the first line following the header
+ *
+ * Read the header at the start of the stream, as with
+ * #ldm_modalias_header_parse, leaving the first line of the body in @line.
+ * The header must be zeroed beforehand, and cleared with
+ * #ldm_modalias_header_clear whatever the result.
+ *
+ * Returns: TRUE if a usable header was found
+ */
+gboolean ldm_modalias_stream_read_header(LdmModaliasStream *self, LdmModaliasHeader *header,
+                                         GString *line, GError **error)
+{
+        g_autoptr(GString) text = g_string_new(NULL);
+        g_autoptr(GError) local_error = NULL;
+
+        while (ldm_modalias_stream_read_line(self, line, &local_error)) {
+                if (!g_str_has_prefix(line->str, LDM_MODALIAS_HEADER_PREFIX)) {
+                        break;
+                }
+                g_string_append_len(text, line->str, (gssize)line->len);
+        }
+
+        if (local_error) {
+                g_propagate_error(error, g_steal_pointer(&local_error));
+                return FALSE;
+        }
+
+        return ldm_modalias_header_parse(header, text->str, text->len);
+}
+
+/**
+ * ldm_modalias_stream_verify:
+ * @path: Path to a possibly compressed modaliases file
+ *
+ * Check that the header of the file still describes its body, i.e. that
+ * the declared alias count and checksum match. This hashes the whole body,
+ * so it is meant for tools checking files rather than for every load.
+ *
+ * Returns: TRUE if the header matches, or there is no header at all
+ */
+gboolean ldm_modalias_stream_verify(const gchar *path, GError **error)
+{
+        g_autoptr(LdmModaliasStream) stream = NULL;
+        g_autoptr(GChecksum) checksum = NULL;
+        g_autoptr(GString) line = NULL;
+        g_autoptr(GError) local_error = NULL;
+        g_autofree gchar *digest = NULL;
+        LdmModaliasHeader header = { 0 };
+        gboolean ret = FALSE;
+        guint n_aliases = 0;
+
+        stream = ldm_modalias_stream_open(path, error);
+        if (!stream) {
+                return FALSE;
+        }
+
+        line = g_string_new(NULL);
+        if (!ldm_modalias_stream_read_header(stream, &header, line, &local_error)) {
+                ret = local_error == NULL;
+                goto cleanup;
+        }
+
+        checksum = ldm_modalias_header_checksum_new();
+        while (!local_error && line->len > 0) {
+                g_checksum_update(checksum, (const guchar *)line->str, (gssize)line->len);
+                if (g_str_has_prefix(line->str, "alias ")) {
+                        ++n_aliases;
+                }
+                ldm_modalias_stream_read_line(stream, line, &local_error);
+        }
+
+        if (local_error) {
+                goto cleanup;
+        }
+
+        digest = ldm_modalias_header_checksum_format(checksum);
+        if (header.n_aliases != n_aliases || g_strcmp0(header.checksum, digest) != 0) {
+                g_set_error(error,
+                            G_FILE_ERROR,
+                            G_FILE_ERROR_INVAL,
+                            "header declares %u aliases (%s), body has %u (%s)",
+                            header.n_aliases,
+                            header.checksum ? header.checksum : "no checksum",
+                            n_aliases,
+                            digest);
+                goto cleanup;
+        }
+
+        ret = TRUE;
+
+cleanup:
+        if (local_error) {
+                g_propagate_error(error, g_steal_pointer(&local_error));
+        }
+        ldm_modalias_header_clear(&header);
+        return ret;
+}
+
+/**
+ * ldm_modalias_write_compressed:
+ * @data: Complete contents of a .modaliases file
+ *
+ * Write the contents to the file with the given compression
+ *
+ * Returns: TRUE if everything was written
+ */
+gboolean ldm_modalias_write_compressed(FILE *fileh, LdmModaliasCompression compression,
+                                       const gchar *data, gsize len, GError **error)
+{
+        g_autofree guchar *out = NULL;
+        gsize out_len = 0;
+
+        switch (compression) {
+        case LDM_MODALIAS_COMPRESSION_NONE:
+                out_len = len;
+                break;
+#ifdef HAVE_ZLIB
+        case LDM_MODALIAS_COMPRESSION_GZIP: {
+                z_stream zlib = { 0 };
+                int ret = 0;
+
+                if (len > G_MAXUINT ||
+                    deflateInit2(&zlib,
+                                 Z_BEST_COMPRESSION,
+                                 Z_DEFLATED,
+                                 16 + MAX_WBITS,
+                                 8,
+                                 Z_DEFAULT_STRATEGY) != Z_OK) {
+                        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "gzip failed");
+                        return FALSE;
+                }
+
+                out_len = deflateBound(&zlib, (uLong)len);
+                out = g_malloc(out_len);
+                zlib.next_in = (Bytef *)data;
+                zlib.avail_in = (uInt)len;
+                zlib.next_out = out;
+                zlib.avail_out = (uInt)out_len;
+
+                ret = deflate(&zlib, Z_FINISH);
+                out_len = zlib.total_out;
+                deflateEnd(&zlib);
+
+                if (ret != Z_STREAM_END) {
+                        g_set_error(error, G_FILE_ERROR, G_FILE_ERROR_FAILED, "gzip failed");
+                        return FALSE;
+                }
+                break;
+        }
+#endif
+#ifdef HAVE_ZSTD
+        case LDM_MODALIAS_COMPRESSION_ZSTD: {
+                size_t ret = 0;
+
+                out = g_malloc(ZSTD_compressBound(len));
+                ret = ZSTD_compress(out, ZSTD_compressBound(len), data, len, LDM_MODALIAS_ZSTD_LEVEL);
+                if (ZSTD_isError(ret)) {
+                        g_set_error(error,
+                                    G_FILE_ERROR,
+                                    G_FILE_ERROR_FAILED,
+                                    "zstd failed: %s",
+                                    ZSTD_getErrorName(ret));
+                        return FALSE;
+                }
+                out_len = ret;
+                break;
+        }
+#endif
+        default:
+                g_set_error(error,
+                            G_FILE_ERROR,
+                            G_FILE_ERROR_NOSYS,
+                            "Compression to %s was not built",
+                            ldm_modalias_compression_get_suffix(compression));
+                return FALSE;
+        }
+
+        if (fwrite(out ? (const gchar *)out : data, 1, out_len, fileh) != out_len) {
+                g_set_error(error,
+                            G_FILE_ERROR,
+                            g_file_error_from_errno(errno),
+                            "Failed to write: %s",
+                            strerror(errno));
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,70 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include <stdio.h>
+
+#include "modalias-header.h"
+
+/*
+ * LdmModaliasCompression
+ *
+ * Compression of a .modaliases file, as given by its suffix. Support for
+ * each compressor is optional at build time.
+ */
+typedef enum {
+        LDM_MODALIAS_COMPRESSION_NONE = 0, /* .modaliases */
+        LDM_MODALIAS_COMPRESSION_GZIP,     /* .modaliases.gz */
+        LDM_MODALIAS_COMPRESSION_ZSTD,     /* .modaliases.zst */
+        LDM_N_MODALIAS_COMPRESSIONS,
+} LdmModaliasCompression;
+
+/*
+ * LdmModaliasStream
+ *
+ * Sequential reader for a possibly compressed .modaliases file. Compressed
+ * files are decompressed a chunk at a time as lines are read, so neither
+ * the whole file nor a temporary copy of it is ever needed.
+ */
+typedef struct LdmModaliasStream LdmModaliasStream;
+
+gboolean ldm_modalias_compression_for_path(const gchar *path,
+                                           LdmModaliasCompression *compression);
+gboolean ldm_modalias_compression_is_supported(LdmModaliasCompression compression);
+const gchar *ldm_modalias_compression_get_suffix(LdmModaliasCompression compression);
+gchar *ldm_modalias_path_get_stem(const gchar *path);
+
+LdmModaliasStream *ldm_modalias_stream_open(const gchar *path, GError **error);
+void ldm_modalias_stream_free(LdmModaliasStream *stream);
+gboolean ldm_modalias_stream_read_line(LdmModaliasStream *stream, GString *line, GError **error);
+gboolean ldm_modalias_stream_read_header(LdmModaliasStream *stream, LdmModaliasHeader *header,
+                                         GString *line, GError **error);
+gboolean ldm_modalias_stream_verify(const gchar *path, GError **error);
+
+gboolean ldm_modalias_write_compressed(FILE *fileh, LdmModaliasCompression compression,
+                                       const gchar *data, gsize len, GError **error);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LdmModaliasStream, ldm_modalias_stream_free)
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -11,8 +11,10 @@
 
 #define _GNU_SOURCE
 
-#include <fnmatch.h>
+#include <string.h>
 
+#include "ldm-private.h"
+#include "modalias-private.h"
 #include "modalias.h"
 #include "util.h"
 
@@ -56,12 +58,19 @@ struct _LdmModaliasClass {
  * #LdmModalias:driver and #LdmModalias:package fields what the end user would
  * need to have installed on their system for the #LdmModalias:driver to be
  * activated. This helps immensely in detecting support for drivers.
+ *
+ * Most matches consist only of whole-field literals and `*`, following the
+ * fixed field grammar of the PCI, USB and HID buses. These are decomposed into
+ * numeric fields with per-field wildcard masks on construction, and compared
+ * against the equally decomposed device modalias with integer operations.
+ * `fnmatch` is only used for irregular matches, such as ranges.
  */
 struct _LdmModalias {
         GInitiallyUnowned parent;
 
         /* What do we match? */
         gchar *match;
+        LdmModaliasFields fields;
 
         /* What kernel driver enables this? */
         gchar *driver;
@@ -160,6 +169,10 @@ static void ldm_modalias_set_property(GObject *object, guint id, const GValue *v
         case PROP_MATCH:
                 g_clear_pointer(&self->match, g_free);
                 self->match = g_value_dup_string(value);
+                memset(&self->fields, 0, sizeof(self->fields));
+                if (self->match) {
+                        ldm_modalias_fields_parse_pattern(&self->fields, self->match);
+                }
                 break;
         case PROP_DRIVER:
                 g_clear_pointer(&self->driver, g_free);
@@ -276,12 +289,39 @@ const gchar *ldm_modalias_get_package(LdmModalias *self)
  * Returns: True if the match_string is indeed a match
  */
 gboolean ldm_modalias_matches(LdmModalias *self, const gchar *match_string)
+{
+        LdmModaliasFields fields = { 0 };
+
+        g_return_val_if_fail(self != NULL, FALSE);
+        g_return_val_if_fail(self->match != NULL, FALSE);
+        g_return_val_if_fail(match_string != NULL, FALSE);
+
+        /* Only worth decomposing the subject if we can use it */
+        if (self->fields.bus) {
+                ldm_modalias_fields_parse(&fields, match_string);
+        }
+
+        return ldm_modalias_matches_fields(self, match_string, &fields);
+}
+
+/**
+ * ldm_modalias_matches_fields:
+ * @match_string: Device modalias to test against
+ * @fields: (nullable): The match_string decomposed by #ldm_modalias_fields_parse
+ *
+ * Test the device modalias by comparing fields where possible, falling back
+ * to fnmatch for irregular matches or modaliases.
+ *
+ * Returns: True if the match_string is indeed a match
+ */
+gboolean ldm_modalias_matches_fields(LdmModalias *self, const gchar *match_string,
+                                     const LdmModaliasFields *fields)
 {
         g_return_val_if_fail(self != NULL, FALSE);
         g_return_val_if_fail(self->match != NULL, FALSE);
         g_return_val_if_fail(match_string != NULL, FALSE);
 
-        return fnmatch(self->match, match_string, 0) == 0 ? TRUE : FALSE;
+        return ldm_modalias_fields_matches(self->match, &self->fields, match_string, fields);
 }
 
 /**
@@ -302,7 +342,7 @@ gboolean ldm_modalias_matches_device(LdmModalias *self, LdmDevice *match_device)
 
         /* Root match? */
         id = ldm_device_get_modalias(match_device);
-        if (id && ldm_modalias_matches(self, id)) {
+        if (id && ldm_modalias_matches_fields(self, id, &match_device->os.modalias_fields)) {
                 return TRUE;
         }
 
@@ -0,0 +1,438 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <libkmod.h>
+#include <string.h>
+#include <sys/utsname.h>
+
+#include "module-resolver.h"
+#include "provider-private.h"
+#include "util.h"
+
+typedef struct kmod_ctx kmod_ctx;
+typedef struct kmod_list kmod_list;
+
+DEF_AUTOFREE(kmod_list, kmod_module_unref_list)
+
+struct _LdmModuleResolverClass {
+        GObjectClass parent_class;
+};
+
+/**
+ * SECTION:module-resolver
+ * @Short_description: Kernel module availability
+ * @see_also: #LdmProvider
+ * @Title: LdmModuleResolver
+ *
+ * An LdmModuleResolver works out whether the kernel module behind an
+ * #LdmProvider, i.e. the #LdmModalias:driver, is already available on the
+ * system. This allows front-ends to skip recommending packages for drivers
+ * that are already present.
+ *
+ * Modules are found through the libkmod indexes (`modules.dep.bin`,
+ * `modules.alias.bin` and `modules.builtin.bin`) of a single kernel
+ * release, by default the running kernel. Index lookups are cached for
+ * the lifetime of the resolver, as they can't change for a release. The
+ * set of loaded modules is read from `/proc/modules` once, when first
+ * needed, and only read again by #ldm_module_resolver_refresh, so one
+ * resolver gives a consistent answer for a whole run.
+ */
+
+/*
+ * LdmModuleResolver
+ *
+ * Batch resolution of kernel module state for providers.
+ */
+struct _LdmModuleResolver {
+        GObject parent;
+
+        gchar *root;    /* Alternative root for all paths, NULL for the host */
+        gchar *release; /* Kernel release to resolve modules for */
+
+        kmod_ctx *kmod;       /* NULL if the release has no module directory */
+        GHashTable *installed; /* Module name -> GINT_TO_POINTER(LdmModuleState + 1) */
+        GHashTable *loaded;    /* Set of loaded module names, NULL until read */
+};
+
+static void ldm_module_resolver_set_property(GObject *object, guint id, const GValue *value,
+                                             GParamSpec *spec);
+static void ldm_module_resolver_get_property(GObject *object, guint id, GValue *value,
+                                             GParamSpec *spec);
+static void ldm_module_resolver_constructed(GObject *obj);
+
+G_DEFINE_TYPE(LdmModuleResolver, ldm_module_resolver, G_TYPE_OBJECT)
+
+/* Property IDs */
+enum { PROP_ROOT = 1, PROP_RELEASE, N_PROPS };
+
+static GParamSpec *obj_properties[N_PROPS] = {
+        NULL,
+};
+
+/**
+ * ldm_module_resolver_dispose:
+ *
+ * Clean up a LdmModuleResolver instance
+ */
+static void ldm_module_resolver_dispose(GObject *obj)
+{
+        LdmModuleResolver *self = LDM_MODULE_RESOLVER(obj);
+
+        g_clear_pointer(&self->root, g_free);
+        g_clear_pointer(&self->release, g_free);
+        g_clear_pointer(&self->kmod, kmod_unref);
+        g_clear_pointer(&self->installed, g_hash_table_unref);
+        g_clear_pointer(&self->loaded, g_hash_table_unref);
+
+        G_OBJECT_CLASS(ldm_module_resolver_parent_class)->dispose(obj);
+}
+
+/**
+ * ldm_module_resolver_class_init:
+ *
+ * Handle class initialisation
+ */
+static void ldm_module_resolver_class_init(LdmModuleResolverClass *klazz)
+{
+        GObjectClass *obj_class = G_OBJECT_CLASS(klazz);
+
+        /* gobject vtable hookup */
+        obj_class->constructed = ldm_module_resolver_constructed;
+        obj_class->dispose = ldm_module_resolver_dispose;
+        obj_class->get_property = ldm_module_resolver_get_property;
+        obj_class->set_property = ldm_module_resolver_set_property;
+
+        /**
+         * LdmModuleResolver:root
+         *
+         * Alternative root directory to find the module indexes and the
+         * list of loaded modules in. When unset, the host is used.
+         */
+        obj_properties[PROP_ROOT] = g_param_spec_string("root",
+                                                        "Root directory",
+                                                        "Root directory for the kernel modules",
+                                                        NULL,
+                                                        G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+        /**
+         * LdmModuleResolver:release
+         *
+         * The kernel release to resolve modules for, as in `uname -r`.
+         * When unset, the running kernel is used.
+         */
+        obj_properties[PROP_RELEASE] =
+            g_param_spec_string("release",
+                                "Kernel release",
+                                "Kernel release to resolve modules for",
+                                NULL,
+                                G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+        g_object_class_install_properties(obj_class, N_PROPS, obj_properties);
+}
+
+static void ldm_module_resolver_set_property(GObject *object, guint id, const GValue *value,
+                                             GParamSpec *spec)
+{
+        LdmModuleResolver *self = LDM_MODULE_RESOLVER(object);
+
+        switch (id) {
+        case PROP_ROOT:
+                g_free(self->root);
+                self->root = g_value_dup_string(value);
+                break;
+        case PROP_RELEASE:
+                g_free(self->release);
+                self->release = g_value_dup_string(value);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+                break;
+        }
+}
+
+static void ldm_module_resolver_get_property(GObject *object, guint id, GValue *value,
+                                             GParamSpec *spec)
+{
+        LdmModuleResolver *self = LDM_MODULE_RESOLVER(object);
+
+        switch (id) {
+        case PROP_ROOT:
+                g_value_set_string(value, self->root);
+                break;
+        case PROP_RELEASE:
+                g_value_set_string(value, self->release);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+                break;
+        }
+}
+
+/**
+ * ldm_module_resolver_init:
+ *
+ * Handle construction of the LdmModuleResolver
+ */
+static void ldm_module_resolver_init(LdmModuleResolver *self)
+{
+        self->installed = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+}
+
+/**
+ * ldm_module_resolver_build_path:
+ * @path: Absolute path on the host
+ *
+ * Returns: (transfer full): The path relative to our root
+ */
+static gchar *ldm_module_resolver_build_path(LdmModuleResolver *self, const gchar *path)
+{
+        if (!self->root) {
+                return g_strdup(path);
+        }
+        return g_build_filename(self->root, path, NULL);
+}
+
+/**
+ * ldm_module_resolver_constructed:
+ *
+ * Root and release are now known, so open the module indexes of the
+ * release up front. modprobe.d configuration is deliberately ignored, as
+ * only the modules shipped for the kernel matter here.
+ */
+static void ldm_module_resolver_constructed(GObject *obj)
+{
+        LdmModuleResolver *self = LDM_MODULE_RESOLVER(obj);
+        static const char *const no_config[] = { NULL };
+        g_autofree gchar *modules_dir = NULL;
+        g_autofree gchar *release_dir = NULL;
+        struct utsname uts = { 0 };
+
+        if (!self->release && uname(&uts) == 0) {
+                self->release = g_strdup(uts.release);
+        }
+
+        G_OBJECT_CLASS(ldm_module_resolver_parent_class)->constructed(obj);
+
+        if (!self->release) {
+                return;
+        }
+
+        modules_dir = ldm_module_resolver_build_path(self, "/lib/modules");
+        release_dir = g_build_filename(modules_dir, self->release, NULL);
+
+        self->kmod = kmod_new(release_dir, no_config);
+        if (!self->kmod) {
+                return;
+        }
+
+        /*
+         * Preloading fails if any one index is missing. libkmod then opens
+         * the index each lookup needs on demand, so keep the context, and a
+         * release without any indexes just finds nothing.
+         */
+        if (kmod_load_resources(self->kmod) < 0) {
+                g_debug("Not all module indexes for %s could be loaded", self->release);
+        }
+}
+
+/**
+ * ldm_module_resolver_new:
+ *
+ * Create a new LdmModuleResolver for the running kernel
+ *
+ * Returns: (transfer full): An #LdmModuleResolver instance.
+ */
+LdmModuleResolver *ldm_module_resolver_new()
+{
+        return g_object_new(LDM_TYPE_MODULE_RESOLVER, NULL);
+}
+
+/**
+ * ldm_module_resolver_get_release:
+ *
+ * Get the kernel release that modules are resolved for
+ *
+ * Returns: (transfer none) (nullable): The kernel release
+ */
+const gchar *ldm_module_resolver_get_release(LdmModuleResolver *self)
+{
+        g_return_val_if_fail(self != NULL, NULL);
+
+        return self->release;
+}
+
+/**
+ * ldm_module_resolver_normalize:
+ *
+ * Dashes and underscores are interchangeable in module names, the kernel
+ * reports them with underscores.
+ *
+ * Returns: (transfer full): Normalized module name
+ */
+static gchar *ldm_module_resolver_normalize(const gchar *module)
+{
+        return g_strdelimit(g_strdup(module), "-", '_');
+}
+
+/**
+ * ldm_module_resolver_read_loaded:
+ *
+ * Read the set of loaded modules in one read of `/proc/modules`
+ */
+static void ldm_module_resolver_read_loaded(LdmModuleResolver *self)
+{
+        g_autofree gchar *path = NULL;
+        g_autofree gchar *contents = NULL;
+        gsize length = 0;
+        const gchar *line = NULL;
+        const gchar *end = NULL;
+
+        if (self->loaded) {
+                g_hash_table_remove_all(self->loaded);
+        } else {
+                self->loaded = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+        }
+
+        path = ldm_module_resolver_build_path(self, "/proc/modules");
+        if (!g_file_get_contents(path, &contents, &length, NULL)) {
+                return;
+        }
+
+        /* Each line is "name size refcount deps state address", we want the name */
+        end = contents + length;
+        for (line = contents; line < end;) {
+                const gchar *eol = memchr(line, '\n', (gsize)(end - line));
+                const gchar *space = NULL;
+
+                if (!eol) {
+                        eol = end;
+                }
+
+                space = memchr(line, ' ', (gsize)(eol - line));
+                if (space && space > line) {
+                        g_hash_table_add(self->loaded, g_strndup(line, (gsize)(space - line)));
+                }
+
+                line = eol + 1;
+        }
+}
+
+/**
+ * ldm_module_resolver_find_installed:
+ *
+ * Look the module up in the indexes of the release, caching the answer.
+ * A module is installed if it is known to the dependency index, or is
+ * built into the kernel.
+ */
+static LdmModuleState ldm_module_resolver_find_installed(LdmModuleResolver *self,
+                                                         const gchar *module)
+{
+        autofree(kmod_list) *list = NULL;
+        gpointer cached = NULL;
+        LdmModuleState state = LDM_MODULE_STATE_MISSING;
+
+        cached = g_hash_table_lookup(self->installed, module);
+        if (cached) {
+                return (LdmModuleState)(GPOINTER_TO_INT(cached) - 1);
+        }
+
+        if (self->kmod && kmod_module_new_from_lookup(self->kmod, module, &list) == 0 && list) {
+                state = LDM_MODULE_STATE_INSTALLED;
+        }
+
+        g_hash_table_insert(self->installed, g_strdup(module), GINT_TO_POINTER(state + 1));
+
+        return state;
+}
+
+/**
+ * ldm_module_resolver_refresh:
+ *
+ * Read the loaded modules again, for long running users that need to see
+ * modules loaded or unloaded since the resolver first looked. The indexes
+ * of the release are unaffected.
+ */
+void ldm_module_resolver_refresh(LdmModuleResolver *self)
+{
+        g_return_if_fail(self != NULL);
+
+        ldm_module_resolver_read_loaded(self);
+}
+
+/**
+ * ldm_module_resolver_lookup:
+ * @module: Name of the kernel module, i.e. "nvidia"
+ *
+ * Find out whether the given kernel module is available. The loaded state
+ * is taken from the last time the loaded modules were read, see
+ * #ldm_module_resolver_refresh.
+ *
+ * Returns: The #LdmModuleState of the module
+ */
+LdmModuleState ldm_module_resolver_lookup(LdmModuleResolver *self, const gchar *module)
+{
+        g_autofree gchar *name = NULL;
+
+        g_return_val_if_fail(self != NULL, LDM_MODULE_STATE_MISSING);
+        g_return_val_if_fail(module != NULL, LDM_MODULE_STATE_MISSING);
+
+        if (!self->loaded) {
+                ldm_module_resolver_read_loaded(self);
+        }
+
+        name = ldm_module_resolver_normalize(module);
+        if (g_hash_table_contains(self->loaded, name)) {
+                return LDM_MODULE_STATE_INSTALLED | LDM_MODULE_STATE_LOADED;
+        }
+
+        return ldm_module_resolver_find_installed(self, name);
+}
+
+/**
+ * ldm_module_resolver_resolve:
+ * @providers: (element-type Ldm.Provider): Providers to resolve
+ *
+ * Update #LdmProvider:installed and #LdmProvider:loaded for every provider
+ * that has a #LdmProvider:driver. Every batch uses the same snapshot of the
+ * loaded modules, see #ldm_module_resolver_refresh.
+ */
+void ldm_module_resolver_resolve(LdmModuleResolver *self, GPtrArray *providers)
+{
+        g_return_if_fail(self != NULL);
+        g_return_if_fail(providers != NULL);
+
+        for (guint i = 0; i < providers->len; i++) {
+                LdmProvider *provider = providers->pdata[i];
+                const gchar *driver = NULL;
+
+                driver = ldm_provider_get_driver(provider);
+                if (!driver) {
+                        continue;
+                }
+
+                ldm_provider_set_module_state(provider, ldm_module_resolver_lookup(self, driver));
+        }
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,71 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LdmModuleResolver LdmModuleResolver;
+typedef struct _LdmModuleResolverClass LdmModuleResolverClass;
+
+/**
+ * LdmModuleState:
+ * @LDM_MODULE_STATE_MISSING: The module isn't available for the kernel
+ * @LDM_MODULE_STATE_INSTALLED: The module is installed, or built into the kernel
+ * @LDM_MODULE_STATE_LOADED: The module is currently loaded
+ *
+ * Availability of a kernel module. A loaded module is always considered
+ * to be installed too.
+ */
+typedef enum {
+        LDM_MODULE_STATE_MISSING = 0,
+        LDM_MODULE_STATE_INSTALLED = 1 << 0,
+        LDM_MODULE_STATE_LOADED = 1 << 1,
+} LdmModuleState;
+
+#define LDM_TYPE_MODULE_RESOLVER ldm_module_resolver_get_type()
+#define LDM_MODULE_RESOLVER(o)                                                                     \
+        (G_TYPE_CHECK_INSTANCE_CAST((o), LDM_TYPE_MODULE_RESOLVER, LdmModuleResolver))
+#define LDM_IS_MODULE_RESOLVER(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), LDM_TYPE_MODULE_RESOLVER))
+#define LDM_MODULE_RESOLVER_CLASS(o)                                                               \
+        (G_TYPE_CHECK_CLASS_CAST((o), LDM_TYPE_MODULE_RESOLVER, LdmModuleResolverClass))
+#define LDM_IS_MODULE_RESOLVER_CLASS(o) (G_TYPE_CHECK_CLASS_TYPE((o), LDM_TYPE_MODULE_RESOLVER))
+#define LDM_MODULE_RESOLVER_GET_CLASS(o)                                                           \
+        (G_TYPE_INSTANCE_GET_CLASS((o), LDM_TYPE_MODULE_RESOLVER, LdmModuleResolverClass))
+
+GType ldm_module_resolver_get_type(void);
+
+/* API */
+LdmModuleResolver *ldm_module_resolver_new(void);
+
+const gchar *ldm_module_resolver_get_release(LdmModuleResolver *resolver);
+LdmModuleState ldm_module_resolver_lookup(LdmModuleResolver *resolver, const gchar *module);
+void ldm_module_resolver_resolve(LdmModuleResolver *resolver, GPtrArray *providers);
+void ldm_module_resolver_refresh(LdmModuleResolver *resolver);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LdmModuleResolver, g_object_unref)
+
+G_END_DECLS
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
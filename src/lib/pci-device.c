@@ -16,6 +16,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "ldm-enums.h"
 #include "ldm-private.h"
 #include "pci-device.h"
 #include "util.h"
@@ -41,6 +42,11 @@ struct _LdmPCIDeviceClass {
  * The primary use case within LDM is to detect GPUs, which will all
  * carry the #LdmDevice:device-type of #LDM_DEVICE_TYPE_PCI | #LDM_DEVICE_TYPE_GPU.
  *
+ * Discrete GPUs in hybrid systems are often runtime suspended. Such devices are
+ * identified from the udev properties recorded for them, and only attributes
+ * that the kernel serves without resuming the device are read. The state found
+ * is available as #LdmPCIDevice:runtime-status.
+ *
  * Users can test if a device is a PCI device without having to cast, by
  * simply checking the #LdmDevice:device-type:
  *
@@ -64,10 +70,37 @@ struct _LdmPCIDevice {
                 guint dev;
                 gint func;
         } address;
+
+        LdmPCIRuntimeStatus runtime_status;
 };
 
+static void ldm_pci_device_get_property(GObject *object, guint id, GValue *value,
+                                        GParamSpec *spec);
+
 G_DEFINE_TYPE(LdmPCIDevice, ldm_pci_device, LDM_TYPE_DEVICE)
 
+/* Property IDs */
+enum { PROP_RUNTIME_STATUS = 1, N_PROPS };
+
+static GParamSpec *obj_properties[N_PROPS] = {
+        NULL,
+};
+
+/*
+ * Values of power/runtime_status, see Documentation/ABI/testing/sysfs-devices-power
+ */
+static const struct {
+        const gchar *name;
+        LdmPCIRuntimeStatus status;
+} ldm_pci_runtime_statuses[] = {
+        { "active", LDM_PCI_RUNTIME_STATUS_ACTIVE },
+        { "suspended", LDM_PCI_RUNTIME_STATUS_SUSPENDED },
+        { "suspending", LDM_PCI_RUNTIME_STATUS_SUSPENDING },
+        { "resuming", LDM_PCI_RUNTIME_STATUS_RESUMING },
+        { "error", LDM_PCI_RUNTIME_STATUS_ERROR },
+        { "unsupported", LDM_PCI_RUNTIME_STATUS_UNSUPPORTED },
+};
+
 /**
  * ldm_pci_device_dispose:
  *
@@ -89,6 +122,37 @@ static void ldm_pci_device_class_init(LdmPCIDeviceClass *klazz)
 
         /* gobject vtable hookup */
         obj_class->dispose = ldm_pci_device_dispose;
+        obj_class->get_property = ldm_pci_device_get_property;
+
+        /**
+         * LdmPCIDevice:runtime-status
+         *
+         * Runtime power management state of the device when it was enumerated
+         */
+        obj_properties[PROP_RUNTIME_STATUS] =
+            g_param_spec_enum("runtime-status",
+                              "Runtime status",
+                              "Runtime power management state",
+                              LDM_TYPE_PCI_RUNTIME_STATUS,
+                              LDM_PCI_RUNTIME_STATUS_UNKNOWN,
+                              G_PARAM_READABLE);
+
+        g_object_class_install_properties(obj_class, N_PROPS, obj_properties);
+}
+
+static void ldm_pci_device_get_property(GObject *object, guint id, GValue *value,
+                                        GParamSpec *spec)
+{
+        LdmPCIDevice *self = LDM_PCI_DEVICE(object);
+
+        switch (id) {
+        case PROP_RUNTIME_STATUS:
+                g_value_set_enum(value, self->runtime_status);
+                break;
+        default:
+                G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
+                break;
+        }
 }
 
 /**
@@ -129,6 +193,51 @@ product:
         self->id.product_id = (gint)(strtoll(sysattr, NULL, 0));
 }
 
+/**
+ * ldm_pci_device_assign_pvid_snapshot:
+ *
+ * Assign product/vendor ID to the device from the udev properties, i.e.
+ * `PCI_ID=10DE:11E2`, without touching sysfs.
+ */
+static void ldm_pci_device_assign_pvid_snapshot(LdmDevice *self)
+{
+        const gchar *pci_id = NULL;
+        guint vendor_id = 0;
+        guint product_id = 0;
+
+        pci_id = g_hash_table_lookup(self->os.hwdb_info, "PCI_ID");
+        if (!pci_id || sscanf(pci_id, "%x:%x", &vendor_id, &product_id) != 2) {
+                return;
+        }
+
+        self->id.vendor_id = (gint)vendor_id;
+        self->id.product_id = (gint)product_id;
+}
+
+/**
+ * ldm_pci_device_assign_runtime_status:
+ *
+ * Find out whether the device is runtime suspended. The kernel answers this
+ * without resuming the device.
+ */
+static void ldm_pci_device_assign_runtime_status(LdmDevice *self, udev_device *device)
+{
+        LdmPCIDevice *pci = LDM_PCI_DEVICE(self);
+        const char *sysattr = NULL;
+
+        sysattr = udev_device_get_sysattr_value(device, "power/runtime_status");
+        if (!sysattr) {
+                return;
+        }
+
+        for (guint i = 0; i < G_N_ELEMENTS(ldm_pci_runtime_statuses); i++) {
+                if (g_str_equal(sysattr, ldm_pci_runtime_statuses[i].name)) {
+                        pci->runtime_status = ldm_pci_runtime_statuses[i].status;
+                        return;
+                }
+        }
+}
+
 /**
  * ldm_pci_device_assign_address:
  *
@@ -158,13 +267,24 @@ static void ldm_pci_device_assign_address(LdmDevice *self, udev_device *device)
  */
 void ldm_pci_device_init_private(LdmDevice *self, udev_device *device)
 {
+        LdmPCIDevice *pci = LDM_PCI_DEVICE(self);
         const char *sysattr = NULL;
+        gboolean asleep = FALSE;
         int pci_class = 0;
 
-        ldm_pci_device_assign_pvid(self, device);
+        ldm_pci_device_assign_runtime_status(self, device);
+        asleep = pci->runtime_status == LDM_PCI_RUNTIME_STATUS_SUSPENDED ||
+                 pci->runtime_status == LDM_PCI_RUNTIME_STATUS_SUSPENDING;
+
+        /* Leave a sleeping device alone, udev recorded all we need */
+        if (asleep) {
+                ldm_pci_device_assign_pvid_snapshot(self);
+        } else {
+                ldm_pci_device_assign_pvid(self, device);
+        }
         ldm_pci_device_assign_address(self, device);
 
-        /* Are we boot_vga ? */
+        /* Are we boot_vga ? The kernel answers this without waking the device */
         sysattr = udev_device_get_sysattr_value(device, "boot_vga");
         if (sysattr && g_str_equal(sysattr, "1")) {
                 self->os.attributes |= LDM_DEVICE_ATTRIBUTE_BOOT_VGA;
@@ -172,13 +292,17 @@ void ldm_pci_device_init_private(LdmDevice *self, udev_device *device)
         sysattr = NULL;
 
         /* Grab the device class */
-        sysattr = udev_device_get_sysattr_value(device, "class");
+        if (asleep) {
+                sysattr = g_hash_table_lookup(self->os.hwdb_info, "PCI_CLASS");
+        } else {
+                sysattr = udev_device_get_sysattr_value(device, "class");
+        }
         if (!sysattr) {
                 return;
         }
 
-        /* Does it look like a display device? */
-        pci_class = (int)(strtoll(sysattr, NULL, 0) >> 8);
+        /* Does it look like a display device? The udev property has no 0x prefix */
+        pci_class = (int)(strtoll(sysattr, NULL, asleep ? 16 : 0) >> 8);
         if (pci_class >= PCI_CLASS_DISPLAY_VGA && pci_class <= PCI_CLASS_DISPLAY_OTHER) {
                 self->os.devtype |= LDM_DEVICE_TYPE_GPU;
         }
@@ -212,6 +336,21 @@ void ldm_pci_device_get_address(LdmPCIDevice *self, guint *bus, guint *dev, gint
         }
 }
 
+/**
+ * ldm_pci_device_get_runtime_status:
+ *
+ * Get the runtime power management state of the device, as it was when the
+ * device was enumerated.
+ *
+ * Returns: The #LdmPCIRuntimeStatus of the device
+ */
+LdmPCIRuntimeStatus ldm_pci_device_get_runtime_status(LdmPCIDevice *self)
+{
+        g_return_val_if_fail(self != NULL, LDM_PCI_RUNTIME_STATUS_UNKNOWN);
+
+        return self->runtime_status;
+}
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
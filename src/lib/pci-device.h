@@ -18,6 +18,29 @@ G_BEGIN_DECLS
 typedef struct _LdmPCIDevice LdmPCIDevice;
 typedef struct _LdmPCIDeviceClass LdmPCIDeviceClass;
 
+/**
+ * LdmPCIRuntimeStatus:
+ * @LDM_PCI_RUNTIME_STATUS_UNKNOWN: The kernel doesn't report a runtime PM state
+ * @LDM_PCI_RUNTIME_STATUS_ACTIVE: The device is powered up
+ * @LDM_PCI_RUNTIME_STATUS_SUSPENDED: The device is runtime suspended
+ * @LDM_PCI_RUNTIME_STATUS_SUSPENDING: The device is being suspended
+ * @LDM_PCI_RUNTIME_STATUS_RESUMING: The device is being resumed
+ * @LDM_PCI_RUNTIME_STATUS_ERROR: Runtime PM failed for the device
+ * @LDM_PCI_RUNTIME_STATUS_UNSUPPORTED: Runtime PM is disabled for the device
+ *
+ * Runtime power management state of a PCI device, as found in the
+ * `power/runtime_status` sysfs attribute when the device was enumerated.
+ */
+typedef enum {
+        LDM_PCI_RUNTIME_STATUS_UNKNOWN = 0,
+        LDM_PCI_RUNTIME_STATUS_ACTIVE,
+        LDM_PCI_RUNTIME_STATUS_SUSPENDED,
+        LDM_PCI_RUNTIME_STATUS_SUSPENDING,
+        LDM_PCI_RUNTIME_STATUS_RESUMING,
+        LDM_PCI_RUNTIME_STATUS_ERROR,
+        LDM_PCI_RUNTIME_STATUS_UNSUPPORTED,
+} LdmPCIRuntimeStatus;
+
 #define LDM_TYPE_PCI_DEVICE ldm_pci_device_get_type()
 #define LDM_PCI_DEVICE(o) (G_TYPE_CHECK_INSTANCE_CAST((o), LDM_TYPE_PCI_DEVICE, LdmPCIDevice))
 #define LDM_IS_PCI_DEVICE(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), LDM_TYPE_PCI_DEVICE))
@@ -30,6 +53,7 @@ typedef struct _LdmPCIDeviceClass LdmPCIDeviceClass;
 GType ldm_pci_device_get_type(void);
 
 void ldm_pci_device_get_address(LdmPCIDevice *device, guint *bus, guint *dev, gint *func);
+LdmPCIRuntimeStatus ldm_pci_device_get_runtime_status(LdmPCIDevice *device);
 
 G_END_DECLS
 
@@ -11,7 +11,11 @@
 
 #define _GNU_SOURCE
 
+#include <string.h>
+
+#include "plugin-private.h"
 #include "plugin.h"
+#include "route.h"
 #include "util.h"
 
 /**
@@ -25,10 +29,20 @@
  *
  * The base LdmPlugin implementation does nothing by itself, and must be
  * extended to be useful.
+ *
+ * Plugins may optionally advertise their coverage, i.e. the buses and vendor
+ * IDs that their rules could possibly match, with #ldm_plugin_add_coverage
+ * and #ldm_plugin_add_coverage_wildcard. The #LdmManager uses this summary
+ * to route devices only to plugins that could match them. A plugin that
+ * never declares any coverage will be consulted for every device.
  */
 struct _LdmPluginPrivate {
         gchar *name;
         gint priority;
+
+        /* Coverage summary. NULL if undeclared (i.e. may match anything) */
+        GHashTable *coverage;
+        gboolean coverage_any;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE(LdmPlugin, ldm_plugin, G_TYPE_INITIALLY_UNOWNED)
@@ -39,6 +53,10 @@ static GParamSpec *obj_properties[N_PROPS] = {
         NULL,
 };
 
+enum { SIGNAL_CHANGED = 0, N_SIGNALS };
+
+static guint obj_signals[N_SIGNALS] = { 0 };
+
 static void ldm_plugin_set_property(GObject *object, guint id, const GValue *value,
                                     GParamSpec *spec);
 static void ldm_plugin_get_property(GObject *object, guint id, GValue *value, GParamSpec *spec);
@@ -53,6 +71,7 @@ static void ldm_plugin_dispose(GObject *obj)
         LdmPlugin *self = LDM_PLUGIN(obj);
 
         g_clear_pointer(&self->priv->name, g_free);
+        g_clear_pointer(&self->priv->coverage, g_hash_table_unref);
 
         G_OBJECT_CLASS(ldm_plugin_parent_class)->dispose(obj);
 }
@@ -99,6 +118,34 @@ static void ldm_plugin_class_init(LdmPluginClass *klazz)
                              G_PARAM_READWRITE);
 
         g_object_class_install_properties(obj_class, N_PROPS, obj_properties);
+
+        /**
+         * LdmPlugin::changed:
+         * @plugin: The plugin that changed
+         *
+         * Emitted whenever the priority or the coverage of the plugin changes,
+         * allowing the #LdmManager to invalidate its plugin order and routing
+         * tables without rechecking every plugin.
+         */
+        obj_signals[SIGNAL_CHANGED] = g_signal_new("changed",
+                                                   LDM_TYPE_PLUGIN,
+                                                   G_SIGNAL_RUN_LAST,
+                                                   0,
+                                                   NULL,
+                                                   NULL,
+                                                   NULL,
+                                                   G_TYPE_NONE,
+                                                   0);
+}
+
+/**
+ * ldm_plugin_changed:
+ *
+ * Let everyone routing devices to this plugin know that it changed
+ */
+static void ldm_plugin_changed(LdmPlugin *self)
+{
+        g_signal_emit(self, obj_signals[SIGNAL_CHANGED], 0);
 }
 
 static void ldm_plugin_set_property(GObject *object, guint id, const GValue *value,
@@ -112,7 +159,10 @@ static void ldm_plugin_set_property(GObject *object, guint id, const GValue *val
                 self->priv->name = g_value_dup_string(value);
                 break;
         case PROP_PRIORITY:
-                self->priv->priority = g_value_get_int(value);
+                if (self->priv->priority != g_value_get_int(value)) {
+                        self->priv->priority = g_value_get_int(value);
+                        ldm_plugin_changed(self);
+                }
                 break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
@@ -217,6 +267,219 @@ LdmProvider *ldm_plugin_get_provider(LdmPlugin *self, LdmDevice *device)
         return klazz->get_provider(self, device);
 }
 
+/**
+ * ldm_plugin_get_result:
+ * @device: Device to match
+ * @result: (out caller-allocates): Storage for the result
+ *
+ * Match the device like #ldm_plugin_get_provider, without constructing an
+ * #LdmProvider. Plugins without a `get_result` implementation still go
+ * through `get_provider`, and the provider is discarded.
+ *
+ * Returns: TRUE if the plugin supports the device
+ */
+gboolean ldm_plugin_get_result(LdmPlugin *self, LdmDevice *device, LdmProviderResult *result)
+{
+        LdmPluginClass *klazz = NULL;
+
+        g_return_val_if_fail(self != NULL, FALSE);
+        g_return_val_if_fail(device != NULL, FALSE);
+        g_return_val_if_fail(result != NULL, FALSE);
+
+        klazz = LDM_PLUGIN_GET_CLASS(self);
+        memset(result, 0, sizeof(*result));
+
+        if (klazz->get_result) {
+                if (!klazz->get_result(self, device, result)) {
+                        return FALSE;
+                }
+        } else {
+                g_autoptr(LdmProvider) provider = NULL;
+
+                provider = ldm_plugin_get_provider(self, device);
+                if (!provider) {
+                        return FALSE;
+                }
+                if (g_object_is_floating(provider)) {
+                        g_object_ref_sink(provider);
+                }
+
+                result->package = g_intern_string(ldm_provider_get_package(provider));
+                result->driver = g_intern_string(ldm_provider_get_driver(provider));
+        }
+
+        result->plugin = self;
+        result->priority = self->priv->priority;
+        return TRUE;
+}
+
+/**
+ * ldm_plugin_account_memory:
+ * @usage: Usage to add the memory of this plugin to
+ *
+ * Account the memory used by this plugin. The plugin instance itself is
+ * counted as an alias object, and implementations add whatever they own
+ * with the `account_memory` virtual function.
+ */
+void ldm_plugin_account_memory(LdmPlugin *self, LdmMemoryUsage *usage)
+{
+        LdmPluginClass *klazz = NULL;
+        GTypeQuery query = { 0 };
+
+        g_return_if_fail(self != NULL);
+        g_return_if_fail(usage != NULL);
+
+        g_type_query(G_OBJECT_TYPE(self), &query);
+        ldm_memory_usage_add(usage,
+                             LDM_MEMORY_CATEGORY_ALIASES,
+                             query.instance_size + sizeof(LdmPluginPrivate),
+                             1);
+        ldm_memory_usage_add_string(usage, LDM_MEMORY_CATEGORY_STRINGS, self->priv->name);
+
+        /* Coverage is only there to route devices */
+        if (self->priv->coverage) {
+                ldm_memory_usage_add_hash_table(usage,
+                                                LDM_MEMORY_CATEGORY_CACHES,
+                                                self->priv->coverage);
+                ldm_memory_usage_add(usage,
+                                     LDM_MEMORY_CATEGORY_CACHES,
+                                     g_hash_table_size(self->priv->coverage) * sizeof(LdmRoute),
+                                     0);
+        }
+
+        klazz = LDM_PLUGIN_GET_CLASS(self);
+        if (klazz->account_memory) {
+                klazz->account_memory(self, usage);
+        }
+}
+
+/**
+ * ldm_plugin_insert_route:
+ *
+ * Add the route to our coverage table if we don't already know about it
+ */
+static void ldm_plugin_insert_route(LdmPlugin *self, const LdmRoute *route)
+{
+        LdmRoute *copy = NULL;
+
+        if (!self->priv->coverage) {
+                self->priv->coverage =
+                    g_hash_table_new_full(ldm_route_hash, ldm_route_equal, g_free, NULL);
+        }
+
+        if (g_hash_table_contains(self->priv->coverage, route)) {
+                return;
+        }
+
+        copy = g_new0(LdmRoute, 1);
+        *copy = *route;
+        g_hash_table_add(self->priv->coverage, copy);
+        ldm_plugin_changed(self);
+}
+
+/**
+ * ldm_plugin_add_coverage:
+ * @bus: Bus name as found in the modalias, i.e. "pci"
+ * @vendor_id: Vendor ID on the given bus
+ *
+ * Declare that this plugin may match devices from the given vendor on
+ * the given bus. Plugin implementations should call this for every rule
+ * they contain so that the #LdmManager can route devices to them.
+ */
+void ldm_plugin_add_coverage(LdmPlugin *self, const gchar *bus, guint vendor_id)
+{
+        LdmRoute route = { 0 };
+
+        g_return_if_fail(self != NULL);
+        g_return_if_fail(bus != NULL);
+
+        route.bus = g_intern_string(bus);
+        route.vendor_id = vendor_id;
+        route.any_vendor = FALSE;
+
+        ldm_plugin_insert_route(self, &route);
+}
+
+/**
+ * ldm_plugin_add_coverage_wildcard:
+ * @bus: (nullable): Bus name as found in the modalias, i.e. "pci"
+ *
+ * Declare that this plugin may match devices from any vendor on the given
+ * bus. If @bus is NULL, the plugin may match any device at all and will
+ * always be consulted by the #LdmManager.
+ */
+void ldm_plugin_add_coverage_wildcard(LdmPlugin *self, const gchar *bus)
+{
+        LdmRoute route = { 0 };
+
+        g_return_if_fail(self != NULL);
+
+        if (!bus) {
+                if (!self->priv->coverage_any) {
+                        self->priv->coverage_any = TRUE;
+                        ldm_plugin_changed(self);
+                }
+                return;
+        }
+
+        route.bus = g_intern_string(bus);
+        route.vendor_id = 0;
+        route.any_vendor = TRUE;
+
+        ldm_plugin_insert_route(self, &route);
+}
+
+/**
+ * ldm_plugin_covers:
+ * @bus: Bus name as found in the modalias, i.e. "pci"
+ * @vendor_id: Vendor ID on the given bus
+ *
+ * Determine whether the coverage of this plugin includes the given bus
+ * and vendor. Plugins without any declared coverage cover everything.
+ *
+ * Returns: TRUE if the plugin could match devices from this vendor
+ */
+gboolean ldm_plugin_covers(LdmPlugin *self, const gchar *bus, guint vendor_id)
+{
+        LdmRoute route = { 0 };
+
+        g_return_val_if_fail(self != NULL, FALSE);
+        g_return_val_if_fail(bus != NULL, FALSE);
+
+        if (!ldm_plugin_get_coverage(self)) {
+                return TRUE;
+        }
+
+        route.bus = g_intern_string(bus);
+        route.vendor_id = vendor_id;
+        route.any_vendor = FALSE;
+
+        if (g_hash_table_contains(self->priv->coverage, &route)) {
+                return TRUE;
+        }
+
+        route.vendor_id = 0;
+        route.any_vendor = TRUE;
+
+        return g_hash_table_contains(self->priv->coverage, &route);
+}
+
+/**
+ * ldm_plugin_get_coverage:
+ *
+ * Private API for the manager to build routing tables.
+ *
+ * Returns: (transfer none) (nullable): Set of #LdmRoute, or NULL if the plugin
+ * may match any device
+ */
+GHashTable *ldm_plugin_get_coverage(LdmPlugin *self)
+{
+        if (self->priv->coverage_any) {
+                return NULL;
+        }
+        return self->priv->coverage;
+}
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
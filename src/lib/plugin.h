@@ -14,6 +14,7 @@
 #include <glib-object.h>
 
 #include <device.h>
+#include <memory-usage.h>
 
 G_BEGIN_DECLS
 
@@ -28,14 +29,19 @@ typedef struct _LdmPluginClass LdmPluginClass;
  * LdmPluginClass:
  * @parent_class: The parent class
  * @get_provider: Virtual get_provider function
+ * @get_result: Cheaper alternative to get_provider, filling the package and
+ *  driver of the result without constructing an #LdmProvider. Optional.
+ * @account_memory: Add the memory owned by the plugin implementation to the usage
  */
 struct _LdmPluginClass {
         GInitiallyUnownedClass parent_class;
 
         LdmProvider *(*get_provider)(LdmPlugin *plugin, LdmDevice *device);
+        void (*account_memory)(LdmPlugin *plugin, LdmMemoryUsage *usage);
+        gboolean (*get_result)(LdmPlugin *plugin, LdmDevice *device, LdmProviderResult *result);
 
         /*< private >*/
-        gpointer padding[12];
+        gpointer padding[10];
 };
 
 struct _LdmPlugin {
@@ -59,6 +65,12 @@ gint ldm_plugin_get_priority(LdmPlugin *plugin);
 void ldm_plugin_set_priority(LdmPlugin *plugin, gint priority);
 
 LdmProvider *ldm_plugin_get_provider(LdmPlugin *self, LdmDevice *device);
+gboolean ldm_plugin_get_result(LdmPlugin *plugin, LdmDevice *device, LdmProviderResult *result);
+void ldm_plugin_account_memory(LdmPlugin *plugin, LdmMemoryUsage *usage);
+
+void ldm_plugin_add_coverage(LdmPlugin *plugin, const gchar *bus, guint vendor_id);
+void ldm_plugin_add_coverage_wildcard(LdmPlugin *plugin, const gchar *bus);
+gboolean ldm_plugin_covers(LdmPlugin *plugin, const gchar *bus, guint vendor_id);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(LdmPlugin, g_object_unref)
 
@@ -11,14 +11,17 @@
 
 #define _GNU_SOURCE
 
-#include <errno.h>
-#include <fcntl.h>
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 
+#include "ldm-private.h"
+#include "modalias-fields.h"
+#include "modalias-header.h"
 #include "modalias-plugin.h"
+#include "modalias-stream.h"
+#include "prefix-match.h"
+#include "route.h"
 #include "util.h"
 
 struct _LdmModaliasPluginClass {
@@ -26,6 +29,9 @@ struct _LdmModaliasPluginClass {
 };
 
 static LdmProvider *ldm_modalias_plugin_get_provider(LdmPlugin *plugin, LdmDevice *device);
+static gboolean ldm_modalias_plugin_get_result(LdmPlugin *plugin, LdmDevice *device,
+                                               LdmProviderResult *result);
+static void ldm_modalias_plugin_account_memory(LdmPlugin *plugin, LdmMemoryUsage *usage);
 
 /**
  * SECTION:modalias-plugin
@@ -59,14 +65,60 @@ static LdmProvider *ldm_modalias_plugin_get_provider(LdmPlugin *plugin, LdmDevic
  * If a hardware device matching `pci:v000014E4d*sv*sd*bc02sc80i` is discovered,
  * it requires `wl.ko` to operate correctly (or to enhance it). The user can find
  * `wl.ko` in the `broadcom-sta` package.
+ *
+ * Internally the literal prefix of every match (i.e. `pci:v000014E4d`) is
+ * indexed, and compared against device modaliases many rules at a time using
+ * SIMD instructions where available. The rules that survive this test are
+ * then compared field by field, see #LdmModalias, and only irregular rules
+ * are evaluated with `fnmatch`.
+ *
+ * Files generated by `mkmodaliases` start with a header of `# ldm-` comments
+ * declaring the buses and vendors covered by the file, the number of aliases
+ * and a checksum of the aliases. #LdmManager uses the header to defer loading
+ * a file until a device it covers shows up, see #ldm_manager_add_modalias_plugin_for_path.
+ *
+ * Rules are not kept as #LdmModalias objects. The file is mapped and split
+ * into columns in place, and only the matches are copied into the string
+ * storage of the plugin. Drivers and packages are interned once, so results
+ * can hand them out as they are. A redefined match keeps its stored string,
+ * so the storage only ever holds one string per rule.
  */
 struct _LdmModaliasPlugin {
         LdmPlugin parent;
 
-        /* Our known modalias implementations */
-        GHashTable *modaliases;
+        /* Our known modalias rules */
+        struct {
+                GStringChunk *strings; /* Backing storage for the match of every rule */
+                GString *lookup;       /* Terminated copy of the match being inserted */
+                GArray *entries;       /* LdmModaliasEntry */
+                GHashTable *matches;   /* Match -> index + 1 into entries */
+                const gchar *driver;   /* Most recent driver, interned */
+                const gchar *package;  /* Most recent package, interned */
+                gsize string_bytes;    /* Bytes stored in the chunk */
+                guint n_strings;       /* Strings stored in the chunk */
+        } rules;
+
+        /* Literal prefix index over the rules, rebuilt on demand */
+        struct {
+                LdmPrefixTable prefixes;
+                GArray *order; /* Rule indices, ordered as prefixes */
+                gboolean dirty;
+        } index;
 };
 
+/*
+ * LdmModaliasEntry
+ *
+ * A single rule, with strings owned by the plugin storage.
+ */
+typedef struct LdmModaliasEntry {
+        const gchar *match;
+        const gchar *driver;
+        const gchar *package;
+        guint specificity; /* Literal characters in the match */
+        LdmModaliasFields fields;
+} LdmModaliasEntry;
+
 G_DEFINE_TYPE(LdmModaliasPlugin, ldm_modalias_plugin, LDM_TYPE_PLUGIN)
 
 /**
@@ -78,7 +130,15 @@ static void ldm_modalias_plugin_dispose(GObject *obj)
 {
         LdmModaliasPlugin *self = LDM_MODALIAS_PLUGIN(obj);
 
-        g_clear_pointer(&self->modaliases, g_hash_table_unref);
+        g_clear_pointer(&self->rules.matches, g_hash_table_unref);
+        g_clear_pointer(&self->rules.entries, g_array_unref);
+        g_clear_pointer(&self->rules.strings, g_string_chunk_free);
+        if (self->rules.lookup) {
+                g_string_free(self->rules.lookup, TRUE);
+                self->rules.lookup = NULL;
+        }
+        g_clear_pointer(&self->index.order, g_array_unref);
+        ldm_prefix_table_clear(&self->index.prefixes);
 
         G_OBJECT_CLASS(ldm_modalias_plugin_parent_class)->dispose(obj);
 }
@@ -98,6 +158,8 @@ static void ldm_modalias_plugin_class_init(LdmModaliasPluginClass *klazz)
 
         /* plugin vtable hookup */
         plug_class->get_provider = ldm_modalias_plugin_get_provider;
+        plug_class->get_result = ldm_modalias_plugin_get_result;
+        plug_class->account_memory = ldm_modalias_plugin_account_memory;
 }
 
 /**
@@ -107,8 +169,12 @@ static void ldm_modalias_plugin_class_init(LdmModaliasPluginClass *klazz)
  */
 static void ldm_modalias_plugin_init(LdmModaliasPlugin *self)
 {
-        /* Map name to modalias */
-        self->modaliases = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, g_object_unref);
+        /* Strings live in the chunk, the table only maps them to entries */
+        self->rules.strings = g_string_chunk_new(4096);
+        self->rules.lookup = g_string_new(NULL);
+        self->rules.entries = g_array_new(FALSE, FALSE, sizeof(LdmModaliasEntry));
+        self->rules.matches = g_hash_table_new(g_str_hash, g_str_equal);
+        self->index.dirty = TRUE;
 }
 
 /**
@@ -125,98 +191,316 @@ LdmPlugin *ldm_modalias_plugin_new(const gchar *name)
 }
 
 /**
- * ldm_modalias_plugin_new_from_filename:
- * @filename: Path to a modaliases file
+ * ldm_modalias_plugin_intern:
+ * @last: Most recently interned string of this kind
+ * @len: Length of the string, or -1 if nul terminated
  *
- * Create a new LdmPlugin for modalias detection. The named file will be
- * opened and the resulting plugin will be seeded from that file.
+ * Intern the driver or package of a rule. Rules from one file nearly always
+ * share the driver and package, so we only look those up once per run, and
+ * matches can hand them out without any further lookup.
  *
- * Returns: (transfer full): A newly initialised LdmModaliasPlugin
+ * Returns: (transfer none): The interned string
  */
-LdmPlugin *ldm_modalias_plugin_new_from_filename(const gchar *filename)
+static const gchar *ldm_modalias_plugin_intern(const gchar **last, const gchar *string,
+                                               gssize len)
 {
-        FILE *fp = NULL;
-        char *bfr = NULL;
-        size_t n = 0;
-        ssize_t read = 0;
-        LdmPlugin *ret = NULL;
-        g_autofree gchar *path = NULL;
+        g_autofree gchar *copy = NULL;
+        gsize real_len = len < 0 ? strlen(string) : (gsize)len;
 
-        g_return_val_if_fail(filename != NULL, NULL);
-        if (access(filename, F_OK) != 0) {
-                return NULL;
+        if (*last && strncmp(*last, string, real_len) == 0 && (*last)[real_len] == '\0') {
+                return *last;
         }
 
-        fp = fopen(filename, "r");
-        if (!fp) {
-                fprintf(stderr, "Failed to open %s: %s\n", filename, strerror(errno));
-                return NULL;
-        }
+        /* Columns of a mapped file aren't nul terminated */
+        copy = g_strndup(string, real_len);
+        *last = g_intern_string(copy);
+        return *last;
+}
 
-        /* Strip suffix if set */
-        path = g_path_get_basename(filename);
-        if (g_str_has_suffix(path, ".modaliases")) {
-                path[strlen(path) - strlen(".modaliases")] = '\0';
+/**
+ * ldm_modalias_plugin_insert:
+ * @match_len: Length of the match, or -1 if nul terminated
+ * @driver_len: Length of the driver, or -1 if nul terminated
+ * @package_len: Length of the package, or -1 if nul terminated
+ *
+ * Add a rule to the table, replacing any rule with the same match. The
+ * coverage of the plugin is extended to include the bus and vendor of the
+ * match, see #ldm_plugin_add_coverage.
+ */
+static void ldm_modalias_plugin_insert(LdmModaliasPlugin *self, const gchar *match,
+                                       gssize match_len, const gchar *driver, gssize driver_len,
+                                       const gchar *package, gssize package_len)
+{
+        LdmModaliasEntry entry = { 0 };
+        LdmRoute route = { 0 };
+        gpointer key = NULL;
+        gpointer value = NULL;
+        guint index = 0;
+
+        /* Only store the match once, a redefinition reuses the string */
+        g_string_truncate(self->rules.lookup, 0);
+        g_string_append_len(self->rules.lookup, match, match_len);
+        if (g_hash_table_lookup_extended(self->rules.matches,
+                                         self->rules.lookup->str,
+                                         &key,
+                                         &value)) {
+                entry.match = key;
+                index = GPOINTER_TO_UINT(value);
+        } else {
+                entry.match = g_string_chunk_insert_len(self->rules.strings,
+                                                        self->rules.lookup->str,
+                                                        (gssize)self->rules.lookup->len);
+                self->rules.string_bytes += self->rules.lookup->len + 1;
+                ++self->rules.n_strings;
         }
+        entry.driver = ldm_modalias_plugin_intern(&self->rules.driver, driver, driver_len);
+        entry.package = ldm_modalias_plugin_intern(&self->rules.package, package, package_len);
 
-        ret = ldm_modalias_plugin_new(path);
+        for (const gchar *c = entry.match; *c; c++) {
+                if (*c != '*' && *c != '?' && *c != '[' && *c != ']' && *c != '\\') {
+                        ++entry.specificity;
+                }
+        }
+        ldm_modalias_fields_parse_pattern(&entry.fields, entry.match);
+
+        if (index > 0) {
+                g_array_index(self->rules.entries, LdmModaliasEntry, index - 1) = entry;
+        } else {
+                g_array_append_val(self->rules.entries, entry);
+                g_hash_table_insert(self->rules.matches,
+                                    (gpointer)entry.match,
+                                    GUINT_TO_POINTER(self->rules.entries->len));
+        }
+        self->index.dirty = TRUE;
+
+        /* Advertise what we could match to allow routing */
+        if (!ldm_route_parse(&route, entry.match)) {
+                ldm_plugin_add_coverage_wildcard(LDM_PLUGIN(self), NULL);
+        } else if (route.any_vendor) {
+                ldm_plugin_add_coverage_wildcard(LDM_PLUGIN(self), route.bus);
+        } else {
+                ldm_plugin_add_coverage(LDM_PLUGIN(self), route.bus, route.vendor_id);
+        }
+}
 
-        /* Walk the line. */
-        while ((read = getline(&bfr, &n, fp)) > 0) {
-                gchar *work = NULL;
-                gchar **splits = NULL;
-                LdmModalias *alias = NULL;
+/**
+ * ldm_modalias_plugin_parse:
+ * @data: Contents of a modaliases file, not necessarily nul terminated
+ * @len: Length of the contents
+ *
+ * Split the contents into lines and columns in place, using only pointers
+ * into the contents. Leading and trailing whitespace is ignored, and the
+ * line is split on the first three spaces, so the package is the remainder.
+ *
+ * Returns: Number of alias lines found
+ */
+static guint ldm_modalias_plugin_parse(LdmModaliasPlugin *self, const gchar *data, gsize len)
+{
+        const gchar *end = data + len;
+        const gchar *line = data;
+        guint n_aliases = 0;
+
+        while (line < end) {
+                const gchar *start = line;
+                const gchar *stop = memchr(line, '\n', (gsize)(end - line));
+                const gchar *columns[4] = { NULL };
+                gsize lengths[4] = { 0 };
+                guint n_columns = 0;
+
+                if (!stop) {
+                        stop = end;
+                }
+                line = stop + 1;
 
-                /* Strip the newline from it */
-                if (bfr[read - 1] == '\n') {
-                        bfr[read - 1] = '\0';
-                        --read;
+                while (start < stop && g_ascii_isspace(*start)) {
+                        ++start;
+                }
+                while (stop > start && g_ascii_isspace(stop[-1])) {
+                        --stop;
                 }
 
-                /* Empty lines are uninteresting. */
-                if (read < 1) {
+                /* Empty lines and comments are uninteresting. */
+                if (start == stop || *start == '#') {
                         continue;
                 }
 
-                work = g_strstrip(bfr);
-
-                /* Comment? */
-                if (g_str_has_prefix(work, "#")) {
-                        goto next_line;
+                for (const gchar *c = start; n_columns < 3;) {
+                        const gchar *space = memchr(c, ' ', (gsize)(stop - c));
+
+                        if (!space) {
+                                break;
+                        }
+                        columns[n_columns] = c;
+                        lengths[n_columns] = (gsize)(space - c);
+                        ++n_columns;
+                        c = space + 1;
+                        start = c;
                 }
-
-                splits = g_strsplit(work, " ", 4);
-                if (!splits || g_strv_length(splits) != 4) {
-                        goto next_line;
+                if (n_columns != 3) {
+                        continue;
                 }
+                columns[3] = start;
+                lengths[3] = (gsize)(stop - start);
 
-                if (!g_str_equal(splits[0], "alias")) {
-                        g_warning("unknown directive '%s'", splits[0]);
-                        goto next_line;
+                if (lengths[0] != strlen("alias") || strncmp(columns[0], "alias", lengths[0]) != 0) {
+                        g_warning("unknown directive '%.*s'", (int)lengths[0], columns[0]);
+                        continue;
                 }
 
-                alias = ldm_modalias_new(splits[1], splits[2], splits[3]);
-                if (!alias) {
-                        g_warning("invalid alias '%s'", work);
-                        goto next_line;
-                }
+                ldm_modalias_plugin_insert(self,
+                                           columns[1],
+                                           (gssize)lengths[1],
+                                           columns[2],
+                                           (gssize)lengths[2],
+                                           columns[3],
+                                           (gssize)lengths[3]);
+                ++n_aliases;
+        }
+
+        return n_aliases;
+}
+
+/**
+ * ldm_modalias_plugin_check_header:
+ * @n_aliases: Number of aliases parsed from the body
+ *
+ * The header of a file is trusted to skip loading it, so make sure it still
+ * describes the aliases once they have been loaded anyway. Counting them is
+ * free with the parse; the checksum needs the whole body hashed, so that is
+ * left to `mkmodaliases --verify`.
+ */
+static void ldm_modalias_plugin_check_header(const gchar *filename,
+                                             const LdmModaliasHeader *header, guint n_aliases)
+{
+        if (header->n_aliases != n_aliases) {
+                g_warning("header of %s doesn't match its aliases, regenerate it", filename);
+        }
+}
+
+/**
+ * ldm_modalias_plugin_verify_header:
+ *
+ * Check the header of a file that was read in one piece
+ */
+static void ldm_modalias_plugin_verify_header(const gchar *filename, const gchar *data, gsize len,
+                                              guint n_aliases)
+{
+        LdmModaliasHeader header = { 0 };
+
+        if (ldm_modalias_header_parse(&header, data, len)) {
+                ldm_modalias_plugin_check_header(filename, &header, n_aliases);
+        }
+
+        ldm_modalias_header_clear(&header);
+}
+
+/**
+ * ldm_modalias_plugin_parse_stream:
+ * @filename: Path to a compressed modaliases file
+ *
+ * Decompress the file a chunk at a time, parsing each line as it comes out
+ * of the decompressor, so the decompressed file is never held in memory.
+ * The header is checked along the way.
+ *
+ * Returns: TRUE if the whole file was read
+ */
+static gboolean ldm_modalias_plugin_parse_stream(LdmModaliasPlugin *self, const gchar *filename,
+                                                 GError **error)
+{
+        g_autoptr(LdmModaliasStream) stream = NULL;
+        g_autoptr(GString) line = NULL;
+        g_autoptr(GError) local_error = NULL;
+        LdmModaliasHeader header = { 0 };
+        gboolean have_header = FALSE;
+        guint n_aliases = 0;
+
+        stream = ldm_modalias_stream_open(filename, error);
+        if (!stream) {
+                return FALSE;
+        }
+
+        line = g_string_new(NULL);
+        have_header = ldm_modalias_stream_read_header(stream, &header, line, &local_error);
+
+        while (!local_error && line->len > 0) {
+                n_aliases += ldm_modalias_plugin_parse(self, line->str, line->len);
+                ldm_modalias_stream_read_line(stream, line, &local_error);
+        }
+
+        if (local_error) {
+                ldm_modalias_header_clear(&header);
+                g_propagate_error(error, g_steal_pointer(&local_error));
+                return FALSE;
+        }
+
+        if (have_header) {
+                ldm_modalias_plugin_check_header(filename, &header, n_aliases);
+        }
+
+        ldm_modalias_header_clear(&header);
+        return TRUE;
+}
+
+/**
+ * ldm_modalias_plugin_new_from_filename:
+ * @filename: Path to a modaliases file
+ *
+ * Create a new LdmPlugin for modalias detection. The named file will be
+ * opened and the resulting plugin will be seeded from that file.
+ *
+ * Files ending in `.modaliases.gz` or `.modaliases.zst` are decompressed
+ * as they are parsed, if support for the compression was built.
+ *
+ * Returns: (transfer full): A newly initialised LdmModaliasPlugin
+ */
+LdmPlugin *ldm_modalias_plugin_new_from_filename(const gchar *filename)
+{
+        g_autoptr(GMappedFile) file = NULL;
+        g_autoptr(GError) error = NULL;
+        LdmModaliasCompression compression = LDM_MODALIAS_COMPRESSION_NONE;
+        LdmPlugin *ret = NULL;
+        g_autofree gchar *path = NULL;
+        g_autofree gchar *name = NULL;
+        guint n_aliases = 0;
 
-                /* Add modalias. */
-                ldm_modalias_plugin_add_modalias(LDM_MODALIAS_PLUGIN(ret), alias);
+        g_return_val_if_fail(filename != NULL, NULL);
+        if (access(filename, F_OK) != 0) {
+                return NULL;
+        }
 
-        next_line:
-                if (splits) {
-                        g_strfreev(splits);
+        /* Strip suffix if set */
+        path = g_path_get_basename(filename);
+        name = ldm_modalias_path_get_stem(path);
+
+        ldm_modalias_compression_for_path(filename, &compression);
+        if (compression != LDM_MODALIAS_COMPRESSION_NONE) {
+                ret = ldm_modalias_plugin_new(name ? name : path);
+                if (!ldm_modalias_plugin_parse_stream(LDM_MODALIAS_PLUGIN(ret), filename, &error)) {
+                        fprintf(stderr, "Failed to load %s: %s\n", filename, error->message);
+                        g_object_unref(g_object_ref_sink(ret));
+                        return NULL;
                 }
-                free(bfr);
-                bfr = NULL;
+                return ret;
         }
 
-        if (bfr) {
-                free(bfr);
+        file = g_mapped_file_new(filename, FALSE, &error);
+        if (!file) {
+                fprintf(stderr, "Failed to open %s: %s\n", filename, error->message);
+                return NULL;
         }
 
-        fclose(fp);
+        ret = ldm_modalias_plugin_new(name ? name : path);
+
+        /* Empty files have no contents at all */
+        if (g_mapped_file_get_length(file) > 0) {
+                n_aliases = ldm_modalias_plugin_parse(LDM_MODALIAS_PLUGIN(ret),
+                                                      g_mapped_file_get_contents(file),
+                                                      g_mapped_file_get_length(file));
+                ldm_modalias_plugin_verify_header(filename,
+                                                  g_mapped_file_get_contents(file),
+                                                  g_mapped_file_get_length(file),
+                                                  n_aliases);
+        }
 
         return ret;
 }
@@ -225,8 +509,12 @@ LdmPlugin *ldm_modalias_plugin_new_from_filename(const gchar *filename)
  * ldm_modalias_plugin_add_modalias:
  * @modalias: (transfer full): Modalias object to add to the table
  *
- * Add a new modalias object to the plugin table. This method will take a new
- * reference to the modalias.
+ * Add a new modalias object to the plugin table. The match, driver and
+ * package are copied into the plugin, and a floating reference to the
+ * modalias is consumed.
+ *
+ * The coverage of the plugin is extended to include the bus and vendor of
+ * the modalias match, see #ldm_plugin_add_coverage.
  */
 void ldm_modalias_plugin_add_modalias(LdmModaliasPlugin *self, LdmModalias *modalias)
 {
@@ -235,10 +523,146 @@ void ldm_modalias_plugin_add_modalias(LdmModaliasPlugin *self, LdmModalias *moda
         g_return_if_fail(self != NULL);
         g_return_if_fail(modalias != NULL);
 
+        g_object_ref_sink(modalias);
+
         id = ldm_modalias_get_match(modalias);
         g_assert(id != NULL);
 
-        g_hash_table_replace(self->modaliases, g_strdup(id), g_object_ref_sink(modalias));
+        ldm_modalias_plugin_insert(self,
+                                   id,
+                                   -1,
+                                   ldm_modalias_get_driver(modalias),
+                                   -1,
+                                   ldm_modalias_get_package(modalias),
+                                   -1);
+
+        g_object_unref(modalias);
+}
+
+/**
+ * ldm_modalias_plugin_sort_specific_first:
+ *
+ * Order rules so the most specific match is tested first. Ties are broken
+ * by the match itself so the order never depends on the input order.
+ */
+static gint ldm_modalias_plugin_sort_specific_first(gconstpointer a, gconstpointer b,
+                                                    gpointer v)
+{
+        GArray *entries = v;
+        const LdmModaliasEntry *entry_a = NULL;
+        const LdmModaliasEntry *entry_b = NULL;
+
+        entry_a = &g_array_index(entries, LdmModaliasEntry, *(const guint *)a);
+        entry_b = &g_array_index(entries, LdmModaliasEntry, *(const guint *)b);
+
+        if (entry_a->specificity != entry_b->specificity) {
+                return entry_a->specificity > entry_b->specificity ? -1 : 1;
+        }
+
+        return strcmp(entry_a->match, entry_b->match);
+}
+
+/**
+ * ldm_modalias_plugin_build_index:
+ *
+ * Rebuild the prefix index if the rules changed since last time. Candidates
+ * are indexed most specific first, so that the first match found is always
+ * the same, and the best one.
+ */
+static void ldm_modalias_plugin_build_index(LdmModaliasPlugin *self)
+{
+        guint n_entries = 0;
+
+        if (!self->index.dirty) {
+                return;
+        }
+
+        g_clear_pointer(&self->index.order, g_array_unref);
+        ldm_prefix_table_clear(&self->index.prefixes);
+
+        n_entries = self->rules.entries->len;
+        self->index.order = g_array_sized_new(FALSE, FALSE, sizeof(guint), n_entries);
+        ldm_prefix_table_init(&self->index.prefixes, n_entries);
+
+        for (guint i = 0; i < n_entries; i++) {
+                g_array_append_val(self->index.order, i);
+        }
+        g_array_sort_with_data(self->index.order,
+                               ldm_modalias_plugin_sort_specific_first,
+                               self->rules.entries);
+
+        for (guint i = 0; i < n_entries; i++) {
+                const LdmModaliasEntry *entry = NULL;
+
+                entry = &g_array_index(self->rules.entries,
+                                       LdmModaliasEntry,
+                                       g_array_index(self->index.order, guint, i));
+                ldm_prefix_table_set(&self->index.prefixes, i, entry->match);
+        }
+
+        self->index.dirty = FALSE;
+}
+
+/**
+ * ldm_modalias_plugin_find:
+ * @device: Device to test
+ *
+ * Find the first rule matching the device or one of its children. The
+ * prefix index rules out most candidates before we compare fields, or
+ * resort to fnmatch.
+ *
+ * Returns: (nullable): The matching rule
+ */
+static const LdmModaliasEntry *ldm_modalias_plugin_find(LdmModaliasPlugin *self,
+                                                        LdmDevice *device)
+{
+        g_autoptr(GList) kids = NULL;
+        const gchar *id = NULL;
+
+        id = ldm_device_get_modalias(device);
+        if (id) {
+                LdmPrefixSubject subject = { 0 };
+
+                ldm_prefix_subject_init(&subject, id);
+
+                for (guint group = 0; group < self->index.prefixes.n_groups; group++) {
+                        guint32 survivors = 0;
+
+                        survivors =
+                            ldm_prefix_table_scan_group(&self->index.prefixes, group, &subject);
+
+                        while (survivors) {
+                                const LdmModaliasEntry *entry = NULL;
+                                gint bit = g_bit_nth_lsf(survivors, -1);
+                                guint index = 0;
+
+                                survivors &= survivors - 1;
+                                index = g_array_index(self->index.order,
+                                                      guint,
+                                                      group * LDM_PREFIX_GROUP + (guint)bit);
+                                entry = &g_array_index(self->rules.entries, LdmModaliasEntry, index);
+                                if (ldm_modalias_fields_matches(entry->match,
+                                                                &entry->fields,
+                                                                id,
+                                                                &device->os.modalias_fields)) {
+                                        return entry;
+                                }
+                        }
+                }
+        }
+
+        /* Try matching child devices (interfaces) */
+        kids = ldm_device_get_children(device);
+        for (GList *elem = kids; elem; elem = elem->next) {
+                const LdmModaliasEntry *entry = NULL;
+
+                entry = ldm_modalias_plugin_find(self, LDM_DEVICE(elem->data));
+                if (entry) {
+                        return entry;
+                }
+        }
+
+        return NULL;
 }
 
 /**
@@ -254,22 +678,82 @@ void ldm_modalias_plugin_add_modalias(LdmModaliasPlugin *self, LdmModalias *moda
 static LdmProvider *ldm_modalias_plugin_get_provider(LdmPlugin *plugin, LdmDevice *device)
 {
         LdmModaliasPlugin *self = LDM_MODALIAS_PLUGIN(plugin);
-        LdmProvider *ret = NULL;
-        GHashTableIter iter = { 0 };
-        __ldm_unused__ gpointer key = NULL;
-        LdmModalias *modalias = NULL;
-
-        g_hash_table_iter_init(&iter, self->modaliases);
-        while (g_hash_table_iter_next(&iter, &key, (void **)&modalias)) {
-                if (!ldm_modalias_matches_device(modalias, device)) {
-                        continue;
-                }
+        const LdmModaliasEntry *entry = NULL;
 
-                ret = ldm_provider_new(plugin, device, ldm_modalias_get_package(modalias));
-                return ret;
+        ldm_modalias_plugin_build_index(self);
+
+        entry = ldm_modalias_plugin_find(self, device);
+        if (!entry) {
+                return NULL;
         }
 
-        return NULL;
+        return ldm_provider_new_full(plugin, device, entry->package, entry->driver);
+}
+
+/**
+ * ldm_modalias_plugin_get_result:
+ * @result: (out caller-allocates): Result to fill in
+ *
+ * Match exactly as #ldm_modalias_plugin_get_provider does, handing back the
+ * interned rule strings rather than copies in a new #LdmProvider.
+ *
+ * Returns: TRUE if a rule matched the device
+ */
+static gboolean ldm_modalias_plugin_get_result(LdmPlugin *plugin, LdmDevice *device,
+                                               LdmProviderResult *result)
+{
+        LdmModaliasPlugin *self = LDM_MODALIAS_PLUGIN(plugin);
+        const LdmModaliasEntry *entry = NULL;
+
+        ldm_modalias_plugin_build_index(self);
+
+        entry = ldm_modalias_plugin_find(self, device);
+        if (!entry) {
+                return FALSE;
+        }
+
+        result->package = entry->package;
+        result->driver = entry->driver;
+        return TRUE;
+}
+
+/**
+ * ldm_modalias_plugin_account_memory:
+ *
+ * Rules are alias objects, while the match table and prefix index are only
+ * there to speed up matching. Redefined rules share their match, so every
+ * stored string is live.
+ */
+static void ldm_modalias_plugin_account_memory(LdmPlugin *plugin, LdmMemoryUsage *usage)
+{
+        LdmModaliasPlugin *self = LDM_MODALIAS_PLUGIN(plugin);
+
+        ldm_memory_usage_add(usage,
+                             LDM_MEMORY_CATEGORY_ALIASES,
+                             self->rules.entries->len * sizeof(LdmModaliasEntry),
+                             self->rules.entries->len);
+        ldm_memory_usage_add(usage,
+                             LDM_MEMORY_CATEGORY_STRINGS,
+                             self->rules.string_bytes,
+                             self->rules.n_strings);
+
+        ldm_memory_usage_add_hash_table(usage, LDM_MEMORY_CATEGORY_CACHES, self->rules.matches);
+        ldm_memory_usage_add(usage,
+                             LDM_MEMORY_CATEGORY_CACHES,
+                             sizeof(GString) + self->rules.lookup->allocated_len,
+                             1);
+        if (self->index.order) {
+                ldm_memory_usage_add(usage,
+                                     LDM_MEMORY_CATEGORY_CACHES,
+                                     self->index.order->len * sizeof(guint),
+                                     1);
+        }
+        if (self->index.prefixes.n_groups > 0) {
+                ldm_memory_usage_add(usage,
+                                     LDM_MEMORY_CATEGORY_CACHES,
+                                     ldm_prefix_table_get_size(&self->index.prefixes),
+                                     1);
+        }
 }
 
 /*
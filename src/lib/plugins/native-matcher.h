@@ -0,0 +1,124 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+/*
+ * This header defines the ABI between #LdmNativePlugin and the matcher
+ * modules generated by `mkmodaliases --emit-c`. It is deliberately free of
+ * any GLib types so that generated modules only need a C compiler.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * LDM_NATIVE_MATCHER_ABI:
+ *
+ * Version of the #LdmNativeMatcher structure. Modules built against a
+ * different version are refused.
+ */
+#define LDM_NATIVE_MATCHER_ABI 1
+
+/**
+ * LDM_NATIVE_MATCHER_SYMBOL:
+ *
+ * Name of the #LdmNativeMatcher symbol exported by a matcher module
+ */
+#define LDM_NATIVE_MATCHER_SYMBOL "ldm_native_matcher"
+
+/**
+ * LdmNativeAlias:
+ * @match: The fnmatch style modalias pattern
+ * @driver: The kernel driver supporting matching hardware
+ * @package: The package providing the kernel driver
+ *
+ * A single alias known to a matcher module, identical to one line of a
+ * `.modaliases` file.
+ */
+typedef struct LdmNativeAlias {
+        const char *match;
+        const char *driver;
+        const char *package;
+} LdmNativeAlias;
+
+/**
+ * LdmNativeRoute:
+ * @bus: (nullable): Bus name, i.e. "pci", or NULL to match any bus
+ * @vendor_id: Vendor ID on the bus
+ * @any_vendor: Non-zero if any vendor on the bus may match
+ *
+ * Coverage information for the module, see #ldm_plugin_add_coverage
+ */
+typedef struct LdmNativeRoute {
+        const char *bus;
+        unsigned int vendor_id;
+        int any_vendor;
+} LdmNativeRoute;
+
+/**
+ * LdmNativeQuery:
+ * @modalias: The complete device modalias
+ * @bus: The bus name, i.e. "pci"
+ * @vendor_id: Vendor ID of the device
+ * @product_id: Product ID of the device, i.e. the "d" field for PCI
+ * @has_ids: Non-zero if @bus, @vendor_id and @product_id are valid
+ *
+ * A device modalias, pre-parsed by the library into numeric fields.
+ */
+typedef struct LdmNativeQuery {
+        const char *modalias;
+        const char *bus;
+        unsigned int vendor_id;
+        unsigned int product_id;
+        int has_ids;
+} LdmNativeQuery;
+
+/**
+ * LdmNativeMatcher:
+ * @abi: Must be #LDM_NATIVE_MATCHER_ABI
+ * @n_aliases: Number of aliases in @aliases
+ * @aliases: All aliases known to the module
+ * @n_routes: Number of routes in @routes
+ * @routes: Coverage of the module
+ * @match: Return the alias an #LdmModaliasPlugin with the same aliases
+ *   would pick for the query, or NULL
+ *
+ * The matcher table exported by a module as #LDM_NATIVE_MATCHER_SYMBOL.
+ * A module must agree with #LdmModaliasPlugin: the most specific matching
+ * alias wins, and a later alias with the same match replaces an earlier one.
+ */
+typedef struct LdmNativeMatcher {
+        unsigned int abi;
+        unsigned int n_aliases;
+        const LdmNativeAlias *aliases;
+        unsigned int n_routes;
+        const LdmNativeRoute *routes;
+        const LdmNativeAlias *(*match)(const LdmNativeQuery *query);
+} LdmNativeMatcher;
+
+#ifdef __cplusplus
+}
+#endif
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
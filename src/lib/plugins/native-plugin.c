@@ -0,0 +1,304 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <gmodule.h>
+#include <string.h>
+
+#include "native-matcher.h"
+#include "native-plugin.h"
+#include "route.h"
+#include "util.h"
+
+struct _LdmNativePluginClass {
+        LdmPluginClass parent_class;
+};
+
+/*
+ * LdmNativeInterned
+ *
+ * Package and driver of an alias, interned once when the module is loaded
+ * so that matches can hand them out as they are.
+ */
+typedef struct LdmNativeInterned {
+        const gchar *package;
+        const gchar *driver;
+} LdmNativeInterned;
+
+static LdmProvider *ldm_native_plugin_get_provider(LdmPlugin *plugin, LdmDevice *device);
+static gboolean ldm_native_plugin_get_result(LdmPlugin *plugin, LdmDevice *device,
+                                             LdmProviderResult *result);
+
+/**
+ * SECTION:native-plugin
+ * @Short_description: Compiled modalias matcher plugin
+ * @see_also: #LdmModaliasPlugin, #LdmPlugin
+ * @Title: LdmNativePlugin
+ *
+ * The LdmNativePlugin has the same provider semantics as an #LdmModaliasPlugin,
+ * however the rules are compiled ahead of time into a loadable module rather
+ * than being interpreted at runtime.
+ *
+ * These modules are generated from a `.modaliases` file with `mkmodaliases --emit-c`,
+ * and contain a nested switch over the bus, vendor and product of the device.
+ * Most lookups are therefore resolved with a handful of integer comparisons,
+ * and `fnmatch` is only used to confirm the remaining fields of a candidate.
+ *
+ * Loading a module runs its code, so modules are only ever loaded when asked
+ * for by #ldm_manager_add_native_plugin_for_path, or from the system modalias
+ * directory by #ldm_manager_add_system_modalias_plugins, which prefers a
+ * module named `nvidia.so` over `nvidia.modaliases` alongside it.
+ */
+struct _LdmNativePlugin {
+        LdmPlugin parent;
+
+        GModule *module;
+        const LdmNativeMatcher *matcher;
+        LdmNativeInterned *interned; /* One per alias of the matcher */
+};
+
+G_DEFINE_TYPE(LdmNativePlugin, ldm_native_plugin, LDM_TYPE_PLUGIN)
+
+/**
+ * ldm_native_plugin_dispose:
+ *
+ * Clean up a LdmNativePlugin instance
+ */
+static void ldm_native_plugin_dispose(GObject *obj)
+{
+        LdmNativePlugin *self = LDM_NATIVE_PLUGIN(obj);
+
+        /* Matcher lives within the module */
+        self->matcher = NULL;
+        g_clear_pointer(&self->interned, g_free);
+        g_clear_pointer(&self->module, g_module_close);
+
+        G_OBJECT_CLASS(ldm_native_plugin_parent_class)->dispose(obj);
+}
+
+/**
+ * ldm_native_plugin_class_init:
+ *
+ * Handle class initialisation
+ */
+static void ldm_native_plugin_class_init(LdmNativePluginClass *klazz)
+{
+        GObjectClass *obj_class = G_OBJECT_CLASS(klazz);
+        LdmPluginClass *plug_class = LDM_PLUGIN_CLASS(klazz);
+
+        /* gobject vtable hookup */
+        obj_class->dispose = ldm_native_plugin_dispose;
+
+        /* plugin vtable hookup */
+        plug_class->get_provider = ldm_native_plugin_get_provider;
+        plug_class->get_result = ldm_native_plugin_get_result;
+}
+
+/**
+ * ldm_native_plugin_init:
+ *
+ * Handle construction of the LdmNativePlugin
+ */
+static void ldm_native_plugin_init(__ldm_unused__ LdmNativePlugin *self)
+{
+}
+
+/**
+ * ldm_native_plugin_new_from_filename:
+ * @filename: Path to a matcher module generated by `mkmodaliases`
+ *
+ * Create a new LdmPlugin from a compiled matcher module. The name of the
+ * plugin is the basename of the module, without the `.so` suffix.
+ *
+ * Returns: (transfer full) (nullable): A newly initialised LdmNativePlugin,
+ * or NULL if the module could not be loaded.
+ */
+LdmPlugin *ldm_native_plugin_new_from_filename(const gchar *filename)
+{
+        GModule *module = NULL;
+        const LdmNativeMatcher *matcher = NULL;
+        LdmNativePlugin *self = NULL;
+        g_autofree gchar *name = NULL;
+
+        g_return_val_if_fail(filename != NULL, NULL);
+
+        if (!g_module_supported()) {
+                return NULL;
+        }
+
+        module = g_module_open(filename, G_MODULE_BIND_LAZY | G_MODULE_BIND_LOCAL);
+        if (!module) {
+                g_warning("failed to load %s: %s", filename, g_module_error());
+                return NULL;
+        }
+
+        if (!g_module_symbol(module, LDM_NATIVE_MATCHER_SYMBOL, (gpointer *)&matcher) ||
+            !matcher) {
+                g_warning("%s is not a matcher module", filename);
+                g_module_close(module);
+                return NULL;
+        }
+
+        if (matcher->abi != LDM_NATIVE_MATCHER_ABI || !matcher->match) {
+                g_warning("%s has unsupported matcher ABI %u", filename, matcher->abi);
+                g_module_close(module);
+                return NULL;
+        }
+
+        /* Strip suffix if set */
+        name = g_path_get_basename(filename);
+        if (g_str_has_suffix(name, ".so")) {
+                name[strlen(name) - strlen(".so")] = '\0';
+        }
+
+        self = g_object_new(LDM_TYPE_NATIVE_PLUGIN, "name", name, "priority", 0, NULL);
+        self->module = module;
+        self->matcher = matcher;
+
+        /* Copied, the strings go away with the module */
+        self->interned = g_new0(LdmNativeInterned, MAX(matcher->n_aliases, 1));
+        for (guint i = 0; i < matcher->n_aliases; i++) {
+                self->interned[i].package = g_intern_string(matcher->aliases[i].package);
+                self->interned[i].driver = g_intern_string(matcher->aliases[i].driver);
+        }
+
+        /* Advertise what we could match to allow routing */
+        for (guint i = 0; i < matcher->n_routes; i++) {
+                const LdmNativeRoute *route = &matcher->routes[i];
+
+                if (!route->bus || route->any_vendor) {
+                        ldm_plugin_add_coverage_wildcard(LDM_PLUGIN(self), route->bus);
+                } else {
+                        ldm_plugin_add_coverage(LDM_PLUGIN(self), route->bus, route->vendor_id);
+                }
+        }
+
+        return LDM_PLUGIN(self);
+}
+
+/**
+ * ldm_native_plugin_find:
+ * @device: Device to test
+ *
+ * Find the first alias matching the device or one of its children.
+ *
+ * Returns: (nullable): The matching alias
+ */
+static const LdmNativeAlias *ldm_native_plugin_find(LdmNativePlugin *self, LdmDevice *device)
+{
+        g_autoptr(GList) kids = NULL;
+        const gchar *id = NULL;
+
+        id = ldm_device_get_modalias(device);
+        if (id) {
+                LdmNativeQuery query = { 0 };
+                const LdmNativeAlias *alias = NULL;
+
+                query.modalias = id;
+                query.has_ids =
+                    ldm_route_parse_ids(id, &query.bus, &query.vendor_id, &query.product_id);
+
+                alias = self->matcher->match(&query);
+                if (alias) {
+                        return alias;
+                }
+        }
+
+        /* Try matching child devices (interfaces) */
+        kids = ldm_device_get_children(device);
+        for (GList *elem = kids; elem; elem = elem->next) {
+                const LdmNativeAlias *alias = NULL;
+
+                alias = ldm_native_plugin_find(self, LDM_DEVICE(elem->data));
+                if (alias) {
+                        return alias;
+                }
+        }
+
+        return NULL;
+}
+
+/**
+ * ldm_native_plugin_get_provider:
+ * @device: Test input device
+ *
+ * Ask the compiled matcher for an alias matching the device. If one is
+ * found, return a new #LdmProvider to help configure that device.
+ *
+ * Returns: (transfer full) (nullable): A new #LdmProvider for the device
+ */
+static LdmProvider *ldm_native_plugin_get_provider(LdmPlugin *plugin, LdmDevice *device)
+{
+        LdmNativePlugin *self = LDM_NATIVE_PLUGIN(plugin);
+        const LdmNativeAlias *alias = NULL;
+
+        if (!self->matcher) {
+                return NULL;
+        }
+
+        alias = ldm_native_plugin_find(self, device);
+        if (!alias) {
+                return NULL;
+        }
+
+        return ldm_provider_new_full(plugin, device, alias->package, alias->driver);
+}
+
+/**
+ * ldm_native_plugin_get_result:
+ * @result: (out caller-allocates): Result to fill in
+ *
+ * Same match as #ldm_native_plugin_get_provider, without the #LdmProvider
+ *
+ * Returns: TRUE if the matcher found an alias for the device
+ */
+static gboolean ldm_native_plugin_get_result(LdmPlugin *plugin, LdmDevice *device,
+                                             LdmProviderResult *result)
+{
+        LdmNativePlugin *self = LDM_NATIVE_PLUGIN(plugin);
+        const LdmNativeAlias *alias = NULL;
+        gsize index = 0;
+
+        if (!self->matcher) {
+                return FALSE;
+        }
+
+        alias = ldm_native_plugin_find(self, device);
+        if (!alias) {
+                return FALSE;
+        }
+
+        /* Matchers hand out entries of their own table */
+        index = (gsize)(alias - self->matcher->aliases);
+        if (alias < self->matcher->aliases || index >= self->matcher->n_aliases) {
+                result->package = g_intern_string(alias->package);
+                result->driver = g_intern_string(alias->driver);
+                return TRUE;
+        }
+
+        result->package = self->interned[index].package;
+        result->driver = self->interned[index].driver;
+        return TRUE;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,52 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+
+#include <plugin.h>
+
+G_BEGIN_DECLS
+
+typedef struct _LdmNativePlugin LdmNativePlugin;
+typedef struct _LdmNativePluginClass LdmNativePluginClass;
+
+#define LDM_TYPE_NATIVE_PLUGIN ldm_native_plugin_get_type()
+#define LDM_NATIVE_PLUGIN(o)                                                                       \
+        (G_TYPE_CHECK_INSTANCE_CAST((o), LDM_TYPE_NATIVE_PLUGIN, LdmNativePlugin))
+#define LDM_IS_NATIVE_PLUGIN(o) (G_TYPE_CHECK_INSTANCE_TYPE((o), LDM_TYPE_NATIVE_PLUGIN))
+#define LDM_NATIVE_PLUGIN_CLASS(o)                                                                 \
+        (G_TYPE_CHECK_CLASS_CAST((o), LDM_TYPE_NATIVE_PLUGIN, LdmNativePluginClass))
+#define LDM_IS_NATIVE_PLUGIN_CLASS(o) (G_TYPE_CHECK_CLASS_TYPE((o), LDM_TYPE_NATIVE_PLUGIN))
+#define LDM_NATIVE_PLUGIN_GET_CLASS(o)                                                             \
+        (G_TYPE_INSTANCE_GET_CLASS((o), LDM_TYPE_NATIVE_PLUGIN, LdmNativePluginClass))
+
+GType ldm_native_plugin_get_type(void);
+
+/* API */
+
+LdmPlugin *ldm_native_plugin_new_from_filename(const gchar *filename);
+
+G_END_DECLS
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
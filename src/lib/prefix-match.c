@@ -0,0 +1,294 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "prefix-match.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__)))
+#define LDM_PREFIX_X86 1
+#include <immintrin.h>
+#else
+#define LDM_PREFIX_X86 0
+#endif
+
+/* Size of one position row, and of a whole group */
+#define LDM_PREFIX_ROW LDM_PREFIX_GROUP
+#define LDM_PREFIX_BLOCK (LDM_PREFIX_WIDTH * LDM_PREFIX_ROW)
+
+/*
+ * A kernel tests every candidate in one group against the subject, returning
+ * the subset of the alive mask for which the literal prefix matches.
+ */
+typedef guint32 (*LdmPrefixKernel)(const guint8 *bytes, const guint8 *ignore, guint max_len,
+                                   const guint8 *subject, guint32 alive);
+
+static inline gboolean ldm_prefix_is_glob(gchar c)
+{
+        return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+/**
+ * ldm_prefix_scan_scalar:
+ *
+ * Portable fallback kernel
+ */
+static guint32 ldm_prefix_scan_scalar(const guint8 *bytes, const guint8 *ignore, guint max_len,
+                                      const guint8 *subject, guint32 alive)
+{
+        for (guint i = 0; i < max_len && alive; i++) {
+                const guint8 *row = bytes + i * LDM_PREFIX_ROW;
+                const guint8 *skip = ignore + i * LDM_PREFIX_ROW;
+                guint32 ok = 0;
+
+                for (guint c = 0; c < LDM_PREFIX_ROW; c++) {
+                        if (row[c] == subject[i] || skip[c]) {
+                                ok |= 1u << c;
+                        }
+                }
+                alive &= ok;
+        }
+
+        return alive;
+}
+
+#if LDM_PREFIX_X86
+
+/**
+ * ldm_prefix_scan_sse2:
+ *
+ * Baseline x86 kernel, testing 16 candidates per comparison
+ */
+static guint32 ldm_prefix_scan_sse2(const guint8 *bytes, const guint8 *ignore, guint max_len,
+                                    const guint8 *subject, guint32 alive)
+{
+        for (guint i = 0; i < max_len && alive; i++) {
+                const guint8 *row = bytes + i * LDM_PREFIX_ROW;
+                const guint8 *skip = ignore + i * LDM_PREFIX_ROW;
+                __m128i needle = _mm_set1_epi8((char)subject[i]);
+                __m128i lo, hi;
+                guint32 ok = 0;
+
+                lo = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)row), needle);
+                hi = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(row + 16)), needle);
+                lo = _mm_or_si128(lo, _mm_loadu_si128((const __m128i *)skip));
+                hi = _mm_or_si128(hi, _mm_loadu_si128((const __m128i *)(skip + 16)));
+
+                ok = (guint32)_mm_movemask_epi8(lo) & 0xFFFF;
+                ok |= ((guint32)_mm_movemask_epi8(hi) & 0xFFFF) << 16;
+                alive &= ok;
+        }
+
+        return alive;
+}
+
+/**
+ * ldm_prefix_scan_avx2:
+ *
+ * Tests all 32 candidates of a group per comparison. Only used when the
+ * CPU reports AVX2 support at runtime.
+ */
+__attribute__((target("avx2"))) static guint32 ldm_prefix_scan_avx2(const guint8 *bytes,
+                                                                    const guint8 *ignore,
+                                                                    guint max_len,
+                                                                    const guint8 *subject,
+                                                                    guint32 alive)
+{
+        for (guint i = 0; i < max_len && alive; i++) {
+                const guint8 *row = bytes + i * LDM_PREFIX_ROW;
+                const guint8 *skip = ignore + i * LDM_PREFIX_ROW;
+                __m256i needle = _mm256_set1_epi8((char)subject[i]);
+                __m256i eq;
+
+                eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)row), needle);
+                eq = _mm256_or_si256(eq, _mm256_loadu_si256((const __m256i *)skip));
+                alive &= (guint32)_mm256_movemask_epi8(eq);
+        }
+
+        return alive;
+}
+
+#endif
+
+/**
+ * ldm_prefix_get_kernel:
+ *
+ * Select the best kernel for this CPU, once.
+ */
+static LdmPrefixKernel ldm_prefix_get_kernel(void)
+{
+        static gsize kernel_index = 0;
+        static const LdmPrefixKernel kernels[] = {
+                ldm_prefix_scan_scalar,
+#if LDM_PREFIX_X86
+                ldm_prefix_scan_sse2,
+                ldm_prefix_scan_avx2,
+#endif
+        };
+
+        if (g_once_init_enter(&kernel_index)) {
+                gsize index = 0;
+#if LDM_PREFIX_X86
+                __builtin_cpu_init();
+                index = __builtin_cpu_supports("avx2") ? 2 : 1;
+#endif
+                /* Stored off by one as zero means uninitialised */
+                g_once_init_leave(&kernel_index, index + 1);
+        }
+
+        return kernels[kernel_index - 1];
+}
+
+/**
+ * ldm_prefix_table_init:
+ * @n_items: Number of candidates in the table
+ *
+ * Allocate storage for the given number of candidates. Each candidate will
+ * match anything until set with #ldm_prefix_table_set
+ */
+void ldm_prefix_table_init(LdmPrefixTable *table, guint n_items)
+{
+        gsize n_bytes = 0;
+
+        memset(table, 0, sizeof(*table));
+        if (n_items < 1) {
+                return;
+        }
+
+        table->n_items = n_items;
+        table->n_groups = (n_items + LDM_PREFIX_GROUP - 1) / LDM_PREFIX_GROUP;
+        n_bytes = (gsize)table->n_groups * LDM_PREFIX_BLOCK;
+
+        table->bytes = g_malloc0(n_bytes);
+        table->ignore = g_malloc(n_bytes);
+        memset(table->ignore, 0xFF, n_bytes);
+        table->max_len = g_malloc0(table->n_groups);
+}
+
+/**
+ * ldm_prefix_table_set:
+ * @index: Candidate index
+ * @pattern: fnmatch style pattern for the candidate
+ *
+ * Store the literal prefix of the pattern at the given index
+ */
+void ldm_prefix_table_set(LdmPrefixTable *table, guint index, const gchar *pattern)
+{
+        guint group = index / LDM_PREFIX_GROUP;
+        guint column = index % LDM_PREFIX_GROUP;
+        guint8 *bytes = NULL;
+        guint8 *ignore = NULL;
+        guint len = 0;
+
+        g_assert(index < table->n_items);
+
+        bytes = table->bytes + (gsize)group * LDM_PREFIX_BLOCK + column;
+        ignore = table->ignore + (gsize)group * LDM_PREFIX_BLOCK + column;
+
+        for (len = 0; len < LDM_PREFIX_WIDTH; len++) {
+                gchar c = pattern[len];
+
+                if (c == '\0' || ldm_prefix_is_glob(c)) {
+                        break;
+                }
+                bytes[len * LDM_PREFIX_ROW] = (guint8)c;
+                ignore[len * LDM_PREFIX_ROW] = 0x00;
+        }
+
+        if (len > table->max_len[group]) {
+                table->max_len[group] = (guint8)len;
+        }
+}
+
+/**
+ * ldm_prefix_table_clear:
+ *
+ * Release the storage used by the table
+ */
+void ldm_prefix_table_clear(LdmPrefixTable *table)
+{
+        g_clear_pointer(&table->bytes, g_free);
+        g_clear_pointer(&table->ignore, g_free);
+        g_clear_pointer(&table->max_len, g_free);
+        table->n_items = 0;
+        table->n_groups = 0;
+}
+
+/**
+ * ldm_prefix_table_get_size:
+ *
+ * Returns: Number of bytes allocated for the table
+ */
+gsize ldm_prefix_table_get_size(const LdmPrefixTable *table)
+{
+        return (gsize)table->n_groups * (LDM_PREFIX_BLOCK * 2 + 1);
+}
+
+/**
+ * ldm_prefix_subject_init:
+ * @string: The subject string, i.e. a device modalias
+ *
+ * Prepare the subject for scanning against a table
+ */
+void ldm_prefix_subject_init(LdmPrefixSubject *subject, const gchar *string)
+{
+        memset(subject->bytes, 0, sizeof(subject->bytes));
+
+        for (guint i = 0; i < LDM_PREFIX_WIDTH && string[i]; i++) {
+                subject->bytes[i] = (guint8)string[i];
+        }
+}
+
+/**
+ * ldm_prefix_table_scan_group:
+ * @group: Index of the candidate group
+ * @subject: Prepared subject
+ *
+ * Test the subject against every candidate of the group at once.
+ *
+ * Returns: A bitmask of the candidates whose literal prefix matches, where
+ * bit N corresponds to index (group * LDM_PREFIX_GROUP + N)
+ */
+guint32 ldm_prefix_table_scan_group(const LdmPrefixTable *table, guint group,
+                                    const LdmPrefixSubject *subject)
+{
+        guint32 alive = G_MAXUINT32;
+        guint tail = table->n_items % LDM_PREFIX_GROUP;
+        gsize offset = (gsize)group * LDM_PREFIX_BLOCK;
+
+        g_assert(group < table->n_groups);
+
+        /* Mask off unused candidates in the final group */
+        if (group == table->n_groups - 1 && tail != 0) {
+                alive = (1u << tail) - 1;
+        }
+
+        return ldm_prefix_get_kernel()(table->bytes + offset,
+                                       table->ignore + offset,
+                                       table->max_len[group],
+                                       subject->bytes,
+                                       alive);
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,69 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * Number of leading bytes of each pattern that we index, and the number of
+ * candidates in a single group (one bit each in the scan result).
+ */
+#define LDM_PREFIX_WIDTH 32
+#define LDM_PREFIX_GROUP 32
+
+/*
+ * LdmPrefixTable
+ *
+ * Literal prefixes (everything before the first glob character) of a set of
+ * fnmatch patterns, stored transposed in groups of LDM_PREFIX_GROUP so that
+ * one vector comparison tests the same byte position of every candidate in
+ * the group. Candidates that survive the scan must still be checked with
+ * fnmatch, the table only rules out patterns that cannot possibly match.
+ */
+typedef struct LdmPrefixTable {
+        guint8 *bytes;   /* [group][position][candidate] literal bytes */
+        guint8 *ignore;  /* [group][position][candidate] 0xFF past the literal */
+        guint8 *max_len; /* [group] longest literal in the group */
+        guint n_items;   /* Number of candidates */
+        guint n_groups;  /* Number of candidate groups */
+} LdmPrefixTable;
+
+/*
+ * LdmPrefixSubject
+ *
+ * A zero padded copy of the subject string, prepared once per scan.
+ */
+typedef struct LdmPrefixSubject {
+        guint8 bytes[LDM_PREFIX_WIDTH];
+} LdmPrefixSubject;
+
+void ldm_prefix_table_init(LdmPrefixTable *table, guint n_items);
+void ldm_prefix_table_set(LdmPrefixTable *table, guint index, const gchar *pattern);
+void ldm_prefix_table_clear(LdmPrefixTable *table);
+gsize ldm_prefix_table_get_size(const LdmPrefixTable *table);
+
+void ldm_prefix_subject_init(LdmPrefixSubject *subject, const gchar *string);
+guint32 ldm_prefix_table_scan_group(const LdmPrefixTable *table, guint group,
+                                    const LdmPrefixSubject *subject);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -11,6 +11,7 @@
 
 #define _GNU_SOURCE
 
+#include "provider-private.h"
 #include "provider.h"
 #include "util.h"
 
@@ -22,6 +23,10 @@
  *
  * An LdmProvider is the result type when searching for hardware providers
  * using the #LdmManager plugins.
+ *
+ * Bulk consumers may use #ldm_manager_get_provider_results instead, which
+ * returns plain #LdmProviderResult structs, and only construct an
+ * LdmProvider with #ldm_provider_new_from_result where one is needed.
  */
 
 struct _LdmProviderClass {
@@ -34,7 +39,9 @@ struct _LdmProvider {
         LdmDevice *device;
         LdmPlugin *plugin;
         gchar *package;
+        gchar *driver;
         gboolean installed;
+        gboolean loaded;
 };
 
 static void ldm_provider_set_property(GObject *object, guint id, const GValue *value,
@@ -43,8 +50,19 @@ static void ldm_provider_get_property(GObject *object, guint id, GValue *value,
 
 G_DEFINE_TYPE(LdmProvider, ldm_provider, G_TYPE_INITIALLY_UNOWNED)
 
+G_DEFINE_BOXED_TYPE(LdmProviderResult, ldm_provider_result, ldm_provider_result_copy,
+                    ldm_provider_result_free)
+
 /* Property IDs */
-enum { PROP_DEVICE = 1, PROP_PLUGIN, PROP_PACKAGE, N_PROPS };
+enum {
+        PROP_DEVICE = 1,
+        PROP_PLUGIN,
+        PROP_PACKAGE,
+        PROP_DRIVER,
+        PROP_INSTALLED,
+        PROP_LOADED,
+        N_PROPS
+};
 
 static GParamSpec *obj_properties[N_PROPS] = {
         NULL,
@@ -59,6 +77,7 @@ static void ldm_provider_dispose(GObject *obj)
 {
         LdmProvider *self = LDM_PROVIDER(obj);
         g_clear_pointer(&self->package, g_free);
+        g_clear_pointer(&self->driver, g_free);
 
         G_OBJECT_CLASS(ldm_provider_parent_class)->dispose(obj);
 }
@@ -114,6 +133,43 @@ static void ldm_provider_class_init(LdmProviderClass *klazz)
                                 NULL,
                                 G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
 
+        /**
+         * LdmProvider:driver: (transfer none)
+         *
+         * The kernel module that supports the device once the package is
+         * installed, if known.
+         */
+        obj_properties[PROP_DRIVER] =
+            g_param_spec_string("driver",
+                                "Kernel driver",
+                                "Kernel module provided by the package",
+                                NULL,
+                                G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE);
+
+        /**
+         * LdmProvider:installed
+         *
+         * Whether the #LdmProvider:driver is already installed. This is only
+         * known once the provider has been passed to an #LdmModuleResolver.
+         */
+        obj_properties[PROP_INSTALLED] = g_param_spec_boolean("installed",
+                                                              "Installed",
+                                                              "Whether the driver is installed",
+                                                              FALSE,
+                                                              G_PARAM_READABLE);
+
+        /**
+         * LdmProvider:loaded
+         *
+         * Whether the #LdmProvider:driver is currently loaded. This is only
+         * known once the provider has been passed to an #LdmModuleResolver.
+         */
+        obj_properties[PROP_LOADED] = g_param_spec_boolean("loaded",
+                                                           "Loaded",
+                                                           "Whether the driver is loaded",
+                                                           FALSE,
+                                                           G_PARAM_READABLE);
+
         g_object_class_install_properties(obj_class, N_PROPS, obj_properties);
 }
 
@@ -133,6 +189,10 @@ static void ldm_provider_set_property(GObject *object, guint id, const GValue *v
                 g_clear_pointer(&self->package, g_free);
                 self->package = g_value_dup_string(value);
                 break;
+        case PROP_DRIVER:
+                g_clear_pointer(&self->driver, g_free);
+                self->driver = g_value_dup_string(value);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
                 break;
@@ -153,6 +213,15 @@ static void ldm_provider_get_property(GObject *object, guint id, GValue *value,
         case PROP_PACKAGE:
                 g_value_set_string(value, self->package);
                 break;
+        case PROP_DRIVER:
+                g_value_set_string(value, self->driver);
+                break;
+        case PROP_INSTALLED:
+                g_value_set_boolean(value, self->installed);
+                break;
+        case PROP_LOADED:
+                g_value_set_boolean(value, self->loaded);
+                break;
         default:
                 G_OBJECT_WARN_INVALID_PROPERTY_ID(object, id, spec);
                 break;
@@ -192,6 +261,77 @@ LdmProvider *ldm_provider_new(LdmPlugin *parent_plugin, LdmDevice *device,
                             NULL);
 }
 
+/**
+ * ldm_provider_new_full:
+ * @parent_plugin: The plugin to associate this provider with
+ * @device: The device to associate this provider with
+ * @package_name: The package or bundle name to install.
+ * @driver: (nullable): The kernel module provided by the package
+ *
+ * Construct a new #LdmProvider that also knows which kernel module it
+ * provides, so that an #LdmModuleResolver can tell if it is already
+ * installed.
+ *
+ * Returns: (transfer full): A new #LdmProvider instance
+ */
+LdmProvider *ldm_provider_new_full(LdmPlugin *parent_plugin, LdmDevice *device,
+                                   const gchar *package_name, const gchar *driver)
+{
+        return g_object_new(LDM_TYPE_PROVIDER,
+                            "plugin",
+                            parent_plugin,
+                            "device",
+                            device,
+                            "package",
+                            package_name,
+                            "driver",
+                            driver,
+                            NULL);
+}
+
+/**
+ * ldm_provider_new_from_result:
+ * @result: A result from #ldm_manager_get_provider_results
+ * @device: The device the result was found for
+ *
+ * Construct the #LdmProvider equivalent to the result
+ *
+ * Returns: (transfer full): A new #LdmProvider instance
+ */
+LdmProvider *ldm_provider_new_from_result(const LdmProviderResult *result, LdmDevice *device)
+{
+        g_return_val_if_fail(result != NULL, NULL);
+
+        return ldm_provider_new_full(result->plugin, device, result->package, result->driver);
+}
+
+/**
+ * ldm_provider_result_copy:
+ *
+ * Returns: (transfer full): A copy of the result
+ */
+LdmProviderResult *ldm_provider_result_copy(const LdmProviderResult *result)
+{
+        LdmProviderResult *copy = NULL;
+
+        g_return_val_if_fail(result != NULL, NULL);
+
+        copy = g_new(LdmProviderResult, 1);
+        *copy = *result;
+        return copy;
+}
+
+/**
+ * ldm_provider_result_free:
+ *
+ * Free a result returned by #ldm_provider_result_copy. The strings are
+ * interned and never freed.
+ */
+void ldm_provider_result_free(LdmProviderResult *result)
+{
+        g_free(result);
+}
+
 /**
  * ldm_provider_get_device:
  *
@@ -233,6 +373,70 @@ const gchar *ldm_provider_get_package(LdmProvider *self)
         return (const gchar *)self->package;
 }
 
+/**
+ * ldm_provider_get_driver:
+ *
+ * Get the kernel module provided by the package, if known.
+ *
+ * Returns: (transfer none) (nullable): The kernel module name.
+ */
+const gchar *ldm_provider_get_driver(LdmProvider *self)
+{
+        g_return_val_if_fail(self != NULL, NULL);
+        return (const gchar *)self->driver;
+}
+
+/**
+ * ldm_provider_get_installed:
+ *
+ * Determine whether the #LdmProvider:driver is already installed, as found
+ * by #ldm_module_resolver_resolve.
+ *
+ * Returns: TRUE if the driver is installed
+ */
+gboolean ldm_provider_get_installed(LdmProvider *self)
+{
+        g_return_val_if_fail(self != NULL, FALSE);
+        return self->installed;
+}
+
+/**
+ * ldm_provider_get_loaded:
+ *
+ * Determine whether the #LdmProvider:driver is currently loaded, as found
+ * by #ldm_module_resolver_resolve.
+ *
+ * Returns: TRUE if the driver is loaded
+ */
+gboolean ldm_provider_get_loaded(LdmProvider *self)
+{
+        g_return_val_if_fail(self != NULL, FALSE);
+        return self->loaded;
+}
+
+/**
+ * ldm_provider_set_module_state:
+ * @state: State of the #LdmProvider:driver
+ *
+ * Record the module state found by the #LdmModuleResolver
+ */
+void ldm_provider_set_module_state(LdmProvider *self, LdmModuleState state)
+{
+        gboolean installed = (state & LDM_MODULE_STATE_INSTALLED) ? TRUE : FALSE;
+        gboolean loaded = (state & LDM_MODULE_STATE_LOADED) ? TRUE : FALSE;
+
+        g_return_if_fail(self != NULL);
+
+        if (self->installed != installed) {
+                self->installed = installed;
+                g_object_notify_by_pspec(G_OBJECT(self), obj_properties[PROP_INSTALLED]);
+        }
+        if (self->loaded != loaded) {
+                self->loaded = loaded;
+                g_object_notify_by_pspec(G_OBJECT(self), obj_properties[PROP_LOADED]);
+        }
+}
+
 /*
  * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
  *
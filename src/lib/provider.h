@@ -19,6 +19,7 @@ G_BEGIN_DECLS
 
 typedef struct _LdmProvider LdmProvider;
 typedef struct _LdmProviderClass LdmProviderClass;
+typedef struct _LdmProviderResult LdmProviderResult;
 
 /* Fix circular references between Provider and Plugin */
 #include <plugin.h>
@@ -33,15 +34,47 @@ typedef struct _LdmProviderClass LdmProviderClass;
 
 GType ldm_provider_get_type(void);
 
+/**
+ * LdmProviderResult:
+ * @plugin: (transfer none): The plugin that matched the device
+ * @package: Interned name of the package or bundle to install
+ * @driver: (nullable): Interned name of the kernel module provided by the package
+ * @priority: Priority of the plugin when the device was matched
+ *
+ * Plain result of matching a device against a plugin, for consumers that
+ * don't need a full #LdmProvider. The strings are interned, so they may be
+ * compared by pointer and are never freed. The plugin is only valid for
+ * as long as the #LdmManager owning it.
+ */
+struct _LdmProviderResult {
+        LdmPlugin *plugin;
+        const gchar *package;
+        const gchar *driver;
+        gint priority;
+};
+
+#define LDM_TYPE_PROVIDER_RESULT ldm_provider_result_get_type()
+
+GType ldm_provider_result_get_type(void);
+LdmProviderResult *ldm_provider_result_copy(const LdmProviderResult *result);
+void ldm_provider_result_free(LdmProviderResult *result);
+
 /* API */
 
 LdmProvider *ldm_provider_new(LdmPlugin *parent_plugin, LdmDevice *device,
                               const gchar *package_name);
+LdmProvider *ldm_provider_new_full(LdmPlugin *parent_plugin, LdmDevice *device,
+                                   const gchar *package_name, const gchar *driver);
+LdmProvider *ldm_provider_new_from_result(const LdmProviderResult *result, LdmDevice *device);
 LdmDevice *ldm_provider_get_device(LdmProvider *provider);
 LdmPlugin *ldm_provider_get_plugin(LdmProvider *provider);
 const gchar *ldm_provider_get_package(LdmProvider *provider);
+const gchar *ldm_provider_get_driver(LdmProvider *provider);
+gboolean ldm_provider_get_installed(LdmProvider *provider);
+gboolean ldm_provider_get_loaded(LdmProvider *provider);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(LdmProvider, g_object_unref)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(LdmProviderResult, ldm_provider_result_free)
 
 G_END_DECLS
 
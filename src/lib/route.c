@@ -0,0 +1,303 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+#include "route.h"
+
+/*
+ * Buses for which we know how to find the vendor and product fields. The
+ * unique flags indicate that the marker character can only ever appear once
+ * in a modalias for that bus, so a glob appearing before it cannot cause the
+ * literal field to match anything other than the real field.
+ *
+ * PCI is not unique due to the "sv" (subvendor) and "sd" (subdevice) fields,
+ * and the USB product marker also appears in "dp" and "ip".
+ */
+static const struct {
+        const gchar *bus;
+        gchar vendor;
+        gboolean vendor_unique;
+        gchar product;
+        gboolean product_unique;
+} ldm_route_buses[] = {
+        { "pci", 'v', FALSE, 'd', FALSE },
+        { "usb", 'v', TRUE, 'p', FALSE },
+        { "hid", 'v', TRUE, 'p', TRUE },
+};
+
+static inline gboolean ldm_route_is_glob(gchar c)
+{
+        return c == '*' || c == '?' || c == '[' || c == '\\';
+}
+
+static inline gboolean ldm_route_is_marker(gchar c)
+{
+        return c >= 'a' && c <= 'z';
+}
+
+/**
+ * ldm_route_parse_hex:
+ *
+ * Parse the field value between start and end.
+ *
+ * Returns: FALSE if the value isn't a literal hex ID that we can represent
+ */
+static gboolean ldm_route_parse_hex(const gchar *start, const gchar *end, guint32 *out)
+{
+        guint32 value = 0;
+        gsize len = (gsize)(end - start);
+
+        if (len < 1 || len > 8) {
+                return FALSE;
+        }
+
+        for (const gchar *c = start; c < end; c++) {
+                gint digit = g_ascii_xdigit_value(*c);
+                if (digit < 0) {
+                        return FALSE;
+                }
+                value = (value << 4) | (guint32)digit;
+        }
+
+        *out = value;
+        return TRUE;
+}
+
+/**
+ * ldm_route_find_field:
+ * @fields: The modalias following the bus separator
+ * @marker: Single character marker of the field, i.e. 'v'
+ * @unique: Whether the marker only ever appears once for this bus
+ * @out: Storage for the field value
+ *
+ * Walk marker/value tokens, i.e. "v" "000010DE" "d" "00001C60", and find the
+ * value of the given field, if it is provably literal.
+ *
+ * Returns: TRUE if the field was found and has a literal value
+ */
+static gboolean ldm_route_find_field(const gchar *fields, gchar marker, gboolean unique,
+                                     guint32 *out)
+{
+        const gchar *c = fields;
+
+        while (*c) {
+                const gchar *marker_start = c;
+                const gchar *value = NULL;
+                gboolean seen_glob = FALSE;
+
+                while (*c && ldm_route_is_marker(*c)) {
+                        ++c;
+                }
+                value = c;
+                while (*c && !ldm_route_is_marker(*c)) {
+                        if (ldm_route_is_glob(*c)) {
+                                seen_glob = TRUE;
+                        }
+                        ++c;
+                }
+
+                if (value - marker_start != 1 || *marker_start != marker) {
+                        continue;
+                }
+
+                /* Glob before the field may swallow a similar marker */
+                for (const gchar *g = fields; g < marker_start && !unique; g++) {
+                        if (ldm_route_is_glob(*g)) {
+                                return FALSE;
+                        }
+                }
+
+                if (seen_glob) {
+                        return FALSE;
+                }
+
+                return ldm_route_parse_hex(value, c, out);
+        }
+
+        return FALSE;
+}
+
+/**
+ * ldm_route_parse_bus:
+ *
+ * Find the bus of the modalias, and the index of our knowledge about it.
+ *
+ * Returns: Pointer to the fields following the bus, or NULL if no bus
+ * could be determined.
+ */
+static const gchar *ldm_route_parse_bus(const gchar *modalias, const gchar **bus_out,
+                                        gint *known_out)
+{
+        gchar bus[32] = { 0 };
+        const gchar *sep = NULL;
+        gsize bus_len = 0;
+
+        sep = strchr(modalias, ':');
+        if (!sep) {
+                return NULL;
+        }
+
+        bus_len = (gsize)(sep - modalias);
+        if (bus_len < 1 || bus_len >= sizeof(bus)) {
+                return NULL;
+        }
+
+        for (gsize i = 0; i < bus_len; i++) {
+                if (ldm_route_is_glob(modalias[i])) {
+                        return NULL;
+                }
+                bus[i] = modalias[i];
+        }
+
+        *bus_out = g_intern_string(bus);
+        *known_out = -1;
+
+        for (guint i = 0; i < G_N_ELEMENTS(ldm_route_buses); i++) {
+                if (g_str_equal(bus, ldm_route_buses[i].bus)) {
+                        *known_out = (gint)i;
+                        break;
+                }
+        }
+
+        return sep + 1;
+}
+
+/**
+ * ldm_route_parse:
+ * @route: (out): Storage for the route
+ * @modalias: A device modalias or fnmatch style modalias pattern
+ *
+ * Extract the bus and vendor from the given modalias. Patterns are handled
+ * conservatively: if we cannot prove the vendor field is literal, the
+ * route will cover every vendor on the bus.
+ *
+ * Returns: FALSE if no bus could be determined, i.e. the pattern may match
+ * devices on any bus.
+ */
+gboolean ldm_route_parse(LdmRoute *route, const gchar *modalias)
+{
+        const gchar *fields = NULL;
+        gint known = -1;
+
+        g_return_val_if_fail(route != NULL, FALSE);
+        g_return_val_if_fail(modalias != NULL, FALSE);
+
+        fields = ldm_route_parse_bus(modalias, &route->bus, &known);
+        if (!fields) {
+                return FALSE;
+        }
+
+        route->vendor_id = 0;
+        route->any_vendor = TRUE;
+
+        /* Bus level coverage only */
+        if (known < 0) {
+                return TRUE;
+        }
+
+        if (ldm_route_find_field(fields,
+                                 ldm_route_buses[known].vendor,
+                                 ldm_route_buses[known].vendor_unique,
+                                 &route->vendor_id)) {
+                route->any_vendor = FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * ldm_route_parse_ids:
+ * @modalias: A device modalias or fnmatch style modalias pattern
+ * @bus: (out): Interned bus name
+ * @vendor_id: (out): Vendor ID
+ * @product_id: (out): Product ID, i.e. the "d" field for PCI
+ *
+ * Extract the bus, vendor and product from the given modalias. For patterns
+ * this only succeeds if both the vendor and product are provably literal,
+ * meaning any device matching the pattern has exactly these IDs.
+ *
+ * Returns: TRUE if all of the IDs could be determined
+ */
+gboolean ldm_route_parse_ids(const gchar *modalias, const gchar **bus, guint32 *vendor_id,
+                             guint32 *product_id)
+{
+        const gchar *fields = NULL;
+        gint known = -1;
+
+        g_return_val_if_fail(modalias != NULL, FALSE);
+
+        fields = ldm_route_parse_bus(modalias, bus, &known);
+        if (!fields || known < 0) {
+                return FALSE;
+        }
+
+        if (!ldm_route_find_field(fields,
+                                  ldm_route_buses[known].vendor,
+                                  ldm_route_buses[known].vendor_unique,
+                                  vendor_id)) {
+                return FALSE;
+        }
+
+        return ldm_route_find_field(fields,
+                                    ldm_route_buses[known].product,
+                                    ldm_route_buses[known].product_unique,
+                                    product_id);
+}
+
+/**
+ * ldm_route_hash:
+ *
+ * GHashFunc for #LdmRoute keys
+ */
+guint ldm_route_hash(gconstpointer v)
+{
+        const LdmRoute *route = v;
+        guint hash = g_direct_hash(route->bus);
+
+        if (route->any_vendor) {
+                return hash;
+        }
+
+        return (hash * 31) ^ route->vendor_id;
+}
+
+/**
+ * ldm_route_equal:
+ *
+ * GEqualFunc for #LdmRoute keys
+ */
+gboolean ldm_route_equal(gconstpointer a, gconstpointer b)
+{
+        const LdmRoute *route_a = a;
+        const LdmRoute *route_b = b;
+
+        if (route_a->bus != route_b->bus || route_a->any_vendor != route_b->any_vendor) {
+                return FALSE;
+        }
+
+        return route_a->any_vendor || route_a->vendor_id == route_b->vendor_id;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,49 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/*
+ * LdmRoute
+ *
+ * A route is the coarse (bus, vendor) key extracted from a modalias or from
+ * an fnmatch style modalias pattern. It is used to skip plugins that cannot
+ * possibly match a device, without ever invoking fnmatch.
+ *
+ * The bus is always an interned string so that routes may be compared and
+ * hashed by pointer.
+ */
+typedef struct LdmRoute {
+        const gchar *bus;    /* Interned bus name, i.e. "pci" */
+        guint32 vendor_id;   /* Vendor ID when any_vendor is FALSE */
+        gboolean any_vendor; /* Route covers every vendor on the bus */
+} LdmRoute;
+
+gboolean ldm_route_parse(LdmRoute *route, const gchar *modalias);
+gboolean ldm_route_parse_ids(const gchar *modalias, const gchar **bus, guint32 *vendor_id,
+                             guint32 *product_id);
+guint ldm_route_hash(gconstpointer v);
+gboolean ldm_route_equal(gconstpointer a, gconstpointer b);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -51,9 +51,16 @@ static int ldm_session_init_configure_optimus(void)
 
 static int ldm_session_init_configure(void)
 {
+        g_autoptr(LdmGLXManager) glx_manager = NULL;
         g_autoptr(LdmManager) manager = NULL;
         g_autoptr(LdmGPUConfig) config = NULL;
 
+        /* In render offload mode the iGPU is already primary, nothing to do */
+        glx_manager = ldm_glx_manager_new();
+        if (ldm_glx_manager_get_hybrid_mode(glx_manager) == LDM_HYBRID_MODE_OFFLOAD) {
+                return EXIT_SUCCESS;
+        }
+
         /* Grab manager now */
         manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR | LDM_MANAGER_FLAGS_GPU_QUICK);
         if (!manager) {
@@ -79,8 +86,8 @@ static int ldm_session_init_configure(void)
  * Main entry into ldm-session-init
  *
  * This is a quick and easy init point for all sessions with LDM enabled distros.
- * If hybrid graphics are enabled, we execute the relevant xrandr setup and exit.
- * Otherwise, we just exit, real quick.
+ * If hybrid graphics are enabled in the "always on" mode, we execute the relevant
+ * xrandr setup and exit. Otherwise, we just exit, real quick.
  *
  * The idea is to allow the package to provide the stateless configurations for
  * the various helpers (lightdm, gdm, etc) so it doesn't have to do lots of
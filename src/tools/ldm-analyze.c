@@ -0,0 +1,603 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include "../lib/util.h"
+#include "config.h"
+
+#include <errno.h>
+#include <glib.h>
+#include <glob.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <umockdev.h>
+#include <unistd.h>
+
+#include "ldm.h"
+
+DEF_AUTOFREE(UMockdevTestbed, g_object_unref)
+
+/* Number of snapshots a worker claims at once, to keep the queue cold */
+#define ANALYZE_BATCH 16
+
+/* Size of the reads from a worker */
+#define ANALYZE_CHUNK 65536
+
+/* umockdev only redirects sysfs for processes with its preload library */
+#define ANALYZE_PRELOAD "libumockdev-preload"
+
+/**
+ * A worker process and the lines it has sent so far
+ */
+typedef struct AnalyzeWorker {
+        pid_t pid;
+        int fd;          /* Read end of the worker's pipe, -1 once closed */
+        GString *buffer; /* Anything after the last complete line */
+} AnalyzeWorker;
+
+static void print_usage(const char *progname)
+{
+        fprintf(stderr, "%s usage: [recordings directory or file...]\n", progname);
+        fprintf(stderr, "Run '%s --help' for further information\n", progname);
+}
+
+static void print_version(void)
+{
+        fputs(PACKAGE_NAME " version " PACKAGE_VERSION "\n\n", stdout);
+        fputs("Copyright © 2017-2018 Solus Project\n\n", stdout);
+        fputs(PACKAGE_NAME
+              " "
+              "is free software; you can redistribute it and/or modify\n\
+it under the terms of the GNU Lesser General Public License as published by\n\
+the Free Software Foundation; either version 2.1 of the License, or\n\
+(at your option) any later version.\n",
+              stdout);
+}
+
+/**
+ * CLI options that we know about
+ */
+
+static gboolean opt_version = FALSE;
+static gint opt_jobs = 0;
+static gchar *opt_modalias_dir = NULL;
+static gchar *opt_filename = NULL;
+static gchar **opt_strings = NULL;
+
+static GOptionEntry cli_entries[] = {
+        { "version", 'v', 0, G_OPTION_ARG_NONE, &opt_version, "Print version and exit", NULL },
+        { "jobs",
+          'j',
+          0,
+          G_OPTION_ARG_INT,
+          &opt_jobs,
+          "Number of worker processes, one per CPU by default",
+          "N" },
+        { "modalias-dir",
+          'm',
+          0,
+          G_OPTION_ARG_FILENAME,
+          &opt_modalias_dir,
+          "Directory of .modaliases files, the system directory by default",
+          "DIR" },
+        { "output",
+          'o',
+          0,
+          G_OPTION_ARG_FILENAME,
+          &opt_filename,
+          "Redirect to the given file",
+          NULL },
+        { G_OPTION_REMAINING,
+          0,
+          0,
+          G_OPTION_ARG_STRING_ARRAY,
+          &opt_strings,
+          "Recordings",
+          "[recordings...]" },
+        { 0 },
+};
+
+/**
+ * Append a JSON string, or null
+ */
+static void json_append_string(GString *out, const gchar *str)
+{
+        if (!str) {
+                g_string_append(out, "null");
+                return;
+        }
+
+        g_string_append_c(out, '"');
+        for (const gchar *c = str; *c; c++) {
+                switch (*c) {
+                case '"':
+                        g_string_append(out, "\\\"");
+                        break;
+                case '\\':
+                        g_string_append(out, "\\\\");
+                        break;
+                case '\n':
+                        g_string_append(out, "\\n");
+                        break;
+                case '\t':
+                        g_string_append(out, "\\t");
+                        break;
+                default:
+                        if ((guchar)*c < 0x20) {
+                                g_string_append_printf(out, "\\u%04x", (guchar)*c);
+                        } else {
+                                g_string_append_c(out, *c);
+                        }
+                        break;
+                }
+        }
+        g_string_append_c(out, '"');
+}
+
+/**
+ * Short name for the GPU configuration, most specific first like `status`
+ */
+static const gchar *analyze_gpu_type(LdmGPUConfig *config)
+{
+        if (ldm_gpu_config_has_type(config, LDM_GPU_TYPE_OPTIMUS)) {
+                return "optimus";
+        } else if (ldm_gpu_config_has_type(config, LDM_GPU_TYPE_HYBRID)) {
+                return "hybrid";
+        } else if (ldm_gpu_config_has_type(config, LDM_GPU_TYPE_CROSSFIRE)) {
+                return "crossfire";
+        } else if (ldm_gpu_config_has_type(config, LDM_GPU_TYPE_SLI)) {
+                return "sli";
+        } else if (ldm_gpu_config_has_type(config, LDM_GPU_TYPE_COMPOSITE)) {
+                return "composite";
+        }
+        return "simple";
+}
+
+/**
+ * Collect the recordings named on the command line, expanding directories
+ * to the `*.umockdev` files within them.
+ */
+static GPtrArray *analyze_collect_snapshots(gchar **paths, guint n_paths)
+{
+        GPtrArray *snapshots = NULL;
+
+        snapshots = g_ptr_array_new_with_free_func(g_free);
+
+        for (guint i = 0; i < n_paths; i++) {
+                g_autofree gchar *glob_path = NULL;
+                glob_t glo = { 0 };
+
+                if (!g_file_test(paths[i], G_FILE_TEST_IS_DIR)) {
+                        g_ptr_array_add(snapshots, g_strdup(paths[i]));
+                        continue;
+                }
+
+                glob_path = g_strdup_printf("%s%s*.umockdev", paths[i], G_DIR_SEPARATOR_S);
+                if (glob(glob_path, 0, NULL, &glo) == 0) {
+                        for (size_t j = 0; j < glo.gl_pathc; j++) {
+                                g_ptr_array_add(snapshots, g_strdup(glo.gl_pathv[j]));
+                        }
+                }
+                globfree(&glo);
+        }
+
+        return snapshots;
+}
+
+/**
+ * Append the device and every provider found for it
+ */
+static void analyze_device(LdmManager *manager, LdmDevice *device, GString *out)
+{
+        g_autoptr(GArray) results = NULL;
+
+        g_string_append(out, "{\"path\":");
+        json_append_string(out, ldm_device_get_path(device));
+        g_string_append(out, ",\"name\":");
+        json_append_string(out, ldm_device_get_name(device));
+        g_string_append(out, ",\"vendor\":");
+        json_append_string(out, ldm_device_get_vendor(device));
+        g_string_append(out, ",\"modalias\":");
+        json_append_string(out, ldm_device_get_modalias(device));
+        g_string_append(out, ",\"providers\":[");
+
+        /* Only printed, so there's no need for LdmProvider objects */
+        results = ldm_manager_get_provider_results(manager, device);
+        for (guint i = 0; i < results->len; i++) {
+                const LdmProviderResult *result = &g_array_index(results, LdmProviderResult, i);
+
+                if (i > 0) {
+                        g_string_append_c(out, ',');
+                }
+                g_string_append(out, "{\"plugin\":");
+                json_append_string(out, ldm_plugin_get_name(result->plugin));
+                g_string_append(out, ",\"package\":");
+                json_append_string(out, result->package);
+                g_string_append(out, ",\"driver\":");
+                json_append_string(out, result->driver);
+                g_string_append_c(out, '}');
+        }
+
+        g_string_append(out, "]}");
+}
+
+/**
+ * Load the modalias plugins with the library loader, so files are chosen,
+ * decompressed and deferred exactly as they would be on the recorded machine.
+ * Compiled matcher modules are only ever loaded from the system directory.
+ */
+static void analyze_load_plugins(LdmManager *manager)
+{
+        if (opt_modalias_dir) {
+                ldm_manager_add_modalias_plugins_for_directory(manager, opt_modalias_dir);
+        } else {
+                ldm_manager_add_system_modalias_plugins(manager);
+        }
+}
+
+/**
+ * Replay a single recording and append its JSON line
+ */
+static void analyze_snapshot(const gchar *path, GString *out)
+{
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmManager) manager = NULL;
+        g_autoptr(LdmGPUConfig) gpu_config = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *name = NULL;
+        const gchar *failure = NULL;
+
+        name = g_path_get_basename(path);
+        g_string_append(out, "{\"snapshot\":");
+        json_append_string(out, name);
+
+        bed = umockdev_testbed_new();
+        if (!umockdev_testbed_add_from_file(bed, path, &error)) {
+                failure = error->message;
+                goto failed;
+        }
+
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        if (!manager) {
+                failure = "Failed to initialise LdmManager";
+                goto failed;
+        }
+
+        /* Files whose header covers none of the devices are never parsed */
+        analyze_load_plugins(manager);
+
+        gpu_config = ldm_gpu_config_new(manager);
+        g_string_append(out, ",\"gpu\":");
+        json_append_string(out, gpu_config ? analyze_gpu_type(gpu_config) : NULL);
+
+        g_string_append(out, ",\"devices\":[");
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_ANY);
+        for (guint i = 0; i < devices->len; i++) {
+                if (i > 0) {
+                        g_string_append_c(out, ',');
+                }
+                analyze_device(manager, devices->pdata[i], out);
+        }
+        g_string_append(out, "]}\n");
+        return;
+
+failed:
+        g_string_append(out, ",\"error\":");
+        json_append_string(out, failure);
+        g_string_append(out, "}\n");
+}
+
+/**
+ * Body of each worker process. Snapshots are claimed in batches from the
+ * shared counter, so a worker stuck on a huge recording doesn't hold up
+ * the others.
+ */
+static int analyze_worker(GPtrArray *snapshots, guint *next, int fd)
+{
+        g_autoptr(GString) out = NULL;
+        FILE *output = NULL;
+
+        output = fdopen(fd, "w");
+        if (!output) {
+                return EXIT_FAILURE;
+        }
+
+        out = g_string_sized_new(ANALYZE_CHUNK);
+
+        for (;;) {
+                guint start = __atomic_fetch_add(next, ANALYZE_BATCH, __ATOMIC_RELAXED);
+                guint end = MIN(start + ANALYZE_BATCH, snapshots->len);
+
+                if (start >= snapshots->len) {
+                        break;
+                }
+
+                for (guint i = start; i < end; i++) {
+                        g_string_truncate(out, 0);
+                        analyze_snapshot(snapshots->pdata[i], out);
+                        fwrite(out->str, 1, out->len, output);
+                }
+        }
+
+        return fclose(output) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Read whatever a worker has sent, and forward only complete lines so
+ * that the output of the workers never interleaves.
+ */
+static gboolean analyze_forward(AnalyzeWorker *worker, FILE *output)
+{
+        gchar chunk[ANALYZE_CHUNK];
+        ssize_t n_read = 0;
+        gchar *last = NULL;
+        gsize n_lines = 0;
+
+        n_read = read(worker->fd, chunk, sizeof(chunk));
+        if (n_read < 0 && errno == EINTR) {
+                return TRUE;
+        }
+        if (n_read <= 0) {
+                return FALSE;
+        }
+
+        g_string_append_len(worker->buffer, chunk, n_read);
+        last = memrchr(worker->buffer->str, '\n', worker->buffer->len);
+        if (!last) {
+                return TRUE;
+        }
+
+        n_lines = (gsize)(last - worker->buffer->str) + 1;
+        fwrite(worker->buffer->str, 1, n_lines, output);
+        g_string_erase(worker->buffer, 0, (gssize)n_lines);
+
+        return TRUE;
+}
+
+/**
+ * Fork the workers and merge their results into the output
+ */
+static int analyze(GPtrArray *snapshots, guint n_jobs)
+{
+        g_autofree AnalyzeWorker *workers = NULL;
+        g_autofree struct pollfd *fds = NULL;
+        FILE *output = stdout;
+        guint *next = NULL;
+        guint n_open = 0;
+        int ret = EXIT_SUCCESS;
+
+        if (opt_filename) {
+                output = fopen(opt_filename, "w");
+                if (!output) {
+                        fprintf(stderr,
+                                "Failed to open %s for writing: %s\n",
+                                opt_filename,
+                                strerror(errno));
+                        return EXIT_FAILURE;
+                }
+        }
+
+        /* Work queue shared with every worker */
+        next = mmap(NULL, sizeof(guint), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (next == MAP_FAILED) {
+                fprintf(stderr, "Failed to map work queue: %s\n", strerror(errno));
+                ret = EXIT_FAILURE;
+                goto cleanup;
+        }
+        *next = 0;
+
+        n_jobs = CLAMP(n_jobs, 1, MAX(snapshots->len, 1));
+        workers = g_new0(AnalyzeWorker, n_jobs);
+        fds = g_new0(struct pollfd, n_jobs);
+        for (guint i = 0; i < n_jobs; i++) {
+                workers[i].fd = -1;
+        }
+
+        /* Nothing buffered may be written twice by the children */
+        fflush(output);
+
+        for (guint i = 0; i < n_jobs; i++) {
+                int pipefd[2] = { -1, -1 };
+
+                if (pipe(pipefd) != 0) {
+                        fprintf(stderr, "Failed to create pipe: %s\n", strerror(errno));
+                        ret = EXIT_FAILURE;
+                        break;
+                }
+
+                workers[i].pid = fork();
+                if (workers[i].pid < 0) {
+                        fprintf(stderr, "Failed to fork worker: %s\n", strerror(errno));
+                        close(pipefd[0]);
+                        close(pipefd[1]);
+                        ret = EXIT_FAILURE;
+                        break;
+                }
+
+                if (workers[i].pid == 0) {
+                        close(pipefd[0]);
+                        for (guint j = 0; j < i; j++) {
+                                close(workers[j].fd);
+                        }
+                        _exit(analyze_worker(snapshots, next, pipefd[1]));
+                }
+
+                close(pipefd[1]);
+                workers[i].fd = pipefd[0];
+                workers[i].buffer = g_string_new(NULL);
+                ++n_open;
+        }
+
+        while (n_open > 0) {
+                guint n_fds = 0;
+
+                for (guint i = 0; i < n_jobs; i++) {
+                        if (workers[i].fd < 0) {
+                                continue;
+                        }
+                        fds[n_fds].fd = workers[i].fd;
+                        fds[n_fds].events = POLLIN;
+                        fds[n_fds].revents = 0;
+                        ++n_fds;
+                }
+
+                if (poll(fds, n_fds, -1) < 0) {
+                        if (errno == EINTR) {
+                                continue;
+                        }
+                        fprintf(stderr, "Failed to poll workers: %s\n", strerror(errno));
+                        ret = EXIT_FAILURE;
+                        break;
+                }
+
+                for (guint i = 0, f = 0; i < n_jobs; i++) {
+                        if (workers[i].fd < 0) {
+                                continue;
+                        }
+                        if (fds[f++].revents == 0) {
+                                continue;
+                        }
+                        if (analyze_forward(&workers[i], output)) {
+                                continue;
+                        }
+                        close(workers[i].fd);
+                        workers[i].fd = -1;
+                        --n_open;
+                }
+        }
+
+        for (guint i = 0; i < n_jobs; i++) {
+                int status = 0;
+
+                if (workers[i].fd >= 0) {
+                        close(workers[i].fd);
+                }
+                if (workers[i].buffer) {
+                        g_string_free(workers[i].buffer, TRUE);
+                }
+                if (workers[i].pid <= 0) {
+                        continue;
+                }
+                if (waitpid(workers[i].pid, &status, 0) < 0 || !WIFEXITED(status) ||
+                    WEXITSTATUS(status) != EXIT_SUCCESS) {
+                        fprintf(stderr, "Worker %d failed, some snapshots are missing\n",
+                                (int)workers[i].pid);
+                        ret = EXIT_FAILURE;
+                }
+        }
+
+        munmap(next, sizeof(guint));
+
+cleanup:
+        if (output != stdout) {
+                fclose(output);
+        } else {
+                fflush(output);
+        }
+
+        return ret;
+}
+
+int main(int argc, char **argv)
+{
+        g_autoptr(GError) error = NULL;
+        g_autoptr(GOptionContext) opt_context = NULL;
+        g_autoptr(GPtrArray) snapshots = NULL;
+        const gchar *preload = NULL;
+        int ret = EXIT_FAILURE;
+        guint n_strings = 0;
+
+        /* Replay needs the umockdev preload, so run ourselves under the wrapper */
+        preload = g_getenv("LD_PRELOAD");
+        if (!preload || !strstr(preload, ANALYZE_PRELOAD)) {
+                g_autofree gchar **wrapped = NULL;
+
+                wrapped = g_new0(gchar *, (gsize)argc + 2);
+                wrapped[0] = (gchar *)"umockdev-wrapper";
+                memcpy(wrapped + 1, argv, sizeof(gchar *) * (gsize)argc);
+
+                execvp(wrapped[0], wrapped);
+                fprintf(stderr, "Failed to run under umockdev-wrapper: %s\n", strerror(errno));
+                return EXIT_FAILURE;
+        }
+
+        opt_context = g_option_context_new(NULL);
+        g_option_context_add_main_entries(opt_context, cli_entries, "linux-driver-management");
+        g_option_context_set_summary(opt_context,
+                                     "Report the providers for a set of umockdev recordings");
+
+        if (!g_option_context_parse(opt_context, &argc, &argv, &error)) {
+                fprintf(stderr, "Failed to parse arguments: %s\n", error->message);
+                goto cleanup;
+        }
+
+        if (opt_version) {
+                print_version();
+                ret = EXIT_SUCCESS;
+                goto cleanup;
+        }
+
+        n_strings = opt_strings ? g_strv_length(opt_strings) : 0;
+        if (n_strings < 1) {
+                print_usage(argv[0]);
+                goto cleanup;
+        }
+
+        if (opt_modalias_dir && !g_file_test(opt_modalias_dir, G_FILE_TEST_IS_DIR)) {
+                fprintf(stderr, "Not a directory: %s\n", opt_modalias_dir);
+                goto cleanup;
+        }
+
+        if (opt_jobs < 0) {
+                fprintf(stderr, "Invalid number of jobs: %d\n", opt_jobs);
+                goto cleanup;
+        }
+
+        snapshots = analyze_collect_snapshots(opt_strings, n_strings);
+        if (snapshots->len < 1) {
+                fprintf(stderr, "No recordings found\n");
+                goto cleanup;
+        }
+
+        ret = analyze(snapshots, opt_jobs > 0 ? (guint)opt_jobs : g_get_num_processors());
+
+cleanup:
+        if (opt_modalias_dir) {
+                g_free(opt_modalias_dir);
+        }
+        if (opt_filename) {
+                g_free(opt_filename);
+        }
+        if (opt_strings && *opt_strings) {
+                g_strfreev(opt_strings);
+        }
+
+        return ret;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
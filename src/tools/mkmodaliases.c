@@ -11,6 +11,9 @@
 
 #define _GNU_SOURCE
 
+#include "../lib/modalias-header.h"
+#include "../lib/modalias-stream.h"
+#include "../lib/route.h"
 #include "../lib/util.h"
 #include "config.h"
 
@@ -32,7 +35,8 @@ DEF_AUTOFREE(kmod_list, kmod_module_info_free_list)
 
 static void print_usage(const char *progname)
 {
-        fprintf(stderr, "%s usage: package-name [.ko files]\n", progname);
+        fprintf(stderr, "%s usage: package-name [.ko or .modaliases files]\n", progname);
+        fprintf(stderr, "       %s --verify [.modaliases files]\n", progname);
         fprintf(stderr, "Run '%s --help' for further information\n", progname);
 }
 
@@ -53,11 +57,24 @@ the Free Software Foundation; either version 2.1 of the License, or\n\
  */
 
 static gboolean opt_version = FALSE;
+static gboolean opt_emit_c = FALSE;
+static gboolean opt_verify = FALSE;
 static gchar *opt_filename = NULL;
+static gchar *opt_compress = NULL;
 static gchar **opt_strings = NULL;
 
+/* Resolved from --compress, or the suffix of --output */
+static LdmModaliasCompression mk_compression = LDM_MODALIAS_COMPRESSION_NONE;
+
 static GOptionEntry cli_entries[] = {
         { "version", 'v', 0, G_OPTION_ARG_NONE, &opt_version, "Print version and exit", NULL },
+        { "emit-c",
+          'c',
+          0,
+          G_OPTION_ARG_NONE,
+          &opt_emit_c,
+          "Emit C source for a native matcher module",
+          NULL },
         { "output",
           'o',
           0,
@@ -65,20 +82,59 @@ static GOptionEntry cli_entries[] = {
           &opt_filename,
           "Redirect to the given file",
           NULL },
+        { "verify",
+          'V',
+          0,
+          G_OPTION_ARG_NONE,
+          &opt_verify,
+          "Check the headers of existing modaliases files",
+          NULL },
+        { "compress",
+          'z',
+          0,
+          G_OPTION_ARG_STRING,
+          &opt_compress,
+          "Compress the modaliases file (gzip, zstd)",
+          "METHOD" },
         { G_OPTION_REMAINING,
           0,
           0,
           G_OPTION_ARG_STRING_ARRAY,
           &opt_strings,
           "Options",
-          "- package-name [.ko file] [.ko file]" },
+          "- package-name [.ko or .modaliases file] [.ko or .modaliases file]" },
         { 0 },
 };
 
 /**
- * Examine just one kmod module and emit the info to the output file.
+ * A single alias found in a kernel module or modaliases file
  */
-static gboolean examine_module(const gchar *package_name, FILE *fileh, kmod_module *module)
+typedef struct MkAlias {
+        gchar *match;
+        gchar *driver;
+        gchar *package;
+        guint index;       /* Order of discovery, then table order for the C matcher */
+        guint specificity; /* Literal characters, as LdmModaliasPlugin counts them */
+
+        /* Classification for the C matcher */
+        enum { MK_ALIAS_IRREGULAR = 0, MK_ALIAS_VENDOR, MK_ALIAS_PRODUCT } kind;
+        const gchar *bus;
+        guint32 vendor_id;
+        guint32 product_id;
+} MkAlias;
+
+static void mk_alias_free(MkAlias *alias)
+{
+        g_free(alias->match);
+        g_free(alias->driver);
+        g_free(alias->package);
+        g_free(alias);
+}
+
+/**
+ * Examine just one kmod module and collect all of its aliases
+ */
+static gboolean examine_module(const gchar *package_name, GPtrArray *aliases, kmod_module *module)
 {
         const char *kname = NULL;
         autofree(kmod_list) *list = NULL;
@@ -99,22 +155,533 @@ static gboolean examine_module(const gchar *package_name, FILE *fileh, kmod_modu
                 if (!key || !g_str_equal(key, "alias")) {
                         continue;
                 }
-                const char *value = kmod_module_info_get_value(iter);
-                if (fprintf(fileh, "alias %s %s %s\n", value, kname, package_name) < 0) {
-                        return FALSE;
-                }
+                MkAlias *alias = g_new0(MkAlias, 1);
+                alias->match = g_strdup(kmod_module_info_get_value(iter));
+                alias->driver = g_strdup(kname);
+                alias->package = g_strdup(package_name);
+                alias->index = aliases->len;
+                g_ptr_array_add(aliases, alias);
         };
 
         return TRUE;
 }
 
+/**
+ * Collect the aliases of an existing modaliases file, which keep their own
+ * package names. Lines are split as LdmModaliasPlugin splits them.
+ */
+static gboolean examine_modaliases(const gchar *path, GPtrArray *aliases)
+{
+        g_autoptr(LdmModaliasStream) stream = NULL;
+        g_autoptr(GString) line = NULL;
+        g_autoptr(GError) error = NULL;
+
+        stream = ldm_modalias_stream_open(path, &error);
+        if (!stream) {
+                fprintf(stderr, "Couldn't open %s: %s\n", path, error->message);
+                return FALSE;
+        }
+
+        line = g_string_new(NULL);
+        while (ldm_modalias_stream_read_line(stream, line, &error)) {
+                g_auto(GStrv) columns = NULL;
+                MkAlias *alias = NULL;
+
+                g_strstrip(line->str);
+                if (line->str[0] == '\0' || line->str[0] == '#') {
+                        continue;
+                }
+
+                columns = g_strsplit(line->str, " ", 4);
+                if (g_strv_length(columns) != 4 || !g_str_equal(columns[0], "alias")) {
+                        continue;
+                }
+
+                alias = g_new0(MkAlias, 1);
+                alias->match = g_strdup(columns[1]);
+                alias->driver = g_strdup(columns[2]);
+                alias->package = g_strdup(columns[3]);
+                alias->index = aliases->len;
+                g_ptr_array_add(aliases, alias);
+        }
+
+        if (error) {
+                fprintf(stderr, "Couldn't read %s: %s\n", path, error->message);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * Order header routes by bus, then vendor, with the whole bus first
+ */
+static gint mk_route_compare(gconstpointer a, gconstpointer b)
+{
+        const LdmRoute *route_a = a;
+        const LdmRoute *route_b = b;
+        gint ret = strcmp(route_a->bus, route_b->bus);
+
+        if (ret != 0) {
+                return ret;
+        }
+        if (route_a->any_vendor != route_b->any_vendor) {
+                return route_a->any_vendor ? -1 : 1;
+        }
+        if (route_a->vendor_id != route_b->vendor_id) {
+                return route_a->vendor_id < route_b->vendor_id ? -1 : 1;
+        }
+        return 0;
+}
+
+/**
+ * Write aliases in the .modaliases format, preceded by a header declaring
+ * the buses and vendors they cover so that LDM may skip loading the file.
+ */
+static gboolean emit_modaliases(FILE *fileh, GPtrArray *aliases)
+{
+        g_autoptr(GString) body = NULL;
+        g_autoptr(GString) header = NULL;
+        g_autoptr(GArray) routes = NULL;
+        g_autoptr(GError) error = NULL;
+        gboolean any_bus = FALSE;
+        guint n_routes = 0;
+
+        body = g_string_new(NULL);
+        routes = g_array_new(FALSE, FALSE, sizeof(LdmRoute));
+
+        for (guint i = 0; i < aliases->len; i++) {
+                MkAlias *alias = aliases->pdata[i];
+                LdmRoute route = { 0 };
+
+                g_string_append_printf(body,
+                                       "alias %s %s %s\n",
+                                       alias->match,
+                                       alias->driver,
+                                       alias->package);
+
+                if (!ldm_route_parse(&route, alias->match)) {
+                        any_bus = TRUE;
+                        continue;
+                }
+                g_array_append_val(routes, route);
+        }
+
+        /* Sorting brings duplicate routes together */
+        g_array_sort(routes, mk_route_compare);
+        for (guint i = 0; i < routes->len; i++) {
+                LdmRoute *route = &g_array_index(routes, LdmRoute, i);
+
+                if (n_routes > 0 &&
+                    mk_route_compare(route, &g_array_index(routes, LdmRoute, n_routes - 1)) == 0) {
+                        continue;
+                }
+                g_array_index(routes, LdmRoute, n_routes) = *route;
+                ++n_routes;
+        }
+        g_array_set_size(routes, n_routes);
+
+        header = g_string_new(NULL);
+        ldm_modalias_header_write(header, routes, any_bus, aliases->len, body->str, body->len);
+        g_string_append_len(header, body->str, (gssize)body->len);
+
+        /* The checksum covers the body before compression */
+        if (!ldm_modalias_write_compressed(fileh, mk_compression, header->str, header->len, &error)) {
+                fprintf(stderr, "Failed to write modaliases: %s\n", error->message);
+                return FALSE;
+        }
+
+        return TRUE;
+}
+
+/**
+ * Write a string as a C string literal
+ */
+static void emit_c_string(FILE *fileh, const gchar *string)
+{
+        fputc('"', fileh);
+        for (const gchar *c = string; *c; c++) {
+                if (*c == '"' || *c == '\\') {
+                        fprintf(fileh, "\\%c", *c);
+                } else if (g_ascii_isprint(*c)) {
+                        fputc(*c, fileh);
+                } else {
+                        fprintf(fileh, "\\%03o", (guint)(guchar)*c);
+                }
+        }
+        fputc('"', fileh);
+}
+
+/**
+ * Order aliases the way LdmModaliasPlugin tests them: most literal
+ * characters first, with ties broken by the match. The table of the module
+ * is in this order, so the lowest matching index is the alias the plugin
+ * would have picked.
+ */
+static gint mk_alias_compare_specific(gconstpointer a, gconstpointer b)
+{
+        const MkAlias *alias_a = *(const MkAlias **)a;
+        const MkAlias *alias_b = *(const MkAlias **)b;
+
+        if (alias_a->specificity != alias_b->specificity) {
+                return alias_a->specificity > alias_b->specificity ? -1 : 1;
+        }
+
+        return strcmp(alias_a->match, alias_b->match);
+}
+
+/**
+ * Sort aliases so that the C matcher can group them by bus, vendor and
+ * product. Ties retain table order.
+ */
+static gint mk_alias_compare(gconstpointer a, gconstpointer b)
+{
+        const MkAlias *alias_a = *(const MkAlias **)a;
+        const MkAlias *alias_b = *(const MkAlias **)b;
+        gint ret = 0;
+
+        if (alias_a->kind == MK_ALIAS_IRREGULAR || alias_b->kind == MK_ALIAS_IRREGULAR) {
+                if (alias_a->kind != alias_b->kind) {
+                        return alias_a->kind == MK_ALIAS_IRREGULAR ? 1 : -1;
+                }
+                goto by_index;
+        }
+
+        ret = strcmp(alias_a->bus, alias_b->bus);
+        if (ret != 0) {
+                return ret;
+        }
+        if (alias_a->vendor_id != alias_b->vendor_id) {
+                return alias_a->vendor_id < alias_b->vendor_id ? -1 : 1;
+        }
+        /* Exact products before vendor-wide aliases */
+        if (alias_a->kind != alias_b->kind) {
+                return alias_a->kind == MK_ALIAS_PRODUCT ? -1 : 1;
+        }
+        if (alias_a->kind == MK_ALIAS_PRODUCT && alias_a->product_id != alias_b->product_id) {
+                return alias_a->product_id < alias_b->product_id ? -1 : 1;
+        }
+
+by_index:
+        return alias_a->index < alias_b->index ? -1 : (alias_a->index > alias_b->index ? 1 : 0);
+}
+
+/**
+ * LdmModaliasPlugin keeps one alias per match, and a later line with the
+ * same match replaces the driver and package of the earlier one.
+ */
+static void mk_alias_merge_duplicates(GPtrArray *aliases)
+{
+        g_autoptr(GHashTable) seen = NULL;
+
+        seen = g_hash_table_new(g_str_hash, g_str_equal);
+
+        for (guint i = 0; i < aliases->len;) {
+                MkAlias *alias = aliases->pdata[i];
+                MkAlias *earlier = g_hash_table_lookup(seen, alias->match);
+
+                if (!earlier) {
+                        g_hash_table_insert(seen, alias->match, alias);
+                        ++i;
+                        continue;
+                }
+
+                g_free(earlier->driver);
+                g_free(earlier->package);
+                earlier->driver = g_steal_pointer(&alias->driver);
+                earlier->package = g_steal_pointer(&alias->package);
+                g_ptr_array_remove_index(aliases, i);
+        }
+}
+
+/**
+ * Emit a list of candidate aliases, in table order, followed by a lookup
+ * of the first one matching the query that beats the best match so far.
+ */
+static void emit_c_candidates(FILE *lists, GString *body, GPtrArray *groups, guint start,
+                              guint end, guint *n_lists, guint depth)
+{
+        fprintf(lists, "static const unsigned int candidates_%u[] = {", *n_lists);
+        for (guint i = start; i < end; i++) {
+                fprintf(lists, " %u,", ((MkAlias *)groups->pdata[i])->index);
+        }
+        fputs(" N_ALIASES };\n", lists);
+
+        g_string_append_printf(body,
+                               "%*sbest = first_match(query, candidates_%u, best);\n",
+                               (int)(depth * 8),
+                               "",
+                               *n_lists);
+        ++*n_lists;
+}
+
+/**
+ * Write aliases as the source of a native matcher module, see
+ * native-matcher.h in libldm for the ABI.
+ *
+ * The module must pick the same alias as an LdmModaliasPlugin loaded from
+ * the same aliases. Duplicate matches are merged the same way, and the
+ * table is sorted into the order the plugin tests aliases in, so the plugin
+ * would pick the matching alias with the lowest index.
+ *
+ * Aliases whose vendor and product are literal are dispatched through a
+ * switch on the numeric IDs of the device, and those with a literal vendor
+ * only after the product switch. Anything we cannot reason about is always
+ * a candidate. Each list of candidates is in table order, so only its first
+ * match can win, and only if no other list had a lower one.
+ */
+static gboolean emit_c(FILE *fileh, const gchar *package_name, GPtrArray *aliases)
+{
+        g_autoptr(GHashTable) seen_routes = NULL;
+        g_autoptr(GPtrArray) routes = NULL;
+        g_autoptr(GPtrArray) groups = NULL;
+        g_autoptr(GString) body = NULL;
+        guint n_lists = 0;
+        guint i = 0;
+
+        mk_alias_merge_duplicates(aliases);
+
+        /* Classify first, sorting groups the aliases for the switch */
+        for (i = 0; i < aliases->len; i++) {
+                MkAlias *alias = aliases->pdata[i];
+                LdmRoute route = { 0 };
+
+                /* Counted as LdmModaliasPlugin counts them */
+                for (const gchar *c = alias->match; *c; c++) {
+                        if (!strchr("*?[]\\", *c)) {
+                                ++alias->specificity;
+                        }
+                }
+
+                if (ldm_route_parse_ids(alias->match,
+                                        &alias->bus,
+                                        &alias->vendor_id,
+                                        &alias->product_id)) {
+                        alias->kind = MK_ALIAS_PRODUCT;
+                } else if (ldm_route_parse(&route, alias->match) && !route.any_vendor) {
+                        alias->kind = MK_ALIAS_VENDOR;
+                        alias->bus = route.bus;
+                        alias->vendor_id = route.vendor_id;
+                }
+        }
+        g_ptr_array_sort(aliases, mk_alias_compare_specific);
+
+        groups = g_ptr_array_sized_new(aliases->len);
+        for (i = 0; i < aliases->len; i++) {
+                ((MkAlias *)aliases->pdata[i])->index = i;
+                g_ptr_array_add(groups, aliases->pdata[i]);
+        }
+        g_ptr_array_sort(groups, mk_alias_compare);
+
+        /* Unique coverage routes, in alias order */
+        seen_routes = g_hash_table_new_full(ldm_route_hash, ldm_route_equal, g_free, NULL);
+        routes = g_ptr_array_new();
+        for (i = 0; i < aliases->len; i++) {
+                MkAlias *alias = aliases->pdata[i];
+                LdmRoute *route = g_new0(LdmRoute, 1);
+
+                if (!ldm_route_parse(route, alias->match)) {
+                        route->bus = NULL;
+                        route->any_vendor = TRUE;
+                }
+                if (g_hash_table_contains(seen_routes, route)) {
+                        g_free(route);
+                        continue;
+                }
+                g_hash_table_add(seen_routes, route);
+                g_ptr_array_add(routes, route);
+        }
+
+        fprintf(fileh, "/* Generated by mkmodaliases for %s, do not edit. */\n\n", package_name);
+        fputs("#include <fnmatch.h>\n", fileh);
+        fputs("#include <string.h>\n\n", fileh);
+        fputs("#include <plugins/native-matcher.h>\n\n", fileh);
+
+        fprintf(fileh, "#define N_ALIASES %uU\n\n", aliases->len);
+
+        /* Most specific first, as LdmModaliasPlugin tests them */
+        fputs("static const LdmNativeAlias aliases[] = {\n", fileh);
+        for (i = 0; i < aliases->len; i++) {
+                MkAlias *alias = aliases->pdata[i];
+
+                fputs("        { ", fileh);
+                emit_c_string(fileh, alias->match);
+                fputs(", ", fileh);
+                emit_c_string(fileh, alias->driver);
+                fputs(", ", fileh);
+                emit_c_string(fileh, alias->package);
+                fputs(" },\n", fileh);
+        }
+        fputs("        { NULL, NULL, NULL },\n};\n\n", fileh);
+
+        fputs("static const LdmNativeRoute routes[] = {\n", fileh);
+        for (i = 0; i < routes->len; i++) {
+                LdmRoute *route = routes->pdata[i];
+
+                fputs("        { ", fileh);
+                if (route->bus) {
+                        emit_c_string(fileh, route->bus);
+                } else {
+                        fputs("NULL", fileh);
+                }
+                fprintf(fileh, ", 0x%04X, %d },\n", route->vendor_id, route->any_vendor ? 1 : 0);
+        }
+        fputs("        { NULL, 0, 0 },\n};\n\n", fileh);
+
+        /* Dispatch on the IDs of the device, writing the candidate lists as we go */
+        body = g_string_new(NULL);
+        i = 0;
+        while (i < groups->len && ((MkAlias *)groups->pdata[i])->kind != MK_ALIAS_IRREGULAR) {
+                const gchar *bus = ((MkAlias *)groups->pdata[i])->bus;
+
+                g_string_append_printf(body,
+                                        "        if (strcmp(query->bus, \"%s\") == 0) {\n"
+                                        "                switch (query->vendor_id) {\n",
+                                        bus);
+
+                while (i < groups->len) {
+                        MkAlias *alias = groups->pdata[i];
+                        guint32 vendor_id = alias->vendor_id;
+                        gboolean have_products = FALSE;
+                        guint start = 0;
+
+                        if (alias->kind == MK_ALIAS_IRREGULAR || !g_str_equal(alias->bus, bus)) {
+                                break;
+                        }
+
+                        g_string_append_printf(body, "                case 0x%04X:\n", vendor_id);
+
+                        /* Exact products */
+                        while (i < groups->len) {
+                                guint32 product_id = 0;
+
+                                alias = groups->pdata[i];
+                                if (alias->kind != MK_ALIAS_PRODUCT ||
+                                    !g_str_equal(alias->bus, bus) ||
+                                    alias->vendor_id != vendor_id) {
+                                        break;
+                                }
+                                if (!have_products) {
+                                        g_string_append(body,
+                                                        "                        switch "
+                                                        "(query->product_id) {\n");
+                                        have_products = TRUE;
+                                }
+
+                                product_id = alias->product_id;
+                                start = i;
+                                while (i < groups->len) {
+                                        alias = groups->pdata[i];
+                                        if (alias->kind != MK_ALIAS_PRODUCT ||
+                                            !g_str_equal(alias->bus, bus) ||
+                                            alias->vendor_id != vendor_id ||
+                                            alias->product_id != product_id) {
+                                                break;
+                                        }
+                                        ++i;
+                                }
+                                g_string_append_printf(body,
+                                                       "                        case 0x%04X:\n",
+                                                       product_id);
+                                emit_c_candidates(fileh, body, groups, start, i, &n_lists, 4);
+                                g_string_append(body, "                                break;\n");
+                        }
+                        if (have_products) {
+                                g_string_append(body,
+                                                "                        default:\n"
+                                                "                                break;\n"
+                                                "                        }\n");
+                        }
+
+                        /* Vendor-wide aliases */
+                        start = i;
+                        while (i < groups->len) {
+                                alias = groups->pdata[i];
+                                if (alias->kind != MK_ALIAS_VENDOR ||
+                                    !g_str_equal(alias->bus, bus) ||
+                                    alias->vendor_id != vendor_id) {
+                                        break;
+                                }
+                                ++i;
+                        }
+                        if (i > start) {
+                                emit_c_candidates(fileh, body, groups, start, i, &n_lists, 3);
+                        }
+                        g_string_append(body, "                        break;\n");
+                }
+
+                g_string_append(body,
+                                "                default:\n"
+                                "                        break;\n"
+                                "                }\n"
+                                "        }\n\n");
+        }
+
+        /* Anything we couldn't classify is always a candidate */
+        if (i < groups->len) {
+                emit_c_candidates(fileh, body, groups, i, groups->len, &n_lists, 1);
+        }
+        fputc('\n', fileh);
+
+        if (n_lists > 0) {
+                fputs("/* Candidate lists end with N_ALIASES, which no best match can beat */\n"
+                      "static unsigned int first_match(const LdmNativeQuery *query,\n"
+                      "                                const unsigned int *candidates,\n"
+                      "                                unsigned int best)\n"
+                      "{\n"
+                      "        for (; *candidates < best; candidates++) {\n"
+                      "                if (fnmatch(aliases[*candidates].match, query->modalias, "
+                      "0) == 0) {\n"
+                      "                        return *candidates;\n"
+                      "                }\n"
+                      "        }\n"
+                      "        return best;\n"
+                      "}\n\n",
+                      fileh);
+        }
+
+        fputs("static const LdmNativeAlias *match_modalias(const LdmNativeQuery *query)\n"
+              "{\n"
+              "        unsigned int best = N_ALIASES;\n\n"
+              "        /* Without IDs every alias is tested, in table order */\n"
+              "        if (!query->has_ids) {\n"
+              "                for (unsigned int i = 0; i < N_ALIASES; i++) {\n"
+              "                        if (fnmatch(aliases[i].match, query->modalias, 0) == 0) {\n"
+              "                                return &aliases[i];\n"
+              "                        }\n"
+              "                }\n"
+              "                return NULL;\n"
+              "        }\n\n",
+              fileh);
+        fputs(body->str, fileh);
+        fputs("        return best < N_ALIASES ? &aliases[best] : NULL;\n"
+              "}\n\n",
+              fileh);
+
+        fprintf(fileh,
+                "const LdmNativeMatcher ldm_native_matcher = {\n"
+                "        .abi = LDM_NATIVE_MATCHER_ABI,\n"
+                "        .n_aliases = N_ALIASES,\n"
+                "        .aliases = aliases,\n"
+                "        .n_routes = %u,\n"
+                "        .routes = routes,\n"
+                "        .match = match_modalias,\n"
+                "};\n",
+                routes->len);
+
+        return !ferror(fileh);
+}
+
 /**
  * Construct a modaliases file for the given package name and module paths.
+ * Aliases of existing modaliases files are merged in with their own package
+ * names.
  */
 static int mkmodaliases(const char *package_name, gchar **paths, guint n_paths)
 {
         FILE *output_file = NULL;
         autofree(kmod_ctx) *ctx = NULL;
+        g_autoptr(GPtrArray) aliases = NULL;
         int ret = EXIT_FAILURE;
 
         /* Default to stdout if no path is set */
@@ -137,10 +704,20 @@ static int mkmodaliases(const char *package_name, gchar **paths, guint n_paths)
                 goto cleanup;
         }
 
-        /* Walk all modules and pass our fileh */
+        aliases = g_ptr_array_new_with_free_func((GDestroyNotify)mk_alias_free);
+
+        /* Walk all modules and collect their aliases */
         for (guint i = 0; i < n_paths; i++) {
                 const gchar *kpath = paths[i];
                 autofree(kmod_module) *module = NULL;
+                g_autofree gchar *stem = ldm_modalias_path_get_stem(kpath);
+
+                if (stem) {
+                        if (!examine_modaliases(kpath, aliases)) {
+                                goto cleanup;
+                        }
+                        continue;
+                }
 
                 int ret = kmod_module_new_from_path(ctx, kpath, &module);
                 if (ret != 0) {
@@ -148,11 +725,19 @@ static int mkmodaliases(const char *package_name, gchar **paths, guint n_paths)
                         goto cleanup;
                 }
 
-                if (!examine_module(package_name, output_file, module)) {
+                if (!examine_module(package_name, aliases, module)) {
                         goto cleanup;
                 }
         }
 
+        if (opt_emit_c) {
+                if (!emit_c(output_file, package_name, aliases)) {
+                        goto cleanup;
+                }
+        } else if (!emit_modaliases(output_file, aliases)) {
+                goto cleanup;
+        }
+
         /* All good so far */
         ret = EXIT_SUCCESS;
 
@@ -172,6 +757,25 @@ cleanup:
         return ret;
 }
 
+/**
+ * Check that each file's header still describes its aliases
+ */
+static int mk_verify(gchar **paths, guint n_paths)
+{
+        int ret = EXIT_SUCCESS;
+
+        for (guint i = 0; i < n_paths; i++) {
+                g_autoptr(GError) error = NULL;
+
+                if (!ldm_modalias_stream_verify(paths[i], &error)) {
+                        fprintf(stderr, "%s: %s\n", paths[i], error->message);
+                        ret = EXIT_FAILURE;
+                }
+        }
+
+        return ret;
+}
+
 int main(int argc, char **argv)
 {
         g_autoptr(GError) error = NULL;
@@ -196,6 +800,15 @@ int main(int argc, char **argv)
         }
 
         n_strings = opt_strings ? g_strv_length(opt_strings) : 0;
+        if (opt_verify) {
+                if (n_strings < 1) {
+                        print_usage(argv[0]);
+                        goto cleanup;
+                }
+                ret = mk_verify(opt_strings, n_strings);
+                goto cleanup;
+        }
+
         if (n_strings < 2) {
                 print_usage(argv[0]);
                 goto cleanup;
@@ -203,15 +816,44 @@ int main(int argc, char **argv)
 
         package_name = opt_strings[0];
 
+        if (opt_compress) {
+                if (g_str_equal(opt_compress, "gzip")) {
+                        mk_compression = LDM_MODALIAS_COMPRESSION_GZIP;
+                } else if (g_str_equal(opt_compress, "zstd")) {
+                        mk_compression = LDM_MODALIAS_COMPRESSION_ZSTD;
+                } else {
+                        fprintf(stderr, "Unknown compression: %s\n", opt_compress);
+                        goto cleanup;
+                }
+        } else if (opt_filename && !opt_emit_c) {
+                ldm_modalias_compression_for_path(opt_filename, &mk_compression);
+        }
+
+        if (mk_compression != LDM_MODALIAS_COMPRESSION_NONE) {
+                if (opt_emit_c) {
+                        fprintf(stderr, "C sources cannot be compressed\n");
+                        goto cleanup;
+                }
+                if (!ldm_modalias_compression_is_supported(mk_compression)) {
+                        fprintf(stderr,
+                                "%s support was not built into mkmodaliases\n",
+                                ldm_modalias_compression_get_suffix(mk_compression));
+                        goto cleanup;
+                }
+        }
+
         /* Make sure they all exist now */
         for (guint i = 1; i < n_strings; i++) {
+                g_autofree gchar *stem = ldm_modalias_path_get_stem(opt_strings[i]);
+
                 if (access(opt_strings[i], F_OK) != 0) {
-                        fprintf(stderr, "Kernel module does not exist: %s\n", opt_strings[i]);
+                        fprintf(stderr, "Input does not exist: %s\n", opt_strings[i]);
                         goto cleanup;
                 }
-                if (!g_str_has_suffix(opt_strings[i], ".ko")) {
+                if (!stem && !g_str_has_suffix(opt_strings[i], ".ko")) {
                         fprintf(stderr,
-                                "File does not appear to be a kernel module: %s\n",
+                                "File does not appear to be a kernel module or modaliases "
+                                "file: %s\n",
                                 opt_strings[i]);
                         goto cleanup;
                 }
@@ -224,6 +866,9 @@ cleanup:
         if (opt_filename) {
                 g_free(opt_filename);
         }
+        if (opt_compress) {
+                g_free(opt_compress);
+        }
         if (opt_strings && *opt_strings) {
                 g_strfreev(opt_strings);
         }
@@ -0,0 +1,323 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <umockdev.h>
+
+#include "counters.h"
+#include "ldm-private.h"
+#include "ldm.h"
+#include "manager-private.h"
+#include "topology.h"
+#include "util.h"
+
+DEF_AUTOFREE(UMockdevTestbed, g_object_unref)
+
+#define MODALIAS_DIR TEST_DATA_ROOT "/"
+
+/* Default largest scale factor, may be overridden on the command line */
+#define BENCH_MAX_SCALE 16
+
+/* Each stage is repeated and the fastest run is reported */
+#define BENCH_ITERATIONS 3
+
+/*
+ * Scale factor 1 is a busy workstation: 8 GPUs, 4 hubs and 150 USB
+ * interfaces, some with HID children, plus a couple of bluetooth adapters.
+ */
+static const LdmTopology bench_workstation = {
+        .n_gpus = 8,
+        .n_pci = 24,
+        .n_hubs = 4,
+        .n_usb = 50,
+        .n_interfaces = 3,
+        .n_hid = 10,
+        .n_bluetooth = 2,
+};
+
+/**
+ * BenchPhase:
+ *
+ * Measured stages of a run, in the order they happen
+ */
+typedef enum {
+        BENCH_PHASE_CONSTRUCT = 0, /* ldm_manager_new */
+        BENCH_PHASE_DEVICES,       /* ldm_manager_get_devices */
+        BENCH_PHASE_PLUGINS,       /* ldm_manager_add_modalias_plugins_for_directory */
+        BENCH_PHASE_PROVIDERS,     /* ldm_manager_get_providers, for every device */
+        BENCH_N_PHASES,
+} BenchPhase;
+
+static const gchar *bench_phase_names[BENCH_N_PHASES] = {
+        [BENCH_PHASE_CONSTRUCT] = "new",
+        [BENCH_PHASE_DEVICES] = "devices",
+        [BENCH_PHASE_PLUGINS] = "plugins",
+        [BENCH_PHASE_PROVIDERS] = "provide",
+};
+
+typedef struct BenchMeasure {
+        gint64 time;
+        LdmCounterValues counters; /* From the same run as the time */
+        guint n_ops;               /* Operations the phase performed */
+} BenchMeasure;
+
+typedef struct BenchResult {
+        BenchMeasure phases[BENCH_N_PHASES];
+        guint scale;
+        guint n_sysfs;   /* Nodes in the testbed */
+        guint n_devices; /* Top level devices found */
+} BenchResult;
+
+/* Hardware counters, NULL unless asked for and available */
+static LdmCounters *bench_counters = NULL;
+
+static void bench_begin(BenchMeasure *measure)
+{
+        if (bench_counters) {
+                ldm_counters_start(bench_counters);
+        }
+        measure->time = g_get_monotonic_time();
+}
+
+static void bench_end(BenchMeasure *measure, guint n_ops)
+{
+        measure->time = g_get_monotonic_time() - measure->time;
+        measure->n_ops = n_ops;
+        if (bench_counters) {
+                ldm_counters_stop(bench_counters, &measure->counters);
+        }
+}
+
+/**
+ * Measure every phase once on the current testbed
+ */
+static void bench_run_once(BenchResult *result)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        BenchMeasure *phases = result->phases;
+
+        bench_begin(&phases[BENCH_PHASE_CONSTRUCT]);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        bench_end(&phases[BENCH_PHASE_CONSTRUCT], result->n_sysfs);
+
+        bench_begin(&phases[BENCH_PHASE_DEVICES]);
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_ANY);
+        bench_end(&phases[BENCH_PHASE_DEVICES], devices->len);
+        result->n_devices = devices->len;
+
+        bench_begin(&phases[BENCH_PHASE_PLUGINS]);
+        ldm_manager_add_modalias_plugins_for_directory(manager, MODALIAS_DIR);
+        bench_end(&phases[BENCH_PHASE_PLUGINS], manager->plugins->len);
+
+        bench_begin(&phases[BENCH_PHASE_PROVIDERS]);
+        for (guint i = 0; i < devices->len; i++) {
+                g_autoptr(GPtrArray) providers = NULL;
+
+                providers = ldm_manager_get_providers(manager, devices->pdata[i]);
+        }
+        bench_end(&phases[BENCH_PHASE_PROVIDERS], devices->len);
+}
+
+/**
+ * Measure every phase for the given topology, keeping the fastest of each
+ */
+static void bench_run(const LdmTopology *topology, BenchResult *result)
+{
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autofree gchar *recording = NULL;
+        g_autoptr(GError) error = NULL;
+
+        recording = ldm_topology_generate(topology);
+
+        bed = umockdev_testbed_new();
+        if (!umockdev_testbed_add_from_string(bed, recording, &error)) {
+                fprintf(stderr, "Failed to create testbed: %s\n", error->message);
+                exit(EXIT_FAILURE);
+        }
+
+        for (guint i = 0; i < BENCH_ITERATIONS; i++) {
+                BenchResult run = *result;
+
+                bench_run_once(&run);
+                if (i == 0) {
+                        *result = run;
+                        continue;
+                }
+                for (guint p = 0; p < BENCH_N_PHASES; p++) {
+                        if (run.phases[p].time < result->phases[p].time) {
+                                result->phases[p] = run.phases[p];
+                        }
+                }
+        }
+}
+
+/**
+ * Print a counter divided by the operations, or a dash if it wasn't counted
+ */
+static void bench_print_per_op(const BenchMeasure *measure, LdmCounter counter)
+{
+        if (!measure->counters.valid[counter] || measure->n_ops < 1) {
+                fprintf(stdout, " %14s", "-");
+                return;
+        }
+        fprintf(stdout,
+                " %14.1f",
+                (gdouble)measure->counters.values[counter] / (gdouble)measure->n_ops);
+}
+
+/**
+ * Hardware counters per operation of each phase, i.e. per sysfs node for
+ * construction, per plugin for loading and per device otherwise.
+ */
+static void bench_print_counters(GArray *results)
+{
+        fprintf(stdout, "\n%5s %8s %8s", "scale", "phase", "ops");
+        for (guint c = 0; c < LDM_N_COUNTERS; c++) {
+                g_autofree gchar *title = g_strdup_printf("%s/op", ldm_counter_get_name(c));
+                fprintf(stdout, " %14s", title);
+        }
+        fprintf(stdout, " %6s\n", "IPC");
+
+        for (guint i = 0; i < results->len; i++) {
+                const BenchResult *result = &g_array_index(results, BenchResult, i);
+
+                for (guint p = 0; p < BENCH_N_PHASES; p++) {
+                        const BenchMeasure *measure = &result->phases[p];
+                        const LdmCounterValues *counters = &measure->counters;
+
+                        fprintf(stdout,
+                                "%5u %8s %8u",
+                                result->scale,
+                                bench_phase_names[p],
+                                measure->n_ops);
+                        for (guint c = 0; c < LDM_N_COUNTERS; c++) {
+                                bench_print_per_op(measure, c);
+                        }
+
+                        if (counters->valid[LDM_COUNTER_CYCLES] &&
+                            counters->valid[LDM_COUNTER_INSTRUCTIONS] &&
+                            counters->values[LDM_COUNTER_CYCLES] > 0) {
+                                fprintf(stdout,
+                                        " %6.2f\n",
+                                        (gdouble)counters->values[LDM_COUNTER_INSTRUCTIONS] /
+                                            (gdouble)counters->values[LDM_COUNTER_CYCLES]);
+                        } else {
+                                fprintf(stdout, " %6s\n", "-");
+                        }
+                }
+        }
+}
+
+int main(int argc, char **argv)
+{
+        g_autoptr(GArray) results = NULL;
+        LdmCounters counters = { { 0 } };
+        gboolean want_counters = FALSE;
+        guint max_scale = BENCH_MAX_SCALE;
+        gdouble base_cost = 0.0;
+
+        for (int i = 1; i < argc; i++) {
+                if (g_str_equal(argv[i], "-c") || g_str_equal(argv[i], "--counters")) {
+                        want_counters = TRUE;
+                } else {
+                        max_scale = (guint)strtoul(argv[i], NULL, 10);
+                }
+        }
+        if (max_scale < 1) {
+                fprintf(stderr, "usage: %s [--counters] [max-scale]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+
+        /* Counters are a bonus, timing alone is still worth having */
+        if (want_counters) {
+                g_autoptr(GError) error = NULL;
+
+                if (ldm_counters_open(&counters, &error)) {
+                        bench_counters = &counters;
+                } else {
+                        fprintf(stderr, "Hardware counters unavailable: %s\n", error->message);
+                }
+        }
+
+        fprintf(stdout,
+                "%5s %8s %8s %12s %12s %12s %12s %12s %8s\n",
+                "scale",
+                "sysfs",
+                "devices",
+                "new (us)",
+                "devices (us)",
+                "plugins (us)",
+                "provide (us)",
+                "us/sysfs",
+                "growth");
+
+        results = g_array_new(FALSE, TRUE, sizeof(BenchResult));
+
+        for (guint scale = 1; scale <= max_scale; scale *= 2) {
+                LdmTopology topology = { 0 };
+                BenchResult result = { 0 };
+                const BenchMeasure *phases = result.phases;
+                gdouble cost = 0.0;
+
+                ldm_topology_scale(&bench_workstation, scale, &topology);
+                result.scale = scale;
+                result.n_sysfs = ldm_topology_count_devices(&topology);
+
+                bench_run(&topology, &result);
+                g_array_append_val(results, result);
+
+                /* Per-device cost should stay flat if enumeration is linear */
+                cost = (gdouble)(phases[BENCH_PHASE_CONSTRUCT].time +
+                                 phases[BENCH_PHASE_DEVICES].time +
+                                 phases[BENCH_PHASE_PROVIDERS].time) /
+                       (gdouble)result.n_sysfs;
+                if (scale == 1) {
+                        base_cost = cost;
+                }
+
+                fprintf(stdout,
+                        "%5u %8u %8u %12" G_GINT64_FORMAT " %12" G_GINT64_FORMAT
+                        " %12" G_GINT64_FORMAT " %12" G_GINT64_FORMAT " %12.2f %7.2fx\n",
+                        scale,
+                        result.n_sysfs,
+                        result.n_devices,
+                        phases[BENCH_PHASE_CONSTRUCT].time,
+                        phases[BENCH_PHASE_DEVICES].time,
+                        phases[BENCH_PHASE_PLUGINS].time,
+                        phases[BENCH_PHASE_PROVIDERS].time,
+                        cost,
+                        base_cost > 0.0 ? cost / base_cost : 1.0);
+        }
+
+        if (bench_counters) {
+                bench_print_counters(results);
+                ldm_counters_close(bench_counters);
+        }
+
+        return EXIT_SUCCESS;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -0,0 +1,403 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <errno.h>
+#include <glob.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <umockdev.h>
+
+#include "ldm-private.h"
+#include "ldm.h"
+#include "util.h"
+
+DEF_AUTOFREE(UMockdevTestbed, g_object_unref)
+
+#define MODALIAS_DIR TEST_DATA_ROOT "/"
+
+/*
+ * Allocation budgets, in number of allocator calls.
+ *
+ * Each budget is a fixed base plus a cost per unit of input, measured once
+ * caches and type registration have been warmed up. The per-unit costs are
+ * what each path allocates for one device or alias today, and the base is
+ * the fixed setup plus a small margin for amortised table growth. Run with
+ * CK_VERBOSITY=verbose to print the measured counts.
+ */
+#define MANAGER_BUDGET_BASE 1024
+#define MANAGER_BUDGET_PER_DEVICE 256
+#define PLUGIN_BUDGET_BASE 128
+#define PLUGIN_BUDGET_PER_ALIAS 2
+#define PROVIDERS_BUDGET_BASE 32
+#define PROVIDERS_BUDGET_PER_DEVICE 16
+
+/**
+ * We interpose the allocator for the whole process, which includes GLib
+ * (the tests run with G_SLICE=always-malloc), libudev and umockdev. Counting
+ * only happens between alloc_count_begin() and alloc_count_end().
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *ptr);
+
+typedef struct AllocCount {
+        gsize calls;
+        gsize bytes;
+} AllocCount;
+
+static int alloc_counting = 0;
+static AllocCount alloc_count = { 0 };
+
+static inline void alloc_count_add(size_t size)
+{
+        if (!__atomic_load_n(&alloc_counting, __ATOMIC_RELAXED)) {
+                return;
+        }
+        __atomic_add_fetch(&alloc_count.calls, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&alloc_count.bytes, size, __ATOMIC_RELAXED);
+}
+
+void *malloc(size_t size)
+{
+        alloc_count_add(size);
+        return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+        alloc_count_add(nmemb * size);
+        return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+        alloc_count_add(size);
+        return __libc_realloc(ptr, size);
+}
+
+/*
+ * The prefix tables and anything else wanting vector alignment come in
+ * through these, which don't go via malloc().
+ */
+void *memalign(size_t alignment, size_t size)
+{
+        alloc_count_add(size);
+        return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+        void *ret = NULL;
+
+        if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0) {
+                return EINVAL;
+        }
+
+        alloc_count_add(size);
+        ret = __libc_memalign(alignment, size);
+        if (!ret) {
+                return ENOMEM;
+        }
+
+        *memptr = ret;
+        return 0;
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+        if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+                errno = EINVAL;
+                return NULL;
+        }
+
+        alloc_count_add(size);
+        return __libc_memalign(alignment, size);
+}
+
+void free(void *ptr)
+{
+        __libc_free(ptr);
+}
+
+static void alloc_count_begin(void)
+{
+        __atomic_store_n(&alloc_count.calls, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&alloc_count.bytes, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&alloc_counting, 1, __ATOMIC_SEQ_CST);
+}
+
+static AllocCount alloc_count_end(void)
+{
+        AllocCount ret = { 0 };
+
+        __atomic_store_n(&alloc_counting, 0, __ATOMIC_SEQ_CST);
+        ret.calls = __atomic_load_n(&alloc_count.calls, __ATOMIC_RELAXED);
+        ret.bytes = __atomic_load_n(&alloc_count.bytes, __ATOMIC_RELAXED);
+
+        return ret;
+}
+
+/**
+ * Fixture files, discovered once before the loop tests fork
+ */
+static glob_t umockdev_files = { 0 };
+static glob_t modalias_files = { 0 };
+
+/**
+ * Only report the measured counts when check itself was asked to be verbose
+ */
+static gboolean alloc_verbose = FALSE;
+
+/**
+ * Count the lines in a fixture beginning with the given prefix, i.e. the
+ * number of devices ("P: ") in a umockdev file.
+ */
+static guint count_lines_with_prefix(const gchar *path, const gchar *prefix)
+{
+        g_autofree gchar *contents = NULL;
+        g_auto(GStrv) lines = NULL;
+        guint ret = 0;
+
+        fail_if(!g_file_get_contents(path, &contents, NULL, NULL), "Failed to read %s", path);
+
+        lines = g_strsplit(contents, "\n", -1);
+        for (guint i = 0; lines[i]; i++) {
+                if (g_str_has_prefix(lines[i], prefix)) {
+                        ++ret;
+                }
+        }
+
+        return ret;
+}
+
+/**
+ * Count the device and all of its descendants
+ */
+static guint count_device_tree(LdmDevice *device)
+{
+        g_autoptr(GList) kids = NULL;
+        guint ret = 1;
+
+        kids = ldm_device_get_children(device);
+        for (GList *elem = kids; elem; elem = elem->next) {
+                ret += count_device_tree(LDM_DEVICE(elem->data));
+        }
+
+        return ret;
+}
+
+/**
+ * Construct a manager on every umockdev fixture
+ */
+START_TEST(test_allocations_manager)
+{
+        const gchar *path = umockdev_files.gl_pathv[_i];
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmManager) warmup = NULL;
+        g_autoptr(LdmManager) manager = NULL;
+        AllocCount count = { 0 };
+        guint n_devices = 0;
+        gsize budget = 0;
+
+        n_devices = count_lines_with_prefix(path, "P: ");
+        budget = MANAGER_BUDGET_BASE + n_devices * MANAGER_BUDGET_PER_DEVICE;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_file(bed, path, NULL), "Failed to load %s", path);
+
+        warmup = ldm_manager_new(0);
+        fail_if(!warmup, "Failed to get the LdmManager");
+
+        alloc_count_begin();
+        manager = ldm_manager_new(0);
+        count = alloc_count_end();
+
+        fail_if(!manager, "Failed to get the LdmManager");
+        if (alloc_verbose) {
+                fprintf(stdout,
+                        "ldm_manager_new: %s: %zu allocations, %zu bytes (budget %zu)\n",
+                        path,
+                        count.calls,
+                        count.bytes,
+                        budget);
+        }
+        fail_if(count.calls > budget,
+                "ldm_manager_new on %s: %zu allocations exceeds budget of %zu",
+                path,
+                count.calls,
+                budget);
+}
+END_TEST
+
+/**
+ * Load every modaliases file as a plugin
+ */
+START_TEST(test_allocations_plugin)
+{
+        const gchar *path = modalias_files.gl_pathv[_i];
+        g_autoptr(LdmPlugin) warmup = NULL;
+        g_autoptr(LdmPlugin) plugin = NULL;
+        AllocCount count = { 0 };
+        guint n_aliases = 0;
+        gsize budget = 0;
+
+        n_aliases = count_lines_with_prefix(path, "alias ");
+        budget = PLUGIN_BUDGET_BASE + n_aliases * PLUGIN_BUDGET_PER_ALIAS;
+
+        warmup = ldm_modalias_plugin_new_from_filename(path);
+        fail_if(!warmup, "Failed to load %s", path);
+
+        alloc_count_begin();
+        plugin = ldm_modalias_plugin_new_from_filename(path);
+        count = alloc_count_end();
+
+        fail_if(!plugin, "Failed to load %s", path);
+        if (alloc_verbose) {
+                fprintf(stdout,
+                        "ldm_modalias_plugin_new_from_filename: %s: %zu allocations, "
+                        "%zu bytes (budget %zu)\n",
+                        path,
+                        count.calls,
+                        count.bytes,
+                        budget);
+        }
+        fail_if(count.calls > budget,
+                "Loading %s: %zu allocations exceeds budget of %zu",
+                path,
+                count.calls,
+                budget);
+}
+END_TEST
+
+/**
+ * Resolve providers for every device of every umockdev fixture
+ */
+START_TEST(test_allocations_providers)
+{
+        const gchar *path = umockdev_files.gl_pathv[_i];
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmManager) manager = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_file(bed, path, NULL), "Failed to load %s", path);
+
+        manager = ldm_manager_new(0);
+        fail_if(!manager, "Failed to get the LdmManager");
+        ldm_manager_add_modalias_plugins_for_directory(manager, MODALIAS_DIR);
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_ANY);
+
+        for (guint i = 0; i < devices->len; i++) {
+                LdmDevice *device = devices->pdata[i];
+                g_autoptr(GPtrArray) warmup = NULL;
+                g_autoptr(GPtrArray) providers = NULL;
+                AllocCount count = { 0 };
+                gsize budget = 0;
+
+                budget = PROVIDERS_BUDGET_BASE +
+                         count_device_tree(device) * PROVIDERS_BUDGET_PER_DEVICE;
+
+                /* First query builds the routing table and plugin indexes */
+                warmup = ldm_manager_get_providers(manager, device);
+
+                alloc_count_begin();
+                providers = ldm_manager_get_providers(manager, device);
+                count = alloc_count_end();
+
+                if (alloc_verbose) {
+                        fprintf(stdout,
+                                "ldm_manager_get_providers: %s: %s: %zu allocations, "
+                                "%zu bytes (budget %zu)\n",
+                                path,
+                                ldm_device_get_path(device),
+                                count.calls,
+                                count.bytes,
+                                budget);
+                }
+                fail_if(count.calls > budget,
+                        "get_providers for %s: %zu allocations exceeds budget of %zu",
+                        ldm_device_get_path(device),
+                        count.calls,
+                        budget);
+        }
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int ldm_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        if (glob(TEST_DATA_ROOT "/*.umockdev", 0, NULL, &umockdev_files) != 0 ||
+            glob(TEST_DATA_ROOT "/*.modaliases", 0, NULL, &modalias_files) != 0) {
+                fprintf(stderr, "Failed to find test fixtures in %s\n", TEST_DATA_ROOT);
+                abort();
+        }
+
+        tcase_add_loop_test(tc, test_allocations_manager, 0, (int)umockdev_files.gl_pathc);
+        tcase_add_loop_test(tc, test_allocations_plugin, 0, (int)modalias_files.gl_pathc);
+        tcase_add_loop_test(tc, test_allocations_providers, 0, (int)umockdev_files.gl_pathc);
+
+        return s;
+}
+
+int main(__ldm_unused__ int argc, __ldm_unused__ char **argv)
+{
+        int ret = 0;
+
+        alloc_verbose = g_strcmp0(g_getenv("CK_VERBOSITY"), "verbose") == 0;
+        ret = ldm_test_run(test_create());
+
+        globfree(&umockdev_files);
+        globfree(&modalias_files);
+
+        return ret;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
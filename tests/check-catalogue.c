@@ -0,0 +1,428 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <umockdev.h>
+
+#include "ldm.h"
+#include "util.h"
+
+DEF_AUTOFREE(UMockdevTestbed, g_object_unref)
+
+#define NV_MOCKDEV_FILE TEST_DATA_ROOT "/nvidia1060.umockdev"
+
+static int remove_path(const char *path, __ldm_unused__ const struct stat *st,
+                       __ldm_unused__ int flag, __ldm_unused__ struct FTW *ftw)
+{
+        return remove(path);
+}
+
+static UMockdevTestbed *create_bed_from(const char *mockdevname)
+{
+        UMockdevTestbed *bed = NULL;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_file(bed, mockdevname, NULL),
+                "Failed to create device: %s",
+                mockdevname);
+
+        return bed;
+}
+
+static gboolean has_shard(const gchar *directory, const gchar *name)
+{
+        g_autofree gchar *path = g_build_filename(directory, "current", name, NULL);
+
+        return g_file_test(path, G_FILE_TEST_IS_REGULAR);
+}
+
+/**
+ * Count the entries of the catalogue directory, i.e. builds and links
+ */
+static guint count_entries(const gchar *directory)
+{
+        g_autoptr(GDir) dir = NULL;
+        guint ret = 0;
+
+        dir = g_dir_open(directory, 0, NULL);
+        fail_if(!dir, "Failed to open %s", directory);
+        while (g_dir_read_name(dir)) {
+                ++ret;
+        }
+
+        return ret;
+}
+
+/**
+ * Build a catalogue spanning several buses and vendors, and ensure only the
+ * matching packages come back for the GPU, in match order.
+ */
+START_TEST(test_catalogue_packages)
+{
+        g_autoptr(LdmCatalogue) catalogue = NULL;
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GPtrArray) packages = NULL;
+        g_autofree gchar *directory = NULL;
+        GError *error = NULL;
+
+        directory = g_dir_make_tmp("ldm-catalogue-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create catalogue directory");
+
+        catalogue = ldm_catalogue_new(directory);
+        fail_if(!ldm_catalogue_add_alias(catalogue,
+                                         "pci:v000010DEd00001C60sv*sd*bc03sc*i*",
+                                         "nvidia",
+                                         "nvidia-glx-driver",
+                                         &error),
+                "Failed to add alias: %s",
+                error->message);
+        fail_if(!ldm_catalogue_add_alias(catalogue,
+                                         "pci:v000010DEd*sv*sd*bc03sc*i*",
+                                         "nouveau",
+                                         "nouveau-firmware",
+                                         NULL),
+                "Failed to add vendor alias");
+        fail_if(!ldm_catalogue_add_alias(catalogue,
+                                         "pci:v00008086d*sv*sd*bc03sc*i*",
+                                         "i915",
+                                         "intel-firmware",
+                                         NULL),
+                "Failed to add intel alias");
+        fail_if(!ldm_catalogue_add_alias(catalogue, "pci:*bc03*", "vesafb", "vesa-driver", NULL),
+                "Failed to add bus alias");
+        fail_if(!ldm_catalogue_add_alias(catalogue, "usb:v1532p*", "razer", "razer-drivers", NULL),
+                "Failed to add usb alias");
+        fail_if(!ldm_catalogue_add_alias(catalogue, "*", "dummy", "everything", NULL),
+                "Failed to add unroutable alias");
+
+        /* Columns are split on whitespace, so these can't be stored */
+        fail_if(ldm_catalogue_add_alias(catalogue, "pci:v* d*", "bad", "bad", NULL),
+                "Should not accept a match with whitespace");
+
+        fail_if(!ldm_catalogue_commit(catalogue, &error),
+                "Failed to commit catalogue: %s",
+                error->message);
+
+        fail_if(!has_shard(directory, "pci-000010de.shard"), "Missing NVIDIA shard");
+        fail_if(!has_shard(directory, "pci-00008086.shard"), "Missing Intel shard");
+        fail_if(!has_shard(directory, "pci-any.shard"), "Missing PCI shard");
+        fail_if(!has_shard(directory, "usb-00001532.shard"), "Missing Razer shard");
+        fail_if(!has_shard(directory, "any.shard"), "Missing unroutable shard");
+
+        bed = create_bed_from(NV_MOCKDEV_FILE);
+        manager = ldm_manager_new(0);
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_GPU);
+        fail_if(devices->len != 1, "Expected 1 GPU, got %u", devices->len);
+
+        packages = ldm_catalogue_get_packages(catalogue, devices->pdata[0]);
+        fail_if(packages->len != 4, "Expected 4 packages, got %u", packages->len);
+        fail_if(!g_str_equal(packages->pdata[0], "nvidia-glx-driver"),
+                "Wrong first package: %s",
+                packages->pdata[0]);
+        fail_if(!g_str_equal(packages->pdata[1], "nouveau-firmware"),
+                "Wrong second package: %s",
+                packages->pdata[1]);
+        fail_if(!g_str_equal(packages->pdata[2], "vesa-driver"),
+                "Wrong third package: %s",
+                packages->pdata[2]);
+        fail_if(!g_str_equal(packages->pdata[3], "everything"),
+                "Wrong fourth package: %s",
+                packages->pdata[3]);
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * A commit replaces the catalogue, so shards from an earlier build must go,
+ * and committing nothing at all empties it.
+ */
+START_TEST(test_catalogue_rebuild)
+{
+        g_autoptr(LdmCatalogue) catalogue = NULL;
+        g_autofree gchar *directory = NULL;
+
+        directory = g_dir_make_tmp("ldm-catalogue-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create catalogue directory");
+
+        catalogue = ldm_catalogue_new(directory);
+        fail_if(!ldm_catalogue_add_alias(catalogue,
+                                         "pci:v000010DEd*sv*sd*bc03sc*i*",
+                                         "nvidia",
+                                         "nvidia-glx-driver",
+                                         NULL),
+                "Failed to add alias");
+        fail_if(!ldm_catalogue_commit(catalogue, NULL), "Failed to commit first build");
+        fail_if(!has_shard(directory, "pci-000010de.shard"), "Missing NVIDIA shard");
+
+        fail_if(!ldm_catalogue_add_alias(catalogue, "usb:v1532p*", "razer", "razer-drivers", NULL),
+                "Failed to add usb alias");
+        fail_if(!ldm_catalogue_commit(catalogue, NULL), "Failed to commit second build");
+
+        fail_if(has_shard(directory, "pci-000010de.shard"), "Stale NVIDIA shard left behind");
+        fail_if(!has_shard(directory, "usb-00001532.shard"), "Missing Razer shard");
+
+        /* Just the current link and the build it names */
+        fail_if(count_entries(directory) != 2,
+                "Expected 2 entries, got %u",
+                count_entries(directory));
+
+        /* Nothing added, so nothing is left */
+        fail_if(!ldm_catalogue_commit(catalogue, NULL), "Failed to commit empty build");
+        fail_if(has_shard(directory, "usb-00001532.shard"), "Empty commit kept a shard");
+        fail_if(count_entries(directory) != 2,
+                "Expected 2 entries, got %u",
+                count_entries(directory));
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * Plant a catch-all alias in a shard of the current build
+ */
+static void plant_shard(const gchar *directory, const gchar *name, const gchar *package)
+{
+        g_autofree gchar *path = NULL;
+        g_autofree gchar *contents = NULL;
+
+        path = g_build_filename(directory, "current", name, NULL);
+        contents = g_strdup_printf("alias * planted %s\n", package);
+        fail_if(!g_file_set_contents(path, contents, -1, NULL), "Failed to write %s", path);
+}
+
+static gboolean has_package(GPtrArray *packages, const gchar *package)
+{
+        for (guint i = 0; i < packages->len; i++) {
+                if (g_str_equal(packages->pdata[i], package)) {
+                        return TRUE;
+                }
+        }
+
+        return FALSE;
+}
+
+/**
+ * A lookup must only open the shards its device can be routed to. Every
+ * other shard holds an alias that would match anything, so reading one
+ * would show up in the packages.
+ */
+START_TEST(test_catalogue_routed)
+{
+        g_autoptr(LdmCatalogue) catalogue = NULL;
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GPtrArray) packages = NULL;
+        g_autofree gchar *directory = NULL;
+
+        directory = g_dir_make_tmp("ldm-catalogue-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create catalogue directory");
+
+        catalogue = ldm_catalogue_new(directory);
+        fail_if(!ldm_catalogue_add_alias(catalogue,
+                                         "pci:v000010DEd*sv*sd*bc03sc*i*",
+                                         "nvidia",
+                                         "nvidia-glx-driver",
+                                         NULL),
+                "Failed to add alias");
+        fail_if(!ldm_catalogue_commit(catalogue, NULL), "Failed to commit catalogue");
+
+        plant_shard(directory, "pci-any.shard", "routed-pci");
+        plant_shard(directory, "any.shard", "routed-any");
+        plant_shard(directory, "pci-00008086.shard", "unrouted-vendor");
+        plant_shard(directory, "pci-00001002.shard", "unrouted-vendor");
+        plant_shard(directory, "usb-any.shard", "unrouted-bus");
+        plant_shard(directory, "usb-000010de.shard", "unrouted-bus");
+        plant_shard(directory, "hid-any.shard", "unrouted-bus");
+
+        bed = create_bed_from(NV_MOCKDEV_FILE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_GPU);
+        fail_if(devices->len != 1, "Expected 1 GPU, got %u", devices->len);
+
+        packages = ldm_catalogue_get_packages(catalogue, devices->pdata[0]);
+        fail_if(!has_package(packages, "nvidia-glx-driver"), "Missing NVIDIA package");
+        fail_if(!has_package(packages, "routed-pci"), "Bus shard was not read");
+        fail_if(!has_package(packages, "routed-any"), "Unroutable shard was not read");
+        fail_if(has_package(packages, "unrouted-vendor"), "Read the shard of another vendor");
+        fail_if(has_package(packages, "unrouted-bus"), "Read the shard of another bus");
+        fail_if(packages->len != 3, "Expected 3 packages, got %u", packages->len);
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * Commit a build with one alias in each shard the GPU is routed to, all
+ * with packages named after the build.
+ */
+static void commit_generation(LdmCatalogue *catalogue, const gchar *build)
+{
+        const gchar *matches[] = {
+                "pci:v000010DEd*sv*sd*bc03sc*i*",
+                "pci:*bc03*",
+                "*",
+        };
+
+        for (guint i = 0; i < G_N_ELEMENTS(matches); i++) {
+                g_autofree gchar *package = g_strdup_printf("%s-%u", build, i);
+
+                fail_if(!ldm_catalogue_add_alias(catalogue, matches[i], "dummy", package, NULL),
+                        "Failed to add alias %s",
+                        matches[i]);
+        }
+
+        fail_if(!ldm_catalogue_commit(catalogue, NULL), "Failed to commit %s", build);
+}
+
+typedef struct {
+        const gchar *directory;
+        gint stop;
+        gint commits;
+} CommitLoop;
+
+/**
+ * Keep replacing the catalogue from another thread, as a writer process would
+ */
+static gpointer commit_loop(gpointer data)
+{
+        CommitLoop *loop = data;
+        g_autoptr(LdmCatalogue) catalogue = ldm_catalogue_new(loop->directory);
+
+        while (!g_atomic_int_get(&loop->stop)) {
+                commit_generation(catalogue,
+                                  g_atomic_int_get(&loop->commits) % 2 ? "odd" : "even");
+                g_atomic_int_inc(&loop->commits);
+        }
+
+        return NULL;
+}
+
+/**
+ * Lookups racing commits must always see one whole build, and never lose
+ * shards to a commit that removes their build halfway through.
+ */
+START_TEST(test_catalogue_commit_during_lookup)
+{
+        g_autoptr(LdmCatalogue) catalogue = NULL;
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autofree gchar *directory = NULL;
+        CommitLoop loop = { 0 };
+        GThread *thread = NULL;
+
+        directory = g_dir_make_tmp("ldm-catalogue-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create catalogue directory");
+
+        catalogue = ldm_catalogue_new(directory);
+        commit_generation(catalogue, "even");
+
+        bed = create_bed_from(NV_MOCKDEV_FILE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_GPU);
+        fail_if(devices->len != 1, "Expected 1 GPU, got %u", devices->len);
+
+        loop.directory = directory;
+        thread = g_thread_new("commit-loop", commit_loop, &loop);
+
+        /* Keep going until plenty of commits have landed between lookups */
+        for (guint i = 0; i < 2000 || g_atomic_int_get(&loop.commits) < 100; i++) {
+                g_autoptr(GPtrArray) packages = NULL;
+                const gchar *build = NULL;
+
+                packages = ldm_catalogue_get_packages(catalogue, devices->pdata[0]);
+                fail_if(packages->len != 3,
+                        "Lookup %u saw %u packages, expected 3",
+                        i,
+                        packages->len);
+
+                build = g_str_has_prefix(packages->pdata[0], "odd-") ? "odd" : "even";
+                for (guint j = 0; j < packages->len; j++) {
+                        g_autofree gchar *package = g_strdup_printf("%s-%u", build, j);
+
+                        fail_if(!g_str_equal(packages->pdata[j], package),
+                                "Lookup %u mixed builds: %s",
+                                i,
+                                packages->pdata[j]);
+                }
+        }
+
+        g_atomic_int_set(&loop.stop, 1);
+        g_thread_join(thread);
+
+        /* Just the current link and the build it names, nothing retired */
+        fail_if(count_entries(directory) != 2,
+                "Expected 2 entries, got %u",
+                count_entries(directory));
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int ldm_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_catalogue_packages);
+        tcase_add_test(tc, test_catalogue_rebuild);
+        tcase_add_test(tc, test_catalogue_routed);
+        tcase_add_test(tc, test_catalogue_commit_during_lookup);
+
+        return s;
+}
+
+int main(__ldm_unused__ int argc, __ldm_unused__ char **argv)
+{
+        return ldm_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
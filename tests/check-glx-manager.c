@@ -0,0 +1,302 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include "config.h"
+
+#include <check.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <umockdev.h>
+
+#include "ldm-private.h"
+#include "ldm.h"
+#include "util.h"
+
+DEF_AUTOFREE(UMockdevTestbed, g_object_unref)
+
+#define OPTIMUS_MOCKDEV_FILE TEST_DATA_ROOT "/optimus765m.umockdev"
+
+static UMockdevTestbed *create_bed_from(const char *mockdevname)
+{
+        UMockdevTestbed *bed = NULL;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_file(bed, mockdevname, NULL),
+                "Failed to create device: %s",
+                mockdevname);
+
+        return bed;
+}
+
+static int remove_path(const char *path, __ldm_unused__ const struct stat *st,
+                       __ldm_unused__ int flag, __ldm_unused__ struct FTW *ftw)
+{
+        return remove(path);
+}
+
+/**
+ * Construct a scratch root with the NVIDIA X.Org driver "installed"
+ */
+static gchar *create_root(void)
+{
+        g_autofree gchar *drivers = NULL;
+        g_autofree gchar *driver = NULL;
+        gchar *root = NULL;
+
+        root = g_dir_make_tmp("ldm-glx-XXXXXX", NULL);
+        fail_if(!root, "Failed to create scratch root");
+
+        drivers = g_build_filename(root, XORG_MODULE_DIRECTORY, "drivers", NULL);
+        fail_if(g_mkdir_with_parents(drivers, 00755) != 0, "Failed to create %s", drivers);
+
+        driver = g_build_filename(drivers, "nvidia_drv.so", NULL);
+        fail_if(!g_file_set_contents(driver, "", 0, NULL), "Failed to create %s", driver);
+
+        return root;
+}
+
+static gchar *read_root_file(const gchar *root, const gchar *path)
+{
+        g_autofree gchar *full_path = NULL;
+        gchar *contents = NULL;
+
+        full_path = g_build_filename(root, path, NULL);
+        if (!g_file_get_contents(full_path, &contents, NULL, NULL)) {
+                return NULL;
+        }
+
+        return contents;
+}
+
+static LdmGLXManager *create_glx_manager(const gchar *root)
+{
+        return g_object_new(LDM_TYPE_GLX_MANAGER, "root", root, NULL);
+}
+
+/**
+ * Render offload must leave the iGPU primary, and record mode 2
+ */
+START_TEST(test_glx_manager_optimus_offload)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmGPUConfig) gpu = NULL;
+        g_autoptr(LdmGLXManager) glx = NULL;
+        g_autofree gchar *root = NULL;
+        g_autofree gchar *hybrid = NULL;
+        g_autofree gchar *xorg = NULL;
+
+        bed = create_bed_from(OPTIMUS_MOCKDEV_FILE);
+        manager = ldm_manager_new(0);
+        gpu = ldm_gpu_config_new(manager);
+        fail_if(!ldm_gpu_config_has_type(gpu, LDM_GPU_TYPE_OPTIMUS), "Failed to detect Optimus");
+
+        root = create_root();
+        glx = create_glx_manager(root);
+        fail_if(ldm_glx_manager_get_hybrid_mode(glx) != LDM_HYBRID_MODE_ALWAYS_ON,
+                "Hybrid mode should default to always on");
+
+        ldm_glx_manager_set_hybrid_mode(glx, LDM_HYBRID_MODE_OFFLOAD);
+        fail_if(!ldm_glx_manager_apply_configuration(glx, gpu), "Failed to apply configuration");
+
+        hybrid = read_root_file(root, LDM_HYBRID_FILE);
+        fail_if(g_strcmp0(hybrid, "2") != 0, "Hybrid file should be 2, got '%s'", hybrid);
+
+        xorg = read_root_file(root, SYSCONFDIR "/X11/xorg.conf.d/00-ldm.conf");
+        fail_if(!xorg, "Missing X.Org configuration");
+        fail_if(!strstr(xorg, "Option \"AllowNVIDIAGPUScreens\""), "Missing GPU screens option");
+        fail_if(!strstr(xorg, "Screen 0 \"Intel Screen\""), "iGPU should drive the screen");
+        fail_if(!strstr(xorg, "Driver \"modesetting\"\n        BusID \"PCI:0:2:0\""),
+                "Missing iGPU device section:\n%s",
+                xorg);
+        fail_if(!strstr(xorg, "Driver \"nvidia\"\n        BusID \"PCI:2:0:0\""),
+                "Missing NVIDIA device section:\n%s",
+                xorg);
+
+        /* A fresh manager must pick the mode back up from the hybrid file */
+        g_clear_object(&glx);
+        glx = create_glx_manager(root);
+        fail_if(ldm_glx_manager_get_hybrid_mode(glx) != LDM_HYBRID_MODE_OFFLOAD,
+                "Hybrid mode not restored from the hybrid file");
+
+        nftw(root, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * Switching back to always on must replace the offload configuration
+ */
+START_TEST(test_glx_manager_optimus_always_on)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmGPUConfig) gpu = NULL;
+        g_autoptr(LdmGLXManager) glx = NULL;
+        g_autofree gchar *root = NULL;
+        g_autofree gchar *hybrid = NULL;
+        g_autofree gchar *xorg = NULL;
+
+        bed = create_bed_from(OPTIMUS_MOCKDEV_FILE);
+        manager = ldm_manager_new(0);
+        gpu = ldm_gpu_config_new(manager);
+
+        root = create_root();
+        glx = g_object_new(LDM_TYPE_GLX_MANAGER,
+                           "root",
+                           root,
+                           "hybrid-mode",
+                           LDM_HYBRID_MODE_OFFLOAD,
+                           NULL);
+        fail_if(!ldm_glx_manager_apply_configuration(glx, gpu), "Failed to apply configuration");
+
+        ldm_glx_manager_set_hybrid_mode(glx, LDM_HYBRID_MODE_ALWAYS_ON);
+        fail_if(!ldm_glx_manager_apply_configuration(glx, gpu), "Failed to apply configuration");
+
+        hybrid = read_root_file(root, LDM_HYBRID_FILE);
+        fail_if(g_strcmp0(hybrid, "1") != 0, "Hybrid file should be 1, got '%s'", hybrid);
+
+        xorg = read_root_file(root, SYSCONFDIR "/X11/xorg.conf.d/00-ldm.conf");
+        fail_if(!xorg, "Missing X.Org configuration");
+        fail_if(strstr(xorg, "AllowNVIDIAGPUScreens") != NULL, "Stale offload configuration");
+        fail_if(!strstr(xorg, "BusID \"PCI:2:0:0\""), "Missing NVIDIA BusID:\n%s", xorg);
+
+        nftw(root, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/*
+ * Workstation with two NVIDIA cards, the first one used to boot
+ */
+static const gchar *sli_recording =
+    "P: /devices/pci0000:00/0000:00:01.0/0000:01:00.0\n"
+    "E: DRIVER=nvidia\n"
+    "E: ID_MODEL_FROM_DATABASE=GP104 [GeForce GTX 1080]\n"
+    "E: ID_VENDOR_FROM_DATABASE=NVIDIA Corporation\n"
+    "E: PCI_CLASS=30000\n"
+    "E: PCI_ID=10DE:1B80\n"
+    "E: SUBSYSTEM=pci\n"
+    "A: boot_vga=1\n"
+    "A: class=0x030000\n"
+    "A: device=0x1b80\n"
+    "A: modalias=pci:v000010DEd00001B80sv00001043sd00008591bc03sc00i00\n"
+    "A: vendor=0x10de\n"
+    "\n"
+    "P: /devices/pci0000:00/0000:00:03.0/0000:03:00.0\n"
+    "E: DRIVER=nvidia\n"
+    "E: ID_MODEL_FROM_DATABASE=GP104 [GeForce GTX 1080]\n"
+    "E: ID_VENDOR_FROM_DATABASE=NVIDIA Corporation\n"
+    "E: PCI_CLASS=30000\n"
+    "E: PCI_ID=10DE:1B80\n"
+    "E: SUBSYSTEM=pci\n"
+    "A: boot_vga=0\n"
+    "A: class=0x030000\n"
+    "A: device=0x1b80\n"
+    "A: modalias=pci:v000010DEd00001B80sv00001043sd00008591bc03sc00i00\n"
+    "A: vendor=0x10de\n"
+    "\n";
+
+/**
+ * SLI must list every card of the group with its BusID
+ */
+START_TEST(test_glx_manager_sli)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmGPUConfig) gpu = NULL;
+        g_autoptr(LdmGLXManager) glx = NULL;
+        g_autofree gchar *root = NULL;
+        g_autofree gchar *hybrid = NULL;
+        g_autofree gchar *xorg = NULL;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_string(bed, sli_recording, NULL),
+                "Failed to create testbed");
+        manager = ldm_manager_new(0);
+        gpu = ldm_gpu_config_new(manager);
+        fail_if(!ldm_gpu_config_has_type(gpu, LDM_GPU_TYPE_SLI), "Failed to detect SLI");
+
+        root = create_root();
+        glx = create_glx_manager(root);
+        fail_if(!ldm_glx_manager_apply_configuration(glx, gpu), "Failed to apply configuration");
+
+        xorg = read_root_file(root, SYSCONFDIR "/X11/xorg.conf.d/00-ldm.conf");
+        fail_if(!xorg, "Missing X.Org configuration");
+        fail_if(!strstr(xorg, "Identifier \"NVIDIA Card 0\"\n        Driver \"nvidia\"\n"
+                              "        BusID \"PCI:1:0:0\""),
+                "Missing primary device section:\n%s",
+                xorg);
+        fail_if(!strstr(xorg, "Identifier \"NVIDIA Card 1\"\n        Driver \"nvidia\"\n"
+                              "        BusID \"PCI:3:0:0\""),
+                "Missing secondary device section:\n%s",
+                xorg);
+        fail_if(!strstr(xorg, "Device \"NVIDIA Card 0\"\n        Option \"SLI\" \"Auto\""),
+                "Missing SLI screen:\n%s",
+                xorg);
+        hybrid = read_root_file(root, LDM_HYBRID_FILE);
+        fail_if(hybrid != NULL, "SLI must not leave a hybrid file behind");
+
+        nftw(root, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int ldm_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_glx_manager_optimus_offload);
+        tcase_add_test(tc, test_glx_manager_optimus_always_on);
+        tcase_add_test(tc, test_glx_manager_sli);
+
+        return s;
+}
+
+int main(__ldm_unused__ int argc, __ldm_unused__ char **argv)
+{
+        return ldm_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -18,6 +18,7 @@
 
 #include "ldm-private.h"
 #include "ldm.h"
+#include "topology.h"
 #include "util.h"
 
 DEF_AUTOFREE(UMockdevTestbed, g_object_unref)
@@ -117,6 +118,254 @@ START_TEST(test_gpu_config_desktop_nvidia)
 }
 END_TEST
 
+/*
+ * Optimus laptop with the NVIDIA GPU runtime suspended. The sysfs attributes
+ * that would wake it are deliberately missing, so the device can only be
+ * identified from the udev properties.
+ */
+static const gchar *suspended_optimus_recording =
+    "P: /devices/pci0000:00/0000:00:02.0\n"
+    "E: DRIVER=i915\n"
+    "E: MODALIAS=pci:v00008086d00000416sv00001462sd000010E0bc03sc00i00\n"
+    "E: PCI_CLASS=30000\n"
+    "E: PCI_ID=8086:0416\n"
+    "E: PCI_SLOT_NAME=0000:00:02.0\n"
+    "E: SUBSYSTEM=pci\n"
+    "A: boot_vga=1\n"
+    "A: class=0x030000\n"
+    "A: device=0x0416\n"
+    "A: modalias=pci:v00008086d00000416sv00001462sd000010E0bc03sc00i00\n"
+    "A: power/runtime_status=active\n"
+    "A: vendor=0x8086\n"
+    "\n"
+    "P: /devices/pci0000:00/0000:00:01.0/0000:01:00.0\n"
+    "E: DRIVER=nvidia\n"
+    "E: MODALIAS=pci:v000010DEd000011E2sv00001462sd000010E0bc03sc02i00\n"
+    "E: PCI_CLASS=30200\n"
+    "E: PCI_ID=10DE:11E2\n"
+    "E: PCI_SLOT_NAME=0000:01:00.0\n"
+    "E: SUBSYSTEM=pci\n"
+    "A: power/runtime_status=suspended\n"
+    "\n";
+
+/**
+ * Enumeration must be able to identify a sleeping discrete GPU without
+ * reading the attributes that would resume it
+ */
+START_TEST(test_gpu_config_optimus_suspended)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmGPUConfig) gpu = NULL;
+        LdmDevice *device = NULL;
+        guint n_gpu = 0;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_string(bed, suspended_optimus_recording, NULL),
+                "Failed to create testbed");
+        manager = ldm_manager_new(0);
+
+        gpu = ldm_gpu_config_new(manager);
+        fail_if(!gpu, "Failed to create GPUConfig");
+
+        n_gpu = ldm_gpu_config_count(gpu);
+        fail_if(n_gpu != 2, "Invalid number of GPUs (%u) - expected %u", n_gpu, 2);
+        fail_if(!ldm_gpu_config_has_type(gpu, LDM_GPU_TYPE_OPTIMUS), "Failed to detect Optimus");
+
+        device = ldm_gpu_config_get_secondary_device(gpu);
+        fail_if(!device, "Missing discrete GPU");
+        fail_if(ldm_device_get_vendor_id(device) != LDM_PCI_VENDOR_ID_NVIDIA,
+                "Wrong vendor for suspended GPU: %x",
+                ldm_device_get_vendor_id(device));
+        fail_if(ldm_device_get_product_id(device) != 0x11E2,
+                "Wrong product for suspended GPU: %x",
+                ldm_device_get_product_id(device));
+        fail_if(g_strcmp0(ldm_device_get_modalias(device),
+                          "pci:v000010DEd000011E2sv00001462sd000010E0bc03sc02i00") != 0,
+                "Wrong modalias for suspended GPU");
+        fail_if(ldm_pci_device_get_runtime_status(LDM_PCI_DEVICE(device)) !=
+                    LDM_PCI_RUNTIME_STATUS_SUSPENDED,
+                "Discrete GPU should be suspended");
+
+        device = ldm_gpu_config_get_primary_device(gpu);
+        fail_if(ldm_pci_device_get_runtime_status(LDM_PCI_DEVICE(device)) !=
+                    LDM_PCI_RUNTIME_STATUS_ACTIVE,
+                "Integrated GPU should be active");
+}
+END_TEST
+
+/*
+ * Workstation with two NVIDIA cards, the first one used to boot
+ */
+static const gchar *sli_recording =
+    "P: /devices/pci0000:00/0000:00:01.0/0000:01:00.0\n"
+    "E: DRIVER=nvidia\n"
+    "E: ID_MODEL_FROM_DATABASE=GP104 [GeForce GTX 1080]\n"
+    "E: ID_VENDOR_FROM_DATABASE=NVIDIA Corporation\n"
+    "E: PCI_CLASS=30000\n"
+    "E: PCI_ID=10DE:1B80\n"
+    "E: SUBSYSTEM=pci\n"
+    "A: boot_vga=1\n"
+    "A: class=0x030000\n"
+    "A: device=0x1b80\n"
+    "A: modalias=pci:v000010DEd00001B80sv00001043sd00008591bc03sc00i00\n"
+    "A: vendor=0x10de\n"
+    "\n"
+    "P: /devices/pci0000:00/0000:00:03.0/0000:03:00.0\n"
+    "E: DRIVER=nvidia\n"
+    "E: ID_MODEL_FROM_DATABASE=GP104 [GeForce GTX 1080]\n"
+    "E: ID_VENDOR_FROM_DATABASE=NVIDIA Corporation\n"
+    "E: PCI_CLASS=30000\n"
+    "E: PCI_ID=10DE:1B80\n"
+    "E: SUBSYSTEM=pci\n"
+    "A: boot_vga=0\n"
+    "A: class=0x030000\n"
+    "A: device=0x1b80\n"
+    "A: modalias=pci:v000010DEd00001B80sv00001043sd00008591bc03sc00i00\n"
+    "A: vendor=0x10de\n"
+    "\n";
+
+/**
+ * Both cards must end up in the SLI group, boot_vga first
+ */
+START_TEST(test_gpu_config_sli)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmGPUConfig) gpu = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_string(bed, sli_recording, NULL),
+                "Failed to create testbed");
+        manager = ldm_manager_new(0);
+
+        gpu = ldm_gpu_config_new(manager);
+        fail_if(!gpu, "Failed to create GPUConfig");
+
+        fail_if(!ldm_gpu_config_has_type(gpu, LDM_GPU_TYPE_COMPOSITE | LDM_GPU_TYPE_SLI),
+                "Failed to detect SLI");
+
+        devices = ldm_gpu_config_get_devices(gpu);
+        fail_if(devices->len != 2, "Invalid number of SLI GPUs (%u) - expected 2", devices->len);
+        fail_if(devices->pdata[0] != ldm_gpu_config_get_primary_device(gpu),
+                "Primary GPU should lead the group");
+        fail_if(!ldm_device_has_attribute(devices->pdata[0], LDM_DEVICE_ATTRIBUTE_BOOT_VGA),
+                "Primary GPU should be boot_vga");
+}
+END_TEST
+
+/**
+ * Only the discrete GPU takes part in the desktop configuration
+ */
+START_TEST(test_gpu_config_devices_simple)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmGPUConfig) gpu = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+
+        bed = create_bed_from(DESKTOP_NVIDIA_MOCKDEV_FILE);
+        manager = ldm_manager_new(0);
+        gpu = ldm_gpu_config_new(manager);
+
+        devices = ldm_gpu_config_get_devices(gpu);
+        fail_if(devices->len != 1, "Invalid number of GPUs (%u) - expected 1", devices->len);
+        fail_if(devices->pdata[0] != ldm_gpu_config_get_detection_device(gpu),
+                "Wrong GPU in simple configuration");
+}
+END_TEST
+
+/**
+ * Build the manager the way `linux-driver-management run` does, probing
+ * with the given number of threads
+ */
+static LdmManager *create_run_manager(const gchar *n_threads)
+{
+        LdmManager *manager = NULL;
+
+        g_setenv("LDM_PROBE_THREADS", n_threads, TRUE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR | LDM_MANAGER_FLAGS_GPU_QUICK);
+        g_unsetenv("LDM_PROBE_THREADS");
+        fail_if(!manager, "Failed to get the LdmManager");
+
+        return manager;
+}
+
+/**
+ * Device paths and priorities in manager order, with the GPU configuration
+ */
+static gchar *describe_run_config(LdmGPUConfig *gpu)
+{
+        g_autoptr(GPtrArray) devices = NULL;
+        GString *description = g_string_new(NULL);
+        LdmDevice *secondary = NULL;
+
+        devices = ldm_manager_get_devices(ldm_gpu_config_get_manager(gpu), LDM_DEVICE_TYPE_ANY);
+        for (guint i = 0; i < devices->len; i++) {
+                g_string_append_printf(description,
+                                       "%s %u\n",
+                                       ldm_device_get_path(devices->pdata[i]),
+                                       ldm_device_get_priority(devices->pdata[i]));
+        }
+
+        secondary = ldm_gpu_config_get_secondary_device(gpu);
+        g_string_append_printf(description,
+                               "type %d, %u gpus, primary %s, secondary %s, detection %s\n",
+                               ldm_gpu_config_get_gpu_type(gpu),
+                               ldm_gpu_config_count(gpu),
+                               ldm_device_get_path(ldm_gpu_config_get_primary_device(gpu)),
+                               secondary ? ldm_device_get_path(secondary) : "none",
+                               ldm_device_get_path(ldm_gpu_config_get_detection_device(gpu)));
+
+        return g_string_free(description, FALSE);
+}
+
+/**
+ * The quick GPU probe behind `linux-driver-management run` must find the
+ * same devices and configuration on several threads as on one.
+ */
+START_TEST(test_gpu_config_parallel)
+{
+        static const LdmTopology machine = {
+                .n_gpus = 2,
+                .n_pci = 300,
+        };
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmManager) serial_manager = NULL;
+        g_autoptr(LdmManager) parallel_manager = NULL;
+        g_autoptr(LdmGPUConfig) serial = NULL;
+        g_autoptr(LdmGPUConfig) parallel = NULL;
+        g_autofree gchar *recording = NULL;
+        g_autofree gchar *expected = NULL;
+        g_autofree gchar *result = NULL;
+
+        recording = ldm_topology_generate(&machine);
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_string(bed, recording, NULL),
+                "Failed to create generated machine");
+
+        serial_manager = create_run_manager("1");
+        serial = ldm_gpu_config_new(serial_manager);
+        fail_if(!serial, "Failed to create serial GPUConfig");
+        fail_if(!ldm_gpu_config_has_type(serial, LDM_GPU_TYPE_OPTIMUS), "Failed to detect Optimus");
+        fail_if(ldm_gpu_config_count(serial) != 2,
+                "Invalid number of GPUs (%u) - expected 2",
+                ldm_gpu_config_count(serial));
+
+        parallel_manager = create_run_manager("4");
+        parallel = ldm_gpu_config_new(parallel_manager);
+        fail_if(!parallel, "Failed to create parallel GPUConfig");
+
+        expected = describe_run_config(serial);
+        result = describe_run_config(parallel);
+        fail_if(!g_str_equal(expected, result),
+                "Parallel probe differs from serial probe:\n%s\nversus\n%s",
+                result,
+                expected);
+}
+END_TEST
+
 /**
  * Standard helper for running a test suite
  */
@@ -145,6 +394,10 @@ static Suite *test_create(void)
         tcase_add_test(tc, test_gpu_config_simple);
         tcase_add_test(tc, test_gpu_config_optimus);
         tcase_add_test(tc, test_gpu_config_desktop_nvidia);
+        tcase_add_test(tc, test_gpu_config_optimus_suspended);
+        tcase_add_test(tc, test_gpu_config_sli);
+        tcase_add_test(tc, test_gpu_config_devices_simple);
+        tcase_add_test(tc, test_gpu_config_parallel);
 
         return s;
 }
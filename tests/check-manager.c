@@ -18,6 +18,8 @@
 
 #include "ldm-private.h"
 #include "ldm.h"
+#include "manager-private.h"
+#include "topology.h"
 #include "util.h"
 
 DEF_AUTOFREE(UMockdevTestbed, g_object_unref)
@@ -138,6 +140,218 @@ START_TEST(test_manager_bluetooth_usb)
 }
 END_TEST
 
+static void device_changed_cb(__ldm_unused__ LdmManager *manager, LdmDevice *device, gpointer v)
+{
+        LdmDevice **changed = v;
+
+        g_set_object(changed, device);
+}
+
+static gboolean hotplug_timeout_cb(gpointer v)
+{
+        gboolean *timed_out = v;
+
+        *timed_out = TRUE;
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * Send the uevent for the device and run the main context until the manager
+ * has emitted the given signal for it.
+ */
+static LdmDevice *hotplug_uevent(LdmManager *manager, UMockdevTestbed *bed,
+                                 const gchar *sysfs_path, const gchar *action,
+                                 const gchar *signal)
+{
+        LdmDevice *changed = NULL;
+        gboolean timed_out = FALSE;
+        gulong handler = 0;
+        guint timeout = 0;
+
+        handler = g_signal_connect(manager, signal, G_CALLBACK(device_changed_cb), &changed);
+        umockdev_testbed_uevent(bed, sysfs_path, action);
+
+        timeout = g_timeout_add_seconds(5, hotplug_timeout_cb, &timed_out);
+        while (!changed && !timed_out) {
+                g_main_context_iteration(NULL, TRUE);
+        }
+        if (!timed_out) {
+                g_source_remove(timeout);
+        }
+        g_signal_handler_disconnect(manager, handler);
+
+        fail_if(!changed, "No %s after the '%s' uevent", signal, action);
+        return changed;
+}
+
+/**
+ * Create a standalone HID device, i.e. a receiver plugged straight into the
+ * machine, without announcing it.
+ */
+static gchar *add_hid_device(UMockdevTestbed *bed)
+{
+        gchar *sysfs_path = NULL;
+
+        sysfs_path = umockdev_testbed_add_device(bed,
+                                                 "hid",
+                                                 "0003:1532:021E.0009",
+                                                 NULL,
+                                                 /* attributes */
+                                                 "modalias",
+                                                 "hid:b0003g0000v00001532p0000021E",
+                                                 NULL,
+                                                 /* properties */
+                                                 "MODALIAS",
+                                                 "hid:b0003g0000v00001532p0000021E",
+                                                 NULL);
+        fail_if(!sysfs_path, "Failed to create HID device");
+
+        return sysfs_path;
+}
+
+/**
+ * Listening to raw kernel uevents must not change what we enumerate
+ */
+START_TEST(test_manager_kernel_events)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        LdmManagerFlags flags = LDM_MANAGER_FLAGS_NONE;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_file(bed, BLUETOOTH_UMOCKDEV_FILE, NULL),
+                "Failed to create Bluetooth device");
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_KERNEL_EVENTS);
+        fail_if(!manager, "Failed to get the LdmManager");
+
+        g_object_get(manager, "flags", &flags, NULL);
+        fail_if((flags & LDM_MANAGER_FLAGS_KERNEL_EVENTS) != LDM_MANAGER_FLAGS_KERNEL_EVENTS,
+                "Manager lost the kernel events flag");
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_BLUETOOTH);
+        fail_if(!devices, "Failed to obtain devices");
+        fail_if(devices->len != 1, "Invalid device set");
+        fail_if(!ldm_device_has_type(devices->pdata[0], LDM_DEVICE_TYPE_USB),
+                "Device should be identified as USB!");
+}
+END_TEST
+
+/**
+ * Hotplug works the same way when the monitor listens to raw kernel uevents
+ */
+START_TEST(test_manager_kernel_events_hotplug)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(LdmDevice) added = NULL;
+        g_autoptr(LdmDevice) removed = NULL;
+        g_autofree gchar *sysfs_path = NULL;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_file(bed, BLUETOOTH_UMOCKDEV_FILE, NULL),
+                "Failed to create Bluetooth device");
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_KERNEL_EVENTS);
+        fail_if(!manager, "Failed to get the LdmManager");
+
+        sysfs_path = add_hid_device(bed);
+        added = hotplug_uevent(manager, bed, sysfs_path, "add", "device-added");
+        fail_if(!g_str_equal(ldm_device_get_path(added), sysfs_path),
+                "Wrong device added: %s",
+                ldm_device_get_path(added));
+        fail_if(!ldm_device_has_type(added, LDM_DEVICE_TYPE_HID), "Device should be HID");
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_HID);
+        fail_if(devices->len != 1, "Hotplugged device should be listed");
+        g_clear_pointer(&devices, g_ptr_array_unref);
+
+        removed = hotplug_uevent(manager, bed, sysfs_path, "remove", "device-removed");
+        fail_if(removed != added, "Wrong device removed");
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_HID);
+        fail_if(devices->len != 0, "Removed device should not be listed");
+}
+END_TEST
+
+/**
+ * Walk the device tree, counting devices and ensuring children were added
+ * after their parents.
+ */
+static guint count_device_tree(LdmDevice *device)
+{
+        g_autoptr(GList) kids = NULL;
+        guint ret = 1;
+
+        kids = ldm_device_get_children(device);
+        for (GList *elem = kids; elem; elem = elem->next) {
+                LdmDevice *child = elem->data;
+
+                fail_if(ldm_device_get_priority(child) <= ldm_device_get_priority(device),
+                        "Child %s added before its parent",
+                        ldm_device_get_path(child));
+                ret += count_device_tree(child);
+        }
+
+        return ret;
+}
+
+/**
+ * Enumerate a generated machine large enough to be probed by several
+ * threads, and ensure the merge produces the same tree a serial walk would.
+ */
+START_TEST(test_manager_parallel)
+{
+        static const LdmTopology machine = {
+                .n_gpus = 8,
+                .n_pci = 48,
+                .n_hubs = 4,
+                .n_usb = 100,
+                .n_interfaces = 3,
+                .n_hid = 20,
+                .n_bluetooth = 4,
+        };
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autofree gchar *recording = NULL;
+        guint n_toplevel = 0;
+        guint n_devices = 0;
+
+        recording = ldm_topology_generate(&machine);
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_string(bed, recording, NULL),
+                "Failed to create generated machine");
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        fail_if(!manager, "Failed to get the LdmManager");
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_ANY);
+        fail_if(!devices, "Failed to obtain devices");
+
+        /* PCI functions, xHCI, root hub, hubs and USB devices */
+        n_toplevel = machine.n_gpus + machine.n_pci + 2 + machine.n_hubs + machine.n_usb +
+                     machine.n_bluetooth;
+        fail_if(devices->len != n_toplevel,
+                "Expected %u top level devices, found %u",
+                n_toplevel,
+                devices->len);
+
+        for (guint i = 0; i < devices->len; i++) {
+                if (i > 0) {
+                        fail_if(ldm_device_get_priority(devices->pdata[i]) <=
+                                    ldm_device_get_priority(devices->pdata[i - 1]),
+                                "Duplicate device priority");
+                }
+                n_devices += count_device_tree(devices->pdata[i]);
+        }
+
+        fail_if(n_devices != ldm_topology_count_devices(&machine),
+                "Expected %u devices, found %u",
+                ldm_topology_count_devices(&machine),
+                n_devices);
+}
+END_TEST
+
 START_TEST(test_manager_wifi_pci)
 {
         g_autoptr(LdmManager) manager = NULL;
@@ -160,6 +374,340 @@ START_TEST(test_manager_wifi_pci)
 }
 END_TEST
 
+/**
+ * Every index row must describe the top level device at the same position
+ */
+static void assert_index_consistent(LdmManager *manager)
+{
+        guint n_rows = manager->devices->len;
+
+        fail_if(manager->index.types->len != n_rows, "Type column out of step");
+        fail_if(manager->index.attributes->len != n_rows, "Attribute column out of step");
+        fail_if(manager->index.vendor_id->len != n_rows, "Vendor column out of step");
+        fail_if(manager->index.product_id->len != n_rows, "Product column out of step");
+        fail_if(manager->index.priority->len != n_rows, "Priority column out of step");
+
+        for (guint i = 0; i < n_rows; i++) {
+                LdmDevice *device = manager->devices->pdata[i];
+                guint types = g_array_index(manager->index.types, guint, i);
+                guint attributes = g_array_index(manager->index.attributes, guint, i);
+
+                for (guint bit = 1; bit < LDM_DEVICE_TYPE_MAX; bit <<= 1) {
+                        fail_if(((types & bit) != 0) != ldm_device_has_type(device, bit),
+                                "Row %u disagrees on type %u of %s",
+                                i,
+                                bit,
+                                ldm_device_get_path(device));
+                }
+                for (guint bit = 1; bit < LDM_DEVICE_ATTRIBUTE_MAX; bit <<= 1) {
+                        fail_if(((attributes & bit) != 0) != ldm_device_has_attribute(device, bit),
+                                "Row %u disagrees on attribute %u of %s",
+                                i,
+                                bit,
+                                ldm_device_get_path(device));
+                }
+                fail_if(g_array_index(manager->index.vendor_id, gint, i) !=
+                            ldm_device_get_vendor_id(device),
+                        "Row %u has the wrong vendor",
+                        i);
+                fail_if(g_array_index(manager->index.product_id, gint, i) !=
+                            ldm_device_get_product_id(device),
+                        "Row %u has the wrong product",
+                        i);
+                fail_if(g_array_index(manager->index.priority, gint, i) !=
+                            ldm_device_get_priority(device),
+                        "Row %u has the wrong priority",
+                        i);
+        }
+}
+
+static gint sort_device_by_priority(gconstpointer a, gconstpointer b)
+{
+        return ldm_device_get_priority(*(LdmDevice **)a) -
+               ldm_device_get_priority(*(LdmDevice **)b);
+}
+
+/**
+ * The index must find exactly what walking every device with
+ * ldm_device_has_type found, in the same order.
+ */
+static void assert_query_matches_walk(LdmManager *manager, LdmDeviceType class_mask)
+{
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GPtrArray) walked = NULL;
+
+        devices = ldm_manager_get_devices(manager, class_mask);
+        walked = g_ptr_array_new();
+        for (guint i = 0; i < manager->devices->len; i++) {
+                if (ldm_device_has_type(manager->devices->pdata[i], class_mask)) {
+                        g_ptr_array_add(walked, manager->devices->pdata[i]);
+                }
+        }
+        g_ptr_array_sort(walked, sort_device_by_priority);
+
+        fail_if(devices->len != walked->len,
+                "Mask %u: expected %u devices, found %u",
+                class_mask,
+                walked->len,
+                devices->len);
+        for (guint i = 0; i < walked->len; i++) {
+                fail_if(devices->pdata[i] != walked->pdata[i],
+                        "Mask %u: device %u differs",
+                        class_mask,
+                        i);
+        }
+}
+
+static void assert_queries_match_walk(LdmManager *manager)
+{
+        assert_query_matches_walk(manager, LDM_DEVICE_TYPE_ANY);
+        for (guint bit = 1; bit < LDM_DEVICE_TYPE_MAX; bit <<= 1) {
+                assert_query_matches_walk(manager, bit);
+        }
+        assert_query_matches_walk(manager, LDM_DEVICE_TYPE_GPU | LDM_DEVICE_TYPE_PCI);
+        assert_query_matches_walk(manager, LDM_DEVICE_TYPE_USB | LDM_DEVICE_TYPE_HID);
+}
+
+/**
+ * Querying by class mask finds the same devices the plain walk over all
+ * devices did, for every class.
+ */
+START_TEST(test_manager_query)
+{
+        static const LdmTopology machine = {
+                .n_gpus = 2,
+                .n_pci = 6,
+                .n_hubs = 2,
+                .n_usb = 12,
+                .n_interfaces = 2,
+                .n_hid = 4,
+                .n_bluetooth = 2,
+        };
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autofree gchar *recording = NULL;
+
+        recording = ldm_topology_generate(&machine);
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_string(bed, recording, NULL),
+                "Failed to create generated machine");
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        fail_if(!manager, "Failed to get the LdmManager");
+
+        assert_index_consistent(manager);
+        assert_queries_match_walk(manager);
+}
+END_TEST
+
+/**
+ * Removing a top level device shifts the index rows along with the devices,
+ * and removing children refreshes the row of their top level device.
+ */
+START_TEST(test_manager_index_hotplug)
+{
+        static const LdmTopology machine = {
+                .n_gpus = 2,
+                .n_pci = 6,
+                .n_hubs = 2,
+                .n_usb = 12,
+                .n_interfaces = 1,
+                .n_hid = 4,
+                .n_bluetooth = 2,
+        };
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GPtrArray) hid = NULL;
+        g_autoptr(LdmDevice) removed = NULL;
+        g_autoptr(GList) kids = NULL;
+        g_autofree gchar *recording = NULL;
+        LdmDevice *parent = NULL;
+        LdmDevice *middle = NULL;
+
+        recording = ldm_topology_generate(&machine);
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_string(bed, recording, NULL),
+                "Failed to create generated machine");
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NONE);
+        fail_if(!manager, "Failed to get the LdmManager");
+        assert_index_consistent(manager);
+
+        hid = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_HID);
+        fail_if(hid->len != machine.n_hid, "Expected %u HID devices", machine.n_hid);
+        parent = hid->pdata[0];
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_ANY);
+        middle = devices->pdata[devices->len / 2];
+        fail_if(middle == parent, "Picked the HID device twice");
+
+        /* Unplug the children, then use the top level removal as a fence */
+        kids = ldm_device_get_children(parent);
+        fail_if(!kids, "HID device should have children");
+        for (GList *elem = kids; elem; elem = elem->next) {
+                umockdev_testbed_uevent(bed, ldm_device_get_path(elem->data), "remove");
+        }
+        removed = hotplug_uevent(manager,
+                                 bed,
+                                 ldm_device_get_path(middle),
+                                 "remove",
+                                 "device-removed");
+        fail_if(removed != middle, "Wrong device removed");
+
+        fail_if(manager->devices->len != devices->len - 1, "Device was not removed");
+        fail_if(ldm_device_has_type(parent, LDM_DEVICE_TYPE_HID), "Children were not removed");
+        assert_index_consistent(manager);
+        assert_queries_match_walk(manager);
+
+        g_clear_pointer(&hid, g_ptr_array_unref);
+        hid = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_HID);
+        fail_if(hid->len != machine.n_hid - 1, "Stale HID row left in the index");
+}
+END_TEST
+
+/**
+ * Devices present at construction, hotplugged devices and plugin changes each bump the
+ * generation, and the change log answers for as far back as it reaches. Plugin changes
+ * between two polls are logged once.
+ */
+START_TEST(test_manager_changes)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GPtrArray) added = NULL;
+        g_autoptr(GPtrArray) removed = NULL;
+        g_autoptr(LdmDevice) device = NULL;
+        g_autofree gchar *sysfs_path = NULL;
+        LdmPlugin *plugin = NULL;
+        gboolean providers_changed = FALSE;
+        guint64 generation = 0;
+        guint64 hotplug = 0;
+        guint64 next = 0;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_file(bed, NV_MOCKDEV_FILE, NULL),
+                "Failed to create NVIDIA device");
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NONE);
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_ANY);
+        generation = ldm_manager_get_generation(manager);
+        fail_if(generation != devices->len,
+                "Expected generation %u, got %" G_GUINT64_FORMAT,
+                devices->len,
+                generation);
+
+        /* Everything was added since the start */
+        fail_if(!ldm_manager_get_changes(manager, 0, &next, &added, &removed, &providers_changed),
+                "Changes since construction should be known");
+        fail_if(next != generation, "Wrong current generation");
+        fail_if(added->len != devices->len, "Expected %u added, got %u", devices->len, added->len);
+        fail_if(removed->len != 0, "Nothing should have been removed");
+        fail_if(providers_changed, "No plugins were added");
+        g_clear_pointer(&added, g_ptr_array_unref);
+        g_clear_pointer(&removed, g_ptr_array_unref);
+
+        fail_if(!ldm_manager_get_changes(manager, generation, NULL, &added, NULL, NULL),
+                "Changes since the current generation should be known");
+        fail_if(added->len != 0, "Nothing should have been added");
+        g_clear_pointer(&added, g_ptr_array_unref);
+
+        /* Adding a plugin, then changing it */
+        plugin = ldm_modalias_plugin_new("changes");
+        ldm_manager_add_plugin(manager, plugin);
+        fail_if(!ldm_manager_get_changes(manager,
+                                         generation,
+                                         &next,
+                                         &added,
+                                         &removed,
+                                         &providers_changed),
+                "Plugin changes should be known");
+        fail_if(next != generation + 1, "Adding a plugin should bump the generation once");
+        fail_if(!providers_changed, "Providers should have changed");
+        fail_if(added->len != 0 || removed->len != 0, "No devices should have changed");
+        g_clear_pointer(&added, g_ptr_array_unref);
+        g_clear_pointer(&removed, g_ptr_array_unref);
+
+        ldm_plugin_set_priority(plugin, 100);
+        fail_if(ldm_manager_get_generation(manager) != next + 1,
+                "Changing a plugin should bump the generation");
+
+        fail_if(ldm_manager_get_changes(manager, next + 100, NULL, NULL, NULL, NULL),
+                "Generations from the future are unknown");
+
+        /* A device that came and went between two polls is in neither list */
+        sysfs_path = add_hid_device(bed);
+
+        hotplug = ldm_manager_get_generation(manager);
+        device = hotplug_uevent(manager, bed, sysfs_path, "add", "device-added");
+        g_clear_object(&device);
+        device = hotplug_uevent(manager, bed, sysfs_path, "remove", "device-removed");
+        g_clear_object(&device);
+
+        fail_if(!ldm_manager_get_changes(manager, hotplug, &next, &added, &removed, NULL),
+                "Hotplug changes should be known");
+        fail_if(next != hotplug + 2, "Adding and removing should bump the generation twice");
+        fail_if(added->len != 0, "A device that came and went should not be added");
+        fail_if(removed->len != 0, "A device that came and went should not be removed");
+        g_clear_pointer(&added, g_ptr_array_unref);
+        g_clear_pointer(&removed, g_ptr_array_unref);
+
+        /* Polling in between sees the add, then the removal */
+        generation = next;
+        device = hotplug_uevent(manager, bed, sysfs_path, "add", "device-added");
+        fail_if(!ldm_manager_get_changes(manager, generation, &next, &added, &removed, NULL),
+                "Hotplug add should be known");
+        fail_if(added->len != 1 || added->pdata[0] != device, "Expected the hotplugged device");
+        fail_if(removed->len != 0, "Nothing should have been removed");
+        g_clear_pointer(&added, g_ptr_array_unref);
+        g_clear_pointer(&removed, g_ptr_array_unref);
+
+        generation = next;
+        g_clear_object(&device);
+        device = hotplug_uevent(manager, bed, sysfs_path, "remove", "device-removed");
+        fail_if(!ldm_manager_get_changes(manager, generation, &next, &added, &removed, NULL),
+                "Hotplug removal should be known");
+        fail_if(added->len != 0, "Nothing should have been added");
+        fail_if(removed->len != 1 || removed->pdata[0] != device, "Expected the removed device");
+        g_clear_pointer(&added, g_ptr_array_unref);
+        g_clear_pointer(&removed, g_ptr_array_unref);
+
+        /* Loading more plugins than the log holds is a single change */
+        for (guint i = 0; i < LDM_MANAGER_CHANGE_LOG_SIZE + 44; i++) {
+                g_autofree gchar *name = g_strdup_printf("changes-%u", i);
+
+                ldm_manager_add_plugin(manager, ldm_modalias_plugin_new(name));
+        }
+        fail_if(!ldm_manager_get_changes(manager,
+                                         generation,
+                                         &next,
+                                         &added,
+                                         &removed,
+                                         &providers_changed),
+                "Loading plugins should not push the hotplug removal out of the log");
+        fail_if(next != generation + 2, "Loading plugins should bump the generation once");
+        fail_if(removed->len != 1 || removed->pdata[0] != device, "Expected the removed device");
+        fail_if(!providers_changed, "Providers should have changed");
+        g_clear_pointer(&added, g_ptr_array_unref);
+        g_clear_pointer(&removed, g_ptr_array_unref);
+
+        /* Plugin changes seen by separate polls are separate changes, and push
+         * the construction and the hotplugged device out of the log */
+        for (guint i = 0; i < LDM_MANAGER_CHANGE_LOG_SIZE + 44; i++) {
+                ldm_plugin_set_priority(plugin, (gint)i + 200);
+                ldm_manager_get_generation(manager);
+        }
+        fail_if(ldm_manager_get_changes(manager, 0, &next, NULL, NULL, NULL),
+                "Changes since construction should have been forgotten");
+        fail_if(ldm_manager_get_changes(manager, hotplug, NULL, NULL, NULL, NULL),
+                "Hotplug changes should have been forgotten");
+        fail_if(ldm_manager_get_changes(manager, generation, NULL, NULL, NULL, NULL),
+                "The hotplug removal should have been forgotten");
+        fail_if(!ldm_manager_get_changes(manager, next - 1, NULL, NULL, NULL, &providers_changed),
+                "Recent changes should be known");
+        fail_if(!providers_changed, "Providers should have changed");
+}
+END_TEST
+
 /**
  * Standard helper for running a test suite
  */
@@ -189,6 +737,12 @@ static Suite *test_create(void)
         tcase_add_test(tc, test_manager_optimus);
         tcase_add_test(tc, test_manager_bluetooth_usb);
         tcase_add_test(tc, test_manager_wifi_pci);
+        tcase_add_test(tc, test_manager_kernel_events);
+        tcase_add_test(tc, test_manager_kernel_events_hotplug);
+        tcase_add_test(tc, test_manager_parallel);
+        tcase_add_test(tc, test_manager_changes);
+        tcase_add_test(tc, test_manager_query);
+        tcase_add_test(tc, test_manager_index_hotplug);
 
         return s;
 }
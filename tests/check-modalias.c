@@ -12,6 +12,7 @@
 #define _GNU_SOURCE
 
 #include <check.h>
+#include <fnmatch.h>
 #include <stdio.h>
 #include <stdlib.h>
 
@@ -24,6 +25,8 @@
  */
 #define NVIDIA_MODALIAS "pci:v000010DEd00001C60sv00001558sd000065A4bc03sc00i00"
 
+#define INTEL_MODALIAS "pci:v00008086d00000416sv00001462sd000010E0bc03sc00i00"
+
 #define GLX_MATCH "pci:v000010DEd00001C60sv*sd*bc03sc*i*"
 #define GLX_NO_MATCH "pci:v000010DEd00001B84sv*sd*bc03sc*i*"
 
@@ -45,6 +48,7 @@ static LdmDevice *create_fake_device(const char *name, const char *vendor, const
         ret->id.vendor = g_strdup(vendor);
         if (modalias) {
                 ret->os.modalias = g_strdup(modalias);
+                ldm_modalias_fields_parse(&ret->os.modalias_fields, modalias);
         }
         /* Deliberately fakey sysfs path */
         ret->os.sysfs_path = g_strdup_printf("/fake/path/%s/%s", name, vendor);
@@ -88,6 +92,65 @@ START_TEST(test_modalias_device)
 }
 END_TEST
 
+/**
+ * Field-wise matching must agree with fnmatch, whether or not the match
+ * could be decomposed into fields.
+ */
+START_TEST(test_modalias_fields)
+{
+        static const struct {
+                const gchar *match;
+                const gchar *modalias;
+                gboolean structured;
+                gboolean matches;
+        } table[] = {
+                /* Class code only */
+                { "pci:v*d*sv*sd*bc03sc*i*", NVIDIA_MODALIAS, TRUE, TRUE },
+                { "pci:v*d*sv*sd*bc02sc*i*", NVIDIA_MODALIAS, TRUE, FALSE },
+                /* Trailing wildcard may span the remaining fields */
+                { "pci:v000010DEd*", NVIDIA_MODALIAS, TRUE, TRUE },
+                { "pci:v00008086d*", NVIDIA_MODALIAS, TRUE, FALSE },
+                /* Single digit wildcards */
+                { "pci:v000010DEd00001C6?sv*sd*bc03sc*i*", NVIDIA_MODALIAS, TRUE, TRUE },
+                { "pci:v000010DEd00001B?0sv*sd*bc03sc*i*", NVIDIA_MODALIAS, TRUE, FALSE },
+                /* Wrong bus */
+                { "usb:v10DEp*d*dc*dsc*dp*ic*isc*ip*in*", NVIDIA_MODALIAS, TRUE, FALSE },
+                /* Interface match against a device without interface fields */
+                { "usb:v1532p021Ed*dc*dsc*dp*ic*isc*ip*in*",
+                  "usb:v1532p021Ed0100dc00dsc00dp00",
+                  TRUE,
+                  FALSE },
+                { "usb:v1532p021Ed*dc*dsc*dp*ic*isc*ip*in*",
+                  "usb:v1532p021Ed0100dc00dsc00dp00ic03isc00ip00in00",
+                  TRUE,
+                  TRUE },
+                /* Irregular, handled by fnmatch */
+                { "pci:v000010DEd00001[BC]*", NVIDIA_MODALIAS, FALSE, TRUE },
+                { "pci:v000010ded00001C60sv*sd*bc03sc*i*", NVIDIA_MODALIAS, FALSE, FALSE },
+                { "dmi:*", NVIDIA_MODALIAS, FALSE, FALSE },
+        };
+
+        for (guint i = 0; i < G_N_ELEMENTS(table); i++) {
+                g_autoptr(LdmModalias) modalias = NULL;
+                LdmModaliasFields fields = { 0 };
+                gboolean fnmatched = FALSE;
+
+                modalias = ldm_modalias_new(table[i].match, "test", "test");
+                fnmatched = fnmatch(table[i].match, table[i].modalias, 0) == 0;
+
+                fail_if(ldm_modalias_fields_parse_pattern(&fields, table[i].match) !=
+                            table[i].structured,
+                        "Wrong decomposition of %s",
+                        table[i].match);
+                fail_if(fnmatched != table[i].matches, "Broken test entry %s", table[i].match);
+                fail_if(ldm_modalias_matches(modalias, table[i].modalias) != table[i].matches,
+                        "%s against %s disagrees with fnmatch",
+                        table[i].match,
+                        table[i].modalias);
+        }
+}
+END_TEST
+
 /**
  * Test loading modalias driver from a modalias file
  */
@@ -104,6 +167,36 @@ START_TEST(test_modalias_file)
 }
 END_TEST
 
+/**
+ * Ensure the plugin finds the right rule out of a large table, where only
+ * a handful of rules survive the literal prefix test.
+ */
+START_TEST(test_modalias_plugin_device)
+{
+        g_autoptr(LdmPlugin) driver = NULL;
+        g_autoptr(LdmDevice) nvidia_device = NULL;
+        g_autoptr(LdmDevice) intel_device = NULL;
+        g_autoptr(LdmProvider) provider = NULL;
+        g_autoptr(LdmProvider) no_provider = NULL;
+
+        driver = ldm_modalias_plugin_new_from_filename(NV_MODALIAS_FILE);
+        fail_if(!driver, "Failed to construct driver from modalias file");
+
+        nvidia_device = create_fake_device("GTX 1060", "NVIDIA", NVIDIA_MODALIAS);
+        intel_device = create_fake_device("HD 4600", "Intel", INTEL_MODALIAS);
+
+        provider = ldm_plugin_get_provider(driver, nvidia_device);
+        fail_if(!provider, "Failed to find provider for NVIDIA device");
+        fail_if(!g_str_equal(ldm_provider_get_package(provider), "nvidia-glx-driver"),
+                "Invalid package for NVIDIA device");
+        fail_if(g_strcmp0(ldm_provider_get_driver(provider), "nvidia") != 0,
+                "Invalid driver for NVIDIA device");
+
+        no_provider = ldm_plugin_get_provider(driver, intel_device);
+        fail_if(no_provider != NULL, "Intel device should not have a provider");
+}
+END_TEST
+
 /**
  * Standard helper for running a test suite
  */
@@ -131,7 +224,9 @@ static Suite *test_create(void)
 
         tcase_add_test(tc, test_modalias_simple);
         tcase_add_test(tc, test_modalias_device);
+        tcase_add_test(tc, test_modalias_fields);
         tcase_add_test(tc, test_modalias_file);
+        tcase_add_test(tc, test_modalias_plugin_device);
 
         return s;
 }
@@ -0,0 +1,274 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <check.h>
+#include <ftw.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ldm.h"
+#include "util.h"
+
+/* Release that can't possibly have module indexes on the host */
+#define TEST_RELEASE "0.0.0-ldm-test"
+
+/* libkmod index format, as written by depmod */
+#define INDEX_MAGIC 0xB007F457
+#define INDEX_VERSION 0x00020001
+#define INDEX_NODE_PREFIX 0x80000000
+#define INDEX_NODE_VALUES 0x40000000
+#define INDEX_HEADER_SIZE 12
+
+static int remove_path(const char *path, __ldm_unused__ const struct stat *st,
+                       __ldm_unused__ int flag, __ldm_unused__ struct FTW *ftw)
+{
+        return remove(path);
+}
+
+/**
+ * Construct a scratch root with the given /proc/modules contents
+ */
+static gchar *create_root(const gchar *modules)
+{
+        g_autofree gchar *proc = NULL;
+        g_autofree gchar *path = NULL;
+        gchar *root = NULL;
+
+        root = g_dir_make_tmp("ldm-kmod-XXXXXX", NULL);
+        fail_if(!root, "Failed to create scratch root");
+
+        proc = g_build_filename(root, "proc", NULL);
+        fail_if(g_mkdir_with_parents(proc, 00755) != 0, "Failed to create %s", proc);
+
+        path = g_build_filename(proc, "modules", NULL);
+        fail_if(!g_file_set_contents(path, modules, -1, NULL), "Failed to create %s", path);
+
+        return root;
+}
+
+static void index_append_u32(GByteArray *index, guint32 value)
+{
+        guint32 be = GUINT32_TO_BE(value);
+
+        g_byte_array_append(index, (const guint8 *)&be, sizeof(be));
+}
+
+/**
+ * Write a libkmod index holding a single key, as depmod would for a release
+ * with a single module. The whole trie is then just the root node.
+ */
+static void write_index(const gchar *root, const gchar *name, const gchar *key,
+                        const gchar *value)
+{
+        g_autoptr(GByteArray) index = NULL;
+        g_autofree gchar *directory = NULL;
+        g_autofree gchar *path = NULL;
+
+        index = g_byte_array_new();
+        index_append_u32(index, INDEX_MAGIC);
+        index_append_u32(index, INDEX_VERSION);
+        index_append_u32(index, INDEX_HEADER_SIZE | INDEX_NODE_PREFIX | INDEX_NODE_VALUES);
+
+        /* Prefix, then a single value with its priority */
+        g_byte_array_append(index, (const guint8 *)key, (guint)strlen(key) + 1);
+        index_append_u32(index, 1);
+        index_append_u32(index, 0);
+        g_byte_array_append(index, (const guint8 *)value, (guint)strlen(value) + 1);
+
+        directory = g_build_filename(root, "lib", "modules", TEST_RELEASE, NULL);
+        fail_if(g_mkdir_with_parents(directory, 00755) != 0, "Failed to create %s", directory);
+
+        path = g_build_filename(directory, name, NULL);
+        fail_if(!g_file_set_contents(path, (const gchar *)index->data, (gssize)index->len, NULL),
+                "Failed to create %s",
+                path);
+}
+
+/**
+ * Replace /proc/modules of the scratch root
+ */
+static void write_loaded(const gchar *root, const gchar *modules)
+{
+        g_autofree gchar *path = g_build_filename(root, "proc", "modules", NULL);
+
+        fail_if(!g_file_set_contents(path, modules, -1, NULL), "Failed to write %s", path);
+}
+
+static LdmModuleResolver *create_resolver(const gchar *root)
+{
+        return g_object_new(LDM_TYPE_MODULE_RESOLVER, "root", root, "release", TEST_RELEASE, NULL);
+}
+
+/**
+ * Loaded modules are installed by definition, and names are normalized
+ */
+START_TEST(test_module_resolver_lookup)
+{
+        g_autoptr(LdmModuleResolver) resolver = NULL;
+        g_autofree gchar *root = NULL;
+
+        root = create_root("nvidia 17649664 58 nvidia_modeset, Live 0x0000000000000000 (POE)\n"
+                           "snd_hda_intel 40960 3 - Live 0x0000000000000000\n");
+        resolver = create_resolver(root);
+
+        fail_if(g_strcmp0(ldm_module_resolver_get_release(resolver), TEST_RELEASE) != 0,
+                "Wrong kernel release");
+
+        fail_if(ldm_module_resolver_lookup(resolver, "nvidia") !=
+                    (LDM_MODULE_STATE_INSTALLED | LDM_MODULE_STATE_LOADED),
+                "nvidia should be loaded");
+        fail_if(ldm_module_resolver_lookup(resolver, "snd-hda-intel") !=
+                    (LDM_MODULE_STATE_INSTALLED | LDM_MODULE_STATE_LOADED),
+                "snd-hda-intel should match snd_hda_intel");
+
+        /* No indexes for this release, so nothing else can be installed */
+        fail_if(ldm_module_resolver_lookup(resolver, "wl") != LDM_MODULE_STATE_MISSING,
+                "wl should be missing");
+        fail_if(ldm_module_resolver_lookup(resolver, "wl") != LDM_MODULE_STATE_MISSING,
+                "Cached wl lookup should be missing");
+
+        nftw(root, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * A batch resolve must mark each provider by its driver
+ */
+START_TEST(test_module_resolver_resolve)
+{
+        g_autoptr(LdmModuleResolver) resolver = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        g_autofree gchar *root = NULL;
+        LdmProvider *loaded = NULL;
+        LdmProvider *missing = NULL;
+        LdmProvider *unknown = NULL;
+
+        root = create_root("nvidia 17649664 58 nvidia_modeset, Live 0x0000000000000000 (POE)\n");
+        resolver = create_resolver(root);
+
+        loaded = ldm_provider_new_full(NULL, NULL, "nvidia-glx-driver", "nvidia");
+        missing = ldm_provider_new_full(NULL, NULL, "broadcom-sta", "wl");
+        unknown = ldm_provider_new(NULL, NULL, "razer-drivers");
+
+        providers = g_ptr_array_new_with_free_func(g_object_unref);
+        g_ptr_array_add(providers, g_object_ref_sink(loaded));
+        g_ptr_array_add(providers, g_object_ref_sink(missing));
+        g_ptr_array_add(providers, g_object_ref_sink(unknown));
+
+        ldm_module_resolver_resolve(resolver, providers);
+
+        fail_if(!ldm_provider_get_installed(loaded), "nvidia should be installed");
+        fail_if(!ldm_provider_get_loaded(loaded), "nvidia should be loaded");
+        fail_if(ldm_provider_get_installed(missing), "wl should not be installed");
+        fail_if(ldm_provider_get_loaded(missing), "wl should not be loaded");
+        fail_if(ldm_provider_get_installed(unknown), "Provider without driver can't be installed");
+
+        nftw(root, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * Only the dependency and alias indexes exist, so libkmod can't preload
+ * every index. Lookups must still find modules through the indexes that do
+ * exist, and loaded modules are reported from a snapshot of /proc/modules.
+ */
+START_TEST(test_module_resolver_index)
+{
+        g_autoptr(LdmModuleResolver) resolver = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        g_autofree gchar *root = NULL;
+        LdmProvider *installed = NULL;
+
+        root = create_root("nvidia 17649664 58 nvidia_modeset, Live 0x0000000000000000 (POE)\n");
+        write_index(root, "modules.dep.bin", "fake_mod", "kernel/drivers/misc/fake_mod.ko:");
+        write_index(root, "modules.alias.bin", "pci:v00001234d*", "fake_mod");
+        resolver = create_resolver(root);
+
+        fail_if(ldm_module_resolver_lookup(resolver, "fake-mod") != LDM_MODULE_STATE_INSTALLED,
+                "fake-mod should be installed from the index");
+        fail_if(ldm_module_resolver_lookup(resolver, "nvidia") !=
+                    (LDM_MODULE_STATE_INSTALLED | LDM_MODULE_STATE_LOADED),
+                "nvidia should be loaded");
+        fail_if(ldm_module_resolver_lookup(resolver, "wl") != LDM_MODULE_STATE_MISSING,
+                "wl should be missing");
+
+        /* Loading a module isn't seen until the resolver is refreshed */
+        write_loaded(root, "wl 6365184 0 - Live 0x0000000000000000 (POE)\n");
+
+        installed = ldm_provider_new_full(NULL, NULL, "broadcom-sta", "wl");
+        providers = g_ptr_array_new_with_free_func(g_object_unref);
+        g_ptr_array_add(providers, g_object_ref_sink(installed));
+
+        ldm_module_resolver_resolve(resolver, providers);
+        fail_if(ldm_provider_get_loaded(installed), "wl was loaded after the snapshot");
+
+        ldm_module_resolver_refresh(resolver);
+        ldm_module_resolver_resolve(resolver, providers);
+        fail_if(!ldm_provider_get_loaded(installed), "wl should be loaded once refreshed");
+        fail_if(ldm_module_resolver_lookup(resolver, "nvidia") != LDM_MODULE_STATE_MISSING,
+                "nvidia was unloaded and isn't in the index");
+
+        nftw(root, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * Standard helper for running a test suite
+ */
+static int ldm_test_run(Suite *suite)
+{
+        SRunner *runner = NULL;
+        int n_failed = 0;
+
+        runner = srunner_create(suite);
+        srunner_run_all(runner, CK_VERBOSE);
+        n_failed = srunner_ntests_failed(runner);
+        srunner_free(runner);
+
+        return n_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static Suite *test_create(void)
+{
+        Suite *s = NULL;
+        TCase *tc = NULL;
+
+        s = suite_create(__FILE__);
+        tc = tcase_create(__FILE__);
+        suite_add_tcase(s, tc);
+
+        tcase_add_test(tc, test_module_resolver_lookup);
+        tcase_add_test(tc, test_module_resolver_resolve);
+        tcase_add_test(tc, test_module_resolver_index);
+
+        return s;
+}
+
+int main(__ldm_unused__ int argc, __ldm_unused__ char **argv)
+{
+        return ldm_test_run(test_create());
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
@@ -12,12 +12,18 @@
 #define _GNU_SOURCE
 
 #include <check.h>
+#include <ftw.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
 #include <umockdev.h>
+#include <unistd.h>
 
 #include "ldm-private.h"
 #include "ldm.h"
+#include "manager-private.h"
+#include "modalias-stream.h"
 #include "util.h"
 
 DEF_AUTOFREE(UMockdevTestbed, g_object_unref)
@@ -27,10 +33,14 @@ DEF_AUTOFREE(UMockdevTestbed, g_object_unref)
 
 #define NV_MAIN_MODALIAS TEST_DATA_ROOT "/nvidia-glx-driver.modaliases"
 #define NV_340_MODALIAS TEST_DATA_ROOT "/nvidia-340-glx-driver.modaliases"
+#define NV_MAIN_ZSTD_MODALIAS TEST_DATA_ROOT "/nvidia-glx-driver.modaliases.zst"
 #define MODALIAS_DIR TEST_DATA_ROOT "/"
 
 #define RAZER_MOCKDEV_FILE TEST_DATA_ROOT "/razer-ornata-chroma.umockdev"
-#define RAZER_MODALIAS TEST_DATA_ROOT "razer-drivers.modaliases"
+#define RAZER_MODALIAS TEST_DATA_ROOT "/razer-drivers.modaliases"
+
+/* Kept out of MODALIAS_DIR, the winners don't depend on the order of lines */
+#define PRECEDENCE_MODALIAS TEST_DATA_ROOT "/precedence/precedence.modaliases"
 
 static UMockdevTestbed *create_bed_from(const char *mockdevname)
 {
@@ -152,6 +162,117 @@ START_TEST(test_plugins_nvidia_multiple_glob)
 }
 END_TEST
 
+/**
+ * The best provider must be the first of all providers, and follow priority
+ * changes made after the plugins were added.
+ */
+START_TEST(test_plugins_best_provider)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmGPUConfig) gpu = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        g_autoptr(LdmProvider) best = NULL;
+        g_autoptr(LdmProvider) new_best = NULL;
+        LdmDevice *device = NULL;
+        LdmPlugin *legacy = NULL;
+
+        bed = create_bed_from(OPTIMUS_MOCKDEV_FILE);
+        manager = ldm_manager_new(0);
+
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, NV_340_MODALIAS),
+                "Failed to add 340 modalias file");
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, NV_MAIN_MODALIAS),
+                "Failed to add main modalias file");
+
+        gpu = ldm_gpu_config_new(manager);
+        fail_if(!gpu, "Failed to create GPUConfig");
+        device = ldm_gpu_config_get_detection_device(gpu);
+
+        providers = ldm_manager_get_providers(manager, device);
+        fail_if(providers->len != 2, "Expected 2 providers, got %u providers", providers->len);
+
+        best = ldm_manager_get_best_provider(manager, device);
+        fail_if(!best, "Failed to find the best provider");
+        fail_if(ldm_provider_get_plugin(best) != ldm_provider_get_plugin(providers->pdata[0]),
+                "Best provider should come from %s, got %s",
+                ldm_plugin_get_name(ldm_provider_get_plugin(providers->pdata[0])),
+                ldm_plugin_get_name(ldm_provider_get_plugin(best)));
+
+        /* Promote the legacy driver above the main driver */
+        legacy = ldm_provider_get_plugin(providers->pdata[1]);
+        ldm_plugin_set_priority(legacy,
+                                ldm_plugin_get_priority(ldm_provider_get_plugin(best)) + 1);
+
+        new_best = ldm_manager_get_best_provider(manager, device);
+        fail_if(!new_best, "Failed to find the best provider");
+        fail_if(!g_str_equal(ldm_plugin_get_name(ldm_provider_get_plugin(new_best)),
+                             "nvidia-340-glx-driver"),
+                "Best provider should follow the new priority, got %s",
+                ldm_plugin_get_name(ldm_provider_get_plugin(new_best)));
+}
+END_TEST
+
+/**
+ * Plain results must describe the same providers, in the same order
+ */
+START_TEST(test_plugins_provider_results)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmGPUConfig) gpu = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        g_autoptr(GArray) results = NULL;
+        g_autoptr(LdmProvider) provider = NULL;
+        LdmDevice *device = NULL;
+
+        bed = create_bed_from(OPTIMUS_MOCKDEV_FILE);
+        manager = ldm_manager_new(0);
+
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, NV_340_MODALIAS),
+                "Failed to add 340 modalias file");
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, NV_MAIN_MODALIAS),
+                "Failed to add main modalias file");
+
+        gpu = ldm_gpu_config_new(manager);
+        fail_if(!gpu, "Failed to create GPUConfig");
+        device = ldm_gpu_config_get_detection_device(gpu);
+
+        providers = ldm_manager_get_providers(manager, device);
+        results = ldm_manager_get_provider_results(manager, device);
+        fail_if(results->len != providers->len,
+                "Expected %u results, got %u results",
+                providers->len,
+                results->len);
+
+        for (guint i = 0; i < results->len; i++) {
+                const LdmProviderResult *result = &g_array_index(results, LdmProviderResult, i);
+                LdmProvider *expected = providers->pdata[i];
+
+                fail_if(result->plugin != ldm_provider_get_plugin(expected),
+                        "Result %u has the wrong plugin",
+                        i);
+                fail_if(result->package != g_intern_string(ldm_provider_get_package(expected)),
+                        "Result %u package should be interned",
+                        i);
+                fail_if(result->driver != g_intern_string(ldm_provider_get_driver(expected)),
+                        "Result %u driver should be interned",
+                        i);
+                fail_if(result->priority != ldm_plugin_get_priority(result->plugin),
+                        "Result %u has the wrong priority",
+                        i);
+        }
+
+        provider = ldm_provider_new_from_result(&g_array_index(results, LdmProviderResult, 0),
+                                                device);
+        fail_if(!g_str_equal(ldm_provider_get_package(provider),
+                             ldm_provider_get_package(providers->pdata[0])),
+                "Provider from result has the wrong package");
+        fail_if(ldm_provider_get_device(provider) != device,
+                "Provider from result has the wrong device");
+}
+END_TEST
+
 /**
  * This test ensures we're able to identify `hid:` style modaliases on HID
  * devices in a USB device tree.
@@ -189,6 +310,1046 @@ START_TEST(test_plugins_razer)
 }
 END_TEST
 
+/**
+ * Ensure modalias plugins advertise the correct coverage so that the manager
+ * can route devices to them, including hid: aliases with a wildcard group.
+ */
+START_TEST(test_plugins_coverage)
+{
+        g_autoptr(LdmPlugin) nvidia = NULL;
+        g_autoptr(LdmPlugin) razer = NULL;
+        g_autoptr(LdmPlugin) plugin = NULL;
+        LdmModalias *alias = NULL;
+
+        nvidia = ldm_modalias_plugin_new_from_filename(NV_MAIN_MODALIAS);
+        fail_if(!nvidia, "Failed to load main modalias file");
+        fail_if(!ldm_plugin_covers(nvidia, "pci", LDM_PCI_VENDOR_ID_NVIDIA),
+                "NVIDIA plugin should cover NVIDIA PCI devices");
+        fail_if(ldm_plugin_covers(nvidia, "pci", LDM_PCI_VENDOR_ID_INTEL),
+                "NVIDIA plugin should not cover Intel PCI devices");
+        fail_if(ldm_plugin_covers(nvidia, "usb", LDM_PCI_VENDOR_ID_NVIDIA),
+                "NVIDIA plugin should not cover USB devices");
+
+        razer = ldm_modalias_plugin_new_from_filename(TEST_DATA_ROOT "/razer-drivers.modaliases");
+        fail_if(!razer, "Failed to load razer modalias file");
+        fail_if(!ldm_plugin_covers(razer, "hid", 0x1532), "Razer plugin should cover Razer HID");
+        fail_if(ldm_plugin_covers(razer, "usb", 0x1532), "Razer plugin should not cover USB");
+
+        /* Wildcard vendors cover the whole bus */
+        plugin = ldm_modalias_plugin_new("wildcard");
+        alias = ldm_modalias_new("pci:v*d*sv*sd*bc02sc80i*", "wl", "broadcom-sta");
+        ldm_modalias_plugin_add_modalias(LDM_MODALIAS_PLUGIN(plugin), alias);
+        fail_if(!ldm_plugin_covers(plugin, "pci", 0x14E4), "Wildcard plugin should cover PCI");
+        fail_if(ldm_plugin_covers(plugin, "usb", 0x14E4), "Wildcard plugin should not cover USB");
+}
+END_TEST
+
+#ifdef NATIVE_RAZER_MODULE
+/**
+ * Ensure a compiled matcher module generated by mkmodaliases has the same
+ * provider semantics as the modalias plugin it was generated from.
+ */
+START_TEST(test_plugins_native)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        g_autoptr(LdmPlugin) plugin = NULL;
+        const gchar *plugin_id = NULL;
+
+        /* Text files are not matcher modules */
+        plugin = ldm_native_plugin_new_from_filename(TEST_DATA_ROOT "/razer-drivers.modaliases");
+        fail_if(plugin != NULL, "Should not load a modaliases file as a native plugin");
+
+        bed = create_bed_from(RAZER_MOCKDEV_FILE);
+        manager = ldm_manager_new(0);
+
+        fail_if(!ldm_manager_add_native_plugin_for_path(manager, NATIVE_RAZER_MODULE),
+                "Failed to add native razer plugin");
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_USB | LDM_DEVICE_TYPE_HID);
+        fail_if(devices->len != 1, "Failed to find HID device!");
+
+        providers = ldm_manager_get_providers(manager, devices->pdata[0]);
+        fail_if(providers->len != 1, "Expected 1 provider, got %u providers", providers->len);
+
+        plugin_id = ldm_plugin_get_name(ldm_provider_get_plugin(providers->pdata[0]));
+        fail_if(!g_str_equal(plugin_id, "razer-drivers"),
+                "Expected 'razer-drivers' plugin, got '%s'",
+                plugin_id);
+        fail_if(!g_str_equal(ldm_provider_get_package(providers->pdata[0]), "razer-drivers"),
+                "Expected 'razer-drivers' package");
+}
+END_TEST
+
+/**
+ * Compare the results of a module and the modaliases file it was generated
+ * from for every device of the machine.
+ *
+ * Returns: The package the module picked for the last matching device
+ */
+static const gchar *compare_native(LdmManager *manager, const gchar *modaliases,
+                                   const gchar *module)
+{
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(LdmPlugin) interpreted = NULL;
+        g_autoptr(LdmPlugin) native = NULL;
+        const gchar *package = NULL;
+
+        interpreted = ldm_modalias_plugin_new_from_filename(modaliases);
+        fail_if(!interpreted, "Failed to load %s", modaliases);
+        native = ldm_native_plugin_new_from_filename(module);
+        fail_if(!native, "Failed to load %s", module);
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_ANY);
+        for (guint i = 0; i < devices->len; i++) {
+                LdmDevice *device = devices->pdata[i];
+                LdmProviderResult expected = { 0 };
+                LdmProviderResult result = { 0 };
+                gboolean matched = FALSE;
+
+                matched = ldm_plugin_get_result(interpreted, device, &expected);
+                fail_if(ldm_plugin_get_result(native, device, &result) != matched,
+                        "%s and %s disagree on whether %s matches",
+                        modaliases,
+                        module,
+                        ldm_device_get_name(device));
+                if (!matched) {
+                        continue;
+                }
+
+                fail_if(!g_str_equal(expected.package, result.package) ||
+                            !g_str_equal(expected.driver, result.driver),
+                        "%s picked %s (%s), %s picked %s (%s)",
+                        modaliases,
+                        expected.package,
+                        expected.driver,
+                        module,
+                        result.package,
+                        result.driver);
+                package = result.package;
+        }
+
+        /* Interned, so it outlives the plugin */
+        return package;
+}
+
+/**
+ * Generated modules must pick the same alias the interpreter picks, which
+ * is the most specific one, with later definitions of a match winning.
+ */
+START_TEST(test_plugins_native_precedence)
+{
+        static const gchar *beds[] = { RAZER_MOCKDEV_FILE, NV_MOCKDEV_FILE };
+        static const gchar *expected[] = { "razer-product-redefined", "irregular-specific" };
+
+        for (guint i = 0; i < G_N_ELEMENTS(beds); i++) {
+                g_autoptr(LdmManager) manager = NULL;
+                autofree(UMockdevTestbed) *bed = NULL;
+                const gchar *package = NULL;
+
+                bed = create_bed_from(beds[i]);
+                manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+
+                compare_native(manager, RAZER_MODALIAS, NATIVE_RAZER_MODULE);
+                compare_native(manager, NV_MAIN_MODALIAS, NATIVE_NVIDIA_MODULE);
+
+                package = compare_native(manager, PRECEDENCE_MODALIAS, NATIVE_PRECEDENCE_MODULE);
+                fail_if(g_strcmp0(package, expected[i]) != 0,
+                        "Expected '%s', got '%s'",
+                        expected[i],
+                        package);
+        }
+}
+END_TEST
+#endif
+
+/**
+ * Write a modaliases file with a header covering the given routes
+ */
+static gchar *create_modaliases(const gchar *routes, const gchar *body)
+{
+        g_autofree gchar *checksum = NULL;
+        g_autofree gchar *contents = NULL;
+        gchar *path = NULL;
+        gint fd = -1;
+
+        checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA256, body, -1);
+        contents = g_strdup_printf("# ldm-routes: %s\n# ldm-aliases: 1\n# ldm-checksum: sha256:%s\n%s",
+                                   routes,
+                                   checksum,
+                                   body);
+
+        fd = g_file_open_tmp("ldm-XXXXXX.modaliases", &path, NULL);
+        fail_if(fd < 0, "Failed to create modaliases file");
+        close(fd);
+        fail_if(!g_file_set_contents(path, contents, -1, NULL), "Failed to write %s", path);
+
+        return path;
+}
+
+/**
+ * A header that doesn't cover any device defers loading the file, even
+ * though (deliberately, for the test) its aliases would match.
+ */
+START_TEST(test_plugins_deferred)
+{
+        static const gchar *body =
+            "alias pci:v000010DEd*sv*sd*bc03sc*i* nvidia nvidia-glx-driver\n";
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        g_autofree gchar *amd = NULL;
+        g_autofree gchar *nvidia = NULL;
+
+        bed = create_bed_from(NV_MOCKDEV_FILE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_GPU);
+        fail_if(devices->len != 1, "Failed to find NVIDIA device");
+
+        amd = create_modaliases("pci:00001002", body);
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, amd),
+                "Failed to defer AMD modalias file");
+        providers = ldm_manager_get_providers(manager, devices->pdata[0]);
+        fail_if(providers->len != 0, "Deferred plugin should not have been loaded");
+        g_clear_pointer(&providers, g_ptr_array_unref);
+
+        nvidia = create_modaliases("pci:000010DE", body);
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, nvidia),
+                "Failed to add NVIDIA modalias file");
+        providers = ldm_manager_get_providers(manager, devices->pdata[0]);
+        fail_if(providers->len != 1, "Expected 1 provider, got %u providers", providers->len);
+
+        unlink(amd);
+        unlink(nvidia);
+}
+END_TEST
+
+static void device_added_cb(__ldm_unused__ LdmManager *manager, LdmDevice *device, gpointer v)
+{
+        LdmDevice **added = v;
+
+        g_set_object(added, device);
+}
+
+static gboolean hotplug_timeout_cb(gpointer v)
+{
+        gboolean *timed_out = v;
+
+        *timed_out = TRUE;
+        return G_SOURCE_REMOVE;
+}
+
+/**
+ * Announce a standalone HID device, i.e. a receiver plugged straight into
+ * the machine, and run the main context until the manager has added it.
+ */
+static LdmDevice *hotplug_hid_device(LdmManager *manager, UMockdevTestbed *bed,
+                                     const gchar *modalias)
+{
+        g_autofree gchar *sysfs_path = NULL;
+        LdmDevice *added = NULL;
+        gboolean timed_out = FALSE;
+        gulong handler = 0;
+        guint timeout = 0;
+
+        handler = g_signal_connect(manager, "device-added", G_CALLBACK(device_added_cb), &added);
+
+        sysfs_path = umockdev_testbed_add_device(bed,
+                                                 "hid",
+                                                 "0003:1532:021E.0009",
+                                                 NULL,
+                                                 /* attributes */
+                                                 "modalias",
+                                                 modalias,
+                                                 NULL,
+                                                 /* properties */
+                                                 "MODALIAS",
+                                                 modalias,
+                                                 NULL);
+        fail_if(!sysfs_path, "Failed to create HID device");
+        umockdev_testbed_uevent(bed, sysfs_path, "add");
+
+        timeout = g_timeout_add_seconds(5, hotplug_timeout_cb, &timed_out);
+        while (!added && !timed_out) {
+                g_main_context_iteration(NULL, TRUE);
+        }
+        if (!timed_out) {
+                g_source_remove(timeout);
+        }
+        g_signal_handler_disconnect(manager, handler);
+
+        fail_if(!added, "Hotplugged HID device was never added");
+        return added;
+}
+
+/**
+ * A deferred plugin is loaded once a covered device is hotplugged, and
+ * keeps the priority it was given when deferred, so a file added after
+ * it still takes precedence.
+ */
+START_TEST(test_plugins_deferred_hotplug)
+{
+        static const gchar *razer_body =
+            "alias hid:b0003g*v00001532p0000021E razerkbd razer-drivers\n";
+        static const gchar *generic_body =
+            "alias hid:b0003g*v00001532p* hid-generic razer-generic\n";
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmDevice) device = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        g_autoptr(LdmProvider) best = NULL;
+        g_autofree gchar *razer = NULL;
+        g_autofree gchar *generic = NULL;
+        gint razer_priority = -1;
+        gint generic_priority = -1;
+        gint fd = -1;
+
+        bed = create_bed_from(NV_MOCKDEV_FILE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NONE);
+
+        /* Nothing on the NVIDIA machine is covered, so this is deferred */
+        razer = create_modaliases("hid:00001532", razer_body);
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, razer),
+                "Failed to defer Razer modalias file");
+
+        /* Without a header the file is loaded straight away */
+        fd = g_file_open_tmp("ldm-XXXXXX.modaliases", &generic, NULL);
+        fail_if(fd < 0, "Failed to create modaliases file");
+        close(fd);
+        fail_if(!g_file_set_contents(generic, generic_body, -1, NULL),
+                "Failed to write %s",
+                generic);
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, generic),
+                "Failed to add generic modalias file");
+
+        device = hotplug_hid_device(manager, bed, "hid:b0003g0001v00001532p0000021E");
+
+        providers = ldm_manager_get_providers(manager, device);
+        fail_if(providers->len != 2, "Expected 2 providers, got %u providers", providers->len);
+
+        for (guint i = 0; i < providers->len; i++) {
+                LdmProvider *provider = providers->pdata[i];
+                gint priority = ldm_plugin_get_priority(ldm_provider_get_plugin(provider));
+
+                if (g_str_equal(ldm_provider_get_package(provider), "razer-drivers")) {
+                        razer_priority = priority;
+                } else if (g_str_equal(ldm_provider_get_package(provider), "razer-generic")) {
+                        generic_priority = priority;
+                }
+        }
+
+        fail_if(razer_priority < 0, "Deferred plugin was not loaded on hotplug");
+        fail_if(generic_priority < 0, "Generic plugin is missing");
+        fail_if(razer_priority >= generic_priority,
+                "Deferred plugin lost its priority slot (%d vs %d)",
+                razer_priority,
+                generic_priority);
+
+        best = ldm_manager_get_best_provider(manager, device);
+        fail_if(!best || !g_str_equal(ldm_provider_get_package(best), "razer-generic"),
+                "Later plugin should still be preferred");
+
+        unlink(razer);
+        unlink(generic);
+}
+END_TEST
+
+static int remove_path(const char *path, __ldm_unused__ const struct stat *st,
+                       __ldm_unused__ int flag, __ldm_unused__ struct FTW *ftw)
+{
+        return remove(path);
+}
+
+#ifdef NATIVE_RAZER_MODULE
+/**
+ * Create a directory holding the razer modaliases, with a header, and the
+ * native module generated from them alongside as `razer-drivers.so`
+ */
+static gchar *create_native_directory(void)
+{
+        g_autofree gchar *body = NULL;
+        g_autofree gchar *checksum = NULL;
+        g_autofree gchar *contents = NULL;
+        g_autofree gchar *module = NULL;
+        g_autofree gchar *modaliases_path = NULL;
+        g_autofree gchar *module_path = NULL;
+        gchar *directory = NULL;
+        gsize module_len = 0;
+        guint n_aliases = 0;
+
+        directory = g_dir_make_tmp("ldm-native-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create native directory");
+
+        fail_if(!g_file_get_contents(RAZER_MODALIAS, &body, NULL, NULL),
+                "Failed to read razer modaliases");
+        for (const gchar *line = body; line; line = strchr(line, '\n')) {
+                if (*line == '\n') {
+                        ++line;
+                }
+                if (g_str_has_prefix(line, "alias ")) {
+                        ++n_aliases;
+                }
+        }
+        checksum = g_compute_checksum_for_string(G_CHECKSUM_SHA256, body, -1);
+        contents = g_strdup_printf(
+            "# ldm-routes: hid:00001532\n# ldm-aliases: %u\n# ldm-checksum: sha256:%s\n%s",
+            n_aliases,
+            checksum,
+            body);
+        modaliases_path = g_build_filename(directory, "razer-drivers.modaliases", NULL);
+        fail_if(!g_file_set_contents(modaliases_path, contents, -1, NULL),
+                "Failed to write %s",
+                modaliases_path);
+
+        fail_if(!g_file_get_contents(NATIVE_RAZER_MODULE, &module, &module_len, NULL),
+                "Failed to read native module");
+        module_path = g_build_filename(directory, "razer-drivers.so", NULL);
+        fail_if(!g_file_set_contents(module_path, module, (gssize)module_len, NULL),
+                "Failed to write %s",
+                module_path);
+
+        return directory;
+}
+
+/**
+ * Modalias files are data, so a module alongside one in a directory that
+ * isn't trusted must never be loaded.
+ */
+START_TEST(test_plugins_native_untrusted)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        g_autofree gchar *directory = NULL;
+        g_autofree gchar *path = NULL;
+
+        directory = create_native_directory();
+        path = g_build_filename(directory, "razer-drivers.modaliases", NULL);
+
+        bed = create_bed_from(RAZER_MOCKDEV_FILE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_USB | LDM_DEVICE_TYPE_HID);
+        fail_if(devices->len != 1, "Failed to find HID device!");
+
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, path),
+                "Failed to add razer modalias file");
+        providers = ldm_manager_get_providers(manager, devices->pdata[0]);
+        fail_if(providers->len != 1, "Expected 1 provider, got %u providers", providers->len);
+        fail_if(!LDM_IS_MODALIAS_PLUGIN(ldm_provider_get_plugin(providers->pdata[0])),
+                "Loaded the module alongside a modalias file");
+        g_clear_pointer(&providers, g_ptr_array_unref);
+
+        fail_if(!ldm_manager_add_modalias_plugins_for_directory(manager, directory),
+                "Failed to add razer modalias directory");
+        providers = ldm_manager_get_providers(manager, devices->pdata[0]);
+        fail_if(providers->len != 1, "Expected 1 provider, got %u providers", providers->len);
+        fail_if(!LDM_IS_MODALIAS_PLUGIN(ldm_provider_get_plugin(providers->pdata[0])),
+                "Loaded a module from a modalias directory");
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * A trusted directory prefers the module, but still defers it by the
+ * header of the modalias file it was generated from.
+ */
+START_TEST(test_plugins_native_deferred)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmDevice) device = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        g_autofree gchar *directory = NULL;
+        LdmDeferredPlugin *deferred = NULL;
+
+        directory = create_native_directory();
+
+        bed = create_bed_from(NV_MOCKDEV_FILE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NONE);
+
+        fail_if(!ldm_manager_add_modalias_plugins_from(manager, directory, TRUE),
+                "Failed to add trusted razer directory");
+        fail_if(manager->plugins->len != 0, "Module was loaded without a covered device");
+        fail_if(manager->deferred->len != 1,
+                "Expected 1 deferred plugin, got %u",
+                manager->deferred->len);
+        deferred = manager->deferred->pdata[0];
+        fail_if(!deferred->native_path || !g_str_has_suffix(deferred->native_path, ".so"),
+                "Deferred plugin forgot its module");
+
+        device = hotplug_hid_device(manager, bed, "hid:b0003g0001v00001532p0000021E");
+
+        providers = ldm_manager_get_providers(manager, device);
+        fail_if(providers->len != 1, "Expected 1 provider, got %u providers", providers->len);
+        fail_if(!LDM_IS_NATIVE_PLUGIN(ldm_provider_get_plugin(providers->pdata[0])),
+                "Trusted directory should prefer the module");
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+#endif
+
+/**
+ * Write the contents into the directory with the given compression
+ */
+static gchar *write_modaliases(const gchar *contents, gsize len, const gchar *directory,
+                               const gchar *name, LdmModaliasCompression compression)
+{
+        g_autoptr(GError) error = NULL;
+        gchar *path = NULL;
+        FILE *fileh = NULL;
+
+        path = g_build_filename(directory, name, NULL);
+        fileh = fopen(path, "w");
+        fail_if(!fileh, "Failed to create %s", path);
+        fail_if(!ldm_modalias_write_compressed(fileh, compression, contents, len, &error),
+                "Failed to write %s: %s",
+                path,
+                error ? error->message : "short write");
+        fail_if(fclose(fileh) != 0, "Failed to write %s", path);
+
+        return path;
+}
+
+/**
+ * Write the source file into the directory with the given compression
+ */
+static gchar *copy_modaliases(const gchar *source, const gchar *directory, const gchar *name,
+                              LdmModaliasCompression compression)
+{
+        g_autofree gchar *contents = NULL;
+        gsize len = 0;
+
+        fail_if(!g_file_get_contents(source, &contents, &len, NULL), "Failed to read %s", source);
+
+        return write_modaliases(contents, len, directory, name, compression);
+}
+
+/**
+ * Read the whole file back through the stream, i.e. decompressed
+ */
+static gchar *read_modaliases(const gchar *path)
+{
+        g_autoptr(LdmModaliasStream) stream = NULL;
+        g_autoptr(GError) error = NULL;
+        g_autoptr(GString) line = NULL;
+        GString *contents = NULL;
+
+        stream = ldm_modalias_stream_open(path, &error);
+        fail_if(!stream, "Failed to open %s: %s", path, error ? error->message : "unknown");
+
+        line = g_string_new(NULL);
+        contents = g_string_new(NULL);
+        while (ldm_modalias_stream_read_line(stream, line, &error)) {
+                g_string_append(contents, line->str);
+        }
+        fail_if(error != NULL, "Failed to read %s: %s", path, error ? error->message : "");
+
+        return g_string_free(contents, FALSE);
+}
+
+/**
+ * The main and legacy NVIDIA files in the directory must provide for the
+ * Optimus machine, in that order.
+ */
+static void assert_nvidia_directory(const gchar *directory)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(LdmGPUConfig) gpu = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        const gchar *plugin_id = NULL;
+
+        bed = create_bed_from(OPTIMUS_MOCKDEV_FILE);
+        manager = ldm_manager_new(0);
+
+        fail_if(!ldm_manager_add_modalias_plugins_for_directory(manager, directory),
+                "Failed to add compressed modalias directory");
+
+        gpu = ldm_gpu_config_new(manager);
+        fail_if(!gpu, "Failed to create GPUConfig");
+
+        providers = ldm_gpu_config_get_providers(gpu);
+        fail_if(providers->len != 2, "Expected 2 provider, got %u providers", providers->len);
+
+        plugin_id = ldm_plugin_get_name(ldm_provider_get_plugin(providers->pdata[0]));
+        fail_if(!g_str_equal(plugin_id, "nvidia-glx-driver"),
+                "First candidate should be nvidia-glx-driver, got %s",
+                plugin_id);
+
+        plugin_id = ldm_plugin_get_name(ldm_provider_get_plugin(providers->pdata[1]));
+        fail_if(!g_str_equal(plugin_id, "nvidia-340-glx-driver"),
+                "Second candidate should be nvidia-340-glx-driver, got %s",
+                plugin_id);
+}
+
+/**
+ * A stream cut short must be refused rather than loaded halfway
+ */
+static void assert_truncated_refused(const gchar *directory, LdmModaliasCompression compression)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        g_autofree gchar *name = NULL;
+        g_autofree gchar *broken_path = NULL;
+        struct stat st = { 0 };
+
+        name = g_strconcat("broken", ldm_modalias_compression_get_suffix(compression), NULL);
+        broken_path = copy_modaliases(NV_MAIN_MODALIAS, directory, name, compression);
+        fail_if(stat(broken_path, &st) != 0, "Failed to stat %s", broken_path);
+        fail_if(truncate(broken_path, st.st_size / 2) != 0, "Failed to truncate %s", broken_path);
+
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        fail_if(ldm_manager_add_modalias_plugin_for_path(manager, broken_path),
+                "Truncated modalias file should not be loaded");
+        unlink(broken_path);
+}
+
+/**
+ * Whatever ldm_modalias_write_compressed writes reads back unchanged,
+ * for every compression this build supports.
+ */
+START_TEST(test_plugins_write_compressed)
+{
+        g_autofree gchar *directory = NULL;
+        g_autofree gchar *contents = NULL;
+        gsize len = 0;
+
+        directory = g_dir_make_tmp("ldm-compressed-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create modalias directory");
+        fail_if(!g_file_get_contents(NV_340_MODALIAS, &contents, &len, NULL),
+                "Failed to read %s",
+                NV_340_MODALIAS);
+
+        for (guint i = 0; i < LDM_N_MODALIAS_COMPRESSIONS; i++) {
+                LdmModaliasCompression compression = (LdmModaliasCompression)i;
+                g_autofree gchar *name = NULL;
+                g_autofree gchar *path = NULL;
+                g_autofree gchar *read_back = NULL;
+
+                if (!ldm_modalias_compression_is_supported(compression)) {
+                        continue;
+                }
+
+                name = g_strconcat("round-trip",
+                                   ldm_modalias_compression_get_suffix(compression),
+                                   NULL);
+                path = write_modaliases(contents, len, directory, name, compression);
+                read_back = read_modaliases(path);
+                fail_if(!g_str_equal(read_back, contents), "%s did not read back unchanged", name);
+        }
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+#ifdef HAVE_ZLIB
+/**
+ * Compressed files are found by the directory glob, named without their
+ * suffix, and sorted along with the plain files. Damaged files are refused.
+ */
+START_TEST(test_plugins_compressed)
+{
+        g_autofree gchar *directory = NULL;
+        g_autofree gchar *main_path = NULL;
+        g_autofree gchar *legacy_path = NULL;
+
+        directory = g_dir_make_tmp("ldm-compressed-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create modalias directory");
+
+        main_path = copy_modaliases(NV_MAIN_MODALIAS,
+                                    directory,
+                                    "nvidia-glx-driver.modaliases.gz",
+                                    LDM_MODALIAS_COMPRESSION_GZIP);
+        legacy_path = copy_modaliases(NV_340_MODALIAS,
+                                      directory,
+                                      "nvidia-340-glx-driver.modaliases",
+                                      LDM_MODALIAS_COMPRESSION_NONE);
+
+        assert_nvidia_directory(directory);
+        assert_truncated_refused(directory, LDM_MODALIAS_COMPRESSION_GZIP);
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+
+/**
+ * Only one copy of a file is used when it is present both plain and
+ * compressed, so the copies can't replace each other or undo a deferral.
+ */
+START_TEST(test_plugins_compressed_copies)
+{
+        static const gchar *razer_body =
+            "alias hid:b0003g*v00001532p0000021E razerkbd razer-drivers\n";
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autofree gchar *directory = NULL;
+        g_autofree gchar *headered = NULL;
+        g_autofree gchar *razer_plain = NULL;
+        g_autofree gchar *razer_gzip = NULL;
+        g_autofree gchar *nvidia_plain = NULL;
+        g_autofree gchar *nvidia_gzip = NULL;
+        LdmDeferredPlugin *deferred = NULL;
+
+        directory = g_dir_make_tmp("ldm-compressed-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create modalias directory");
+
+        /* No Razer device here, so the plain copy is deferred */
+        headered = g_strdup_printf("# ldm-routes: hid:00001532\n# ldm-aliases: 1\n%s", razer_body);
+        razer_plain = write_modaliases(headered,
+                                       strlen(headered),
+                                       directory,
+                                       "razer-drivers.modaliases",
+                                       LDM_MODALIAS_COMPRESSION_NONE);
+        razer_gzip = write_modaliases(razer_body,
+                                      strlen(razer_body),
+                                      directory,
+                                      "razer-drivers.modaliases.gz",
+                                      LDM_MODALIAS_COMPRESSION_GZIP);
+
+        /* Both plain and compressed, without a header */
+        nvidia_plain = copy_modaliases(NV_MAIN_MODALIAS,
+                                       directory,
+                                       "nvidia-glx-driver.modaliases",
+                                       LDM_MODALIAS_COMPRESSION_NONE);
+        nvidia_gzip = copy_modaliases(NV_MAIN_MODALIAS,
+                                      directory,
+                                      "nvidia-glx-driver.modaliases.gz",
+                                      LDM_MODALIAS_COMPRESSION_GZIP);
+
+        bed = create_bed_from(NV_MOCKDEV_FILE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        fail_if(!ldm_manager_add_modalias_plugins_for_directory(manager, directory),
+                "Failed to add modalias directory");
+
+        fail_if(manager->deferred->len != 1,
+                "Expected 1 deferred plugin, got %u",
+                manager->deferred->len);
+        deferred = manager->deferred->pdata[0];
+        fail_if(!g_str_has_suffix(deferred->path, "razer-drivers.modaliases"),
+                "The plain copy should have been deferred, not %s",
+                deferred->path);
+
+        fail_if(manager->plugins->len != 1, "Expected 1 plugin, got %u", manager->plugins->len);
+        fail_if(manager->modalias_plugin_priority != 2,
+                "Each file should take a single priority, next is %d",
+                manager->modalias_plugin_priority);
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+#endif
+
+#ifdef HAVE_ZSTD
+/**
+ * A file compressed by the zstd tool itself loads like the plain one, as
+ * does one written by ldm_modalias_write_compressed.
+ */
+START_TEST(test_plugins_compressed_zstd)
+{
+        g_autofree gchar *directory = NULL;
+        g_autofree gchar *main_path = NULL;
+        g_autofree gchar *legacy_path = NULL;
+
+        directory = g_dir_make_tmp("ldm-compressed-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create modalias directory");
+
+        /* Copied as is, it is already compressed */
+        main_path = copy_modaliases(NV_MAIN_ZSTD_MODALIAS,
+                                    directory,
+                                    "nvidia-glx-driver.modaliases.zst",
+                                    LDM_MODALIAS_COMPRESSION_NONE);
+        legacy_path = copy_modaliases(NV_340_MODALIAS,
+                                      directory,
+                                      "nvidia-340-glx-driver.modaliases.zst",
+                                      LDM_MODALIAS_COMPRESSION_ZSTD);
+
+        assert_nvidia_directory(directory);
+        assert_truncated_refused(directory, LDM_MODALIAS_COMPRESSION_ZSTD);
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+}
+END_TEST
+#endif
+
+#ifdef MKMODALIASES
+/**
+ * Run one of the tools, failing the test unless it succeeds
+ *
+ * @out: (nullable): Storage for the standard output, discarded if NULL
+ */
+static void run_tool(const gchar *tool, const gchar *const *args, gchar **out)
+{
+        g_autoptr(GPtrArray) argv = NULL;
+        g_autoptr(GError) error = NULL;
+        g_autofree gchar *err = NULL;
+        gint status = 0;
+
+        argv = g_ptr_array_new();
+        g_ptr_array_add(argv, (gpointer)tool);
+        for (const gchar *const *arg = args; *arg; arg++) {
+                g_ptr_array_add(argv, (gpointer)*arg);
+        }
+        g_ptr_array_add(argv, NULL);
+
+        fail_if(!g_spawn_sync(NULL,
+                              (gchar **)argv->pdata,
+                              NULL,
+                              out ? G_SPAWN_DEFAULT : G_SPAWN_STDOUT_TO_DEV_NULL,
+                              NULL,
+                              NULL,
+                              out,
+                              &err,
+                              &status,
+                              &error),
+                "Failed to run %s: %s",
+                tool,
+                error ? error->message : "unknown");
+        fail_if(!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS,
+                "%s failed: %s",
+                tool,
+                err);
+}
+
+/**
+ * `mkmodaliases --compress` writes files that verify, and that provide for
+ * the hardware their aliases describe.
+ */
+START_TEST(test_plugins_mkmodaliases_compress)
+{
+        static const gchar *methods[LDM_N_MODALIAS_COMPRESSIONS] = {
+                [LDM_MODALIAS_COMPRESSION_GZIP] = "gzip",
+                [LDM_MODALIAS_COMPRESSION_ZSTD] = "zstd",
+        };
+        g_autofree gchar *directory = NULL;
+        guint n_tested = 0;
+
+        directory = g_dir_make_tmp("ldm-compressed-XXXXXX", NULL);
+        fail_if(!directory, "Failed to create modalias directory");
+
+        for (guint i = 0; i < LDM_N_MODALIAS_COMPRESSIONS; i++) {
+                LdmModaliasCompression compression = (LdmModaliasCompression)i;
+                g_autoptr(LdmManager) manager = NULL;
+                autofree(UMockdevTestbed) *bed = NULL;
+                g_autoptr(GPtrArray) devices = NULL;
+                g_autoptr(GPtrArray) providers = NULL;
+                g_autofree gchar *compress = NULL;
+                g_autofree gchar *output = NULL;
+                g_autofree gchar *path = NULL;
+                g_autofree gchar *contents = NULL;
+
+                if (!methods[i] || !ldm_modalias_compression_is_supported(compression)) {
+                        continue;
+                }
+
+                compress = g_strdup_printf("--compress=%s", methods[i]);
+                path = g_strconcat(directory,
+                                   G_DIR_SEPARATOR_S "razer-drivers",
+                                   ldm_modalias_compression_get_suffix(compression),
+                                   NULL);
+                output = g_strdup_printf("--output=%s", path);
+                run_tool(MKMODALIASES,
+                         (const gchar *const[]){
+                             compress, output, "razer-drivers", RAZERKBD_MODULE, NULL },
+                         NULL);
+                run_tool(MKMODALIASES, (const gchar *const[]){ "--verify", path, NULL }, NULL);
+
+                contents = read_modaliases(path);
+                fail_if(!g_str_has_prefix(contents, "# ldm-routes: "),
+                        "%s should start with a header",
+                        path);
+                fail_if(!strstr(contents, "alias hid:b0003g*v00001532p0000021E razerkbd "),
+                        "%s lost the keyboard alias",
+                        path);
+
+                bed = create_bed_from(RAZER_MOCKDEV_FILE);
+                manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+                fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, path),
+                        "Failed to add %s",
+                        path);
+
+                devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_HID);
+                fail_if(devices->len != 1, "Failed to find HID device!");
+                providers = ldm_manager_get_providers(manager, devices->pdata[0]);
+                fail_if(providers->len != 1,
+                        "Expected 1 provider from %s, got %u",
+                        path,
+                        providers->len);
+
+                unlink(path);
+                ++n_tested;
+        }
+
+        nftw(directory, remove_path, 8, FTW_DEPTH | FTW_PHYS);
+
+        if (n_tested == 0) {
+                fprintf(stderr, "No compression built, mkmodaliases --compress not tested\n");
+        }
+}
+END_TEST
+
+#ifdef LDM_ANALYZE
+/**
+ * Find the JSON line ldm-analyze wrote for the recording
+ */
+static const gchar *find_snapshot(gchar **lines, const gchar *snapshot)
+{
+        g_autofree gchar *key = g_strdup_printf("{\"snapshot\":\"%s\",", snapshot);
+
+        for (gchar **line = lines; *line; line++) {
+                if (g_str_has_prefix(*line, key)) {
+                        return *line;
+                }
+        }
+
+        fail_if(TRUE, "No result for %s", snapshot);
+        return NULL;
+}
+
+/**
+ * Smoke test of ldm-analyze: several workers replay the recordings with the
+ * test modalias directory, and report the providers the library finds.
+ */
+START_TEST(test_plugins_analyze)
+{
+        g_autofree gchar *out = NULL;
+        g_auto(GStrv) lines = NULL;
+        const gchar *line = NULL;
+
+        run_tool(LDM_ANALYZE,
+                 (const gchar *const[]){ "--jobs=2",
+                                         "--modalias-dir=" TEST_DATA_ROOT,
+                                         NV_MOCKDEV_FILE,
+                                         RAZER_MOCKDEV_FILE,
+                                         TEST_DATA_ROOT "/missing.umockdev",
+                                         NULL },
+                 &out);
+
+        lines = g_strsplit(out, "\n", -1);
+        fail_if(g_strv_length(lines) != 4,
+                "Expected 3 lines, got %u",
+                g_strv_length(lines) - 1);
+
+        line = find_snapshot(lines, "nvidia1060.umockdev");
+        fail_if(!strstr(line, "\"gpu\":\"simple\""), "Wrong GPU type: %s", line);
+        fail_if(!strstr(line, "\"plugin\":\"nvidia-glx-driver\""),
+                "Missing NVIDIA provider: %s",
+                line);
+
+        line = find_snapshot(lines, "razer-ornata-chroma.umockdev");
+        fail_if(!strstr(line, "\"package\":\"razer-drivers\""),
+                "Missing Razer provider: %s",
+                line);
+
+        line = find_snapshot(lines, "missing.umockdev");
+        fail_if(!strstr(line, "\"error\":"), "Missing recording should fail: %s", line);
+}
+END_TEST
+#endif
+#endif
+
+/**
+ * Memory accounting must see the devices, their properties and the alias
+ * patterns, and grow once devices have been routed to plugins.
+ */
+START_TEST(test_plugins_memory_usage)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(GPtrArray) providers = NULL;
+        LdmMemoryUsage usage = { 0 };
+        gsize caches = 0;
+        gsize total = 0;
+
+        bed = create_bed_from(NV_MOCKDEV_FILE);
+        manager = ldm_manager_new(0);
+
+        fail_if(!ldm_manager_add_modalias_plugin_for_path(manager, NV_MAIN_MODALIAS),
+                "Failed to add main modalias file");
+
+        ldm_manager_get_memory_usage(manager, &usage);
+        fail_if(usage.objects[LDM_MEMORY_CATEGORY_DEVICES] < 1, "No devices accounted");
+        fail_if(usage.objects[LDM_MEMORY_CATEGORY_PROPERTIES] < 1, "No properties accounted");
+        fail_if(usage.objects[LDM_MEMORY_CATEGORY_ALIASES] < 2, "No alias patterns accounted");
+        fail_if(usage.bytes[LDM_MEMORY_CATEGORY_STRINGS] == 0, "No strings accounted");
+
+        for (guint i = 0; i < LDM_MEMORY_N_CATEGORIES; i++) {
+                total += usage.bytes[i];
+        }
+        fail_if(ldm_memory_usage_get_total(&usage) != total, "Total doesn't match categories");
+
+        /* Routing a device builds the routing table */
+        caches = usage.bytes[LDM_MEMORY_CATEGORY_CACHES];
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_GPU);
+        fail_if(devices->len != 1, "Failed to find NVIDIA device");
+        providers = ldm_manager_get_providers(manager, devices->pdata[0]);
+        fail_if(providers->len != 1, "Expected 1 provider, got %u providers", providers->len);
+
+        ldm_manager_get_memory_usage(manager, &usage);
+        fail_if(usage.bytes[LDM_MEMORY_CATEGORY_CACHES] <= caches, "Routing table not accounted");
+}
+END_TEST
+
+/**
+ * Redefining a match reuses its string, so reloading the same aliases never
+ * grows the string storage of the plugin.
+ */
+START_TEST(test_plugins_memory_redefined)
+{
+        g_autoptr(LdmPlugin) plugin = NULL;
+        LdmMemoryUsage first = { 0 };
+        LdmMemoryUsage usage = { 0 };
+        LdmProviderResult result = { 0 };
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autoptr(LdmManager) manager = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+
+        plugin = ldm_modalias_plugin_new("redefined");
+        ldm_modalias_plugin_add_modalias(LDM_MODALIAS_PLUGIN(plugin),
+                                         ldm_modalias_new("pci:v000010DEd*sv*sd*bc03sc*i*",
+                                                          "nvidia",
+                                                          "redefined-0"));
+        ldm_plugin_account_memory(plugin, &first);
+
+        for (guint i = 1; i < 1000; i++) {
+                g_autofree gchar *package = g_strdup_printf("redefined-%u", i);
+
+                ldm_modalias_plugin_add_modalias(LDM_MODALIAS_PLUGIN(plugin),
+                                                 ldm_modalias_new("pci:v000010DEd*sv*sd*bc03sc*i*",
+                                                                  "nvidia",
+                                                                  package));
+        }
+        ldm_plugin_account_memory(plugin, &usage);
+
+        fail_if(usage.bytes[LDM_MEMORY_CATEGORY_STRINGS] !=
+                    first.bytes[LDM_MEMORY_CATEGORY_STRINGS],
+                "Redefinitions grew the strings from %zu to %zu bytes",
+                first.bytes[LDM_MEMORY_CATEGORY_STRINGS],
+                usage.bytes[LDM_MEMORY_CATEGORY_STRINGS]);
+        fail_if(usage.objects[LDM_MEMORY_CATEGORY_ALIASES] !=
+                    first.objects[LDM_MEMORY_CATEGORY_ALIASES],
+                "Redefinitions should not add aliases");
+
+        /* The last definition still wins */
+        bed = create_bed_from(NV_MOCKDEV_FILE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_GPU);
+        fail_if(devices->len != 1, "Failed to find NVIDIA device");
+        fail_if(!ldm_plugin_get_result(plugin, devices->pdata[0], &result),
+                "Redefined alias should match");
+        fail_if(!g_str_equal(result.package, "redefined-999"),
+                "Expected 'redefined-999', got '%s'",
+                result.package);
+}
+END_TEST
+
 /**
  * Standard helper for running a test suite
  */
@@ -217,7 +1378,34 @@ static Suite *test_create(void)
         tcase_add_test(tc, test_plugins_nvidia);
         tcase_add_test(tc, test_plugins_nvidia_multiple);
         tcase_add_test(tc, test_plugins_nvidia_multiple_glob);
+        tcase_add_test(tc, test_plugins_best_provider);
+        tcase_add_test(tc, test_plugins_provider_results);
         tcase_add_test(tc, test_plugins_razer);
+        tcase_add_test(tc, test_plugins_coverage);
+        tcase_add_test(tc, test_plugins_deferred);
+        tcase_add_test(tc, test_plugins_deferred_hotplug);
+#ifdef NATIVE_RAZER_MODULE
+        tcase_add_test(tc, test_plugins_native);
+        tcase_add_test(tc, test_plugins_native_precedence);
+        tcase_add_test(tc, test_plugins_native_untrusted);
+        tcase_add_test(tc, test_plugins_native_deferred);
+#endif
+        tcase_add_test(tc, test_plugins_write_compressed);
+#ifdef HAVE_ZLIB
+        tcase_add_test(tc, test_plugins_compressed);
+        tcase_add_test(tc, test_plugins_compressed_copies);
+#endif
+#ifdef HAVE_ZSTD
+        tcase_add_test(tc, test_plugins_compressed_zstd);
+#endif
+#ifdef MKMODALIASES
+        tcase_add_test(tc, test_plugins_mkmodaliases_compress);
+#endif
+#ifdef LDM_ANALYZE
+        tcase_add_test(tc, test_plugins_analyze);
+#endif
+        tcase_add_test(tc, test_plugins_memory_usage);
+        tcase_add_test(tc, test_plugins_memory_redefined);
 
         return s;
 }
@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <umockdev.h>
+#include <unistd.h>
 
 #include "ldm-private.h"
 #include "ldm.h"
@@ -98,6 +99,77 @@ START_TEST(test_manager_usb_noisy)
 }
 END_TEST
 
+/**
+ * Filtered hubs must never become devices, and a filtered device must take
+ * its interfaces with it. The system rules file can be swapped out.
+ */
+START_TEST(test_manager_usb_filtered)
+{
+        g_autoptr(LdmManager) manager = NULL;
+        g_autoptr(LdmDeviceFilter) filter = NULL;
+        autofree(UMockdevTestbed) *bed = NULL;
+        g_autoptr(GPtrArray) devices = NULL;
+        g_autofree gchar *path = NULL;
+        g_autofree gchar *system_path = NULL;
+        gint fd = -1;
+
+        bed = umockdev_testbed_new();
+        fail_if(!umockdev_testbed_add_from_file(bed, YETI_UMOCKDEV_FILE, NULL),
+                "Failed to create Blue Yeti device");
+
+        /* Root hub is class 9 */
+        filter = ldm_device_filter_new();
+        ldm_device_filter_add_rule(filter, "usb", "usb_device", 9, 0xFF, 0);
+        manager = ldm_manager_new_with_filter(LDM_MANAGER_FLAGS_NO_MONITOR, filter);
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_USB);
+        fail_if(devices->len != 1, "Expected 1 device, got %u devices", devices->len);
+        fail_if(ldm_device_get_vendor_id(devices->pdata[0]) != 0xb58e, "Root hub wasn't filtered");
+        g_clear_pointer(&devices, g_ptr_array_unref);
+        g_clear_object(&manager);
+        g_clear_object(&filter);
+
+        /* Same again by vendor, from a rules file */
+        fd = g_file_open_tmp("ldm-filter-XXXXXX.conf", &path, NULL);
+        fail_if(fd < 0, "Failed to create rules file");
+        close(fd);
+        fail_if(!g_file_set_contents(path, "[yeti]\nSubsystem=usb\nVendorID=0xb58e\n", -1, NULL),
+                "Failed to write %s",
+                path);
+
+        filter = ldm_device_filter_new();
+        fail_if(!ldm_device_filter_add_rules_from_file(filter, path, NULL),
+                "Failed to load rules file");
+        fail_if(ldm_device_filter_get_n_rules(filter) != 1, "Expected 1 rule");
+        manager = ldm_manager_new_with_filter(LDM_MANAGER_FLAGS_NO_MONITOR, filter);
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_AUDIO);
+        fail_if(devices->len != 0, "Interfaces of a filtered device were added");
+        g_clear_pointer(&devices, g_ptr_array_unref);
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_USB);
+        fail_if(devices->len != 1, "Expected only the root hub, got %u devices", devices->len);
+        g_clear_pointer(&devices, g_ptr_array_unref);
+        g_clear_object(&manager);
+
+        /* The same file standing in for the system configuration */
+        system_path = g_strdup(g_getenv("LDM_DEVICE_FILTER_FILE"));
+        g_setenv("LDM_DEVICE_FILTER_FILE", path, TRUE);
+        manager = ldm_manager_new(LDM_MANAGER_FLAGS_NO_MONITOR);
+        if (system_path) {
+                g_setenv("LDM_DEVICE_FILTER_FILE", system_path, TRUE);
+        } else {
+                g_unsetenv("LDM_DEVICE_FILTER_FILE");
+        }
+        unlink(path);
+
+        devices = ldm_manager_get_devices(manager, LDM_DEVICE_TYPE_USB);
+        fail_if(devices->len != 1,
+                "System rules were not overridden, got %u devices",
+                devices->len);
+}
+END_TEST
+
 /**
  * Standard helper for running a test suite
  */
@@ -125,6 +197,7 @@ static Suite *test_create(void)
 
         tcase_add_test(tc, test_manager_usb_simple);
         tcase_add_test(tc, test_manager_usb_noisy);
+        tcase_add_test(tc, test_manager_usb_filtered);
 
         return s;
 }
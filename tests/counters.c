@@ -0,0 +1,165 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "counters.h"
+
+/* Layout of a read() with PERF_FORMAT_TOTAL_TIME_ENABLED | _RUNNING */
+typedef struct CounterReading {
+        guint64 value;
+        guint64 time_enabled;
+        guint64 time_running;
+} CounterReading;
+
+static const struct {
+        const gchar *name;
+        guint64 config;
+} counter_events[LDM_N_COUNTERS] = {
+        [LDM_COUNTER_CYCLES] = { "cycles", PERF_COUNT_HW_CPU_CYCLES },
+        [LDM_COUNTER_INSTRUCTIONS] = { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+        [LDM_COUNTER_CACHE_MISSES] = { "cache-misses", PERF_COUNT_HW_CACHE_MISSES },
+        [LDM_COUNTER_BRANCH_MISSES] = { "branch-misses", PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+/**
+ * Open a disabled event for the calling thread. Kernel and hypervisor time
+ * is excluded so that the default perf_event_paranoid setting allows it,
+ * and threads created later are counted with us.
+ */
+static int counter_open(guint64 config)
+{
+        struct perf_event_attr attr = { 0 };
+
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0UL);
+}
+
+/**
+ * Open every counter the host supports
+ *
+ * Returns: TRUE if at least one counter is available
+ */
+gboolean ldm_counters_open(LdmCounters *self, GError **error)
+{
+        gboolean any = FALSE;
+        int saved_errno = 0;
+
+        for (guint i = 0; i < LDM_N_COUNTERS; i++) {
+                self->fds[i] = counter_open(counter_events[i].config);
+                if (self->fds[i] < 0) {
+                        saved_errno = errno;
+                        continue;
+                }
+                any = TRUE;
+        }
+
+        if (!any) {
+                g_set_error(error,
+                            G_FILE_ERROR,
+                            g_file_error_from_errno(saved_errno),
+                            "perf_event_open: %s",
+                            strerror(saved_errno));
+        }
+
+        return any;
+}
+
+void ldm_counters_close(LdmCounters *self)
+{
+        for (guint i = 0; i < LDM_N_COUNTERS; i++) {
+                if (self->fds[i] >= 0) {
+                        close(self->fds[i]);
+                        self->fds[i] = -1;
+                }
+        }
+}
+
+/**
+ * Reset and enable every open counter
+ */
+void ldm_counters_start(LdmCounters *self)
+{
+        for (guint i = 0; i < LDM_N_COUNTERS; i++) {
+                if (self->fds[i] < 0) {
+                        continue;
+                }
+                ioctl(self->fds[i], PERF_EVENT_IOC_RESET, 0);
+                ioctl(self->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+}
+
+/**
+ * Disable every open counter and read the counts since the last start
+ */
+void ldm_counters_stop(LdmCounters *self, LdmCounterValues *values)
+{
+        memset(values, 0, sizeof(*values));
+
+        for (guint i = 0; i < LDM_N_COUNTERS; i++) {
+                CounterReading reading = { 0 };
+
+                if (self->fds[i] < 0) {
+                        continue;
+                }
+                ioctl(self->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+                if (read(self->fds[i], &reading, sizeof(reading)) != sizeof(reading) ||
+                    reading.time_running == 0) {
+                        continue;
+                }
+
+                /* Estimate the full count if the event shared the PMU */
+                if (reading.time_running < reading.time_enabled) {
+                        reading.value = (guint64)((gdouble)reading.value *
+                                                  (gdouble)reading.time_enabled /
+                                                  (gdouble)reading.time_running);
+                }
+
+                values->values[i] = reading.value;
+                values->valid[i] = TRUE;
+        }
+}
+
+const gchar *ldm_counter_get_name(LdmCounter counter)
+{
+        g_return_val_if_fail(counter < LDM_N_COUNTERS, NULL);
+
+        return counter_events[counter].name;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
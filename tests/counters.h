@@ -0,0 +1,68 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/**
+ * LdmCounter:
+ *
+ * Hardware events counted around each benchmark phase.
+ */
+typedef enum {
+        LDM_COUNTER_CYCLES = 0,
+        LDM_COUNTER_INSTRUCTIONS,
+        LDM_COUNTER_CACHE_MISSES,
+        LDM_COUNTER_BRANCH_MISSES,
+        LDM_N_COUNTERS,
+} LdmCounter;
+
+/**
+ * LdmCounters:
+ *
+ * One perf event per counter, for the calling thread and any thread it
+ * creates once the counters are open. Events the host doesn't support, as
+ * is common in VMs and containers, are left closed.
+ */
+typedef struct LdmCounters {
+        int fds[LDM_N_COUNTERS]; /* -1 if unavailable */
+} LdmCounters;
+
+/**
+ * LdmCounterValues:
+ *
+ * Counts for a single phase, scaled up if the kernel had to multiplex the
+ * events. A counter is only valid if it was open and actually scheduled.
+ */
+typedef struct LdmCounterValues {
+        guint64 values[LDM_N_COUNTERS];
+        gboolean valid[LDM_N_COUNTERS];
+} LdmCounterValues;
+
+gboolean ldm_counters_open(LdmCounters *counters, GError **error);
+void ldm_counters_close(LdmCounters *counters);
+void ldm_counters_start(LdmCounters *counters);
+void ldm_counters_stop(LdmCounters *counters, LdmCounterValues *values);
+const gchar *ldm_counter_get_name(LdmCounter counter);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
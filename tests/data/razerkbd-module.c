@@ -0,0 +1,33 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+/*
+ * Stand-in for a kernel module. mkmodaliases only reads the .modinfo
+ * section, which holds NUL separated key=value pairs just like a real one.
+ */
+__attribute__((used, section(".modinfo"), aligned(1))) static const char razerkbd_modinfo[] =
+    "license=GPL\0"
+    "alias=hid:b0003g*v00001532p0000021E\0"
+    "alias=hid:b0003g*v00001532p00000203\0"
+    "alias=usb:v1532p0000021Ed*dc*dsc*dp*ic03isc*ip*in*";
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
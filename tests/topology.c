@@ -0,0 +1,340 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#define _GNU_SOURCE
+
+#include "topology.h"
+
+/* PCI functions per root bus, leaving room for the xHCI controller */
+#define TOPOLOGY_PCI_PER_BUS 248
+
+/* Well known IDs, so that the test plugins have something to match */
+#define TOPOLOGY_VENDOR_NVIDIA 0x10DE
+#define TOPOLOGY_VENDOR_INTEL 0x8086
+#define TOPOLOGY_VENDOR_RAZER 0x1532
+#define TOPOLOGY_VENDOR_LOGITECH 0x046D
+
+/*
+ * umockdev recordings list each device before its parents, so records are
+ * collected parent first and written out in reverse.
+ */
+typedef struct TopologyWriter {
+        GPtrArray *records;
+        GString *current;
+} TopologyWriter;
+
+static void topology_begin(TopologyWriter *self, const gchar *path)
+{
+        self->current = g_string_new(NULL);
+        g_ptr_array_add(self->records, self->current);
+        g_string_append_printf(self->current, "P: %s\n", path);
+}
+
+static void topology_property(TopologyWriter *self, const gchar *key, const gchar *value)
+{
+        g_string_append_printf(self->current, "E: %s=%s\n", key, value);
+}
+
+static void topology_attribute(TopologyWriter *self, const gchar *key, const gchar *value)
+{
+        g_string_append_printf(self->current, "A: %s=%s\n", key, value);
+}
+
+static void topology_modalias(TopologyWriter *self, const gchar *modalias)
+{
+        topology_property(self, "MODALIAS", modalias);
+        topology_attribute(self, "modalias", modalias);
+}
+
+/**
+ * Emit a PCI function on the root complex
+ */
+static void topology_add_pci(TopologyWriter *self, const gchar *path, guint vendor_id,
+                             guint device_id, guint class_id, gboolean boot_vga)
+{
+        g_autofree gchar *modalias = NULL;
+        g_autofree gchar *value = NULL;
+
+        modalias = g_strdup_printf("pci:v%08Xd%08Xsv00000000sd00000000bc%02Xsc%02Xi%02X",
+                                   vendor_id,
+                                   device_id,
+                                   (class_id >> 16) & 0xFF,
+                                   (class_id >> 8) & 0xFF,
+                                   class_id & 0xFF);
+
+        topology_begin(self, path);
+        topology_property(self, "SUBSYSTEM", "pci");
+        topology_modalias(self, modalias);
+
+        value = g_strdup_printf("0x%04x", vendor_id);
+        topology_attribute(self, "vendor", value);
+        g_free(value);
+
+        value = g_strdup_printf("0x%04x", device_id);
+        topology_attribute(self, "device", value);
+        g_free(value);
+
+        value = g_strdup_printf("0x%06x", class_id);
+        topology_attribute(self, "class", value);
+
+        if (boot_vga) {
+                topology_attribute(self, "boot_vga", "1");
+        }
+}
+
+/**
+ * Emit a USB device or hub
+ */
+static void topology_add_usb_device(TopologyWriter *self, const gchar *path, guint vendor_id,
+                                    guint product_id, guint device_class)
+{
+        g_autofree gchar *modalias = NULL;
+        g_autofree gchar *value = NULL;
+
+        modalias = g_strdup_printf("usb:v%04Xp%04Xd0100dc%02Xdsc00dp00",
+                                   vendor_id,
+                                   product_id,
+                                   device_class);
+
+        topology_begin(self, path);
+        topology_property(self, "SUBSYSTEM", "usb");
+        topology_property(self, "DEVTYPE", "usb_device");
+        topology_modalias(self, modalias);
+
+        value = g_strdup_printf("%04x", vendor_id);
+        topology_attribute(self, "idVendor", value);
+        g_free(value);
+
+        value = g_strdup_printf("%04x", product_id);
+        topology_attribute(self, "idProduct", value);
+        g_free(value);
+
+        value = g_strdup_printf("%02x", device_class);
+        topology_attribute(self, "bDeviceClass", value);
+}
+
+static void topology_add_usb_interface(TopologyWriter *self, const gchar *path, guint vendor_id,
+                                       guint product_id, guint interface_class, guint number)
+{
+        g_autofree gchar *modalias = NULL;
+        g_autofree gchar *value = NULL;
+
+        modalias = g_strdup_printf("usb:v%04Xp%04Xd0100dc00dsc00dp00ic%02Xisc00ip00in%02X",
+                                   vendor_id,
+                                   product_id,
+                                   interface_class,
+                                   number);
+
+        topology_begin(self, path);
+        topology_property(self, "SUBSYSTEM", "usb");
+        topology_property(self, "DEVTYPE", "usb_interface");
+        topology_modalias(self, modalias);
+
+        value = g_strdup_printf("%02x", interface_class);
+        topology_attribute(self, "bInterfaceClass", value);
+        g_free(value);
+
+        value = g_strdup_printf("%02x", number);
+        topology_attribute(self, "bInterfaceNumber", value);
+}
+
+static void topology_add_hid(TopologyWriter *self, const gchar *path, guint vendor_id,
+                             guint product_id)
+{
+        g_autofree gchar *modalias = NULL;
+
+        modalias = g_strdup_printf("hid:b0003g0001v%08Xp%08X", vendor_id, product_id);
+
+        topology_begin(self, path);
+        topology_property(self, "SUBSYSTEM", "hid");
+        topology_modalias(self, modalias);
+}
+
+static void topology_add_bluetooth(TopologyWriter *self, const gchar *path)
+{
+        topology_begin(self, path);
+        topology_property(self, "SUBSYSTEM", "bluetooth");
+        topology_property(self, "DEVTYPE", "host");
+}
+
+/**
+ * ldm_topology_generate:
+ * @topology: Description of the machine
+ *
+ * Returns: (transfer full): A umockdev recording of the machine
+ */
+gchar *ldm_topology_generate(const LdmTopology *topology)
+{
+        TopologyWriter writer = { 0 };
+        GString *ret = NULL;
+        const gchar *xhci = "/devices/pci0000:00/0000:00:1f.0";
+        g_autofree gchar *root_hub = NULL;
+        guint n_functions = 0;
+        guint hid_index = 0;
+
+        writer.records = g_ptr_array_new();
+
+        /* PCI functions, GPUs first */
+        n_functions = topology->n_gpus + topology->n_pci;
+        for (guint i = 0; i < n_functions; i++) {
+                g_autofree gchar *path = NULL;
+                guint bus = i / TOPOLOGY_PCI_PER_BUS;
+                guint slot = (i % TOPOLOGY_PCI_PER_BUS) / 8;
+                guint function = i % 8;
+
+                path = g_strdup_printf("/devices/pci0000:%02x/0000:%02x:%02x.%x",
+                                       bus,
+                                       bus,
+                                       slot,
+                                       function);
+
+                if (i < topology->n_gpus) {
+                        gboolean nvidia = (i % 2) == 0;
+                        topology_add_pci(&writer,
+                                         path,
+                                         nvidia ? TOPOLOGY_VENDOR_NVIDIA : TOPOLOGY_VENDOR_INTEL,
+                                         nvidia ? 0x1C60 : 0x1901,
+                                         0x030000,
+                                         i == 1);
+                } else {
+                        topology_add_pci(&writer,
+                                         path,
+                                         TOPOLOGY_VENDOR_INTEL,
+                                         0x1000 + (i % 0x1000),
+                                         0x060400,
+                                         FALSE);
+                }
+        }
+
+        /* USB controller and root hub */
+        topology_add_pci(&writer, xhci, TOPOLOGY_VENDOR_INTEL, 0x8CB1, 0x0C0330, FALSE);
+        root_hub = g_strdup_printf("%s/usb1", xhci);
+        topology_add_usb_device(&writer, root_hub, 0x1D6B, 0x0002, 0x09);
+
+        for (guint h = 0; h < topology->n_hubs; h++) {
+                g_autofree gchar *path = g_strdup_printf("%s/1-%u", root_hub, h + 1);
+                topology_add_usb_device(&writer, path, 0x05E3, 0x0610, 0x09);
+        }
+
+        /* USB devices, hanging off hubs where we have them */
+        for (guint d = 0; d < topology->n_usb + topology->n_bluetooth; d++) {
+                g_autofree gchar *path = NULL;
+                gboolean bluetooth = d >= topology->n_usb;
+                gboolean hid = !bluetooth && d < MIN(topology->n_hid, topology->n_usb);
+                guint vendor_id = hid ? TOPOLOGY_VENDOR_RAZER : TOPOLOGY_VENDOR_LOGITECH;
+                guint product_id = bluetooth ? 0x0A2B : (hid ? 0x021E : 0xC52B);
+                guint n_interfaces = bluetooth ? 1 : topology->n_interfaces;
+
+                if (topology->n_hubs > 0) {
+                        guint hub = d % topology->n_hubs;
+                        guint port = d / topology->n_hubs;
+                        path = g_strdup_printf("%s/1-%u/1-%u.%u",
+                                               root_hub,
+                                               hub + 1,
+                                               hub + 1,
+                                               port + 1);
+                } else {
+                        path = g_strdup_printf("%s/1-%u", root_hub, d + 1);
+                }
+
+                topology_add_usb_device(&writer, path, vendor_id, product_id, 0x00);
+
+                for (guint i = 0; i < n_interfaces; i++) {
+                        g_autofree gchar *iface = NULL;
+                        g_autofree gchar *child = NULL;
+                        const gchar *name = g_strrstr(path, "/") + 1;
+
+                        iface = g_strdup_printf("%s/%s:1.%u", path, name, i);
+                        topology_add_usb_interface(&writer,
+                                                   iface,
+                                                   vendor_id,
+                                                   product_id,
+                                                   bluetooth ? 0xE0 : 0x03,
+                                                   i);
+
+                        if (bluetooth) {
+                                child = g_strdup_printf("%s/bluetooth/hci%u",
+                                                        iface,
+                                                        d - topology->n_usb);
+                                topology_add_bluetooth(&writer, child);
+                        } else if (hid) {
+                                child = g_strdup_printf("%s/0003:%04X:%04X.%04X",
+                                                        iface,
+                                                        vendor_id,
+                                                        product_id,
+                                                        ++hid_index);
+                                topology_add_hid(&writer, child, vendor_id, product_id);
+                        }
+                }
+        }
+
+        /* Children before parents */
+        ret = g_string_new(NULL);
+        for (guint i = writer.records->len; i > 0; i--) {
+                GString *record = writer.records->pdata[i - 1];
+                g_string_append(ret, record->str);
+                g_string_append_c(ret, '\n');
+                g_string_free(record, TRUE);
+        }
+        g_ptr_array_unref(writer.records);
+
+        return g_string_free(ret, FALSE);
+}
+
+/**
+ * ldm_topology_count_devices:
+ *
+ * Returns: The number of sysfs devices in the generated recording
+ */
+guint ldm_topology_count_devices(const LdmTopology *topology)
+{
+        guint n_usb = topology->n_usb + topology->n_bluetooth;
+        guint ret = 0;
+
+        ret += topology->n_gpus + topology->n_pci + 1; /* xHCI */
+        ret += 1 + topology->n_hubs + n_usb;          /* Root hub, hubs and devices */
+        ret += topology->n_usb * topology->n_interfaces;
+        ret += MIN(topology->n_hid, topology->n_usb) * topology->n_interfaces;
+        ret += topology->n_bluetooth * 2; /* Interface and host */
+
+        return ret;
+}
+
+/**
+ * ldm_topology_scale:
+ * @factor: Multiplier for every device count
+ * @out: (out): Storage for the scaled topology
+ *
+ * Scale the topology, leaving the shape of each USB device untouched.
+ */
+void ldm_topology_scale(const LdmTopology *topology, guint factor, LdmTopology *out)
+{
+        *out = *topology;
+        out->n_gpus *= factor;
+        out->n_pci *= factor;
+        out->n_hubs *= factor;
+        out->n_usb *= factor;
+        out->n_hid *= factor;
+        out->n_bluetooth *= factor;
+}
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */
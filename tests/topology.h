@@ -0,0 +1,47 @@
+/*
+ * This file is part of linux-driver-management.
+ *
+ * Copyright © 2016-2018 Linux Driver Management Developers, Solus Project
+ *
+ * linux-driver-management is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation; either version 2.1
+ * of the License, or (at your option) any later version.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/**
+ * LdmTopology:
+ *
+ * Description of a synthetic machine, used to generate umockdev recordings
+ * far larger than the real fixtures in tests/data.
+ */
+typedef struct LdmTopology {
+        guint n_gpus;       /* PCI display controllers, alternating NVIDIA and Intel */
+        guint n_pci;        /* Other PCI functions */
+        guint n_hubs;       /* USB hubs below the root hub */
+        guint n_usb;        /* USB devices, spread evenly over the hubs */
+        guint n_interfaces; /* Interfaces per USB device */
+        guint n_hid;        /* Of the USB devices, those with a HID child per interface */
+        guint n_bluetooth;  /* USB bluetooth adapters with a host child */
+} LdmTopology;
+
+gchar *ldm_topology_generate(const LdmTopology *topology);
+guint ldm_topology_count_devices(const LdmTopology *topology);
+void ldm_topology_scale(const LdmTopology *topology, guint factor, LdmTopology *out);
+
+/*
+ * Editor modelines  -  https://www.wireshark.org/tools/modelines.html
+ *
+ * Local variables:
+ * c-basic-offset: 8
+ * tab-width: 8
+ * indent-tabs-mode: nil
+ * End:
+ *
+ * vi: set shiftwidth=8 tabstop=8 expandtab:
+ * :indentSize=8:tabSize=8:noTabs=true:
+ */